@@ -14,6 +14,9 @@
 #ifdef HAVE_CODESET
 #include <langinfo.h>
 #endif
+#ifndef __lv2ppu__
+#include <pthread.h>
+#endif
 
 #include "charset.h"
 #include "logging.h"
@@ -32,9 +35,132 @@ char* charset_get_current(void)
 	return charset;
 }
 
+/*
+ * Opening a converter is far more expensive than converting the few bytes
+ * of a TOC text, so descriptors are kept per (from, to) pair and handed
+ * out to one caller at a time. Pairs that are in use by another thread get
+ * a private descriptor that is parked in a free slot afterwards.
+ */
+#define CONVERTER_CACHE_SIZE	16
+#define CHARSET_NAME_SIZE	32
+
+typedef struct
+{
+	char    from[CHARSET_NAME_SIZE];
+	char    to[CHARSET_NAME_SIZE];
+	iconv_t cd;
+	int     busy;
+} charset_converter_t;
+
+static charset_converter_t converters[CONVERTER_CACHE_SIZE];
+static int converter_count = 0;
+#ifndef __lv2ppu__
+static pthread_mutex_t converters_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_CONVERTERS()	pthread_mutex_lock(&converters_lock)
+#define UNLOCK_CONVERTERS()	pthread_mutex_unlock(&converters_lock)
+#else
+/* no portable lock available here, the PS3 build opens a converter per call */
+#define LOCK_CONVERTERS()
+#define UNLOCK_CONVERTERS()
+#endif
+
+static iconv_t charset_open(const char *from, const char *to)
+{
+	int i;
+
+#ifdef __lv2ppu__
+	return iconv_open(to, from);
+#endif
+	LOCK_CONVERTERS();
+	for (i = 0; i < converter_count; i++)
+	{
+		if (!converters[i].busy && strcmp(converters[i].from, from) == 0 && strcmp(converters[i].to, to) == 0)
+		{
+			converters[i].busy = 1;
+			UNLOCK_CONVERTERS();
+			return converters[i].cd;
+		}
+	}
+	UNLOCK_CONVERTERS();
+
+	return iconv_open(to, from);
+}
+
+static void charset_release(iconv_t cd, const char *from, const char *to)
+{
+	int i;
+
+#ifdef __lv2ppu__
+	iconv_close(cd);
+	return;
+#endif
+	/* return the converter to its initial shift state */
+	iconv(cd, NULL, NULL, NULL, NULL);
+
+	LOCK_CONVERTERS();
+	for (i = 0; i < converter_count; i++)
+	{
+		if (converters[i].cd == cd)
+		{
+			converters[i].busy = 0;
+			UNLOCK_CONVERTERS();
+			return;
+		}
+	}
+	if (converter_count < CONVERTER_CACHE_SIZE
+		&& strlen(from) < CHARSET_NAME_SIZE && strlen(to) < CHARSET_NAME_SIZE)
+	{
+		charset_converter_t *converter = &converters[converter_count++];
+		strcpy(converter->from, from);
+		strcpy(converter->to, to);
+		converter->cd = cd;
+		converter->busy = 0;
+		UNLOCK_CONVERTERS();
+		return;
+	}
+	UNLOCK_CONVERTERS();
+
+	iconv_close(cd);
+}
+
+void charset_cleanup(void)
+{
+	int i;
+
+	LOCK_CONVERTERS();
+	for (i = 0; i < converter_count; i++)
+	{
+		if (!converters[i].busy)
+			iconv_close(converters[i].cd);
+	}
+	converter_count = 0;
+	UNLOCK_CONVERTERS();
+}
+
+/*
+ * Character sets that encode 0x00-0x7f as plain ASCII, one byte each.
+ * Shift-JIS and ISO646-JP are left out as they remap '\' and '~'.
+ */
+static int charset_is_ascii_compatible(const char *charset)
+{
+	static const char *prefixes[] =
+	{
+		"US-ASCII", "ASCII", "ANSI_X3.4-1968", "UTF-8", "UTF8", "ISO-8859-", "ISO8859-",
+		"LATIN", "CP125", "WINDOWS-125", NULL
+	};
+	int i;
+
+	for (i = 0; prefixes[i]; i++)
+	{
+		if (strncasecmp(charset, prefixes[i], strlen(prefixes[i])) == 0)
+			return 1;
+	}
+	return 0;
+}
+
 char* charset_convert(const char *string, size_t insize, const char *from, const char *to)
 {
-	size_t outleft, outsize;
+	size_t outleft, outsize, i;
 	iconv_t cd;
 	char *out, *outptr;
 	const char *input = string;
@@ -47,7 +173,18 @@ char* charset_convert(const char *string, size_t insize, const char *from, const
 	if (!to)
 		to = charset_get_current();
 
-	if ((cd = iconv_open(to, from)) == (iconv_t)-1)
+	/* pure ASCII converts to itself between ASCII based charsets */
+	for (i = 0; i < insize && !(string[i] & 0x80); i++)
+		;
+	if (i == insize && charset_is_ascii_compatible(from) && charset_is_ascii_compatible(to))
+	{
+		out = malloc(insize + 4);
+		memcpy(out, string, insize);
+		memset(out + insize, 0, 4);
+		return out;
+	}
+
+	if ((cd = charset_open(from, to)) == (iconv_t)-1)
 	{
 		LOG(lm_main, LOG_ERROR, ("convert_string(): Conversion not supported. "
 			  "Charsets: %s -> %s", from, to));
@@ -95,7 +232,7 @@ char* charset_convert(const char *string, size_t insize, const char *from, const
 	}
     memset(outptr, 0, 4);
 
-	iconv_close(cd);
+	charset_release(cd, from, to);
 	return out;
 }
 
@@ -13,4 +13,7 @@ char* charset_convert(const char *string, size_t insize, const char *from, const
 char* charset_to_utf8(const char *string);
 char* charset_from_utf8(const char *string);
 
+/* Closes the converters kept for reuse by charset_convert. */
+void charset_cleanup(void);
+
 #endif  /* CHARSET_H_INCLUDED */
@@ -0,0 +1,63 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * CRC-32C (Castagnoli), as used by iSCSI and ext4. Start with 0 and pass the
+ * previous result to continue over more data. SSE 4.2 or the ARMv8 CRC
+ * instructions are used where the processor has them.
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/**
+ * The CRC-32C of two blocks one after the other, from the CRC of each and
+ * the length of the second.
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+#define SHA256_DIGEST_SIZE  32
+
+typedef struct
+{
+    uint32_t            state[8];
+    uint64_t            length;
+    uint8_t             block[64];
+    size_t              fill;
+} 
+sha256_t;
+
+void sha256_init(sha256_t *);
+void sha256_update(sha256_t *, const void *buf, size_t len);
+void sha256_final(sha256_t *, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* __CHECKSUM_H__ */
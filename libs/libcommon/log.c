@@ -38,6 +38,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/stat.h> 
@@ -47,6 +48,11 @@
 #include <sys/thread.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#else
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
 #endif
 
 #include "log.h"
@@ -56,8 +62,9 @@ static sys_mutex_t _log_lock;
 #define _LOCK_LOG() sysMutexLock(_log_lock, 0)
 #define _UNLOCK_LOG() sysMutexUnlock(_log_lock)
 #else
-#define _LOCK_LOG()
-#define _UNLOCK_LOG()
+static pthread_mutex_t _log_lock = PTHREAD_MUTEX_INITIALIZER;
+#define _LOCK_LOG() pthread_mutex_lock(&_log_lock)
+#define _UNLOCK_LOG() pthread_mutex_unlock(&_log_lock)
 #endif
 
 #define _PUT_LOG(fd, buf, nb)    { fwrite(buf, 1, nb, fd); fflush(fd); }
@@ -73,6 +80,291 @@ static int             output_time_stamp = 0;
 #define LINE_BUF_SIZE       512
 #define DEFAULT_BUF_SIZE    16384
 
+#ifndef __lv2ppu__
+/*
+ * Asynchronous logging: every thread formats its messages into its own
+ * single producer / single consumer ring, a background thread drains all
+ * rings to the log file once per flush interval. Producers never take a
+ * lock unless their ring is full.
+ */
+#define DEFAULT_RING_SIZE           65536
+#define DEFAULT_FLUSH_INTERVAL_MS   100
+
+typedef struct log_ring_t
+{
+    char              *data;
+    size_t            size;                 /* power of two */
+    size_t            head;                 /* written by the owning thread */
+    size_t            tail;                 /* written by the flusher */
+    int               released;             /* owning thread has exited */
+    unsigned long     tid;
+    struct log_ring_t *next;
+} log_ring_t;
+
+static int              log_async          = 0;
+static size_t           log_ring_size      = DEFAULT_RING_SIZE;
+static int              log_flush_interval = DEFAULT_FLUSH_INTERVAL_MS;
+static log_ring_t       *log_rings         = NULL;
+static pthread_mutex_t  log_rings_lock     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t    log_ring_key;
+static pthread_t        log_flusher;
+static pthread_mutex_t  log_flusher_lock   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   log_flusher_cond   = PTHREAD_COND_INITIALIZER;
+static int              log_flusher_stop   = 0;
+#endif
+
+static unsigned long log_thread_id(void)
+{
+#if defined(__lv2ppu__)
+    sys_ppu_thread_t me = 0;
+    sysThreadGetId(&me);
+    return (unsigned long) me;
+#elif defined(__linux__)
+    return (unsigned long) syscall(SYS_gettid);
+#elif defined(__APPLE__)
+    uint64_t tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    return (unsigned long) tid;
+#else
+    return (unsigned long) (uintptr_t) pthread_self();
+#endif
+}
+
+static int log_time_stamp(char *buf, size_t size)
+{
+    struct tm ts;
+#ifdef __lv2ppu__
+    time_t    now;
+
+    time(&now);
+    ts = *localtime(&now);
+    return snprintf(buf, size, "%04d-%02d-%02d %02d:%02d:%02d - ",
+                    ts.tm_year + 1900, ts.tm_mon + 1, ts.tm_mday,
+                    ts.tm_hour, ts.tm_min, ts.tm_sec);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+#ifdef _WIN32
+    ts = *localtime(&now.tv_sec);
+#else
+    localtime_r(&now.tv_sec, &ts);
+#endif
+    return snprintf(buf, size, "%04d-%02d-%02d %02d:%02d:%02d.%06ld - ",
+                    ts.tm_year + 1900, ts.tm_mon + 1, ts.tm_mday,
+                    ts.tm_hour, ts.tm_min, ts.tm_sec, (long) (now.tv_nsec / 1000));
+#endif
+}
+
+#ifndef __lv2ppu__
+static void log_ring_release(void *arg)
+{
+    log_ring_t *ring = (log_ring_t *) arg;
+
+    __atomic_store_n(&ring->released, 1, __ATOMIC_RELEASE);
+}
+
+static log_ring_t *log_get_ring(void)
+{
+    log_ring_t *ring = (log_ring_t *) pthread_getspecific(log_ring_key);
+
+    if (ring)
+        return ring;
+
+    pthread_mutex_lock(&log_rings_lock);
+
+    /* reuse a drained ring left behind by a thread that has exited */
+    for (ring = log_rings; ring; ring = ring->next)
+    {
+        if (__atomic_load_n(&ring->released, __ATOMIC_ACQUIRE)
+            && ring->head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+            break;
+    }
+    if (ring)
+    {
+        ring->released = 0;
+    }
+    else
+    {
+        ring = (log_ring_t *) calloc(1, sizeof(log_ring_t));
+        if (ring)
+        {
+            ring->size = log_ring_size;
+            ring->data = (char *) malloc(ring->size);
+            if (ring->data)
+            {
+                ring->next = log_rings;
+                log_rings  = ring;
+            }
+            else
+            {
+                free(ring);
+                ring = NULL;
+            }
+        }
+    }
+    if (ring)
+    {
+        ring->tid = log_thread_id();
+        pthread_setspecific(log_ring_key, ring);
+    }
+
+    pthread_mutex_unlock(&log_rings_lock);
+    return ring;
+}
+
+static void log_wake_flusher(void)
+{
+    pthread_mutex_lock(&log_flusher_lock);
+    pthread_cond_signal(&log_flusher_cond);
+    pthread_mutex_unlock(&log_flusher_lock);
+}
+
+static void log_ring_put(log_ring_t *ring, const char *buf, size_t nb)
+{
+    size_t head = ring->head, offset, part;
+
+    if (nb > ring->size)
+        nb = ring->size;
+
+    /* the ring is full, wait for the flusher to make room */
+    while (ring->size - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) < nb)
+    {
+        log_wake_flusher();
+        usleep(1000);
+    }
+
+    offset = head & (ring->size - 1);
+    part   = ring->size - offset < nb ? ring->size - offset : nb;
+    memcpy(ring->data + offset, buf, part);
+    memcpy(ring->data, buf + part, nb - part);
+
+    /* publish the message */
+    __atomic_store_n(&ring->head, head + nb, __ATOMIC_RELEASE);
+}
+
+/*
+ * Writes out everything that has been published in the rings so far, must
+ * be called with the log lock held.
+ */
+static void log_drain_rings(void)
+{
+    log_ring_t *ring;
+    int        written = 0;
+
+    pthread_mutex_lock(&log_rings_lock);
+    for (ring = log_rings; ring; ring = ring->next)
+    {
+        size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        size_t tail = ring->tail, offset, part, nb;
+
+        nb = head - tail;
+        if (nb == 0)
+            continue;
+
+        offset = tail & (ring->size - 1);
+        part   = ring->size - offset < nb ? ring->size - offset : nb;
+        if (log_file)
+        {
+            fwrite(ring->data + offset, 1, part, log_file);
+            fwrite(ring->data, 1, nb - part, log_file);
+            written = 1;
+        }
+
+        /* hand the space back to the producer */
+        __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&log_rings_lock);
+
+    if (written)
+        fflush(log_file);
+}
+
+static void *log_flusher_thread(void *arg)
+{
+    struct timespec deadline;
+
+    (void) arg;
+
+    pthread_mutex_lock(&log_flusher_lock);
+    while (!log_flusher_stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec  += log_flush_interval / 1000;
+        deadline.tv_nsec += (long) (log_flush_interval % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&log_flusher_cond, &log_flusher_lock, &deadline);
+        pthread_mutex_unlock(&log_flusher_lock);
+
+        _LOCK_LOG();
+        log_drain_rings();
+        _UNLOCK_LOG();
+
+        pthread_mutex_lock(&log_flusher_lock);
+    }
+    pthread_mutex_unlock(&log_flusher_lock);
+
+    return 0;
+}
+
+static void log_start_async(size_t ring_size, int flush_interval)
+{
+    size_t size = LINE_BUF_SIZE;
+
+    /* round the ring up to a power of two so positions wrap with a mask */
+    while (size < ring_size)
+        size <<= 1;
+    log_ring_size      = size;
+    log_flush_interval = flush_interval > 0 ? flush_interval : DEFAULT_FLUSH_INTERVAL_MS;
+
+    if (pthread_key_create(&log_ring_key, log_ring_release) != 0)
+        return;
+
+    log_flusher_stop = 0;
+    if (pthread_create(&log_flusher, NULL, log_flusher_thread, NULL) != 0)
+    {
+        pthread_key_delete(log_ring_key);
+        return;
+    }
+    log_async = 1;
+}
+
+static void log_stop_async(void)
+{
+    log_ring_t *ring;
+
+    if (!log_async)
+        return;
+
+    pthread_mutex_lock(&log_flusher_lock);
+    log_flusher_stop = 1;
+    pthread_cond_signal(&log_flusher_cond);
+    pthread_mutex_unlock(&log_flusher_lock);
+    pthread_join(log_flusher, NULL);
+
+    _LOCK_LOG();
+    log_drain_rings();
+    log_async = 0;
+    _UNLOCK_LOG();
+
+    pthread_key_delete(log_ring_key);
+
+    pthread_mutex_lock(&log_rings_lock);
+    while (log_rings)
+    {
+        ring      = log_rings;
+        log_rings = ring->next;
+        free(ring->data);
+        free(ring);
+    }
+    pthread_mutex_unlock(&log_rings_lock);
+}
+#endif
+
 void log_init(void)
 {
     char             *ev = 0;
@@ -95,6 +387,9 @@ void log_init(void)
                            * format string to be size-1.
                            */
         int     is_sync  = 0;
+        int     is_async = 0;
+        int     flush_ms = 0;
+        int32_t ringSize = 0;
         int     evlen   = strlen(ev), pos = 0;
         int32_t bufSize = DEFAULT_BUF_SIZE;
         while (pos < evlen)
@@ -114,11 +409,19 @@ void log_init(void)
             {
                 is_sync = 1;
             }
+            else if (strcasecmp(module, "async") == 0)
+            {
+                is_async = 1;
+            }
+            else if (strcasecmp(module, "flushms") == 0)
+            {
+                flush_ms = level;
+            }
             else if (strcasecmp(module, "bufsize") == 0)
             {
                 if (level >= LINE_BUF_SIZE)
                 {
-                    bufSize = level;
+                    bufSize = ringSize = level;
                 }
             }
             else if (strcasecmp(module, "timestamp") == 0)
@@ -162,6 +465,16 @@ void log_init(void)
         {
             log_file = stderr;
         }
+
+#ifndef __lv2ppu__
+        if (is_async && !is_sync)
+        {
+            log_start_async(ringSize ? (size_t) ringSize : DEFAULT_RING_SIZE, flush_ms);
+        }
+#else
+        (void) is_async;
+        (void) flush_ms;
+#endif
     }
 }
 
@@ -169,6 +482,9 @@ void log_destroy(void)
 {
     log_module_info_t *lm = logModules;
 
+#ifndef __lv2ppu__
+    log_stop_async();
+#endif
     log_flush();
 
     if (log_file && log_file != stdout && log_file != stderr)
@@ -296,35 +612,35 @@ void log_print(const char *fmt, ...)
     char             line[LINE_BUF_SIZE];
     char             *line_long = NULL;
     uint32_t         nb_tid     = 0, nb;
-#ifdef __lv2ppu__
-    sys_ppu_thread_t me        = 0;
-#else
-    int              me     = 0;
+    unsigned long    me;
+#ifndef __lv2ppu__
+    log_ring_t       *ring      = NULL;
 #endif
-    time_t           now;
-    struct tm        ts;
 
     if (!log_file)
     {
         return;
     }
 
+#ifndef __lv2ppu__
+    if (log_async)
+        ring = log_get_ring();
+
+    /* messages from different rings are interleaved, always stamp them */
+    if (output_time_stamp || ring)
+#else
     if (output_time_stamp)
+#endif
     {
-        time(&now);
-        ts = *localtime(&now);
-
-        nb_tid = snprintf(line, sizeof(line) - 1,
-                          "%04d-%02d-%02d %02d:%02d:%02d - ",
-                          ts.tm_year, ts.tm_mon + 1, ts.tm_mday,
-                          ts.tm_hour, ts.tm_min, ts.tm_sec);
+        nb_tid = log_time_stamp(line, sizeof(line) - 1);
     }
 
-#ifdef __lv2ppu__
-    sysThreadGetId(&me);
-    nb_tid += snprintf(line + nb_tid, sizeof(line) - nb_tid - 1, "%ld[%p]: ", me, (void *) me);
+#ifndef __lv2ppu__
+    me = ring ? ring->tid : log_thread_id();
+    nb_tid += snprintf(line + nb_tid, sizeof(line) - nb_tid - 1, "[%lu]: ", me);
 #else
-    nb_tid += snprintf(line + nb_tid, sizeof(line) - nb_tid - 1, "[%d]: ", me);
+    me = log_thread_id();
+    nb_tid += snprintf(line + nb_tid, sizeof(line) - nb_tid - 1, "%ld[%p]: ", (long) me, (void *) me);
 #endif
 
     va_start(ap, fmt);
@@ -344,6 +660,37 @@ void log_print(const char *fmt, ...)
         /* If this failed, we'll fall back to writing the truncated line. */
     }
 
+#ifndef __lv2ppu__
+    if (ring)
+    {
+        if (line_long)
+        {
+            /* keep the line in one piece so it can't be split by a drain */
+            size_t nb_long = strlen(line_long);
+            char   *msg    = (char *) malloc(nb_tid + nb_long + 1);
+
+            if (msg)
+            {
+                memcpy(msg, line, nb_tid);
+                memcpy(msg + nb_tid, line_long, nb_long);
+                nb = nb_tid + nb_long;
+                if (!nb_long || line_long[nb_long - 1] != '\n')
+                    msg[nb++] = '\n';
+                log_ring_put(ring, msg, nb);
+                free(msg);
+            }
+            free(line_long);
+        }
+        else
+        {
+            if (nb && (line[nb - 1] != '\n'))
+                line[nb++] = '\n';
+            log_ring_put(ring, line, nb);
+        }
+        return;
+    }
+#endif
+
     if (line_long)
     {
         nb = strlen(line_long);
@@ -402,6 +749,15 @@ void log_print(const char *fmt, ...)
 
 void log_flush(void)
 {
+#ifndef __lv2ppu__
+    if (log_async)
+    {
+        _LOCK_LOG();
+        log_drain_rings();
+        _UNLOCK_LOG();
+        return;
+    }
+#endif
     if (log_buf && log_file)
     {
         _LOCK_LOG();
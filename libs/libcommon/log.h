@@ -90,6 +90,16 @@ extern "C" {
 ** The special LogModule name "bufsize:<size>" tells the log service 
 ** to set the log buffer to <size>.
 **
+** The special LogModule name "async" tells the log service to format
+** messages into a per-thread ring buffer that a background thread writes
+** out, so logging never serializes the calling threads. "bufsize:<size>"
+** then sets the size of each ring and "flushms:<ms>" the interval at
+** which the rings are flushed (default 100 ms). Messages are always
+** time stamped in this mode.
+**
+** The special LogModule name "timestamp" prefixes every message with
+** the time of day in microsecond resolution.
+**
 ** The environment variable LOG_FILE specifies the log file to use
 ** unless the default of "stderr" is acceptable. For MS Windows
 ** systems, LOG_FILE can be set to a special value: "WinDebug"
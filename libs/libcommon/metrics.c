@@ -0,0 +1,354 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#include "metrics.h"
+
+static const char *stage_names[METRICS_STAGE_COUNT] = 
+{
+    "read", "decrypt", "demux", "dst_decode", "reorder_wait", "write"
+};
+
+static const char *gauge_names[METRICS_GAUGE_COUNT] = 
+{
+    "decode_queue", "reorder_queue", "input_buffers", "output_buffers"
+};
+
+typedef struct
+{
+    uint64_t            calls;
+    uint64_t            nanoseconds;
+    uint64_t            bytes;
+} stage_t;
+
+typedef struct
+{
+    int64_t             last;
+    int64_t             max;
+    int64_t             sum;
+    int64_t             samples;
+} gauge_t;
+
+typedef struct metrics_thread_s
+{
+    char                name[32];
+    metrics_t          *metrics;
+    stage_t             stages[METRICS_STAGE_COUNT];
+    struct metrics_thread_s *next;
+} metrics_thread_t;
+
+struct metrics_s
+{
+    FILE               *out;
+    char               *label;
+    uint64_t            started;
+    uint64_t            interval;               // nanoseconds, 0 without interval lines
+    uint64_t            next_interval;
+
+    pthread_mutex_t     lock;                   // guards the thread list
+    metrics_thread_t   *threads;
+    metrics_thread_t  **threads_tail;
+    gauge_t             gauges[METRICS_GAUGE_COUNT];
+};
+
+// the slot of the calling thread
+static pthread_key_t    thread_key;
+static pthread_once_t   thread_key_once = PTHREAD_ONCE_INIT;
+
+// jobs may share an output file, their lines must not mix
+static pthread_mutex_t  write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void create_thread_key(void)
+{
+    pthread_key_create(&thread_key, NULL);
+}
+
+static inline metrics_thread_t *current_thread(void)
+{
+    pthread_once(&thread_key_once, create_thread_key);
+    return (metrics_thread_t *) pthread_getspecific(thread_key);
+}
+
+// counters are updated by several threads while interval lines are written
+static inline uint64_t load(uint64_t *counter)
+{
+    return __sync_fetch_and_add(counter, 0);
+}
+
+static inline int64_t load_signed(int64_t *counter)
+{
+    return __sync_fetch_and_add(counter, 0);
+}
+
+uint64_t metrics_now(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t) (counter.QuadPart / frequency.QuadPart) * 1000000000ULL
+         + (uint64_t) (counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (uint64_t) frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000000ULL + (uint64_t) tv.tv_usec * 1000ULL;
+#endif
+}
+
+metrics_t *metrics_create(FILE *out, const char *label, double interval)
+{
+    metrics_t *metrics = (metrics_t *) calloc(1, sizeof(metrics_t));
+
+    if (!metrics)
+        return NULL;
+
+    metrics->label = strdup(label ? label : "");
+    if (!metrics->label)
+    {
+        free(metrics);
+        return NULL;
+    }
+    metrics->out = out;
+    metrics->started = metrics_now();
+    metrics->interval = interval > 0 ? (uint64_t) (interval * 1e9) : 0;
+    metrics->next_interval = metrics->started + metrics->interval;
+    metrics->threads_tail = &metrics->threads;
+    pthread_mutex_init(&metrics->lock, NULL);
+    return metrics;
+}
+
+void metrics_destroy(metrics_t *metrics)
+{
+    metrics_thread_t *thread;
+
+    if (!metrics)
+        return;
+
+    while ((thread = metrics->threads) != NULL)
+    {
+        metrics->threads = thread->next;
+        free(thread);
+    }
+    pthread_mutex_destroy(&metrics->lock);
+    free(metrics->label);
+    free(metrics);
+}
+
+void metrics_thread_enter(metrics_t *metrics, const char *name)
+{
+    metrics_thread_t *thread = NULL;
+
+    if (metrics)
+    {
+        pthread_mutex_lock(&metrics->lock);
+        for (thread = metrics->threads; thread && strcmp(thread->name, name) != 0; thread = thread->next)
+            ;
+        if (!thread && (thread = (metrics_thread_t *) calloc(1, sizeof(metrics_thread_t))) != NULL)
+        {
+            snprintf(thread->name, sizeof(thread->name), "%s", name);
+            thread->metrics = metrics;
+            *metrics->threads_tail = thread;
+            metrics->threads_tail = &thread->next;
+        }
+        pthread_mutex_unlock(&metrics->lock);
+    }
+
+    pthread_once(&thread_key_once, create_thread_key);
+    pthread_setspecific(thread_key, thread);
+}
+
+metrics_t *metrics_current(void)
+{
+    metrics_thread_t *thread = current_thread();
+
+    return thread ? thread->metrics : NULL;
+}
+
+uint64_t metrics_start(void)
+{
+    return current_thread() ? metrics_now() : 0;
+}
+
+void metrics_stop(int stage, uint64_t start, uint64_t bytes)
+{
+    metrics_thread_t *thread;
+
+    if (start == 0 || (thread = current_thread()) == NULL)
+        return;
+
+    __sync_fetch_and_add(&thread->stages[stage].calls, 1);
+    __sync_fetch_and_add(&thread->stages[stage].nanoseconds, metrics_now() - start);
+    __sync_fetch_and_add(&thread->stages[stage].bytes, bytes);
+}
+
+void metrics_gauge(int gauge, int value)
+{
+    metrics_thread_t *thread = current_thread();
+    gauge_t          *g;
+    int64_t           max;
+
+    if (!thread)
+        return;
+
+    g = &thread->metrics->gauges[gauge];
+    __sync_lock_test_and_set(&g->last, (int64_t) value);
+    __sync_fetch_and_add(&g->sum, (int64_t) value);
+    __sync_fetch_and_add(&g->samples, 1);
+    do
+    {
+        max = load_signed(&g->max);
+    }
+    while (value > max && !__sync_bool_compare_and_swap(&g->max, max, (int64_t) value));
+}
+
+static void write_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char) *str);
+        else
+            fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+static void write_stages(FILE *out, const stage_t *stages)
+{
+    int i, first = 1;
+
+    fputc('{', out);
+    for (i = 0; i < METRICS_STAGE_COUNT; i++)
+    {
+        if (stages[i].calls == 0)
+            continue;
+        fprintf(out, "%s\"%s\":{\"calls\":%llu,\"seconds\":%.6f,\"bytes\":%llu}", first ? "" : ",", stage_names[i], 
+                (unsigned long long) stages[i].calls, (double) stages[i].nanoseconds / 1e9, (unsigned long long) stages[i].bytes);
+        first = 0;
+    }
+    fputc('}', out);
+}
+
+// writes one line, called with metrics->lock held
+static void write_line(metrics_t *metrics, const char *type, int with_threads)
+{
+    metrics_thread_t *thread;
+    stage_t           total[METRICS_STAGE_COUNT], stages[METRICS_STAGE_COUNT];
+    int64_t           samples;
+    FILE             *out = metrics->out;
+    int               i;
+
+    memset(total, 0, sizeof(total));
+    for (thread = metrics->threads; thread; thread = thread->next)
+    {
+        for (i = 0; i < METRICS_STAGE_COUNT; i++)
+        {
+            total[i].calls += load(&thread->stages[i].calls);
+            total[i].nanoseconds += load(&thread->stages[i].nanoseconds);
+            total[i].bytes += load(&thread->stages[i].bytes);
+        }
+    }
+
+    pthread_mutex_lock(&write_lock);
+    fprintf(out, "{\"type\":\"%s\",\"label\":", type);
+    write_string(out, metrics->label);
+    fprintf(out, ",\"elapsed\":%.6f,\"stages\":", (double) (metrics_now() - metrics->started) / 1e9);
+    write_stages(out, total);
+
+    if (with_threads)
+    {
+        fprintf(out, ",\"threads\":[");
+        for (thread = metrics->threads; thread; thread = thread->next)
+        {
+            for (i = 0; i < METRICS_STAGE_COUNT; i++)
+            {
+                stages[i].calls = load(&thread->stages[i].calls);
+                stages[i].nanoseconds = load(&thread->stages[i].nanoseconds);
+                stages[i].bytes = load(&thread->stages[i].bytes);
+            }
+            fprintf(out, "%s{\"name\":", thread == metrics->threads ? "" : ",");
+            write_string(out, thread->name);
+            fprintf(out, ",\"stages\":");
+            write_stages(out, stages);
+            fputc('}', out);
+        }
+        fputc(']', out);
+    }
+
+    fprintf(out, ",\"gauges\":{");
+    for (i = 0; i < METRICS_GAUGE_COUNT; i++)
+    {
+        samples = load_signed(&metrics->gauges[i].samples);
+        fprintf(out, "%s\"%s\":{\"last\":%lld,\"max\":%lld,\"mean\":%.2f}", i ? "," : "", gauge_names[i],
+                (long long) load_signed(&metrics->gauges[i].last), (long long) load_signed(&metrics->gauges[i].max),
+                samples ? (double) load_signed(&metrics->gauges[i].sum) / (double) samples : 0.0);
+    }
+    fprintf(out, "}}\n");
+    fflush(out);
+    pthread_mutex_unlock(&write_lock);
+}
+
+void metrics_poll(metrics_t *metrics)
+{
+    uint64_t now, next;
+
+    if (!metrics || !metrics->interval || !metrics->out)
+        return;
+
+    // one thread wins the interval, the others carry on
+    now = metrics_now();
+    next = load(&metrics->next_interval);
+    if (now < next || !__sync_bool_compare_and_swap(&metrics->next_interval, next, now + metrics->interval))
+        return;
+
+    pthread_mutex_lock(&metrics->lock);
+    write_line(metrics, "interval", 0);
+    pthread_mutex_unlock(&metrics->lock);
+}
+
+void metrics_report(metrics_t *metrics)
+{
+    if (!metrics || !metrics->out)
+        return;
+
+    pthread_mutex_lock(&metrics->lock);
+    write_line(metrics, "report", 1);
+    pthread_mutex_unlock(&metrics->lock);
+}
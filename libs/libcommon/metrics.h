@@ -0,0 +1,123 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Timers and counters for the stages of an extraction.
+ *
+ * A metrics_t belongs to one job. Every thread working for the job attaches
+ * itself with metrics_thread_enter() and from then on its stage timings are
+ * added to a slot of its own, threads of the same name share a slot. Threads
+ * that never attached (or attached to NULL) measure nothing, the calls below
+ * return right away for them.
+ *
+ * Reports are JSON objects, one per line: "interval" lines while the job runs
+ * and a final "report" with the totals per stage, per thread and the gauges.
+ */
+
+enum
+{
+    METRICS_READ = 0,               // sectors read from the source
+    METRICS_DECRYPT,
+    METRICS_DEMUX,                  // audio frames taken out of the sectors
+    METRICS_DST_DECODE,
+    METRICS_REORDER_WAIT,           // waiting for the next DST frame in order
+    METRICS_WRITE,                  // format handlers writing the output
+
+    METRICS_STAGE_COUNT
+};
+
+enum
+{
+    METRICS_DECODE_QUEUE = 0,       // DST frames waiting for a decode thread
+    METRICS_REORDER_QUEUE,          // decoded frames waiting to be written in order
+    METRICS_INPUT_BUFFERS,          // DST input buffers in use
+    METRICS_OUTPUT_BUFFERS,         // DSD output buffers in use
+
+    METRICS_GAUGE_COUNT
+};
+
+typedef struct metrics_s metrics_t;
+
+/**
+ * Creates the metrics of a job, reports go to "out" (may be NULL) and are
+ * labeled with "label". With an "interval" > 0 (seconds) metrics_poll()
+ * writes interval lines.
+ */
+metrics_t *metrics_create(FILE *out, const char *label, double interval);
+
+/**
+ * Writes the final report, the job's threads must have finished.
+ */
+void metrics_report(metrics_t *);
+
+void metrics_destroy(metrics_t *);
+
+/**
+ * Attaches the calling thread to "metrics" (or detaches it with NULL).
+ */
+void metrics_thread_enter(metrics_t *metrics, const char *name);
+
+/**
+ * The metrics the calling thread is attached to, NULL if none.
+ */
+metrics_t *metrics_current(void);
+
+/**
+ * Starts timing a stage, returns 0 when the thread doesn't measure.
+ */
+uint64_t metrics_start(void);
+
+/**
+ * Adds the time since "start" and "bytes" to a stage of the calling thread.
+ */
+void metrics_stop(int stage, uint64_t start, uint64_t bytes);
+
+/**
+ * Samples a gauge of the calling thread's metrics.
+ */
+void metrics_gauge(int gauge, int value);
+
+/**
+ * Writes an interval line when the interval has passed since the last one,
+ * any thread of the job may call this.
+ */
+void metrics_poll(metrics_t *);
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+uint64_t metrics_now(void);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __METRICS_H__ */
@@ -273,6 +273,7 @@ static bool checkreturn decode_field(pb_istream_t *stream, int wire_type, pb_fie
                         return false;
                     (*size)++;
                 }
+                stream->state = substream.state;
                 return (substream.bytes_left == 0);
             }
             else
@@ -0,0 +1,251 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "trace.h"
+
+#define TRACE_CHUNK_EVENTS 4096
+
+typedef struct
+{
+    uint64_t            ts;                     // nanoseconds since trace_open
+    const char         *name;
+    const char         *arg_name;
+    int64_t             arg;
+    char               *text;
+    int                 phase;
+} trace_event_t;
+
+typedef struct trace_chunk_s
+{
+    int                 count;
+    struct trace_chunk_s *next;
+    trace_event_t       events[TRACE_CHUNK_EVENTS];
+} trace_chunk_t;
+
+// one timeline row, written by one thread at a time
+typedef struct trace_thread_s
+{
+    char                name[32];
+    int                 tid;
+    int                 in_use;
+    trace_chunk_t      *head;
+    trace_chunk_t      *tail;
+    struct trace_thread_s *next;
+} trace_thread_t;
+
+volatile int            trace_enabled = 0;
+
+static FILE            *trace_out;
+static uint64_t         trace_started;
+static pthread_mutex_t  trace_lock = PTHREAD_MUTEX_INITIALIZER;     // guards the row list
+static trace_thread_t  *trace_threads;
+static int              trace_thread_count;
+
+static pthread_key_t    thread_key;
+static pthread_once_t   thread_key_once = PTHREAD_ONCE_INIT;
+
+// the row of an exiting thread is free for the next thread of that name
+static void release_thread(void *arg)
+{
+    trace_thread_t *thread = (trace_thread_t *) arg;
+
+    pthread_mutex_lock(&trace_lock);
+    thread->in_use = 0;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static void create_thread_key(void)
+{
+    pthread_key_create(&thread_key, release_thread);
+}
+
+static trace_thread_t *acquire_thread(const char *name)
+{
+    trace_thread_t *thread;
+
+    pthread_mutex_lock(&trace_lock);
+    for (thread = trace_threads; thread; thread = thread->next)
+    {
+        if (!thread->in_use && name && strcmp(thread->name, name) == 0)
+            break;
+    }
+    if (!thread && (thread = (trace_thread_t *) calloc(1, sizeof(trace_thread_t))) != NULL)
+    {
+        thread->tid = ++trace_thread_count;
+        if (name)
+            snprintf(thread->name, sizeof(thread->name), "%s", name);
+        else
+            snprintf(thread->name, sizeof(thread->name), "thread %d", thread->tid);
+        thread->next = trace_threads;
+        trace_threads = thread;
+    }
+    if (thread)
+        thread->in_use = 1;
+    pthread_mutex_unlock(&trace_lock);
+    return thread;
+}
+
+void trace_thread_enter(const char *name)
+{
+    trace_thread_t *thread;
+
+    pthread_once(&thread_key_once, create_thread_key);
+    thread = (trace_thread_t *) pthread_getspecific(thread_key);
+    if (thread)
+    {
+        if (strcmp(thread->name, name) == 0)
+            return;
+        release_thread(thread);
+    }
+    pthread_setspecific(thread_key, acquire_thread(name));
+}
+
+void trace_event(int phase, const char *name, const char *arg_name, int64_t arg, const char *text)
+{
+    trace_thread_t *thread;
+    trace_event_t  *event;
+    trace_chunk_t  *chunk;
+
+    pthread_once(&thread_key_once, create_thread_key);
+    thread = (trace_thread_t *) pthread_getspecific(thread_key);
+    if (!thread)
+    {
+        // threads that didn't name themselves get a row of their own
+        if (!(thread = acquire_thread(NULL)))
+            return;
+        pthread_setspecific(thread_key, thread);
+    }
+
+    chunk = thread->tail;
+    if (!chunk || chunk->count == TRACE_CHUNK_EVENTS)
+    {
+        if (!(chunk = (trace_chunk_t *) malloc(sizeof(trace_chunk_t))))
+            return;
+        chunk->count = 0;
+        chunk->next = NULL;
+        if (thread->tail)
+            thread->tail->next = chunk;
+        else
+            thread->head = chunk;
+        thread->tail = chunk;
+    }
+
+    event = &chunk->events[chunk->count++];
+    event->ts = metrics_now() - trace_started;
+    event->phase = phase;
+    event->name = name;
+    event->arg_name = arg_name;
+    event->arg = arg;
+    event->text = text ? strdup(text) : NULL;
+}
+
+int trace_open(const char *path)
+{
+    trace_out = fopen(path, "w");
+    if (!trace_out)
+        return -1;
+
+    trace_started = metrics_now();
+    trace_enabled = 1;
+    return 0;
+}
+
+static void write_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char) *str);
+        else
+            fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+void trace_close(void)
+{
+    trace_thread_t *thread;
+    trace_chunk_t  *chunk;
+    trace_event_t  *event;
+    int             i;
+
+    if (!trace_out)
+        return;
+    trace_enabled = 0;
+
+    fprintf(trace_out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(trace_out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"sacd_extract\"}}");
+
+    pthread_mutex_lock(&trace_lock);
+    while ((thread = trace_threads) != NULL)
+    {
+        fprintf(trace_out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", thread->tid);
+        write_string(trace_out, thread->name);
+        fprintf(trace_out, "}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", 
+                thread->tid, thread->tid);
+
+        while ((chunk = thread->head) != NULL)
+        {
+            for (i = 0; i < chunk->count; i++)
+            {
+                event = &chunk->events[i];
+                fprintf(trace_out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", 
+                        event->name, event->phase, thread->tid, (double) event->ts / 1000.0);
+                if (event->arg_name && event->text)
+                {
+                    fprintf(trace_out, ",\"args\":{\"%s\":", event->arg_name);
+                    write_string(trace_out, event->text);
+                    fputc('}', trace_out);
+                }
+                else if (event->arg_name && event->arg != TRACE_NO_ARG)
+                {
+                    fprintf(trace_out, ",\"args\":{\"%s\":%lld}", event->arg_name, (long long) event->arg);
+                }
+                fputc('}', trace_out);
+                free(event->text);
+            }
+            thread->head = chunk->next;
+            free(chunk);
+        }
+
+        // a thread that is still attached keeps its row until it exits
+        trace_threads = thread->next;
+        thread->head = thread->tail = NULL;
+        thread->next = NULL;
+        if (!thread->in_use)
+            free(thread);
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    fprintf(trace_out, "\n]}\n");
+    fclose(trace_out);
+    trace_out = NULL;
+}
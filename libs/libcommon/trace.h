@@ -0,0 +1,106 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Timeline of pipeline events in the Chrome trace event format, for viewing
+ * in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Every thread records into a buffer of its own, the buffers are only
+ * collected when the trace is closed. Until trace_open() the TRACE_ macros
+ * test a single flag and record nothing.
+ *
+ * Spans of a thread must nest, TRACE_END closes the last TRACE_BEGIN. The
+ * names are not copied, use string literals.
+ */
+
+#define TRACE_NO_ARG    (-1)
+
+enum
+{
+    TRACE_PHASE_BEGIN = 'B',
+    TRACE_PHASE_END   = 'E'
+};
+
+extern volatile int trace_enabled;
+
+/**
+ * Starts recording, the timeline is written to "path" by trace_close().
+ */
+int trace_open(const char *path);
+
+/**
+ * Stops recording and writes the timeline, the traced threads must have
+ * finished.
+ */
+void trace_close(void);
+
+/**
+ * Names the timeline row of the calling thread. A thread that exited hands
+ * its row on to the next thread of the same name, so short lived threads
+ * that run one after the other share a row.
+ */
+void trace_thread_enter(const char *name);
+
+/**
+ * Records an event of the calling thread, "arg" is left out when it is
+ * TRACE_NO_ARG, "text" (copied) replaces it when not NULL.
+ */
+void trace_event(int phase, const char *name, const char *arg_name, int64_t arg, const char *text);
+
+#define TRACE_BEGIN(_name, _arg_name, _arg)                                    \
+    do {                                                                        \
+        if (trace_enabled)                                                      \
+            trace_event(TRACE_PHASE_BEGIN, _name, _arg_name, _arg, NULL);       \
+    } while (0)
+
+#define TRACE_BEGIN_TEXT(_name, _arg_name, _text)                              \
+    do {                                                                        \
+        if (trace_enabled)                                                      \
+            trace_event(TRACE_PHASE_BEGIN, _name, _arg_name, TRACE_NO_ARG, _text); \
+    } while (0)
+
+#define TRACE_END(_name)                                                        \
+    do {                                                                        \
+        if (trace_enabled)                                                      \
+            trace_event(TRACE_PHASE_END, _name, NULL, TRACE_NO_ARG, NULL);      \
+    } while (0)
+
+#define TRACE_THREAD(_name)                                                     \
+    do {                                                                        \
+        if (trace_enabled)                                                      \
+            trace_thread_enter(_name);                                          \
+    } while (0)
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __TRACE_H__ */
@@ -112,6 +112,17 @@ void buffer_pool_drop_space(buffer_pool_space_t *space)
     twist(space->use, BY, -1);
 }
 
+/* number of spaces taken from the pool and not yet returned */
+int buffer_pool_in_use(buffer_pool_t *pool)
+{
+    int in_use;
+
+    possess(pool->have);
+    in_use = pool->made - (int) peek_lock(pool->have);
+    release(pool->have);
+    return in_use;
+}
+
 /* free the memory and lock resources of a pool -- return number of spaces for
    debugging and resource usage measurement */
 int buffer_pool_free(buffer_pool_t *pool)
@@ -71,6 +71,9 @@ void buffer_pool_use_space(buffer_pool_space_t *space);
 /* drop a space, returning it to the pool if the use count is zero */
 void buffer_pool_drop_space(buffer_pool_space_t *space);
 
+/* number of spaces taken from the pool and not yet returned */
+int buffer_pool_in_use(buffer_pool_t *pool);
+
 /* free the memory and lock resources of a pool -- return number of spaces for
    debugging and resource usage measurement */
 int buffer_pool_free(buffer_pool_t *pool);
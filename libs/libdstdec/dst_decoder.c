@@ -46,7 +46,12 @@
   "yarn" and this threading code go to him!
 */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
+#include <stdio.h>
 #include <assert.h>
 #ifndef __APPLE__
 #include <malloc.h>
@@ -55,9 +60,12 @@
 #include <string.h>
 #ifdef __linux__
 #include <sys/sysinfo.h>
+#include <sched.h>
 #endif
 
 #include <logging.h>
+#include <metrics.h>
+#include <trace.h>
 
 #include "dst_decoder.h"
 #include "yarn.h"
@@ -104,28 +112,298 @@ struct dst_decoder_s
     lock *write_first;    /* lowest sequence number in list */
     job_t *write_head;
 
-    /* number of decoding threads running */
+    /* decoding threads running, joined by this decoder only so that several
+       decoders can be active at the same time */
     int cthreads;
+    thread **decode_threads;
 
     /* write thread if running */
     thread *writeth;
 
+    /* number of frames handed to the callback */
+    lock *written;
+
     frame_decoded_callback_t frame_decoded_callback;
     frame_error_callback_t frame_error_callback;
     void *userdata;
+
+    /* metrics of the thread that created the decoder, its threads report there */
+    metrics_t *metrics;
+    int thread_names;     /* numbers the decode threads in metrics and traces */
+
+    int pin_node;         /* NUMA node the decode threads are pinned to */
+    int pinned;           /* decode threads pinned so far */
 };
 
-static unsigned processor_count(void)
+/* frames that may be decoded at the same time by all decoders of the process
+   together, NULL when every decoder only limits its own threads */
+static lock *decode_budget = NULL;
+
+void dst_decoder_set_thread_budget(int thread_count)
+{
+    /* called before any decoder is created, the lock is never freed */
+    if (thread_count > 0 && decode_budget == NULL)
+        decode_budget = new_lock(thread_count);
+}
+
+/* set with dst_decoder_set_processor_count, overrides the detected count */
+static int processor_override = 0;
+
+void dst_decoder_set_processor_count(int count)
+{
+    processor_override = count;
+}
+
+#ifdef __linux__
+/* reads the first word (up to 31 characters) and a number after it from a file, 
+   returns how many were found */
+static int read_numbers(const char *path, char *first, long *second)
+{
+    FILE *fd = fopen(path, "r");
+    int count;
+
+    if (!fd)
+        return 0;
+    count = fscanf(fd, "%31s %ld", first, second);
+    fclose(fd);
+    return count > 0 ? count : 0;
+}
+
+/* true when the comma separated controller list of a cgroup v1 hierarchy has "cpu" */
+static int has_cpu_controller(const char *controllers)
+{
+    size_t length;
+
+    while (*controllers)
+    {
+        length = strcspn(controllers, ",");
+        if (length == 3 && strncmp(controllers, "cpu", 3) == 0)
+            return 1;
+        controllers += length;
+        if (*controllers == ',')
+            controllers++;
+    }
+    return 0;
+}
+
+/* processors the CPU quota of a cgroup allows, rounded up, 0 when unlimited */
+static int cgroup_quota(const char *quota_path, const char *period_path)
+{
+    char quota[32];
+    long period = 0;
+
+    if (period_path == NULL)
+    {
+        /* v2: "max 100000" or "400000 100000" */
+        if (read_numbers(quota_path, quota, &period) != 2 || strcmp(quota, "max") == 0)
+            return 0;
+    }
+    else
+    {
+        /* v1: the quota is -1 when unlimited */
+        char period_text[32];
+        long unused;
+
+        if (read_numbers(quota_path, quota, &unused) < 1 || 
+            read_numbers(period_path, period_text, &unused) < 1)
+            return 0;
+        period = atol(period_text);
+    }
+    if (atol(quota) <= 0 || period <= 0)
+        return 0;
+    return (int) ((atol(quota) + period - 1) / period);
+}
+
+/* the lowest CPU quota of the cgroup of this process and its ancestors, 0 when 
+   unlimited -- containers usually see their own cgroup as the root */
+static int cgroup_processor_limit(void)
+{
+    char line[512], path[640], period_path[640], *controllers, *group;
+    FILE *fd;
+    int limit = 0, quota;
+
+    fd = fopen("/proc/self/cgroup", "r");
+    if (!fd)
+        return 0;
+    while (fgets(line, sizeof(line), fd))
+    {
+        /* "hierarchy:controllers:path", v2 has hierarchy 0 and no controllers */
+        line[strcspn(line, "\n")] = '\0';
+        controllers = strchr(line, ':');
+        if (!controllers || !(group = strchr(controllers + 1, ':')))
+            continue;
+        *controllers++ = '\0';
+        *group++ = '\0';
+        if (*group != '/')
+            continue;
+
+        for (;;)
+        {
+            if (strcmp(line, "0") == 0 && *controllers == '\0')
+            {
+                snprintf(path, sizeof(path), "/sys/fs/cgroup%s/cpu.max", group);
+                quota = cgroup_quota(path, NULL);
+            }
+            else if (has_cpu_controller(controllers))
+            {
+                snprintf(path, sizeof(path), "/sys/fs/cgroup/cpu%s/cpu.cfs_quota_us", group);
+                snprintf(period_path, sizeof(period_path), "/sys/fs/cgroup/cpu%s/cpu.cfs_period_us", group);
+                quota = cgroup_quota(path, period_path);
+            }
+            else
+                break;
+
+            if (quota > 0 && (limit == 0 || quota < limit))
+                limit = quota;
+
+            /* on to the parent group, "/" ends up as "" */
+            if (*group == '\0')
+                break;
+            *strrchr(group, '/') = '\0';
+        }
+    }
+    fclose(fd);
+    return limit;
+}
+#endif
+
+static unsigned detected_processors = 0;
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+
+static void detect_processors(void)
 {
 #if defined(_WIN32)
-    return pthread_num_processors_np();
+    detected_processors = pthread_num_processors_np();
 #elif defined(__linux__)
-    return get_nprocs();
+    cpu_set_t set;
+    int count = get_nprocs(), limit;
+
+    /* taskset, numactl or a container runtime may leave us fewer processors */
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+        count = CPU_COUNT(&set) < count ? CPU_COUNT(&set) : count;
+    limit = cgroup_processor_limit();
+    if (limit > 0 && limit < count)
+        count = limit;
+    detected_processors = count > 0 ? (unsigned) count : 1;
 #elif defined(__APPLE__) || defined(__FreeBSD__)
     int count;
     size_t size=sizeof(count);
-    return sysctlbyname("hw.ncpu",&count,&size,NULL,0) ? 1 : count;
+    detected_processors = sysctlbyname("hw.ncpu",&count,&size,NULL,0) ? 1 : count;
+#endif
+}
+
+unsigned dst_decoder_processor_count(void)
+{
+    if (processor_override > 0)
+        return (unsigned) processor_override;
+    pthread_once(&detect_once, detect_processors);
+    return detected_processors;
+}
+
+/* -- CPU pinning -- */
+
+/* the processors decode threads may be pinned to, grouped by NUMA node */
+static int pin_enabled = 0;
+#ifdef __linux__
+static int *pin_cpus = NULL;
+static int pin_node_count = 0;
+static int *pin_node_start = NULL;      /* pin_node_count + 1 entries */
+static int pin_next_node = 0;
+
+/* adds the allowed processors of a "0-3,8-11" list */
+static void add_cpu_list(const char *list, const cpu_set_t *allowed, int *count)
+{
+    char *end;
+    long first, last, cpu;
+
+    while (*list)
+    {
+        first = strtol(list, &end, 10);
+        if (end == list)
+            break;
+        last = first;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, allowed))
+                pin_cpus[(*count)++] = (int) cpu;
+        }
+        list = *end == ',' ? end + 1 : end;
+        if (*list == '\n')
+            break;
+    }
+}
+
+static void setup_pinning(void)
+{
+    cpu_set_t allowed;
+    char path[64], list[1024];
+    FILE *fd;
+    int node, count = 0, cpu;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+    pin_cpus = (int *) malloc(CPU_COUNT(&allowed) * sizeof(int));
+    pin_node_start = (int *) malloc((CPU_SETSIZE + 1) * sizeof(int));
+    if (!pin_cpus || !pin_node_start)
+        return;
+
+    for (node = 0; node < CPU_SETSIZE && count < CPU_COUNT(&allowed); node++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        fd = fopen(path, "r");
+        if (!fd)
+            break;
+        pin_node_start[pin_node_count] = count;
+        if (fgets(list, sizeof(list), fd))
+            add_cpu_list(list, &allowed, &count);
+        fclose(fd);
+        if (count > pin_node_start[pin_node_count])
+            pin_node_count++;
+    }
+
+    /* no NUMA information, one node with every allowed processor */
+    if (pin_node_count == 0)
+    {
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+                pin_cpus[count++] = cpu;
+        }
+        pin_node_start[0] = 0;
+        pin_node_count = count > 0;
+    }
+    pin_node_start[pin_node_count] = count;
+}
+
+/* pins the calling decode thread to one processor of the node of its decoder */
+static void pin_decode_thread(dst_decoder_t *dst_decoder)
+{
+    cpu_set_t set;
+    int node, index, size;
+
+    if (!pin_enabled || pin_node_count == 0)
+        return;
+    node = dst_decoder->pin_node;
+    size = pin_node_start[node + 1] - pin_node_start[node];
+    index = __sync_fetch_and_add(&dst_decoder->pinned, 1) % size;
+    CPU_ZERO(&set);
+    CPU_SET(pin_cpus[pin_node_start[node] + index], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        LOG(lm_main, LOG_ERROR, ("could not pin a decode thread to processor %d", pin_cpus[pin_node_start[node] + index]));
+}
+#else
+#define pin_decode_thread(dst_decoder)
+#endif
+
+void dst_decoder_set_cpu_pinning(int enable)
+{
+#ifdef __linux__
+    if (enable && !pin_enabled)
+        setup_pinning();
 #endif
+    pin_enabled = enable;
 }
 
 /* setup job lists (call from main thread) */
@@ -141,6 +419,9 @@ static void setup_decoding_jobs(dst_decoder_t *dst_decoder)
     dst_decoder->decode_tail = &dst_decoder->decode_head;
     dst_decoder->write_first = new_lock(-1);
     dst_decoder->write_head = NULL;
+    dst_decoder->decode_threads = (thread **) calloc(dst_decoder->procs, sizeof(thread *));
+    if (dst_decoder->decode_threads == NULL)
+        exit(1);
 
     /* initialize buffer pools */
     buffer_pool_create(&dst_decoder->in_pool, 64 * 1024, (dst_decoder->procs << 1) + 2);
@@ -152,7 +433,7 @@ static void setup_decoding_jobs(dst_decoder_t *dst_decoder)
 static void finish_decoding_jobs(dst_decoder_t *dst_decoder)
 {
     job_t job;
-    int caught;
+    int caught, i;
 
     /* only do this once */
     if (dst_decoder->decode_have == NULL)
@@ -167,11 +448,13 @@ static void finish_decoding_jobs(dst_decoder_t *dst_decoder)
     dst_decoder->decode_tail = &(job.next);
     twist(dst_decoder->decode_have, BY, +1);       /* will wake them all up */
 
-    /* join all of the decode threads, verify they all came back */
-    caught = join_all();
-    LOG(lm_main, LOG_NOTICE, ("-- joined %d decode threads", caught));
-    assert(caught == dst_decoder->cthreads);
+    /* join all of the decode threads of this decoder */
+    for (i = 0; i < dst_decoder->cthreads; i++)
+        join(dst_decoder->decode_threads[i]);
+    LOG(lm_main, LOG_NOTICE, ("-- joined %d decode threads", dst_decoder->cthreads));
     dst_decoder->cthreads = 0;
+    free(dst_decoder->decode_threads);
+    dst_decoder->decode_threads = NULL;
 
     /* free the resources */
     caught = buffer_pool_free(&dst_decoder->out_pool);
@@ -194,12 +477,25 @@ static void decode_thread(void *userdata)
     job_t *here, **prior;      /* pointers for inserting in write list */ 
     ebunch      D;
     dst_decoder_t *dst_decoder = (dst_decoder_t *) userdata;
+    uint64_t start;
+    char name[32];
+
+    /* before the decoder state and the buffers are first touched, so they are
+       placed on the node of the processor */
+    pin_decode_thread(dst_decoder);
 
     if (DST_InitDecoder(&D, dst_decoder->channel_count, 64) != 0)
     {
         pthread_exit(0);
     }
 
+    if (dst_decoder->metrics || trace_enabled)
+    {
+        snprintf(name, sizeof(name), "dst decode %d", __sync_add_and_fetch(&dst_decoder->thread_names, 1));
+        metrics_thread_enter(dst_decoder->metrics, name);
+        TRACE_THREAD(name);
+    }
+
     /* keep looking for work */
     for(;;)
     {
@@ -221,9 +517,30 @@ static void decode_thread(void *userdata)
         if (job->more)
         {
             job->out = buffer_pool_get_space(&dst_decoder->out_pool);
+            if (dst_decoder->metrics)
+                metrics_gauge(METRICS_OUTPUT_BUFFERS, buffer_pool_in_use(&dst_decoder->out_pool));
+
+            /* take a slot of the shared budget, so decoders of several discs don't
+               oversubscribe the processors */
+            if (decode_budget)
+            {
+                possess(decode_budget);
+                wait_for(decode_budget, NOT_TO_BE, 0);
+                twist(decode_budget, BY, -1);
+            }
 
             /* Save the error for later, so that the write_thread can output them in DST frame order */
+            TRACE_BEGIN("decode", "frame", job->seq);
+            start = metrics_start();
             job->error = DST_FramDSTDecode(job->in->buf, job->out->buf, job->in->len, job->seq, &D); 
+            metrics_stop(METRICS_DST_DECODE, start, job->in->len);
+            TRACE_END("decode");
+
+            if (decode_budget)
+            {
+                possess(decode_budget);
+                twist(decode_budget, BY, +1);
+            }
             if (job->error != DSTErr_NoError)
                 LOG(lm_main, LOG_ERROR, ("ERROR: %s on frame: %d", DST_GetErrorMessage(job->error), D.FrameHdr.FrameNr));
 
@@ -265,21 +582,38 @@ static void write_thread(void *userdata)
 {
     long seq;                       /* next sequence number looking for */
     job_t *job;                     /* job pulled and working on */
+    job_t *here;
     int more;                       /* true if more chunks to write */
     dst_decoder_t *dst_decoder = (dst_decoder_t *) userdata;
+    uint64_t start;
+    int waiting;
 
     /* build and write header */
     LOG(lm_main, LOG_NOTICE, ("-- write thread running"));
+    if (dst_decoder->metrics)
+        metrics_thread_enter(dst_decoder->metrics, "dst write");
+    TRACE_THREAD("dst write");
 
     /* process output of decode threads until end of input */
     seq = 0;
     do 
     {
         /* get next write job in order */
+        TRACE_BEGIN("reorder wait", "frame", seq);
+        start = metrics_start();
         possess(dst_decoder->write_first);
         wait_for(dst_decoder->write_first, TO_BE, seq);
+        metrics_stop(METRICS_REORDER_WAIT, start, 0);
+        TRACE_END("reorder wait");
         job = dst_decoder->write_head;
         dst_decoder->write_head = job->next;
+        if (dst_decoder->metrics)
+        {
+            /* decoded frames that got ahead of this one */
+            for (waiting = 0, here = job->next; here; here = here->next)
+                waiting++;
+            metrics_gauge(METRICS_REORDER_QUEUE, waiting);
+        }
         twist(dst_decoder->write_first, TO, dst_decoder->write_head == NULL ? -1 : dst_decoder->write_head->seq);
 
         /* report any error */
@@ -291,8 +625,13 @@ static void write_thread(void *userdata)
         if (more)
         {
             /* write the decoded data and drop the output buffer */
+            TRACE_BEGIN("write", "frame", job->seq);
             dst_decoder->frame_decoded_callback(job->out->buf, job->out->len, dst_decoder->userdata);
+            TRACE_END("write");
             buffer_pool_drop_space(job->out);
+
+            possess(dst_decoder->written);
+            twist(dst_decoder->written, BY, +1);
         }
 
         free(job);
@@ -330,7 +669,7 @@ static void finish_write_job(dst_decoder_t *dst_decoder)
     /* start another decode thread if needed */
     if (dst_decoder->cthreads < dst_decoder->procs) 
     {
-        (void)launch(decode_thread, dst_decoder);
+        dst_decoder->decode_threads[dst_decoder->cthreads] = launch(decode_thread, dst_decoder);
         dst_decoder->cthreads++;
     }
 
@@ -345,7 +684,7 @@ static void finish_write_job(dst_decoder_t *dst_decoder)
     dst_decoder->writeth = NULL;
 }
 
-dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata)
+dst_decoder_t* dst_decoder_create(int channel_count, int thread_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata)
 {
     dst_decoder_t *dst_decoder = (dst_decoder_t*) calloc(sizeof(dst_decoder_t), 1);
 
@@ -358,10 +697,17 @@ dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t fr
     dst_decoder->userdata = userdata;
     dst_decoder->frame_decoded_callback = frame_decoded_callback;
     dst_decoder->frame_error_callback = frame_error_callback;
-    dst_decoder->procs = processor_count();
+    dst_decoder->procs = thread_count > 0 ? thread_count : (int) dst_decoder_processor_count();
+    dst_decoder->metrics = metrics_current();
+#ifdef __linux__
+    /* the decoders take turns on the nodes, the threads of one stay together */
+    if (pin_enabled && pin_node_count > 0)
+        dst_decoder->pin_node = __sync_fetch_and_add(&pin_next_node, 1) % pin_node_count;
+#endif
 
     /* if first time or after an option change, setup the job lists */
     setup_decoding_jobs(dst_decoder);
+    dst_decoder->written = new_lock(0);
 
     /* start write thread */
     dst_decoder->writeth = launch(write_thread, dst_decoder);
@@ -371,12 +717,26 @@ dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t fr
 
 void dst_decoder_destroy(dst_decoder_t *dst_decoder)
 {
+    /* waits for the frames still queued */
+    TRACE_BEGIN("dst drain", "frames", dst_decoder->sequence);
     finish_write_job(dst_decoder);
     finish_decoding_jobs(dst_decoder);
+    TRACE_END("dst drain");
 
+    free_lock(dst_decoder->written);
     free(dst_decoder);
 }
 
+void dst_decoder_flush(dst_decoder_t *dst_decoder)
+{
+    /* every frame queued so far has gone through the callback */
+    TRACE_BEGIN("dst flush", "frames", dst_decoder->sequence);
+    possess(dst_decoder->written);
+    wait_for(dst_decoder->written, TO_BE, dst_decoder->sequence);
+    release(dst_decoder->written);
+    TRACE_END("dst flush");
+}
+
 void dst_decoder_decode(dst_decoder_t *dst_decoder, uint8_t* frame_data, size_t frame_size)
 {
     job_t *job;                /* job for decode, then write */
@@ -388,6 +748,8 @@ void dst_decoder_decode(dst_decoder_t *dst_decoder, uint8_t* frame_data, size_t
     job->error = 0;
     job->seq = dst_decoder->sequence;
     job->in = buffer_pool_get_space(&dst_decoder->in_pool);
+    if (dst_decoder->metrics)
+        metrics_gauge(METRICS_INPUT_BUFFERS, buffer_pool_in_use(&dst_decoder->in_pool));
     memcpy(job->in->buf, frame_data, frame_size);
     job->in->len = frame_size;
     job->out = NULL;
@@ -398,7 +760,7 @@ void dst_decoder_decode(dst_decoder_t *dst_decoder, uint8_t* frame_data, size_t
     /* start another decode thread if needed */
     if (dst_decoder->cthreads < dst_decoder->procs) 
     {
-        (void)launch(decode_thread, dst_decoder);
+        dst_decoder->decode_threads[dst_decoder->cthreads] = launch(decode_thread, dst_decoder);
         dst_decoder->cthreads++;
     }
 
@@ -407,5 +769,7 @@ void dst_decoder_decode(dst_decoder_t *dst_decoder, uint8_t* frame_data, size_t
     job->next = NULL;
     *dst_decoder->decode_tail = job;
     dst_decoder->decode_tail = &(job->next);
+    if (dst_decoder->metrics)
+        metrics_gauge(METRICS_DECODE_QUEUE, (int) peek_lock(dst_decoder->decode_have) + 1);
     twist(dst_decoder->decode_have, BY, +1);
 }
@@ -28,9 +28,24 @@ typedef struct dst_decoder_s dst_decoder_t;
 typedef void (*frame_decoded_callback_t)(uint8_t* frame_data, size_t frame_size, void *userdata);
 typedef void (*frame_error_callback_t)(int frame_count, int frame_error_code, const char *frame_error_message, void *userdata);
 
-dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata);
+/* thread_count is the maximum number of decoding threads, 0 uses one per processor */
+dst_decoder_t* dst_decoder_create(int channel_count, int thread_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata);
 void dst_decoder_destroy(dst_decoder_t *dst_decoder);
 void dst_decoder_decode(dst_decoder_t *dst_decoder, uint8_t* frame_data, size_t frame_size);
+/* waits until the frames queued so far have been handed to frame_decoded_callback, 
+   call from the thread that queues them */
+void dst_decoder_flush(dst_decoder_t *dst_decoder);
+/* processors available to this process: the affinity mask and the CPU quota of its 
+   cgroup (v1 or v2) count on Linux */
+unsigned dst_decoder_processor_count(void);
+/* overrides the processor count used for the number of decoding threads, 0 detects it */
+void dst_decoder_set_processor_count(int count);
+/* pins every decoding thread to a processor, the threads of one decoder share a NUMA 
+   node (Linux only), call before the first decoder is created */
+void dst_decoder_set_cpu_pinning(int enable);
+/* limits the number of frames decoded at the same time by all decoders together, 
+   must be called before the first decoder is created */
+void dst_decoder_set_thread_budget(int thread_count);
 
 
 #endif /* DST_DECODER_H */
@@ -85,6 +85,12 @@ Changes:
 #define ONE     (1 << ABITS)
 #define HALF    (1 << (ABITS - 1))
 
+#ifdef _MSC_VER
+#define LT_FORCE_INLINE __forceinline
+#else
+#define LT_FORCE_INLINE __inline __attribute__ ((always_inline))
+#endif
+
 static __inline void LT_ACDecodeBit_Init(ACData *AC, uint8_t *cb, int fs)
 {
     AC->Init = 0;
@@ -238,14 +244,14 @@ static int16_t Reverse7LSBs(int16_t c)
     return reverse[(c + (1 << SIZE_PREDCOEF)) & 127];
 }
 
-static void LT_InitCoefTablesI(ebunch *D, int16_t ICoefI[2 * MAX_CHANNELS][16][256])
+static void LT_InitCoefTablesI(ebunch *D, int16_t ICoefI[2 * MAX_CHANNELS][16][256], int NrOfTables)
 {
     int FilterNr, FilterLength, TableNr, k, i, j;
 
     for (FilterNr = 0; FilterNr < D->FrameHdr.NrOfFilters; FilterNr++)
     {
         FilterLength = D->FrameHdr.PredOrder[FilterNr];
-        for (TableNr = 0; TableNr < 16; TableNr++)
+        for (TableNr = 0; TableNr < NrOfTables; TableNr++)
         {
             k = FilterLength - TableNr * 8;
             if (k > 8)
@@ -296,23 +302,23 @@ static void LT_InitStatus(ebunch *D, uint8_t Status[MAX_CHANNELS][16])
 /* post     : D->WM.Pwm                                                    */
 /*                                                                         */
 /***************************************************************************/
-#define LT_RUN_FILTER_I(FilterTable, ChannelStatus) \
-    Predict  = FilterTable[ 0][ChannelStatus[ 0]]; \
-    Predict += FilterTable[ 1][ChannelStatus[ 1]]; \
-    Predict += FilterTable[ 2][ChannelStatus[ 2]]; \
-    Predict += FilterTable[ 3][ChannelStatus[ 3]]; \
-    Predict += FilterTable[ 4][ChannelStatus[ 4]]; \
-    Predict += FilterTable[ 5][ChannelStatus[ 5]]; \
-    Predict += FilterTable[ 6][ChannelStatus[ 6]]; \
-    Predict += FilterTable[ 7][ChannelStatus[ 7]]; \
-    Predict += FilterTable[ 8][ChannelStatus[ 8]]; \
-    Predict += FilterTable[ 9][ChannelStatus[ 9]]; \
-    Predict += FilterTable[10][ChannelStatus[10]]; \
-    Predict += FilterTable[11][ChannelStatus[11]]; \
-    Predict += FilterTable[12][ChannelStatus[12]]; \
-    Predict += FilterTable[13][ChannelStatus[13]]; \
-    Predict += FilterTable[14][ChannelStatus[14]]; \
-    Predict += FilterTable[15][ChannelStatus[15]];
+#define LT_RUN_FILTER_I(FilterTable, ChannelStatus, NrOfTables) \
+                     Predict  = FilterTable[ 0][ChannelStatus[ 0]]; \
+    if (NrOfTables >  1) Predict += FilterTable[ 1][ChannelStatus[ 1]]; \
+    if (NrOfTables >  2) Predict += FilterTable[ 2][ChannelStatus[ 2]]; \
+    if (NrOfTables >  3) Predict += FilterTable[ 3][ChannelStatus[ 3]]; \
+    if (NrOfTables >  4) Predict += FilterTable[ 4][ChannelStatus[ 4]]; \
+    if (NrOfTables >  5) Predict += FilterTable[ 5][ChannelStatus[ 5]]; \
+    if (NrOfTables >  6) Predict += FilterTable[ 6][ChannelStatus[ 6]]; \
+    if (NrOfTables >  7) Predict += FilterTable[ 7][ChannelStatus[ 7]]; \
+    if (NrOfTables >  8) Predict += FilterTable[ 8][ChannelStatus[ 8]]; \
+    if (NrOfTables >  9) Predict += FilterTable[ 9][ChannelStatus[ 9]]; \
+    if (NrOfTables > 10) Predict += FilterTable[10][ChannelStatus[10]]; \
+    if (NrOfTables > 11) Predict += FilterTable[11][ChannelStatus[11]]; \
+    if (NrOfTables > 12) Predict += FilterTable[12][ChannelStatus[12]]; \
+    if (NrOfTables > 13) Predict += FilterTable[13][ChannelStatus[13]]; \
+    if (NrOfTables > 14) Predict += FilterTable[14][ChannelStatus[14]]; \
+    if (NrOfTables > 15) Predict += FilterTable[15][ChannelStatus[15]];
 
 #define LT_RUN_FILTER_U(FilterTable, ChannelStatus) \
     { \
@@ -329,49 +335,21 @@ static void LT_InitStatus(ebunch *D, uint8_t Status[MAX_CHANNELS][16])
         Predict = (Predict32 >> 16) + (Predict32 & 0xffff); \
     }
 
-int DST_FramDSTDecode(uint8_t *DSTdata, uint8_t *MuxedDSDdata, int FrameSizeInBytes, int FrameCnt, ebunch *D)
+/* the bits of all channels of a frame, NrOfChannels and NrOfTables are constants in 
+   the kernels below: the compiler drops the filter tables past the longest filter of 
+   the frame and can unroll the channels */
+static LT_FORCE_INLINE void LT_DecodeBits(ebunch *D, ACData *AC, int16_t ICoefI[2 * MAX_CHANNELS][16][256], uint8_t Status[MAX_CHANNELS][16], uint8_t *MuxedDSD, 
+                                          const int NrOfChannels, const int NrOfTables)
 {
-    int       error;
     int       BitNr;
+    int       ByteNr;
     int       ChNr;
-    uint8_t   ACError;
-    const int NrOfBitsPerCh = D->FrameHdr.NrOfBitsPerCh;
-    const int NrOfChannels = D->FrameHdr.NrOfChannels;
-    uint8_t   *MuxedDSD = MuxedDSDdata;
-
-    D->FrameHdr.FrameNr       = FrameCnt;
-    D->FrameHdr.CalcNrOfBytes = FrameSizeInBytes;
-    D->FrameHdr.CalcNrOfBits  = D->FrameHdr.CalcNrOfBytes * 8;
-
-    /* unpack DST frame: segmentation, mapping, arithmatic data */
-    error = UnpackDSTframe(D, DSTdata, MuxedDSDdata);
+    const int NrOfBytesPerCh = D->FrameHdr.NrOfBitsPerCh / 8;
 
-    if (error == DSTErr_NoError && D->FrameHdr.DSTCoded == 1)
+    for (ByteNr = 0; ByteNr < NrOfBytesPerCh; ByteNr++)
     {
-        ACData AC;
-#ifdef _MSC_VER
-        __declspec(align(16)) int16_t  LT_ICoefI[2 * MAX_CHANNELS][16][256];
-        __declspec(align(16)) uint8_t  LT_Status[MAX_CHANNELS][16];
-#else
-        int16_t  LT_ICoefI[2 * MAX_CHANNELS][16][256]  __attribute__ ((aligned (16)));
-        uint8_t  LT_Status[MAX_CHANNELS][16] __attribute__ ((aligned (16)));
-#endif
-
-        FillTable4Bit(NrOfChannels, NrOfBitsPerCh, &D->FrameHdr.FSeg, D->FrameHdr.Filter4Bit);
-        FillTable4Bit(NrOfChannels, NrOfBitsPerCh, &D->FrameHdr.PSeg, D->FrameHdr.Ptable4Bit);
-
-        LT_InitCoefTablesI(D, LT_ICoefI);
-        //LT_InitCoefTablesU(D, LT_ICoefU);
-        LT_InitStatus(D, LT_Status);
-
-        LT_ACDecodeBit_Init(&AC, D->AData, D->ADataLen);
-        LT_ACDecodeBit_Decode(&AC, &ACError, Reverse7LSBs(D->FrameHdr.ICoefA[0][0]), D->AData, D->ADataLen);
-
-        memset(MuxedDSD, 0, NrOfBitsPerCh * NrOfChannels / 8); 
-        for (BitNr = 0; BitNr < NrOfBitsPerCh; BitNr++)
+        for (BitNr = ByteNr * 8; BitNr < ByteNr * 8 + 8; BitNr++)
         {
-            int ByteNr = BitNr / 8;
-
             for (ChNr = 0; ChNr < NrOfChannels; ChNr++)
             {
                 int16_t Predict;
@@ -380,7 +358,7 @@ int DST_FramDSTDecode(uint8_t *DSTdata, uint8_t *MuxedDSDdata, int FrameSizeInBy
                 const int Filter = D->FrameHdr.Filter4Bit[ChNr][BitNr];
 
                 /* Calculate output value of the FIR filter */
-                LT_RUN_FILTER_I(LT_ICoefI[Filter], LT_Status[ChNr]);
+                LT_RUN_FILTER_I(ICoefI[Filter], Status[ChNr], NrOfTables);
                 //LT_RUN_FILTER_U(LT_ICoefU[Filter], LT_Status[ChNr]);
                 //Predict = LT_RunFilterI(LT_ICoefI[Filter], LT_Status[ChNr]);
                 //Predict = LT_RunFilterU(LT_ICoefU[Filter], LT_Status[ChNr]);
@@ -388,25 +366,22 @@ int DST_FramDSTDecode(uint8_t *DSTdata, uint8_t *MuxedDSDdata, int FrameSizeInBy
                 /* Arithmetic decode the incoming bit */
                 if ((D->FrameHdr.HalfProb[ChNr]/* == 1*/) && (BitNr < D->FrameHdr.NrOfHalfBits[ChNr]))
                 {
-                    LT_ACDecodeBit_Decode(&AC, &Residual, AC_PROBS / 2, D->AData, D->ADataLen);
+                    LT_ACDecodeBit_Decode(AC, &Residual, AC_PROBS / 2, D->AData, D->ADataLen);
                 }
                 else
                 {
                     const int table4bit = D->FrameHdr.Ptable4Bit[ChNr][BitNr];
                     const int PtableIndex = LT_ACGetPtableIndex(Predict, D->FrameHdr.PtableLen[table4bit]);
 
-                    LT_ACDecodeBit_Decode(&AC, &Residual, D->P_one[table4bit][PtableIndex], D->AData, D->ADataLen);
+                    LT_ACDecodeBit_Decode(AC, &Residual, D->P_one[table4bit][PtableIndex], D->AData, D->ADataLen);
                 }
 
                 /* Channel bit depends on the predicted bit and BitResidual[][] */
                 BitVal = ((((uint16_t)Predict) >> 15) ^ Residual) & 1;
 
-                /* Shift the result into the correct bit position */ \
-                MuxedDSD[ByteNr * NrOfChannels + ChNr] |= (uint8_t)(BitVal << (7 - BitNr % 8));
-
-                /* Update filter */
+                /* Update filter, it shifts the bit in as the output does */
                 {
-                    uint32_t* const st = (uint32_t*)LT_Status[ChNr];
+                    uint32_t* const st = (uint32_t*)Status[ChNr];
                     st[3] = (st[3] << 1) | ((st[2] >> 31) & 1);
                     st[2] = (st[2] << 1) | ((st[1] >> 31) & 1);
                     st[1] = (st[1] << 1) | ((st[0] >> 31) & 1);
@@ -415,6 +390,117 @@ int DST_FramDSTDecode(uint8_t *DSTdata, uint8_t *MuxedDSDdata, int FrameSizeInBy
             }
         }
 
+        /* the last 8 bits of a channel are the low byte of its filter status (most
+           recent bit in the LSB), store them as a whole byte instead of OR'ing in
+           every bit */
+        for (ChNr = 0; ChNr < NrOfChannels; ChNr++)
+        {
+            MuxedDSD[ByteNr * NrOfChannels + ChNr] = (uint8_t) ((uint32_t*)Status[ChNr])[0];
+        }
+    }
+}
+
+typedef void (*LT_DecodeKernel)(ebunch *D, ACData *AC, int16_t ICoefI[2 * MAX_CHANNELS][16][256], uint8_t Status[MAX_CHANNELS][16], uint8_t *MuxedDSD);
+
+/* Channels 0 takes the channel count of the frame */
+#define LT_DECODE_KERNEL(Channels, Tables) \
+    static void LT_DecodeBits_##Channels##_##Tables(ebunch *D, ACData *AC, int16_t ICoefI[2 * MAX_CHANNELS][16][256], uint8_t Status[MAX_CHANNELS][16], uint8_t *MuxedDSD) \
+    { \
+        LT_DecodeBits(D, AC, ICoefI, Status, MuxedDSD, Channels ? Channels : D->FrameHdr.NrOfChannels, Tables); \
+    }
+
+#define LT_DECODE_KERNELS(Channels) \
+    LT_DECODE_KERNEL(Channels, 2) \
+    LT_DECODE_KERNEL(Channels, 4) \
+    LT_DECODE_KERNEL(Channels, 8) \
+    LT_DECODE_KERNEL(Channels, 16)
+
+LT_DECODE_KERNELS(0)
+LT_DECODE_KERNELS(2)
+LT_DECODE_KERNELS(5)
+LT_DECODE_KERNELS(6)
+
+#define LT_KERNEL_ROW(Channels) \
+    { LT_DecodeBits_##Channels##_2, LT_DecodeBits_##Channels##_4, LT_DecodeBits_##Channels##_8, LT_DecodeBits_##Channels##_16 }
+
+/* [channel layout][filter order bucket] */
+static const LT_DecodeKernel LT_DecodeKernels[4][4] = {
+    LT_KERNEL_ROW(0),
+    LT_KERNEL_ROW(2),
+    LT_KERNEL_ROW(5),
+    LT_KERNEL_ROW(6)
+};
+
+/* picks the kernel for the channel count and the longest filter of the frame, 
+   NrOfTables is the number of filter tables it uses */
+static LT_DecodeKernel LT_SelectKernel(ebunch *D, int *NrOfTables)
+{
+    int FilterNr, MaxPredOrder = 0, Tables, Bucket, Layout;
+
+    for (FilterNr = 0; FilterNr < D->FrameHdr.NrOfFilters; FilterNr++)
+    {
+        if (D->FrameHdr.PredOrder[FilterNr] > MaxPredOrder)
+            MaxPredOrder = D->FrameHdr.PredOrder[FilterNr];
+    }
+
+    /* every table covers 8 coefficients */
+    Tables = (MaxPredOrder + 7) / 8;
+    Bucket = Tables <= 2 ? 0 : Tables <= 4 ? 1 : Tables <= 8 ? 2 : 3;
+    *NrOfTables = 2 << Bucket;
+
+    switch (D->FrameHdr.NrOfChannels)
+    {
+    case 2:  Layout = 1; break;
+    case 5:  Layout = 2; break;
+    case 6:  Layout = 3; break;
+    default: Layout = 0; break;
+    }
+    return LT_DecodeKernels[Layout][Bucket];
+}
+
+int DST_FramDSTDecode(uint8_t *DSTdata, uint8_t *MuxedDSDdata, int FrameSizeInBytes, int FrameCnt, ebunch *D)
+{
+    int       error;
+    uint8_t   ACError;
+    const int NrOfBitsPerCh = D->FrameHdr.NrOfBitsPerCh;
+    const int NrOfChannels = D->FrameHdr.NrOfChannels;
+    uint8_t   *MuxedDSD = MuxedDSDdata;
+
+    D->FrameHdr.FrameNr       = FrameCnt;
+    D->FrameHdr.CalcNrOfBytes = FrameSizeInBytes;
+    D->FrameHdr.CalcNrOfBits  = D->FrameHdr.CalcNrOfBytes * 8;
+
+    /* unpack DST frame: segmentation, mapping, arithmatic data */
+    error = UnpackDSTframe(D, DSTdata, MuxedDSDdata);
+
+    if (error == DSTErr_NoError && D->FrameHdr.DSTCoded == 1)
+    {
+        ACData AC;
+        LT_DecodeKernel Kernel;
+        int NrOfTables;
+#ifdef _MSC_VER
+        __declspec(align(16)) int16_t  LT_ICoefI[2 * MAX_CHANNELS][16][256];
+        __declspec(align(16)) uint8_t  LT_Status[MAX_CHANNELS][16];
+#else
+        int16_t  LT_ICoefI[2 * MAX_CHANNELS][16][256]  __attribute__ ((aligned (16)));
+        uint8_t  LT_Status[MAX_CHANNELS][16] __attribute__ ((aligned (16)));
+#endif
+
+        FillTable4Bit(NrOfChannels, NrOfBitsPerCh, &D->FrameHdr.FSeg, D->FrameHdr.Filter4Bit);
+        FillTable4Bit(NrOfChannels, NrOfBitsPerCh, &D->FrameHdr.PSeg, D->FrameHdr.Ptable4Bit);
+
+        /* once per frame, from the unpacked header */
+        Kernel = LT_SelectKernel(D, &NrOfTables);
+
+        LT_InitCoefTablesI(D, LT_ICoefI, NrOfTables);
+        //LT_InitCoefTablesU(D, LT_ICoefU);
+        LT_InitStatus(D, LT_Status);
+
+        LT_ACDecodeBit_Init(&AC, D->AData, D->ADataLen);
+        LT_ACDecodeBit_Decode(&AC, &ACError, Reverse7LSBs(D->FrameHdr.ICoefA[0][0]), D->AData, D->ADataLen);
+
+        Kernel(D, &AC, LT_ICoefI, LT_Status, MuxedDSD);
+
         /* Flush the arithmetic decoder */
         LT_ACDecodeBit_Flush(&AC, &ACError, 0, D->AData, D->ADataLen);
 
@@ -0,0 +1,274 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define DOP_SSSE3
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define DOP_NEON
+#endif
+
+#include "scarletbook.h"
+#include "dop.h"
+
+#define DOP_MARKER_0        0x05
+#define DOP_MARKER_1        0xfa
+
+// the vector kernels work on chunks of whole sample frame pairs that fill
+// whole 16 byte vectors, at most 160 bytes in (5 channels) and 240 out
+#define MAX_IN_VECTORS      10
+#define MAX_OUT_VECTORS     15
+#define MAX_SOURCES         3
+
+typedef struct
+{
+    int                 source[MAX_SOURCES];    // input vectors this output vector takes bytes from
+    uint8_t             shuffle[MAX_SOURCES][16];
+    uint8_t             marker[2][16];          // marker bytes for either phase, zero elsewhere
+}
+dop_vector_t;
+
+struct dop_packer_s
+{
+    int                 channel_count;
+    int                 phase;                  // marker of the next sample frame, 0 is 0x05
+
+    int                 simd;
+    size_t              chunk_in;               // bytes consumed per vector chunk
+    int                 in_vectors;
+    int                 out_vectors;
+    dop_vector_t        vectors[MAX_OUT_VECTORS];
+};
+
+static size_t gcd(size_t a, size_t b)
+{
+    while (b)
+    {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// the input byte (or marker, -1) behind output byte "o" of a chunk
+static int dop_source_byte(int channel_count, int o, int *phase)
+{
+    int sample = o / 3;
+    int frame = sample / channel_count;
+    int channel = sample % channel_count;
+
+    *phase = frame & 1;
+    switch (o % 3)
+    {
+    case 0:
+        return (2 * frame + 1) * channel_count + channel;   // later DSD byte in the low bits
+    case 1:
+        return 2 * frame * channel_count + channel;
+    default:
+        return -1;
+    }
+}
+
+// lays out the shuffles of one chunk, returns 0 if a vector would need more sources than there are
+static int dop_build_vectors(dop_packer_t *packer)
+{
+    int j, k, t;
+
+    packer->chunk_in = 32 * 4 * packer->channel_count / gcd(32, 4 * packer->channel_count);
+    packer->in_vectors = (int) (packer->chunk_in / 16);
+    packer->out_vectors = (int) (packer->chunk_in * 3 / 2 / 16);
+    if (packer->in_vectors > MAX_IN_VECTORS || packer->out_vectors > MAX_OUT_VECTORS)
+        return 0;
+
+    for (j = 0; j < packer->out_vectors; j++)
+    {
+        dop_vector_t *v = &packer->vectors[j];
+        int first = -1, phase;
+
+        memset(v->shuffle, 0x80, sizeof(v->shuffle));
+        memset(v->marker, 0, sizeof(v->marker));
+
+        for (k = 0; k < 16; k++)
+        {
+            int in = dop_source_byte(packer->channel_count, j * 16 + k, &phase);
+
+            if (in < 0)
+            {
+                v->marker[0][k] = phase ? DOP_MARKER_1 : DOP_MARKER_0;
+                v->marker[1][k] = phase ? DOP_MARKER_0 : DOP_MARKER_1;
+                continue;
+            }
+            if (first < 0 || in / 16 < first)
+                first = in / 16;
+        }
+        for (t = 0; t < MAX_SOURCES; t++)
+        {
+            // unused sources point at a vector that exists, their shuffle is all zeroes
+            v->source[t] = first + t < packer->in_vectors ? first + t : first;
+        }
+        for (k = 0; k < 16; k++)
+        {
+            int in = dop_source_byte(packer->channel_count, j * 16 + k, &phase);
+
+            if (in < 0)
+                continue;
+            t = in / 16 - first;
+            if (t >= MAX_SOURCES)
+                return 0;
+            v->shuffle[t][k] = (uint8_t) (in % 16);
+        }
+    }
+    return 1;
+}
+
+dop_packer_t *dop_packer_create(int channel_count)
+{
+    dop_packer_t *packer;
+
+    if (channel_count < 1 || channel_count > MAX_CHANNEL_COUNT)
+        return 0;
+
+    packer = (dop_packer_t *) calloc(1, sizeof(dop_packer_t));
+    if (!packer)
+        return 0;
+
+    packer->channel_count = channel_count;
+    packer->simd = dop_build_vectors(packer);
+#if defined(DOP_SSSE3)
+    // pshufb is SSSE3, the build itself only assumes SSE2
+    packer->simd = packer->simd && __builtin_cpu_supports("ssse3");
+#elif !defined(DOP_NEON)
+    packer->simd = 0;
+#endif
+    return packer;
+}
+
+void dop_packer_destroy(dop_packer_t *packer)
+{
+    free(packer);
+}
+
+#if defined(DOP_SSSE3)
+__attribute__((target("ssse3")))
+static size_t dop_pack_vector(dop_packer_t *packer, const uint8_t *dsd, size_t len, uint8_t *out)
+{
+    const uint8_t *end = dsd + len - len % packer->chunk_in;
+    const uint8_t *start = dsd;
+    __m128i        in[MAX_IN_VECTORS];
+    int            i, j;
+
+    for (; dsd < end; dsd += packer->chunk_in)
+    {
+        for (i = 0; i < packer->in_vectors; i++)
+        {
+            in[i] = _mm_loadu_si128((const __m128i *) (dsd + 16 * i));
+        }
+        for (j = 0; j < packer->out_vectors; j++)
+        {
+            const dop_vector_t *v = &packer->vectors[j];
+            __m128i r;
+
+            r = _mm_loadu_si128((const __m128i *) v->marker[packer->phase]);
+            r = _mm_or_si128(r, _mm_shuffle_epi8(in[v->source[0]], _mm_loadu_si128((const __m128i *) v->shuffle[0])));
+            r = _mm_or_si128(r, _mm_shuffle_epi8(in[v->source[1]], _mm_loadu_si128((const __m128i *) v->shuffle[1])));
+            r = _mm_or_si128(r, _mm_shuffle_epi8(in[v->source[2]], _mm_loadu_si128((const __m128i *) v->shuffle[2])));
+            _mm_storeu_si128((__m128i *) out, r);
+            out += 16;
+        }
+    }
+    return (size_t) (dsd - start);
+}
+#elif defined(DOP_NEON)
+static size_t dop_pack_vector(dop_packer_t *packer, const uint8_t *dsd, size_t len, uint8_t *out)
+{
+    const uint8_t *end = dsd + len - len % packer->chunk_in;
+    const uint8_t *start = dsd;
+    uint8x16_t     in[MAX_IN_VECTORS];
+    int            i, j;
+
+    for (; dsd < end; dsd += packer->chunk_in)
+    {
+        for (i = 0; i < packer->in_vectors; i++)
+        {
+            in[i] = vld1q_u8(dsd + 16 * i);
+        }
+        for (j = 0; j < packer->out_vectors; j++)
+        {
+            const dop_vector_t *v = &packer->vectors[j];
+            uint8x16_t r;
+
+            // out of range indices (0x80) give zero, as with pshufb
+            r = vld1q_u8(v->marker[packer->phase]);
+            r = vorrq_u8(r, vqtbl1q_u8(in[v->source[0]], vld1q_u8(v->shuffle[0])));
+            r = vorrq_u8(r, vqtbl1q_u8(in[v->source[1]], vld1q_u8(v->shuffle[1])));
+            r = vorrq_u8(r, vqtbl1q_u8(in[v->source[2]], vld1q_u8(v->shuffle[2])));
+            vst1q_u8(out, r);
+            out += 16;
+        }
+    }
+    return (size_t) (dsd - start);
+}
+#endif
+
+size_t dop_pack(dop_packer_t *packer, const uint8_t *dsd, size_t len, uint8_t *out)
+{
+    const int channel_count = packer->channel_count;
+    const size_t frame_size = 2 * channel_count;
+    uint8_t  *start = out;
+    uint8_t   marker;
+    size_t    done = 0, i;
+    int       c;
+
+    len -= len % frame_size;
+
+#if defined(DOP_SSSE3) || defined(DOP_NEON)
+    // a chunk holds an even number of sample frames, the phase stays the same
+    if (packer->simd)
+    {
+        done = dop_pack_vector(packer, dsd, len, out);
+        out += done * 3 / 2;
+    }
+#endif
+
+    marker = packer->phase ? DOP_MARKER_1 : DOP_MARKER_0;
+    for (i = done; i < len; i += frame_size)
+    {
+        const uint8_t *in = dsd + i;
+
+        for (c = 0; c < channel_count; c++)
+        {
+            out[0] = in[channel_count + c];
+            out[1] = in[c];
+            out[2] = marker;
+            out += 3;
+        }
+        marker ^= DOP_MARKER_0 ^ DOP_MARKER_1;
+    }
+    packer->phase = marker == DOP_MARKER_1;
+
+    return (size_t) (out - start);
+}
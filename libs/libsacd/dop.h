@@ -0,0 +1,58 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef DOP_H_INCLUDED
+#define DOP_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * DSD over PCM (DoP v1.1) packing.
+ *
+ * Every 24 bit PCM sample carries 16 DSD bits of one channel below a marker
+ * byte, which alternates between 0x05 and 0xFA from one sample frame to the
+ * next. DSD64 becomes 176.4 kHz PCM.
+ */
+
+typedef struct dop_packer_s dop_packer_t;
+
+dop_packer_t *dop_packer_create(int channel_count);
+
+void dop_packer_destroy(dop_packer_t *);
+
+/**
+ * Packs "len" bytes of byte interleaved DSD (most significant bit first, 
+ * as in DSDIFF) into "out" as interleaved little endian 24 bit samples. 
+ * "len" has to be a multiple of twice the channel count. The marker keeps 
+ * alternating across calls. Returns the number of bytes written, len * 3 / 2.
+ */
+size_t dop_pack(dop_packer_t *, const uint8_t *dsd, size_t len, uint8_t *out);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* DOP_H_INCLUDED */
@@ -0,0 +1,480 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define DSD2PCM_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include <dst_decoder.h>
+
+#include "scarletbook.h"
+#include "dsd2pcm.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define LUT_BYTES       16                      // the first stage looks at 128 bits
+#define LUT_TAPS        (LUT_BYTES * 8)
+#define HALF_TAPS       32                      // 352.8 -> 176.4 kHz on the way to 88.2 kHz
+#define FINAL_TAPS      128                     // the halving stage that sets the passband
+#define BLOCK_BYTES     4096                    // DSD bytes per channel converted at once
+#define FLUSH_BYTES     (LUT_BYTES / 2 + HALF_TAPS / 2 + FINAL_TAPS)    // the longest delay through the stages
+
+typedef struct
+{
+    int                 taps;
+    const float        *h;
+    float              *buf;                    // unused input, starts with taps - 1 samples of history
+    int                 fill;
+} fir_stage_t;
+
+typedef struct
+{
+    uint8_t             bytes[LUT_BYTES - 1 + BLOCK_BYTES];     // history followed by new bytes
+    float               work[BLOCK_BYTES];
+    fir_stage_t         stage[2];
+} channel_t;
+
+struct dsd2pcm_s
+{
+    int                 channel_count;
+    int                 stage_count;            // halving stages after the first one
+    int                 bytes_per_sample;       // DSD bytes per channel for one PCM sample
+    int                 delay_bytes;            // DSD bytes per channel still inside the filters
+
+    float               lut[LUT_BYTES][256];
+    float               h_half[HALF_TAPS];
+    float               h_final[FINAL_TAPS];
+    channel_t          *channel[MAX_CHANNEL_COUNT];
+
+    // the conversion in progress, guarded by lock
+    const uint8_t      *dsd;
+    size_t              len;
+    int32_t            *pcm;
+    size_t              samples;
+    int                 next_channel;
+    int                 channels_done;
+    unsigned            generation;
+    int                 quit;
+
+    int                 worker_count;
+    pthread_t           workers[MAX_CHANNEL_COUNT];
+    pthread_mutex_t     lock;
+    pthread_cond_t      work_cond;
+    pthread_cond_t      done_cond;
+};
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    int    k;
+
+    for (k = 1; k < 64 && term > sum * 1e-17; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Kaiser windowed sinc lowpass with unity gain at DC, "cutoff" in cycles per sample
+static void design_lowpass(double *h, int taps, double cutoff, double beta)
+{
+    double center = (taps - 1) / 2.0, sum = 0.0, t, r;
+    int    i;
+
+    for (i = 0; i < taps; i++)
+    {
+        t = i - center;
+        r = t / center;
+        h[i] = t == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+        h[i] *= bessel_i0(beta * sqrt(1.0 - r * r)) / bessel_i0(beta);
+        sum += h[i];
+    }
+    for (i = 0; i < taps; i++)
+    {
+        h[i] /= sum;
+    }
+}
+
+static inline float fir_dot(const float *h, const float *x, int taps)
+{
+    int i;
+#if defined(__AVX__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m128 sum;
+
+    for (i = 0; i < taps; i += 16)
+    {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(h + i), _mm256_loadu_ps(x + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(h + i + 8), _mm256_loadu_ps(x + i + 8)));
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+    sum = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(DSD2PCM_SSE)
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+
+    for (i = 0; i < taps; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(h + i), _mm_loadu_ps(x + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(h + i + 4), _mm_loadu_ps(x + i + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    return _mm_cvtss_f32(acc0);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    float32x2_t sum;
+
+    for (i = 0; i < taps; i += 8)
+    {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(h + i), vld1q_f32(x + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(h + i + 4), vld1q_f32(x + i + 4));
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+    sum = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+    float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    for (i = 0; i < taps; i += 4)
+    {
+        acc[0] += h[i] * x[i];
+        acc[1] += h[i + 1] * x[i + 1];
+        acc[2] += h[i + 2] * x[i + 2];
+        acc[3] += h[i + 3] * x[i + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+// filters "n" samples and keeps every second one, "in" and "out" may be the same
+static int fir_decimate(fir_stage_t *stage, const float *in, int n, float *out)
+{
+    int pos, count = 0;
+
+    memcpy(stage->buf + stage->fill, in, n * sizeof(float));
+    stage->fill += n;
+    for (pos = 0; pos + stage->taps <= stage->fill; pos += 2)
+    {
+        out[count++] = fir_dot(stage->h, stage->buf + pos, stage->taps);
+    }
+    memmove(stage->buf, stage->buf + pos, (stage->fill - pos) * sizeof(float));
+    stage->fill -= pos;
+    return count;
+}
+
+static inline int32_t quantize(float sample)
+{
+    float scaled = sample * 8388608.0f;
+
+    if (scaled >= 8388607.0f)
+        return 8388607;
+    if (scaled <= -8388608.0f)
+        return -8388608;
+    return (int32_t) lrintf(scaled);
+}
+
+static size_t convert_channel(dsd2pcm_t *dsd2pcm, int c)
+{
+    channel_t     *channel = dsd2pcm->channel[c];
+    const uint8_t *src = dsd2pcm->dsd + c;
+    int32_t       *dst = dsd2pcm->pcm + c;
+    size_t         total = dsd2pcm->len / dsd2pcm->channel_count, done, n, i, out = 0;
+    int            stride = dsd2pcm->channel_count, count, k;
+
+    for (done = 0; done < total; done += n)
+    {
+        n = total - done < BLOCK_BYTES ? total - done : BLOCK_BYTES;
+        for (i = 0; i < n; i++)
+        {
+            channel->bytes[LUT_BYTES - 1 + i] = src[(done + i) * stride];
+        }
+
+        // first stage, every byte moves the 128 bit window by 8 bits
+        for (i = 0; i < n; i++)
+        {
+            const uint8_t *window = channel->bytes + i;
+            float          acc0 = 0.0f, acc1 = 0.0f;
+
+            for (k = 0; k < LUT_BYTES; k += 2)
+            {
+                acc0 += dsd2pcm->lut[k][window[k]];
+                acc1 += dsd2pcm->lut[k + 1][window[k + 1]];
+            }
+            channel->work[i] = acc0 + acc1;
+        }
+        memmove(channel->bytes, channel->bytes + n, LUT_BYTES - 1);
+
+        count = (int) n;
+        for (k = 0; k < dsd2pcm->stage_count; k++)
+        {
+            count = fir_decimate(&channel->stage[k], channel->work, count, channel->work);
+        }
+        for (k = 0; k < count; k++)
+        {
+            dst[(out + k) * stride] = quantize(channel->work[k]);
+        }
+        out += count;
+    }
+    return out;
+}
+
+// takes channels of the conversion in progress until none are left
+static void convert_channels(dsd2pcm_t *dsd2pcm)
+{
+    size_t samples;
+    int    c;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&dsd2pcm->lock);
+        c = dsd2pcm->next_channel < dsd2pcm->channel_count ? dsd2pcm->next_channel++ : -1;
+        pthread_mutex_unlock(&dsd2pcm->lock);
+        if (c < 0)
+            break;
+
+        samples = convert_channel(dsd2pcm, c);
+
+        pthread_mutex_lock(&dsd2pcm->lock);
+        dsd2pcm->samples = samples;
+        if (++dsd2pcm->channels_done == dsd2pcm->channel_count)
+            pthread_cond_signal(&dsd2pcm->done_cond);
+        pthread_mutex_unlock(&dsd2pcm->lock);
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    dsd2pcm_t *dsd2pcm = (dsd2pcm_t *) arg;
+    unsigned   seen = 0;
+
+    pthread_mutex_lock(&dsd2pcm->lock);
+    for (;;)
+    {
+        while (!dsd2pcm->quit && dsd2pcm->generation == seen)
+            pthread_cond_wait(&dsd2pcm->work_cond, &dsd2pcm->lock);
+        if (dsd2pcm->quit)
+            break;
+        seen = dsd2pcm->generation;
+        pthread_mutex_unlock(&dsd2pcm->lock);
+
+        convert_channels(dsd2pcm);
+
+        pthread_mutex_lock(&dsd2pcm->lock);
+    }
+    pthread_mutex_unlock(&dsd2pcm->lock);
+    return 0;
+}
+
+static int init_stage(fir_stage_t *stage, const float *h, int taps)
+{
+    stage->taps = taps;
+    stage->h = h;
+    stage->fill = taps - 1;
+    stage->buf = (float *) calloc(taps + BLOCK_BYTES, sizeof(float));
+    return stage->buf ? 0 : -1;
+}
+
+dsd2pcm_t *dsd2pcm_create(int channel_count, int pcm_rate, int thread_count)
+{
+    dsd2pcm_t *dsd2pcm;
+    double     h[LUT_TAPS];
+    int        i, j, k, b;
+
+    if (channel_count < 1 || channel_count > MAX_CHANNEL_COUNT || (pcm_rate != 88200 && pcm_rate != 176400))
+        return NULL;
+
+    dsd2pcm = (dsd2pcm_t *) calloc(1, sizeof(dsd2pcm_t));
+    if (!dsd2pcm)
+        return NULL;
+    dsd2pcm->channel_count = channel_count;
+    dsd2pcm->stage_count = pcm_rate == 88200 ? 2 : 1;
+    dsd2pcm->bytes_per_sample = pcm_rate == 88200 ? 4 : 2;
+    // half the taps of each stage, in DSD bytes at its input rate
+    dsd2pcm->delay_bytes = pcm_rate == 88200 ? FLUSH_BYTES : LUT_BYTES / 2 + FINAL_TAPS / 2;
+
+    // 2822.4 -> 352.8 kHz, flat to 88.2 kHz and at least 120 dB down where it would alias below 88.2 kHz
+    design_lowpass(h, LUT_TAPS, 0.0625, 12.27);
+    for (k = 0; k < LUT_BYTES; k++)
+    {
+        for (b = 0; b < 256; b++)
+        {
+            double sum = 0.0;
+
+            for (j = 0; j < 8; j++)
+                sum += ((b >> (7 - j)) & 1) ? h[k * 8 + j] : -h[k * 8 + j];
+            dsd2pcm->lut[k][b] = (float) sum;
+        }
+    }
+
+    // 352.8 -> 176.4 kHz ahead of the final stage, only guards 0 - 44.1 kHz
+    design_lowpass(h, HALF_TAPS, 0.25, 11.17);
+    for (i = 0; i < HALF_TAPS; i++)
+        dsd2pcm->h_half[i] = (float) h[i];
+
+    // the final halving, passband up to 40% of the output rate, 100 dB down at its Nyquist frequency
+    design_lowpass(h, FINAL_TAPS, 0.225, 9.95);
+    for (i = 0; i < FINAL_TAPS; i++)
+        dsd2pcm->h_final[i] = (float) h[i];
+
+    for (i = 0; i < channel_count; i++)
+    {
+        channel_t *channel = (channel_t *) calloc(1, sizeof(channel_t));
+
+        dsd2pcm->channel[i] = channel;
+        if (!channel)
+            goto error;
+        // DSD silence (alternating bits) averages to zero, as does the initial history
+        memset(channel->bytes, 0x69, sizeof(channel->bytes));
+        if (dsd2pcm->stage_count == 2)
+        {
+            if (init_stage(&channel->stage[0], dsd2pcm->h_half, HALF_TAPS) != 0 ||
+                init_stage(&channel->stage[1], dsd2pcm->h_final, FINAL_TAPS) != 0)
+                goto error;
+        }
+        else if (init_stage(&channel->stage[0], dsd2pcm->h_final, FINAL_TAPS) != 0)
+        {
+            goto error;
+        }
+    }
+
+    pthread_mutex_init(&dsd2pcm->lock, NULL);
+    pthread_cond_init(&dsd2pcm->work_cond, NULL);
+    pthread_cond_init(&dsd2pcm->done_cond, NULL);
+
+    if (thread_count <= 0)
+        thread_count = (int) dst_decoder_processor_count();
+    if (thread_count > channel_count)
+        thread_count = channel_count;
+
+    // the calling thread converts channels as well
+    for (i = 0; i < thread_count - 1; i++)
+    {
+        if (pthread_create(&dsd2pcm->workers[i], NULL, worker_thread, dsd2pcm) != 0)
+            break;
+        dsd2pcm->worker_count++;
+    }
+
+    return dsd2pcm;
+
+error:
+    for (i = 0; i < channel_count; i++)
+    {
+        if (dsd2pcm->channel[i])
+        {
+            free(dsd2pcm->channel[i]->stage[0].buf);
+            free(dsd2pcm->channel[i]->stage[1].buf);
+            free(dsd2pcm->channel[i]);
+        }
+    }
+    free(dsd2pcm);
+    return NULL;
+}
+
+void dsd2pcm_destroy(dsd2pcm_t *dsd2pcm)
+{
+    int i;
+
+    if (!dsd2pcm)
+        return;
+
+    pthread_mutex_lock(&dsd2pcm->lock);
+    dsd2pcm->quit = 1;
+    pthread_cond_broadcast(&dsd2pcm->work_cond);
+    pthread_mutex_unlock(&dsd2pcm->lock);
+    for (i = 0; i < dsd2pcm->worker_count; i++)
+    {
+        pthread_join(dsd2pcm->workers[i], NULL);
+    }
+
+    for (i = 0; i < dsd2pcm->channel_count; i++)
+    {
+        free(dsd2pcm->channel[i]->stage[0].buf);
+        free(dsd2pcm->channel[i]->stage[1].buf);
+        free(dsd2pcm->channel[i]);
+    }
+    pthread_cond_destroy(&dsd2pcm->done_cond);
+    pthread_cond_destroy(&dsd2pcm->work_cond);
+    pthread_mutex_destroy(&dsd2pcm->lock);
+    free(dsd2pcm);
+}
+
+size_t dsd2pcm_max_samples(dsd2pcm_t *dsd2pcm, size_t len)
+{
+    return len / dsd2pcm->channel_count / dsd2pcm->bytes_per_sample + 1;
+}
+
+size_t dsd2pcm_convert(dsd2pcm_t *dsd2pcm, const uint8_t *dsd, size_t len, int32_t *pcm)
+{
+    size_t samples;
+
+    pthread_mutex_lock(&dsd2pcm->lock);
+    dsd2pcm->dsd = dsd;
+    dsd2pcm->len = len - len % dsd2pcm->channel_count;
+    dsd2pcm->pcm = pcm;
+    dsd2pcm->samples = 0;
+    dsd2pcm->next_channel = 0;
+    dsd2pcm->channels_done = 0;
+    dsd2pcm->generation++;
+    if (dsd2pcm->worker_count)
+        pthread_cond_broadcast(&dsd2pcm->work_cond);
+    pthread_mutex_unlock(&dsd2pcm->lock);
+
+    convert_channels(dsd2pcm);
+
+    pthread_mutex_lock(&dsd2pcm->lock);
+    while (dsd2pcm->channels_done < dsd2pcm->channel_count)
+        pthread_cond_wait(&dsd2pcm->done_cond, &dsd2pcm->lock);
+    samples = dsd2pcm->samples;
+    pthread_mutex_unlock(&dsd2pcm->lock);
+
+    return samples;
+}
+
+size_t dsd2pcm_flush_size(dsd2pcm_t *dsd2pcm)
+{
+    return (size_t) dsd2pcm->delay_bytes * dsd2pcm->channel_count;
+}
+
+size_t dsd2pcm_flush(dsd2pcm_t *dsd2pcm, int32_t *pcm)
+{
+    uint8_t silence[FLUSH_BYTES * MAX_CHANNEL_COUNT];
+
+    memset(silence, 0x69, dsd2pcm_flush_size(dsd2pcm));
+    return dsd2pcm_convert(dsd2pcm, silence, dsd2pcm_flush_size(dsd2pcm), pcm);
+}
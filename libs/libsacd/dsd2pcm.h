@@ -0,0 +1,84 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef DSD2PCM_H_INCLUDED
+#define DSD2PCM_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * DSD64 to PCM conversion.
+ *
+ * The 1-bit stream is decimated in stages: a 128 tap FIR evaluated with
+ * lookup tables on whole DSD bytes brings it down to 352.8 kHz, then one or
+ * two polyphase FIR stages halve the rate to 176.4 or 88.2 kHz. The filters
+ * are linear phase, the passband ends at 40% of the output rate.
+ *
+ * The DSD full scale maps to PCM full scale, a 0 dB SACD signal (50%
+ * modulation) ends up at -6 dBFS.
+ */
+
+typedef struct dsd2pcm_s dsd2pcm_t;
+
+/**
+ * Creates a converter for "channel_count" channels to 88200 or 176400 Hz.
+ * The channels are converted by up to "thread_count" threads at the same
+ * time (the calling thread included), 0 picks one per channel and processor.
+ */
+dsd2pcm_t *dsd2pcm_create(int channel_count, int pcm_rate, int thread_count);
+
+void dsd2pcm_destroy(dsd2pcm_t *);
+
+/**
+ * The most samples per channel that converting "len" bytes can return.
+ */
+size_t dsd2pcm_max_samples(dsd2pcm_t *, size_t len);
+
+/**
+ * Converts "len" bytes of byte interleaved DSD (most significant bit first,
+ * as in DSDIFF) to interleaved 24 bit samples in "pcm", the channels keep
+ * their order. Returns the number of samples per channel.
+ */
+size_t dsd2pcm_convert(dsd2pcm_t *, const uint8_t *dsd, size_t len, int32_t *pcm);
+
+/**
+ * The DSD bytes (all channels) that dsd2pcm_flush converts, "pcm" has to
+ * hold dsd2pcm_max_samples of them.
+ */
+size_t dsd2pcm_flush_size(dsd2pcm_t *);
+
+/**
+ * Ends the stream: converts DSD silence until the filters have given out
+ * the samples of everything converted before. Returns the number of
+ * samples per channel, like dsd2pcm_convert.
+ */
+size_t dsd2pcm_flush(dsd2pcm_t *, int32_t *pcm);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* DSD2PCM_H_INCLUDED */
@@ -53,6 +53,7 @@ typedef struct
     size_t              footer_size;
 
     size_t              frame_count;
+    uint64_t            audio_data_offset;  // file offset of the first audio byte
     uint64_t            audio_data_size;
 
     dst_frame_index_t  *frame_indexes;
@@ -62,6 +63,16 @@ typedef struct
 } 
 dsdiff_handle_t;
 
+// what a checkpoint keeps of dsdiff_handle_t, followed by the frame indexes 
+// written so far, the header and footer are made again at close
+typedef struct
+{
+    uint64_t            frame_count;
+    uint64_t            audio_data_offset;
+    uint64_t            audio_data_size;
+} 
+dsdiff_state_t;
+
 static char *get_mtoc_title_text(scarletbook_handle_t *handle)
 {
     master_text_t *master_text = &handle->master_text;
@@ -471,6 +482,9 @@ static int calculate_header_and_footer(scarletbook_output_format_t *ft)
     {
         time_t           rawtime;
         struct tm        * timeinfo;
+#ifndef _WIN32
+        struct tm          timeinfo_buf;
+#endif
         comment_t        * comment;
         char             data[512];
         char            *title;
@@ -482,7 +496,11 @@ static int calculate_header_and_footer(scarletbook_output_format_t *ft)
         comment_ptr += COMMENTS_CHUNK_SIZE;
 
         time(&rawtime);
+#ifdef _WIN32
         timeinfo = localtime(&rawtime);
+#else
+        timeinfo = localtime_r(&rawtime, &timeinfo_buf);    // tracks can be created from several threads
+#endif
 
         comment                    = (comment_t *) comment_ptr;
         comment->timestamp_year    = hton16(sb_handle->master_toc->disc_date_year);
@@ -561,6 +579,28 @@ static int calculate_header_and_footer(scarletbook_output_format_t *ft)
     return 0;
 }
 
+// the TOC gives the playing time in frames, so the DST frame index can be allocated up front
+static void allocate_frame_indexes(scarletbook_output_format_t *ft)
+{
+    dsdiff_handle_t      *handle    = (dsdiff_handle_t *) ft->priv;
+    scarletbook_handle_t *sb_handle = ft->sb_handle;
+    size_t                frame_count;
+
+    if (ft->dsd_encoded_export)
+        return;
+
+    if (handle->edit_master)
+        frame_count = TIME_FRAMECOUNT(&sb_handle->area[ft->area].area_toc->total_playtime);
+    else
+        frame_count = TIME_FRAMECOUNT(&sb_handle->area[ft->area].area_tracklist_time->duration[ft->track]);
+
+    // leave room for the frames of the sectors shared with the next track
+    handle->frame_indexes_allocated = frame_count + SACD_FRAME_RATE;
+    handle->frame_indexes = (dst_frame_index_t *) malloc(handle->frame_indexes_allocated * DST_FRAME_INDEX_SIZE);
+    if (!handle->frame_indexes)
+        handle->frame_indexes_allocated = 0;
+}
+
 static int dsdiff_create_edit_master(scarletbook_output_format_t *ft)
 {
     int ret;
@@ -568,6 +608,8 @@ static int dsdiff_create_edit_master(scarletbook_output_format_t *ft)
     handle->edit_master = 1;
     ret = calculate_header_and_footer(ft);
     fwrite(handle->header, 1, handle->header_size, ft->fd);
+    handle->audio_data_offset = handle->header_size;
+    allocate_frame_indexes(ft);
     return ret;
 }
 
@@ -576,6 +618,8 @@ static int dsdiff_create(scarletbook_output_format_t *ft)
     int ret = calculate_header_and_footer(ft);
     dsdiff_handle_t  *handle = (dsdiff_handle_t *) ft->priv;
     fwrite(handle->header, 1, handle->header_size, ft->fd); 
+    handle->audio_data_offset = handle->header_size;
+    allocate_frame_indexes(ft);
     return ret;
 }
 
@@ -634,21 +678,23 @@ static size_t dsdiff_write_frame(scarletbook_output_format_t *ft, const uint8_t
         {
             size_t nrw;
 
+            // only grows when the TOC playing time was off
             if (handle->frame_count > handle->frame_indexes_allocated)
             {
+                dst_frame_index_t *frame_indexes = (dst_frame_index_t *) realloc(handle->frame_indexes, (handle->frame_indexes_allocated + 10000) * DST_FRAME_INDEX_SIZE);
+                if (!frame_indexes)
+                {
+                    // the frame is dropped, the index stays valid
+                    handle->frame_count--;
+                    return 0;
+                }
+                handle->frame_indexes = frame_indexes;
                 handle->frame_indexes_allocated += 10000;
-                handle->frame_indexes = (dst_frame_index_t *) realloc(handle->frame_indexes, handle->frame_indexes_allocated * DST_FRAME_INDEX_SIZE);
             }
 
+            // frames are written back to back after the header, no need to ask stdio
             handle->frame_indexes[handle->frame_count - 1].length = len;
-
-#ifdef _WIN32
-            handle->frame_indexes[handle->frame_count - 1].offset = _ftelli64(ft->fd) + DST_FRAME_DATA_CHUNK_SIZE;
-#elif defined(__lv2ppu__) || defined(__APPLE__)
-            handle->frame_indexes[handle->frame_count - 1].offset = ftello(ft->fd) + DST_FRAME_DATA_CHUNK_SIZE;
-#else
-            handle->frame_indexes[handle->frame_count - 1].offset = ftello64(ft->fd) + DST_FRAME_DATA_CHUNK_SIZE;
-#endif
+            handle->frame_indexes[handle->frame_count - 1].offset = handle->audio_data_offset + handle->audio_data_size + DST_FRAME_DATA_CHUNK_SIZE;
 
             nrw = fwrite(&dst_frame_data_chunk, 1, DST_FRAME_DATA_CHUNK_SIZE, ft->fd);
             nrw += fwrite(buf, 1, len, ft->fd);
@@ -663,6 +709,69 @@ static size_t dsdiff_write_frame(scarletbook_output_format_t *ft, const uint8_t
     }
 }
 
+static uint8_t *dsdiff_save_state(scarletbook_output_format_t *ft, size_t *size)
+{
+    dsdiff_handle_t *handle = (dsdiff_handle_t *) ft->priv;
+    size_t index_size = handle->frame_indexes ? handle->frame_count * DST_FRAME_INDEX_SIZE : 0;
+    dsdiff_state_t *state;
+
+    state = (dsdiff_state_t *) malloc(sizeof(dsdiff_state_t) + index_size);
+    if (!state)
+        return 0;
+
+    state->frame_count = handle->frame_count;
+    state->audio_data_offset = handle->audio_data_offset;
+    state->audio_data_size = handle->audio_data_size;
+    if (index_size)
+    {
+        memcpy(state + 1, handle->frame_indexes, index_size);
+    }
+
+    *size = sizeof(dsdiff_state_t) + index_size;
+    return (uint8_t *) state;
+}
+
+static int dsdiff_load_state(scarletbook_output_format_t *ft, const uint8_t *buf, size_t size)
+{
+    dsdiff_handle_t *handle = (dsdiff_handle_t *) ft->priv;
+    const dsdiff_state_t *state = (const dsdiff_state_t *) buf;
+    dst_frame_index_t *frame_indexes;
+    size_t index_size;
+
+    if (size < sizeof(dsdiff_state_t))
+        return -1;
+
+    handle->frame_count = (size_t) state->frame_count;
+    handle->audio_data_offset = state->audio_data_offset;
+    handle->audio_data_size = state->audio_data_size;
+
+    allocate_frame_indexes(ft);
+    index_size = size - sizeof(dsdiff_state_t);
+    if (handle->frame_indexes)
+    {
+        if (index_size != handle->frame_count * DST_FRAME_INDEX_SIZE)
+            return -1;
+        if (handle->frame_count > handle->frame_indexes_allocated)
+        {
+            // without the index the file is extracted from scratch
+            frame_indexes = (dst_frame_index_t *) realloc(handle->frame_indexes, (handle->frame_count + 10000) * DST_FRAME_INDEX_SIZE);
+            if (!frame_indexes)
+                return -1;
+            handle->frame_indexes = frame_indexes;
+            handle->frame_indexes_allocated = handle->frame_count + 10000;
+        }
+        memcpy(handle->frame_indexes, state + 1, index_size);
+    }
+    return 0;
+}
+
+static int dsdiff_load_state_edit_master(scarletbook_output_format_t *ft, const uint8_t *buf, size_t size)
+{
+    dsdiff_handle_t *handle = (dsdiff_handle_t *) ft->priv;
+    handle->edit_master = 1;
+    return dsdiff_load_state(ft, buf, size);
+}
+
 scarletbook_format_handler_t const * dsdiff_format_fn(void) 
 {
     static scarletbook_format_handler_t handler = 
@@ -673,7 +782,9 @@ scarletbook_format_handler_t const * dsdiff_format_fn(void)
         dsdiff_write_frame,
         dsdiff_close, 
         OUTPUT_FLAG_DSD | OUTPUT_FLAG_DST,
-        sizeof(dsdiff_handle_t)
+        sizeof(dsdiff_handle_t),
+        dsdiff_save_state,
+        dsdiff_load_state
     };
     return &handler;
 }
@@ -688,7 +799,9 @@ scarletbook_format_handler_t const * dsdiff_edit_master_format_fn(void)
         dsdiff_write_frame,
         dsdiff_close, 
         OUTPUT_FLAG_DSD | OUTPUT_FLAG_DST | OUTPUT_FLAG_EDIT_MASTER,
-        sizeof(dsdiff_handle_t)
+        sizeof(dsdiff_handle_t),
+        dsdiff_save_state,
+        dsdiff_load_state_edit_master
     };
     return &handler;
 }
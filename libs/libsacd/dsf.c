@@ -60,6 +60,16 @@ typedef struct
 } 
 dsf_handle_t;
 
+// what a checkpoint keeps of dsf_handle_t, the header and footer are made again at close
+typedef struct
+{
+    uint64_t            audio_data_size;
+    uint64_t            sample_count;
+    uint32_t            buffer_fill[MAX_CHANNEL_COUNT];
+    uint8_t             buffer[MAX_CHANNEL_COUNT][SACD_BLOCK_SIZE_PER_CHANNEL];
+} 
+dsf_state_t;
+
 static const uint8_t bit_reverse_table[] = 
 {
     0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0, 
@@ -161,20 +171,20 @@ static int dsf_create_header(scarletbook_output_format_t *ft)
     return 0;
 }
 
-uint8_t buffer_prev[MAX_CHANNEL_COUNT][SACD_BLOCK_SIZE_PER_CHANNEL];
-uint8_t *buffer_ptr_prev[MAX_CHANNEL_COUNT];
-
 static int dsf_create(scarletbook_output_format_t *ft)
 {
     int i;
     dsf_handle_t *handle = (dsf_handle_t *) ft->priv;
-
+    scarletbook_area_stream_t *area_stream = ft->area_stream;
 
     // If this is not the first track, carry over the leftover samples from the tail of the previous track for no zero padding.
-    if(ft->track && ft->dsf_nopad){
-        for(i = 0; i < MAX_CHANNEL_COUNT; i++){
-            memcpy(handle->buffer[i], buffer_prev[i], SACD_BLOCK_SIZE_PER_CHANNEL * sizeof(uint8_t));
-            handle->buffer_ptr[i] = handle->buffer[i] + (buffer_ptr_prev[i] - buffer_prev[i]);
+    if (ft->track && ft->dsf_nopad && area_stream && area_stream->dsf_carry_over)
+    {
+        for (i = 0; i < MAX_CHANNEL_COUNT; i++)
+        {
+            memcpy(handle->buffer[i], area_stream->dsf_carry_over + i * SACD_BLOCK_SIZE_PER_CHANNEL, area_stream->dsf_carry_over_len[i]);
+            handle->buffer_ptr[i] = handle->buffer[i] + area_stream->dsf_carry_over_len[i];
+            area_stream->dsf_carry_over_len[i] = 0;
         }
     }
 
@@ -185,14 +195,24 @@ static int dsf_close(scarletbook_output_format_t *ft)
 {
     dsf_handle_t *handle = (dsf_handle_t *) ft->priv;
     scarletbook_handle_t *sb_handle = ft->sb_handle;
-    int i;
+    int i, carry_over;
+
+    carry_over = ft->dsf_nopad && ft->area_stream && ft->track < sb_handle->area[ft->area].area_toc->track_count - 1;
+    if (carry_over && !ft->area_stream->dsf_carry_over)
+    {
+        // without room for the leftover samples this track is padded after all
+        ft->area_stream->dsf_carry_over = (uint8_t *) calloc(MAX_CHANNEL_COUNT, SACD_BLOCK_SIZE_PER_CHANNEL);
+        carry_over = ft->area_stream->dsf_carry_over != NULL;
+    }
 
     // Save the remaining samples in the buffer to be attached to the beginning of the next track.
     // This is needed for padding-less DSF generation.  This is for players that cannot handle zero-padding properly. 
-    if(ft->dsf_nopad && ft->track < sb_handle->area[ft->area].area_toc->track_count - 1){
+    if(carry_over){
+        scarletbook_area_stream_t *area_stream = ft->area_stream;
+
         for(i = 0; i < MAX_CHANNEL_COUNT; i ++){
-            memcpy(buffer_prev[i], handle->buffer[i], SACD_BLOCK_SIZE_PER_CHANNEL);
-            buffer_ptr_prev[i] = buffer_prev[i] + (handle->buffer_ptr[i] - handle->buffer[i]);
+            area_stream->dsf_carry_over_len[i] = handle->buffer_ptr[i] ? handle->buffer_ptr[i] - handle->buffer[i] : 0;
+            memcpy(area_stream->dsf_carry_over + i * SACD_BLOCK_SIZE_PER_CHANNEL, handle->buffer[i], area_stream->dsf_carry_over_len[i]);
         }
     }
     else{
@@ -266,6 +286,56 @@ static size_t dsf_write_frame(scarletbook_output_format_t *ft, const uint8_t *bu
     return (size_t) (handle->audio_data_size - prev_audio_data_size);
 }
 
+static uint8_t *dsf_save_state(scarletbook_output_format_t *ft, size_t *size)
+{
+    dsf_handle_t *handle = (dsf_handle_t *) ft->priv;
+    dsf_state_t *state;
+    int i;
+
+    state = (dsf_state_t *) malloc(sizeof(dsf_state_t));
+    if (!state)
+        return 0;
+
+    state->audio_data_size = handle->audio_data_size;
+    state->sample_count = handle->sample_count;
+    for (i = 0; i < MAX_CHANNEL_COUNT; i++)
+    {
+        state->buffer_fill[i] = handle->buffer_ptr[i] ? (uint32_t) (handle->buffer_ptr[i] - handle->buffer[i]) : 0;
+    }
+    memcpy(state->buffer, handle->buffer, sizeof(state->buffer));
+
+    *size = sizeof(dsf_state_t);
+    return (uint8_t *) state;
+}
+
+static int dsf_load_state(scarletbook_output_format_t *ft, const uint8_t *buf, size_t size)
+{
+    dsf_handle_t *handle = (dsf_handle_t *) ft->priv;
+    const dsf_state_t *state = (const dsf_state_t *) buf;
+    int i;
+
+    if (size != sizeof(dsf_state_t))
+        return -1;
+
+    handle->audio_data_size = state->audio_data_size;
+    handle->sample_count = state->sample_count;
+    handle->channel_count = ft->sb_handle->area[ft->area].area_toc->channel_count;
+    memcpy(handle->buffer, state->buffer, sizeof(handle->buffer));
+    for (i = 0; i < MAX_CHANNEL_COUNT; i++)
+    {
+        if (state->buffer_fill[i] > SACD_BLOCK_SIZE_PER_CHANNEL)
+            return -1;
+        handle->buffer_ptr[i] = handle->buffer[i] + state->buffer_fill[i];
+    }
+
+    // dsf_close appends the footer before it makes the header again
+    handle->footer = (uint8_t *) calloc(DSF_BUFFER_SIZE, 1);
+    if (!handle->footer)
+        return -1;
+    handle->footer_size = scarletbook_id3_tag_render(ft->sb_handle, handle->footer, ft->area, ft->track);
+    return 0;
+}
+
 scarletbook_format_handler_t const * dsf_format_fn(void) 
 {
     static scarletbook_format_handler_t handler = 
@@ -276,7 +346,9 @@ scarletbook_format_handler_t const * dsf_format_fn(void)
         dsf_write_frame,
         dsf_close, 
         OUTPUT_FLAG_DSD,
-        sizeof(dsf_handle_t)
+        sizeof(dsf_handle_t),
+        dsf_save_state,
+        dsf_load_state
     };
     return &handler;
 }
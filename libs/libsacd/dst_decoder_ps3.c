@@ -339,7 +339,7 @@ static void process_dst_frames(dst_decoder_t *dst_decoder)
     }
 }
 
-dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata)
+dst_decoder_t* dst_decoder_create(int channel_count, int thread_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata)
 {
     sys_event_queue_attr_t queue_attr;
     dst_decoder_t *dst_decoder;
@@ -50,7 +50,7 @@ typedef struct dst_decoder_t
 }
 dst_decoder_t;
 
-dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata);
+dst_decoder_t* dst_decoder_create(int channel_count, int thread_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata);
 int dst_decoder_destroy(dst_decoder_t *dst_decoder);
 int dst_decoder_decode(dst_decoder_t *dst_decoder, uint8_t* frame_data, size_t frame_size);
 
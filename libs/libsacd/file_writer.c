@@ -0,0 +1,495 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+#include <logging.h>
+
+#include "file_writer.h"
+
+#ifdef __linux__
+
+#define DIRECT_IO_ALIGNMENT     4096
+#define DIRECT_IO_BUFFER_SIZE   (4 * 1024 * 1024)
+
+typedef struct direct_writer_t
+{
+    int         fd;                 // O_DIRECT, takes the aligned part of the stream
+    int         fd_buffered;        // same file, takes unaligned parts and header updates
+    uint8_t    *buffer;
+    size_t      buffer_start;       // the data is buffer[buffer_start..buffer_fill)
+    size_t      buffer_fill;
+    off64_t     buffer_offset;      // file offset of buffer[0], aligned
+    off64_t     position;
+    off64_t     file_size;
+} 
+direct_writer_t;
+
+static void preallocate(int fd, uint64_t expected_size)
+{
+    // KEEP_SIZE: the handlers seek back to write their headers, so the visible size 
+    // must stay the written size
+    if (expected_size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) expected_size) != 0)
+    {
+        LOG(lm_main, LOG_NOTICE, ("preallocating %" PRIu64 " bytes failed, errno: %d, %s", expected_size, errno, strerror(errno)));
+    }
+}
+
+// cuts the file to "size" and frees the preallocated blocks past it
+static int release_preallocation(int fd, off64_t size)
+{
+    struct stat st;
+
+    if (ftruncate(fd, size) != 0 || fstat(fd, &st) != 0)
+        return -1;
+
+    // truncating to the current size is a no-op on some filesystems and keeps the 
+    // KEEP_SIZE blocks past EOF, they are punched out or dropped by a real resize. 
+    // The preallocation starts at 0, so it ends within the allocated bytes past EOF
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, size, (off_t) st.st_blocks * 512) == 0)
+        return 0;
+    if (ftruncate(fd, size + 1) != 0 || ftruncate(fd, size) != 0)
+        return -1;
+    return 0;
+}
+
+static int pwrite_all(int fd, const uint8_t *buf, size_t len, off64_t offset)
+{
+    ssize_t ret;
+
+    while (len > 0)
+    {
+        ret = pwrite(fd, buf, len, offset);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+// starts an empty buffer at file offset "position", buffer[0] stays on an aligned
+// file offset so the writes go direct again from the next boundary on
+static void direct_writer_restart(direct_writer_t *w, off64_t position)
+{
+    w->buffer_offset = position & ~((off64_t) DIRECT_IO_ALIGNMENT - 1);
+    w->buffer_start = (size_t) (position - w->buffer_offset);
+    w->buffer_fill = w->buffer_start;
+}
+
+static int direct_writer_flush(direct_writer_t *w)
+{
+    size_t head, aligned;
+
+    // only the data up to the first and after the last boundary goes through the page cache
+    head = (w->buffer_start + DIRECT_IO_ALIGNMENT - 1) & ~((size_t) DIRECT_IO_ALIGNMENT - 1);
+    if (head > w->buffer_fill)
+        head = w->buffer_fill;
+    aligned = w->buffer_fill & ~((size_t) DIRECT_IO_ALIGNMENT - 1);
+    if (aligned < head)
+        aligned = head;
+
+    if (head > w->buffer_start && pwrite_all(w->fd_buffered, w->buffer + w->buffer_start, head - w->buffer_start, w->buffer_offset + w->buffer_start) != 0)
+    {
+        return -1;
+    }
+    if (aligned > head && pwrite_all(w->fd, w->buffer + head, aligned - head, w->buffer_offset + head) != 0)
+    {
+        // the file system refused the direct write, go through the page cache instead
+        LOG(lm_main, LOG_NOTICE, ("direct write failed, errno: %d, %s", errno, strerror(errno)));
+        if (pwrite_all(w->fd_buffered, w->buffer + head, aligned - head, w->buffer_offset + head) != 0)
+            return -1;
+    }
+    if (w->buffer_fill > aligned && pwrite_all(w->fd_buffered, w->buffer + aligned, w->buffer_fill - aligned, w->buffer_offset + aligned) != 0)
+    {
+        return -1;
+    }
+    direct_writer_restart(w, w->buffer_offset + (off64_t) w->buffer_fill);
+    return 0;
+}
+
+static ssize_t direct_writer_write(void *cookie, const char *buf, size_t size)
+{
+    direct_writer_t *w = (direct_writer_t *) cookie;
+    size_t done = 0, len;
+
+    // a write somewhere else than the end of the buffer starts a new buffer
+    if (w->position != w->buffer_offset + (off64_t) w->buffer_fill)
+    {
+        if (direct_writer_flush(w) != 0)
+            return -1;
+        direct_writer_restart(w, w->position);
+    }
+
+    while (done < size)
+    {
+        len = size - done;
+        if (len > DIRECT_IO_BUFFER_SIZE - w->buffer_fill)
+            len = DIRECT_IO_BUFFER_SIZE - w->buffer_fill;
+
+        memcpy(w->buffer + w->buffer_fill, buf + done, len);
+        w->buffer_fill += len;
+        done += len;
+
+        if (w->buffer_fill == DIRECT_IO_BUFFER_SIZE && direct_writer_flush(w) != 0)
+            return -1;
+    }
+
+    w->position += size;
+    if (w->position > w->file_size)
+        w->file_size = w->position;
+
+    return size;
+}
+
+static int direct_writer_seek(void *cookie, off64_t *offset, int whence)
+{
+    direct_writer_t *w = (direct_writer_t *) cookie;
+    off64_t position;
+
+    switch (whence)
+    {
+    case SEEK_SET:
+        position = *offset;
+        break;
+    case SEEK_CUR:
+        position = w->position + *offset;
+        break;
+    case SEEK_END:
+        position = w->file_size + *offset;
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+    if (position < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    w->position = position;
+    *offset = position;
+    return 0;
+}
+
+static int direct_writer_close(void *cookie)
+{
+    direct_writer_t *w = (direct_writer_t *) cookie;
+    int ret = 0;
+
+    if (direct_writer_flush(w) != 0)
+        ret = -1;
+
+    // drops the unused part of the preallocation
+    if (release_preallocation(w->fd_buffered, w->file_size) != 0)
+        ret = -1;
+
+    close(w->fd);
+    close(w->fd_buffered);
+    free(w->buffer);
+    free(w);
+
+    return ret;
+}
+
+FILE *file_writer_open_direct(const char *filename, uint64_t expected_size)
+{
+    cookie_io_functions_t io_funcs = { NULL, direct_writer_write, direct_writer_seek, direct_writer_close };
+    direct_writer_t *w;
+    FILE *fd;
+
+    w = (direct_writer_t *) calloc(1, sizeof(direct_writer_t));
+    if (!w)
+        return NULL;
+
+    w->fd_buffered = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (w->fd_buffered < 0)
+    {
+        free(w);
+        return NULL;
+    }
+    w->fd = open(filename, O_WRONLY | O_DIRECT);
+    if (w->fd < 0 || posix_memalign((void **) &w->buffer, DIRECT_IO_ALIGNMENT, DIRECT_IO_BUFFER_SIZE) != 0)
+    {
+        LOG(lm_main, LOG_NOTICE, ("direct I/O not available for %s, errno: %d, %s", filename, errno, strerror(errno)));
+        if (w->fd >= 0)
+            close(w->fd);
+        close(w->fd_buffered);
+        free(w);
+        return NULL;
+    }
+
+    preallocate(w->fd_buffered, expected_size);
+
+    fd = fopencookie(w, "w", io_funcs);
+    if (!fd)
+    {
+        close(w->fd);
+        close(w->fd_buffered);
+        free(w->buffer);
+        free(w);
+        return NULL;
+    }
+
+    // the writer buffers itself
+    setvbuf(fd, NULL, _IONBF, 0);
+
+    return fd;
+}
+
+typedef struct tee_writer_t
+{
+    FILE               *fd;                 // NULL drops the data after the tee
+    off64_t             position;
+    off64_t             size;
+    file_writer_tee_t   tee;
+    void               *userdata;
+    FILE               *stream;             // the tee stream itself
+    struct tee_writer_t *next;
+}
+tee_writer_t;
+
+// the open tee streams, so that file_writer_sync can reach the file behind one
+static tee_writer_t *tee_writers;
+static pthread_mutex_t tee_writers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// returns the stream the tee stream "fd" passes its data on to, NULL when it
+// drops it, or "fd" itself when it is no tee stream
+static FILE *tee_writer_target(FILE *fd)
+{
+    tee_writer_t *w;
+
+    pthread_mutex_lock(&tee_writers_lock);
+    for (w = tee_writers; w && w->stream != fd; w = w->next)
+        ;
+    pthread_mutex_unlock(&tee_writers_lock);
+
+    return w ? w->fd : fd;
+}
+
+static ssize_t tee_writer_write(void *cookie, const char *buf, size_t size)
+{
+    tee_writer_t *w = (tee_writer_t *) cookie;
+    size_t written;
+
+    written = w->fd ? fwrite(buf, 1, size, w->fd) : size;
+    if (written > 0)
+    {
+        w->tee(w->userdata, (uint64_t) w->position, (const uint8_t *) buf, written);
+        w->position += written;
+        if (w->position > w->size)
+            w->size = w->position;
+    }
+    return written == size ? (ssize_t) size : -1;
+}
+
+static int tee_writer_seek(void *cookie, off64_t *offset, int whence)
+{
+    tee_writer_t *w = (tee_writer_t *) cookie;
+    off64_t position;
+
+    if (!w->fd)
+    {
+        position = whence == SEEK_SET ? *offset : whence == SEEK_CUR ? w->position + *offset : w->size + *offset;
+        if (position < 0)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    else if (fseeko(w->fd, *offset, whence) != 0 || (position = ftello(w->fd)) < 0)
+    {
+        return -1;
+    }
+
+    w->position = position;
+    *offset = position;
+    return 0;
+}
+
+static int tee_writer_close(void *cookie)
+{
+    tee_writer_t *w = (tee_writer_t *) cookie;
+    tee_writer_t **pp;
+    int ret = 0;
+
+    pthread_mutex_lock(&tee_writers_lock);
+    for (pp = &tee_writers; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == w)
+        {
+            *pp = w->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&tee_writers_lock);
+
+    if (w->fd)
+    {
+        file_writer_trim(w->fd);
+        ret = fclose(w->fd);
+    }
+    free(w);
+
+    return ret;
+}
+
+FILE *file_writer_open_tee(FILE *fd, file_writer_tee_t tee, void *userdata)
+{
+    cookie_io_functions_t io_funcs = { NULL, tee_writer_write, tee_writer_seek, tee_writer_close };
+    tee_writer_t *w;
+    FILE *tee_fd;
+
+    w = (tee_writer_t *) calloc(1, sizeof(tee_writer_t));
+    if (!w)
+        return NULL;
+
+    w->fd = fd;
+    w->tee = tee;
+    w->userdata = userdata;
+
+    tee_fd = fopencookie(w, "w", io_funcs);
+    if (!tee_fd)
+    {
+        free(w);
+        return NULL;
+    }
+
+    // the tee stream is the buffered one
+    if (fd)
+    {
+        setvbuf(fd, NULL, _IONBF, 0);
+    }
+
+    w->stream = tee_fd;
+    pthread_mutex_lock(&tee_writers_lock);
+    w->next = tee_writers;
+    tee_writers = w;
+    pthread_mutex_unlock(&tee_writers_lock);
+
+    return tee_fd;
+}
+
+void file_writer_preallocate(FILE *fd, uint64_t expected_size)
+{
+    preallocate(fileno(fd), expected_size);
+}
+
+void file_writer_trim(FILE *fd)
+{
+    struct stat st;
+
+    if (fflush(fd) == 0 && fstat(fileno(fd), &st) == 0)
+    {
+        if (release_preallocation(fileno(fd), st.st_size) != 0)
+        {
+            LOG(lm_main, LOG_NOTICE, ("trimming preallocated space failed, errno: %d, %s", errno, strerror(errno)));
+        }
+    }
+}
+
+int file_writer_cut(FILE *fd, uint64_t size)
+{
+    if (fflush(fd) != 0 || ftruncate(fileno(fd), (off_t) size) != 0)
+        return -1;
+    return fseeko(fd, (off_t) size, SEEK_SET);
+}
+
+int file_writer_sync(FILE *fd)
+{
+    if (fflush(fd) != 0)
+        return -1;
+
+    // streams of file_writer_open_tee have no descriptor, they pass their data on
+    // unbuffered and the file behind them is the one to sync
+    fd = tee_writer_target(fd);
+    if (!fd)
+        return 0;
+    if (fflush(fd) != 0)
+        return -1;
+    if (fileno(fd) >= 0)
+        return fdatasync(fileno(fd));
+    return 0;
+}
+
+#else
+
+FILE *file_writer_open_direct(const char *filename, uint64_t expected_size)
+{
+    return NULL;
+}
+
+FILE *file_writer_open_tee(FILE *fd, file_writer_tee_t tee, void *userdata)
+{
+    return NULL;
+}
+
+void file_writer_preallocate(FILE *fd, uint64_t expected_size)
+{
+}
+
+void file_writer_trim(FILE *fd)
+{
+}
+
+int file_writer_cut(FILE *fd, uint64_t size)
+{
+    if (fflush(fd) != 0)
+        return -1;
+#ifdef _WIN32
+    if (_chsize_s(_fileno(fd), (__int64) size) != 0)
+        return -1;
+    return _fseeki64(fd, (__int64) size, SEEK_SET);
+#else
+    return fseeko(fd, (off_t) size, SEEK_SET);
+#endif
+}
+
+int file_writer_sync(FILE *fd)
+{
+    return fflush(fd);
+}
+
+#endif
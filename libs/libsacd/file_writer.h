@@ -0,0 +1,80 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef FILE_WRITER_H_INCLUDED
+#define FILE_WRITER_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * opens a file for writing that bypasses the page cache, data is collected in large 
+ * aligned buffers and written with O_DIRECT, unaligned heads and tails (and the header 
+ * updates done at close) go through a normal descriptor. The file is preallocated with
+ * expected_size and truncated to the written size at fclose.
+ *
+ * Returns NULL when the platform or file system doesn't support direct I/O.
+ */
+FILE *file_writer_open_direct(const char *filename, uint64_t expected_size);
+
+typedef void (*file_writer_tee_t)(void *userdata, uint64_t offset, const uint8_t *buf, size_t len);
+
+/**
+ * puts a stream in front of "fd" that hands every write, with the file offset it goes
+ * to, to "tee" before passing it on. Closing the returned stream trims and closes "fd".
+ * Without "fd" the writes only go to "tee".
+ *
+ * Returns NULL when the platform can't do that, "fd" is still open then.
+ */
+FILE *file_writer_open_tee(FILE *fd, file_writer_tee_t tee, void *userdata);
+
+/**
+ * reserves expected_size bytes for a file that is going to be written sequentially, 
+ * the visible file size doesn't change
+ */
+void file_writer_preallocate(FILE *fd, uint64_t expected_size);
+
+/**
+ * gives back the preallocated space that wasn't used, call before fclose
+ */
+void file_writer_trim(FILE *fd);
+
+/**
+ * cuts a file opened for update to "size" bytes and puts the position there, 
+ * where files can't be cut only the position is set. Returns 0 on success.
+ */
+int file_writer_cut(FILE *fd, uint64_t size);
+
+/**
+ * flushes "fd" and waits for what was written to reach the disk, where
+ * that can be told. Returns 0 on success.
+ */
+int file_writer_sync(FILE *fd);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* FILE_WRITER_H_INCLUDED */
@@ -45,6 +45,8 @@ scarletbook_format_handler_t const * iso_format_fn(void)
         iso_write_frame,
         0, 
         OUTPUT_FLAG_RAW,
+        0,
+        0,
         0
     };
     return &handler;
@@ -0,0 +1,516 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <logging.h>
+
+#include "scarletbook_id3.h"
+#include "scarletbook_output.h"
+#include "scarletbook.h"
+#include "dsd2pcm.h"
+#include "dop.h"
+
+/**
+ * PCM output, DSD64 converted to 24 bit samples at 88.2 or 176.4 kHz and
+ * written as WAV or AIFF. Both carry the ID3 tag of the track in a chunk
+ * after the audio data. The channels keep the SACD order (L, R, C, LFE,
+ * LS, RS), which is also the WAV order for 5.0 and 5.1.
+ *
+ * DoP output packs the DSD unchanged into 24 bit samples at 176.4 kHz,
+ * either as WAV or as a headerless stream.
+ */
+
+#define PCM_DEFAULT_RATE        88200
+#define PCM_BYTES_PER_SAMPLE    3
+#define PCM_HEADER_SIZE         80
+#define PCM_TAG_SIZE            2048
+
+#define WAVE_FORMAT_PCM         0x0001
+#define WAVE_FORMAT_EXTENSIBLE  0xfffe
+
+enum
+{
+    PCM_WAV,
+    PCM_AIFF,
+    DOP_WAV,
+    DOP_RAW
+};
+
+typedef struct
+{
+    int                 aiff;
+    int                 raw;
+    int                 channel_count;
+    int                 rate;
+    uint32_t            channel_mask;
+
+    dsd2pcm_t          *dsd2pcm;
+    dop_packer_t       *dop_packer;
+    int32_t            *samples;
+    size_t              samples_size;           // per channel
+    uint8_t            *packed;
+
+    uint64_t            frame_count;            // PCM sample frames written
+    uint8_t            *tag;
+    size_t              tag_size;
+} 
+pcm_handle_t;
+
+static inline uint8_t *put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t) v; p[1] = (uint8_t) (v >> 8);
+    return p + 2;
+}
+
+static inline uint8_t *put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) v; p[1] = (uint8_t) (v >> 8); p[2] = (uint8_t) (v >> 16); p[3] = (uint8_t) (v >> 24);
+    return p + 4;
+}
+
+static inline uint8_t *put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t) (v >> 8); p[1] = (uint8_t) v;
+    return p + 2;
+}
+
+static inline uint8_t *put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) (v >> 24); p[1] = (uint8_t) (v >> 16); p[2] = (uint8_t) (v >> 8); p[3] = (uint8_t) v;
+    return p + 4;
+}
+
+static inline uint8_t *put_id(uint8_t *p, const char *id)
+{
+    memcpy(p, id, 4);
+    return p + 4;
+}
+
+// 80 bit IEEE extended, as used by AIFF for the sample rate
+static uint8_t *put_extended(uint8_t *p, uint32_t value)
+{
+    int      exponent = 16383 + 31;
+    uint32_t mantissa = value;
+
+    while (mantissa && !(mantissa & 0x80000000))
+    {
+        mantissa <<= 1;
+        exponent--;
+    }
+    p = put_be16(p, (uint16_t) (mantissa ? exponent : 0));
+    p = put_be32(p, mantissa);
+    return put_be32(p, 0);
+}
+
+static inline uint32_t chunk_size(uint64_t size)
+{
+    return size > 0xffffffffULL ? 0xffffffff : (uint32_t) size;
+}
+
+static size_t pcm_data_size(pcm_handle_t *handle)
+{
+    return (size_t) (handle->frame_count * handle->channel_count * PCM_BYTES_PER_SAMPLE);
+}
+
+// chunks are padded to an even size
+static size_t pcm_padded(size_t size)
+{
+    return size + (size & 1);
+}
+
+static size_t wav_create_header(pcm_handle_t *handle, uint8_t *header)
+{
+    uint64_t data_size = pcm_data_size(handle);
+    int      extensible = handle->channel_count > 2;
+    uint16_t block_align = (uint16_t) (handle->channel_count * PCM_BYTES_PER_SAMPLE);
+    size_t   fmt_size = extensible ? 40 : 16;
+    uint8_t *p = header;
+
+    p = put_id(p, "RIFF");
+    p = put_le32(p, chunk_size(4 + 8 + fmt_size + 8 + pcm_padded(data_size) + (handle->tag_size ? 8 + pcm_padded(handle->tag_size) : 0)));
+    p = put_id(p, "WAVE");
+
+    p = put_id(p, "fmt ");
+    p = put_le32(p, (uint32_t) fmt_size);
+    p = put_le16(p, extensible ? WAVE_FORMAT_EXTENSIBLE : WAVE_FORMAT_PCM);
+    p = put_le16(p, (uint16_t) handle->channel_count);
+    p = put_le32(p, (uint32_t) handle->rate);
+    p = put_le32(p, (uint32_t) handle->rate * block_align);
+    p = put_le16(p, block_align);
+    p = put_le16(p, PCM_BYTES_PER_SAMPLE * 8);
+    if (extensible)
+    {
+        // KSDATAFORMAT_SUBTYPE_PCM
+        static const uint8_t subformat_pcm[16] = 
+        {
+            0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+        };
+
+        p = put_le16(p, 22);
+        p = put_le16(p, PCM_BYTES_PER_SAMPLE * 8);
+        p = put_le32(p, handle->channel_mask);
+        memcpy(p, subformat_pcm, sizeof(subformat_pcm));
+        p += sizeof(subformat_pcm);
+    }
+
+    p = put_id(p, "data");
+    p = put_le32(p, chunk_size(data_size));
+
+    return (size_t) (p - header);
+}
+
+static size_t aiff_create_header(pcm_handle_t *handle, uint8_t *header)
+{
+    uint64_t data_size = pcm_data_size(handle);
+    uint8_t *p = header;
+
+    p = put_id(p, "FORM");
+    p = put_be32(p, chunk_size(4 + 8 + 18 + 8 + 8 + pcm_padded(data_size) + (handle->tag_size ? 8 + pcm_padded(handle->tag_size) : 0)));
+    p = put_id(p, "AIFF");
+
+    p = put_id(p, "COMM");
+    p = put_be32(p, 18);
+    p = put_be16(p, (uint16_t) handle->channel_count);
+    p = put_be32(p, chunk_size(handle->frame_count));
+    p = put_be16(p, PCM_BYTES_PER_SAMPLE * 8);
+    p = put_extended(p, (uint32_t) handle->rate);
+
+    p = put_id(p, "SSND");
+    p = put_be32(p, chunk_size(8 + data_size));
+    p = put_be32(p, 0);                     // offset
+    p = put_be32(p, 0);                     // block size
+
+    return (size_t) (p - header);
+}
+
+static int pcm_write_header(scarletbook_output_format_t *ft)
+{
+    pcm_handle_t *handle = (pcm_handle_t *) ft->priv;
+    uint8_t       header[PCM_HEADER_SIZE];
+    size_t        header_size;
+
+    if (handle->raw)
+        return 0;
+
+    header_size = handle->aiff ? aiff_create_header(handle, header) : wav_create_header(handle, header);
+    return fwrite(header, 1, header_size, ft->fd) == header_size ? 0 : -1;
+}
+
+static int pcm_create(scarletbook_output_format_t *ft, int format)
+{
+    pcm_handle_t              *handle = (pcm_handle_t *) ft->priv;
+    area_toc_t                *area_toc = ft->sb_handle->area[ft->area].area_toc;
+    scarletbook_area_stream_t *area_stream = ft->area_stream;
+
+    handle->aiff = format == PCM_AIFF;
+    handle->raw = format == DOP_RAW;
+    handle->channel_count = area_toc->channel_count;
+    handle->rate = ft->pcm_rate ? ft->pcm_rate : PCM_DEFAULT_RATE;
+    if (area_toc->channel_count == 5 && area_toc->extra_settings == 3)
+    {
+        handle->channel_mask = 0x37;        // FL FR FC BL BR
+    }
+    else if (area_toc->channel_count == 6 && area_toc->extra_settings == 4)
+    {
+        handle->channel_mask = 0x3f;        // FL FR FC LFE BL BR
+    }
+    else if (area_toc->channel_count == 2)
+    {
+        handle->channel_mask = 0x03;
+    }
+
+    if (format == DOP_WAV || format == DOP_RAW)
+    {
+        handle->rate = SACD_SAMPLING_FREQUENCY / 16;
+        handle->dop_packer = dop_packer_create(handle->channel_count);
+        if (!handle->dop_packer)
+        {
+            LOG(lm_main, LOG_ERROR, ("can't pack %d channels into DoP", handle->channel_count));
+            return -1;
+        }
+    }
+    else
+    {
+        // carries on with the filters of the previous track, see pcm_finish
+        if (area_stream && area_stream->dsd2pcm)
+        {
+            if (ft->track && area_stream->dsd2pcm_track == ft->track - 1)
+                handle->dsd2pcm = area_stream->dsd2pcm;
+            else
+                dsd2pcm_destroy(area_stream->dsd2pcm);
+            area_stream->dsd2pcm = NULL;
+        }
+        if (!handle->dsd2pcm)
+            handle->dsd2pcm = dsd2pcm_create(handle->channel_count, handle->rate, 0);
+        if (!handle->dsd2pcm)
+        {
+            LOG(lm_main, LOG_ERROR, ("can't convert %d channels to %d Hz", handle->channel_count, handle->rate));
+            return -1;
+        }
+    }
+
+    handle->tag = handle->raw ? 0 : (uint8_t *) calloc(PCM_TAG_SIZE, 1);
+    if (handle->tag)
+    {
+        handle->tag_size = scarletbook_id3_tag_render(ft->sb_handle, handle->tag, ft->area, ft->track);
+    }
+
+    return pcm_write_header(ft);
+}
+
+static int wav_create(scarletbook_output_format_t *ft)
+{
+    return pcm_create(ft, PCM_WAV);
+}
+
+static int aiff_create(scarletbook_output_format_t *ft)
+{
+    return pcm_create(ft, PCM_AIFF);
+}
+
+static int dop_wav_create(scarletbook_output_format_t *ft)
+{
+    return pcm_create(ft, DOP_WAV);
+}
+
+static int dop_raw_create(scarletbook_output_format_t *ft)
+{
+    return pcm_create(ft, DOP_RAW);
+}
+
+static size_t dop_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len)
+{
+    pcm_handle_t *handle = (pcm_handle_t *) ft->priv;
+    size_t        size;
+
+    // 2 DSD bytes per channel become 3 bytes
+    if (len > handle->samples_size)
+    {
+        free(handle->packed);
+        handle->packed = (uint8_t *) malloc(len * 3 / 2);
+        handle->samples_size = handle->packed ? len : 0;
+        if (!handle->samples_size)
+            return 0;
+    }
+
+    size = dop_pack(handle->dop_packer, buf, len, handle->packed);
+    handle->frame_count += size / (handle->channel_count * PCM_BYTES_PER_SAMPLE);
+    return fwrite(handle->packed, 1, size, ft->fd);
+}
+
+// makes room for "max_samples" samples per channel
+static int pcm_reserve(pcm_handle_t *handle, size_t max_samples)
+{
+    if (max_samples > handle->samples_size)
+    {
+        free(handle->samples);
+        free(handle->packed);
+        handle->samples = (int32_t *) malloc(max_samples * handle->channel_count * sizeof(int32_t));
+        handle->packed = (uint8_t *) malloc(max_samples * handle->channel_count * PCM_BYTES_PER_SAMPLE);
+        handle->samples_size = handle->samples && handle->packed ? max_samples : 0;
+        if (!handle->samples_size)
+            return -1;
+    }
+    return 0;
+}
+
+// packs and writes the samples the converter left in handle->samples
+static size_t pcm_write_samples(scarletbook_output_format_t *ft, size_t samples)
+{
+    pcm_handle_t *handle = (pcm_handle_t *) ft->priv;
+    size_t        i, size;
+    uint8_t      *p;
+
+    samples *= handle->channel_count;
+    p = handle->packed;
+    if (handle->aiff)
+    {
+        for (i = 0; i < samples; i++, p += 3)
+        {
+            p[0] = (uint8_t) (handle->samples[i] >> 16);
+            p[1] = (uint8_t) (handle->samples[i] >> 8);
+            p[2] = (uint8_t) handle->samples[i];
+        }
+    }
+    else
+    {
+        for (i = 0; i < samples; i++, p += 3)
+        {
+            p[0] = (uint8_t) handle->samples[i];
+            p[1] = (uint8_t) (handle->samples[i] >> 8);
+            p[2] = (uint8_t) (handle->samples[i] >> 16);
+        }
+    }
+
+    size = fwrite(handle->packed, 1, samples * PCM_BYTES_PER_SAMPLE, ft->fd);
+    handle->frame_count += samples / handle->channel_count;
+    return size;
+}
+
+static size_t pcm_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len)
+{
+    pcm_handle_t *handle = (pcm_handle_t *) ft->priv;
+
+    if (handle->dop_packer)
+        return dop_write_frame(ft, buf, len);
+    if (!handle->dsd2pcm)
+        return 0;
+
+    if (pcm_reserve(handle, dsd2pcm_max_samples(handle->dsd2pcm, len)) != 0)
+        return 0;
+
+    return pcm_write_samples(ft, dsd2pcm_convert(handle->dsd2pcm, buf, len, handle->samples));
+}
+
+// the filters hold back the last few hundred microseconds of the track: the next track 
+// of the area takes the converter over when it follows (see pcm_create), so gapless 
+// tracks join as they were on the disc, otherwise they are flushed into this one
+static void pcm_finish(scarletbook_output_format_t *ft)
+{
+    pcm_handle_t              *handle = (pcm_handle_t *) ft->priv;
+    scarletbook_area_stream_t *area_stream = ft->area_stream;
+
+    if (ft->pcm_continued && area_stream && !area_stream->dsd2pcm)
+    {
+        area_stream->dsd2pcm = handle->dsd2pcm;
+        area_stream->dsd2pcm_track = ft->track;
+        handle->dsd2pcm = NULL;
+    }
+    else if (pcm_reserve(handle, dsd2pcm_max_samples(handle->dsd2pcm, dsd2pcm_flush_size(handle->dsd2pcm))) == 0)
+    {
+        pcm_write_samples(ft, dsd2pcm_flush(handle->dsd2pcm, handle->samples));
+    }
+}
+
+static int pcm_close(scarletbook_output_format_t *ft)
+{
+    pcm_handle_t *handle = (pcm_handle_t *) ft->priv;
+    uint8_t       chunk[8];
+    int           result = 0, rewrite_header = (handle->dsd2pcm || handle->dop_packer) && !handle->raw;
+
+    if (handle->dsd2pcm)
+    {
+        pcm_finish(ft);
+    }
+    if (!handle->raw && (pcm_data_size(handle) & 1))
+    {
+        fputc(0, ft->fd);
+    }
+    if (handle->tag_size)
+    {
+        if (handle->aiff)
+            put_be32(put_id(chunk, "ID3 "), (uint32_t) handle->tag_size);
+        else
+            put_le32(put_id(chunk, "id3 "), (uint32_t) handle->tag_size);
+        fwrite(chunk, 1, sizeof(chunk), ft->fd);
+        fwrite(handle->tag, 1, handle->tag_size, ft->fd);
+        if (handle->tag_size & 1)
+            fputc(0, ft->fd);
+    }
+
+    // the sizes are known now
+    if (rewrite_header)
+    {
+        fseek(ft->fd, 0, SEEK_SET);
+        result = pcm_write_header(ft);
+    }
+
+    dsd2pcm_destroy(handle->dsd2pcm);
+    dop_packer_destroy(handle->dop_packer);
+    free(handle->samples);
+    free(handle->packed);
+    free(handle->tag);
+
+    return result;
+}
+
+scarletbook_format_handler_t const * wav_format_fn(void) 
+{
+    static scarletbook_format_handler_t handler = 
+    {
+        "Microsoft WAVE, 24 bit PCM (wav)", 
+        "wav", 
+        wav_create, 
+        pcm_write_frame,
+        pcm_close, 
+        OUTPUT_FLAG_DSD | OUTPUT_FLAG_PCM,
+        sizeof(pcm_handle_t),
+        0,
+        0
+    };
+    return &handler;
+}
+
+scarletbook_format_handler_t const * aiff_format_fn(void) 
+{
+    static scarletbook_format_handler_t handler = 
+    {
+        "Apple AIFF, 24 bit PCM (aiff)", 
+        "aiff", 
+        aiff_create, 
+        pcm_write_frame,
+        pcm_close, 
+        OUTPUT_FLAG_DSD | OUTPUT_FLAG_PCM,
+        sizeof(pcm_handle_t),
+        0,
+        0
+    };
+    return &handler;
+}
+
+scarletbook_format_handler_t const * dop_wav_format_fn(void) 
+{
+    static scarletbook_format_handler_t handler = 
+    {
+        "DSD over PCM in Microsoft WAVE (dop)", 
+        "dop", 
+        dop_wav_create, 
+        pcm_write_frame,
+        pcm_close, 
+        OUTPUT_FLAG_DSD | OUTPUT_FLAG_DOP,
+        sizeof(pcm_handle_t),
+        0,
+        0
+    };
+    return &handler;
+}
+
+scarletbook_format_handler_t const * dop_raw_format_fn(void) 
+{
+    static scarletbook_format_handler_t handler = 
+    {
+        "DSD over PCM, raw 24 bit little endian (dop_raw)", 
+        "dop_raw", 
+        dop_raw_create, 
+        pcm_write_frame,
+        pcm_close, 
+        OUTPUT_FLAG_DSD | OUTPUT_FLAG_DOP,
+        sizeof(pcm_handle_t),
+        0,
+        0
+    };
+    return &handler;
+}
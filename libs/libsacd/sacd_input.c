@@ -19,12 +19,20 @@
  *
  */
 
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
 
 #if defined(__lv2ppu__)
 #include <sys/file.h>
@@ -49,6 +57,18 @@
 #include "sacd_input.h"
 #include "sacd_pb_stream.h"
 #include "sacd_ripper.pb.h"
+#include "sacd_net_compact.h"
+
+// the protocol version spoken with sacd servers that know DISC_READ_RANGES
+#define NET_PROTOCOL_VERSION    2
+#define NET_MAX_RANGES          16
+#define NET_V2_MAX_SECTORS      2048
+#define NET_V1_MAX_SECTORS      512         // what version 1 servers read at most
+
+// request sizes of local sources, image files on fast storage like larger reads 
+// than optical drives, whose requests take long and hold up the interruption
+#define FILE_READ_LIMITS        { 64, MAX_PROCESSING_BLOCK_SIZE, 8192 }
+#define DRIVE_READ_LIMITS       { 32, MAX_PROCESSING_BLOCK_SIZE, 1024 }
 
 sacd_input_t (*sacd_input_open)         (const char *);
 int          (*sacd_input_close)        (sacd_input_t);
@@ -57,11 +77,15 @@ char *       (*sacd_input_error)        (sacd_input_t);
 int          (*sacd_input_authenticate) (sacd_input_t);
 int          (*sacd_input_decrypt)      (sacd_input_t, uint8_t *, int);
 uint32_t     (*sacd_input_total_sectors)(sacd_input_t);
+ssize_t      (*sacd_input_copy)         (sacd_input_t, int, int, int, off_t);
+ssize_t      (*sacd_input_read_ranges)  (sacd_input_t, const sacd_block_range_t *, int, int);
+void         (*sacd_input_read_limits)  (sacd_input_t, sacd_read_limits_t *);
 
 struct sacd_input_s
 {
     int                 fd;
     uint8_t            *input_buffer;
+    int                 version;            // network protocol version, 1 for old servers
 #if defined(__lv2ppu__)
     device_info_t       device_info;
 #endif
@@ -229,7 +253,7 @@ static ssize_t sacd_dev_input_read(sacd_input_t dev, int pos, int blocks, void *
 
     return (ret != 0) ? 0 : sectors_read;
 
-#else
+#elif defined(WIN32) || defined(_WIN32)
     ssize_t ret, len;
 
     ret = lseek(dev->fd, (off_t) pos * (off_t) SACD_LSN_SIZE, SEEK_SET);
@@ -266,10 +290,114 @@ static ssize_t sacd_dev_input_read(sacd_input_t dev, int pos, int blocks, void *
         len -= ret;
     }
 
+#else
+    ssize_t ret;
+    size_t  len, done = 0;
+    off_t   offset = (off_t) pos * (off_t) SACD_LSN_SIZE;
+
+    /* pread does not move a shared file position, so several threads
+     * can read from the same device at once */
+    len = (size_t) blocks * SACD_LSN_SIZE;
+
+    while (done < len)
+    {
+        ret = pread(dev->fd, (uint8_t *) buffer + done, len - done, offset + (off_t) done);
+
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        if (ret == 0)
+        {
+            /* Nothing more to read.  Return all of the whole blocks, if any. */
+            return (int) (done / SACD_LSN_SIZE);
+        }
+
+        done += ret;
+    }
+
     return blocks;
 #endif
 }
 
+/**
+ * copy blocks to out_fd at out_offset without passing them through user space,
+ * copy_file_range allows the file system to share the extents (reflinks), sendfile 
+ * is used when the source and destination can't do that
+ */
+static ssize_t sacd_dev_input_copy(sacd_input_t dev, int pos, int blocks, int out_fd, off_t out_offset)
+{
+#if defined(__linux__)
+    ssize_t ret;
+    size_t  len = (size_t) blocks * SACD_LSN_SIZE, done = 0;
+    off_t   in_offset = (off_t) pos * (off_t) SACD_LSN_SIZE;
+
+    while (done < len)
+    {
+        ret = copy_file_range(dev->fd, &in_offset, out_fd, &out_offset, len - done, 0);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;
+        done += ret;
+    }
+
+    if (done < len && lseek(out_fd, out_offset, SEEK_SET) == out_offset)
+    {
+        while (done < len)
+        {
+            ret = sendfile(out_fd, dev->fd, &in_offset, len - done);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret <= 0)
+                break;
+            done += ret;
+        }
+    }
+
+    if (done == 0)
+        return -1;
+
+    return (ssize_t) (done / SACD_LSN_SIZE);
+#else
+    return -1;
+#endif
+}
+
+/**
+ * local sources read the ranges one after the other, returns the amount of
+ * blocks read up to the first range that came up short
+ */
+static ssize_t sacd_dev_input_read_ranges(sacd_input_t dev, const sacd_block_range_t *ranges, int range_count, int flags)
+{
+    ssize_t ret, total = 0;
+    int     i;
+
+    for (i = 0; i < range_count; i++)
+    {
+        ret = sacd_dev_input_read(dev, (int) ranges[i].lsn, (int) ranges[i].count, ranges[i].buffer);
+        if (ret > 0)
+            total += ret;
+        if (ret != (ssize_t) ranges[i].count)
+            break;
+    }
+    return total;
+}
+
+static void sacd_dev_input_read_limits(sacd_input_t dev, sacd_read_limits_t *limits)
+{
+    static const sacd_read_limits_t file_limits = FILE_READ_LIMITS;
+    static const sacd_read_limits_t drive_limits = DRIVE_READ_LIMITS;
+#if defined(__lv2ppu__)
+    *limits = drive_limits;
+#else
+    struct stat file_stat;
+
+    *limits = fstat(dev->fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) ? file_limits : drive_limits;
+#endif
+}
+
 /**
  * close the SACD device and clean up.
  */
@@ -344,13 +472,6 @@ static sacd_input_t sacd_net_input_open(const char *target)
         return NULL;
     }
 
-    dev->input_buffer = (uint8_t *) malloc(MAX_PROCESSING_BLOCK_SIZE * SACD_LSN_SIZE + 1024);
-    if (dev->input_buffer == NULL)
-    {
-        fprintf(stderr, "libsacdread: Could not allocate memory.\n");
-        goto error;
-    }
-
     socket_open();
 
     socket_create(&dev->fd, AF_INET, SOCK_STREAM, 0);
@@ -371,7 +492,11 @@ static sacd_input_t sacd_net_input_open(const char *target)
 
     output = pb_ostream_from_socket(&dev->fd);
 
+    // servers that don't know the version field skip it and speak version 1
+    memset(&request, 0, sizeof(request));
     request.type = ServerRequest_Type_DISC_OPEN;
+    request.has_version = true;
+    request.version = NET_PROTOCOL_VERSION;
 
     if (!pb_encode(&output, ServerRequest_fields, &request))
     {
@@ -394,6 +519,19 @@ static sacd_input_t sacd_net_input_open(const char *target)
         goto error;
     }
 
+    // version 1 responses are decoded straight into the caller's buffer, version 2 
+    // ones hold compact records of up to a full request
+    dev->version = 1;
+    if (response.has_version && response.version >= NET_PROTOCOL_VERSION)
+    {
+        dev->input_buffer = (uint8_t *) malloc(NET_V2_MAX_SECTORS * SACD_COMPACT_RECORD_MAX);
+        if (dev->input_buffer)
+        {
+            dev->version = NET_PROTOCOL_VERSION;
+        }
+    }
+    LOG(lm_main, LOG_NOTICE, ("connected to %s, protocol version %d", target, dev->version));
+
     return dev;
 
 error:
@@ -420,6 +558,7 @@ static int sacd_net_input_close(sacd_input_t dev)
         pb_ostream_t output = pb_ostream_from_socket(&dev->fd);
         uint8_t zero = 0;
 
+        memset(&request, 0, sizeof(request));
         request.type = ServerRequest_Type_DISC_CLOSE;
         if (!pb_encode(&output, ServerRequest_fields, &request))
         {
@@ -470,6 +609,7 @@ static uint32_t sacd_net_input_total_sectors(sacd_input_t dev)
         pb_ostream_t output = pb_ostream_from_socket(&dev->fd);
         uint8_t zero = 0;
 
+        memset(&request, 0, sizeof(request));
         request.type = ServerRequest_Type_DISC_SIZE;
 
         if (!pb_encode(&output, ServerRequest_fields, &request))
@@ -494,12 +634,23 @@ static uint32_t sacd_net_input_total_sectors(sacd_input_t dev)
     }
 }
 
+static ssize_t sacd_net_input_read_ranges(sacd_input_t, const sacd_block_range_t *, int, int);
+
 static ssize_t sacd_net_input_read(sacd_input_t dev, int pos, int blocks, void *buffer)
 {
     if (!dev)
     {
         return 0;
     }
+    else if (dev->version >= NET_PROTOCOL_VERSION)
+    {
+        sacd_block_range_t range;
+
+        range.lsn = (uint32_t) pos;
+        range.count = (uint32_t) blocks;
+        range.buffer = (uint8_t *) buffer;
+        return sacd_net_input_read_ranges(dev, &range, 1, 0);
+    }
     else
     {
         uint8_t output_buf[16];
@@ -509,6 +660,7 @@ static ssize_t sacd_net_input_read(sacd_input_t dev, int pos, int blocks, void *
         pb_istream_t input = pb_istream_from_socket(&dev->fd);
         uint8_t zero = 0;
 
+        memset(&request, 0, sizeof(request));
         request.type = ServerRequest_Type_DISC_READ;
         request.sector_offset = pos;
         request.sector_count = blocks;
@@ -575,6 +727,150 @@ static ssize_t sacd_net_input_read(sacd_input_t dev, int pos, int blocks, void *
     return 0;
 }
 
+static ssize_t sacd_net_input_copy(sacd_input_t dev, int pos, int blocks, int out_fd, off_t out_offset)
+{
+    return -1;
+}
+
+// a request should cover the bandwidth-delay product of the connection, larger 
+// ones than a server takes are split into round trips that don't overlap
+static void sacd_net_input_read_limits(sacd_input_t dev, sacd_read_limits_t *limits)
+{
+    limits->min = 64;
+    limits->start = MAX_PROCESSING_BLOCK_SIZE;
+    limits->max = dev->version >= NET_PROTOCOL_VERSION ? NET_V2_MAX_SECTORS : NET_V1_MAX_SECTORS;
+}
+
+/**
+ * sends one DISC_READ_RANGES request, at most NET_MAX_RANGES ranges and
+ * NET_V2_MAX_SECTORS sectors, and expands the compact sector records into
+ * the range buffers. Returns the amount of sectors received.
+ */
+static ssize_t net_read_ranges_v2(sacd_input_t dev, const sacd_block_range_t *ranges, int range_count, int flags)
+{
+    uint8_t output_buf[256];
+    ServerRequest request;
+    ServerResponse response;
+    pb_ostream_t output = pb_ostream_from_buffer(output_buf, sizeof(output_buf));
+    pb_istream_t input = pb_istream_from_socket(&dev->fd);
+    uint8_t zero = 0;
+    const uint8_t *record;
+    size_t left, used, written;
+    ssize_t sectors = 0;
+    uint32_t j;
+    int i;
+
+    memset(&request, 0, sizeof(request));
+    request.type = ServerRequest_Type_DISC_READ_RANGES;
+    for (i = 0; i < range_count; i++)
+    {
+        request.range_offset[i] = ranges[i].lsn;
+        request.range_count[i] = ranges[i].count;
+    }
+    request.range_offset_count = request.range_count_count = range_count;
+    request.has_flags = true;
+    request.flags = ServerRequest_Flags_COMPACT;
+    if (flags & SACD_READ_AUDIO_ONLY)
+        request.flags |= ServerRequest_Flags_AUDIO_ONLY;
+
+    if (!pb_encode(&output, ServerRequest_fields, &request) || !pb_write(&output, &zero, 1))
+        return 0;
+
+    if (socket_send(&dev->fd, (char *) output_buf, output.bytes_written, &written, 0, 0) != IO_DONE || written != output.bytes_written)
+        return 0;
+
+    memset(&response, 0, sizeof(response));
+    response.data.bytes = dev->input_buffer;
+    if (!pb_decode(&input, ServerResponse_fields, &response))
+        return 0;
+
+    if (response.type != ServerResponse_Type_DISC_READ_RANGES || !response.has_data)
+        return 0;
+
+    record = response.data.bytes;
+    left = response.data.size;
+    for (i = 0; i < range_count; i++)
+    {
+        for (j = 0; j < ranges[i].count && sectors < response.result; j++)
+        {
+            used = sacd_expand_sector(record, left, ranges[i].buffer + (size_t) j * SACD_LSN_SIZE);
+            if (used == 0)
+            {
+                LOG(lm_main, LOG_ERROR, ("malformed sector record in read response"));
+                return sectors;
+            }
+            record += used;
+            left -= used;
+            sectors++;
+        }
+    }
+    return sectors;
+}
+
+/**
+ * reads several ranges in as few round trips as possible, version 1 servers
+ * get one DISC_READ per range. Returns the amount of blocks read up to the
+ * first range that came up short.
+ */
+static ssize_t sacd_net_input_read_ranges(sacd_input_t dev, const sacd_block_range_t *ranges, int range_count, int flags)
+{
+    sacd_block_range_t batch[NET_MAX_RANGES];
+    uint32_t done, sectors, count;
+    ssize_t ret, total = 0;
+    int i, batch_count;
+
+    if (!dev)
+        return 0;
+
+    if (dev->version < NET_PROTOCOL_VERSION)
+    {
+        for (i = 0; i < range_count; i++)
+        {
+            for (done = 0; done < ranges[i].count; done += count)
+            {
+                count = min(ranges[i].count - done, (uint32_t) NET_V1_MAX_SECTORS);
+                ret = sacd_net_input_read(dev, (int) (ranges[i].lsn + done), (int) count, ranges[i].buffer + (size_t) done * SACD_LSN_SIZE);
+                if (ret > 0)
+                    total += ret;
+                if (ret != (ssize_t) count)
+                    return total;
+            }
+        }
+        return total;
+    }
+
+    // as many ranges per request as fit, long ranges are split up
+    i = 0;
+    done = 0;
+    while (i < range_count)
+    {
+        batch_count = 0;
+        sectors = 0;
+        while (i < range_count && batch_count < NET_MAX_RANGES && sectors < NET_V2_MAX_SECTORS)
+        {
+            count = min(ranges[i].count - done, NET_V2_MAX_SECTORS - sectors);
+            batch[batch_count].lsn = ranges[i].lsn + done;
+            batch[batch_count].count = count;
+            batch[batch_count].buffer = ranges[i].buffer + (size_t) done * SACD_LSN_SIZE;
+            batch_count++;
+            sectors += count;
+            done += count;
+            if (done == ranges[i].count)
+            {
+                done = 0;
+                i++;
+            }
+        }
+
+        ret = net_read_ranges_v2(dev, batch, batch_count, flags);
+        if (ret > 0)
+            total += ret;
+        if (ret != (ssize_t) sectors)
+            break;
+    }
+    return total;
+}
+
 /**
  * Setup read functions with either network or file access
  */
@@ -595,8 +891,12 @@ int sacd_input_setup(const char* path)
         }
     }
 
+    // only switch backends when needed, readers opened earlier may still be using the current one
     if (net_conn)
     {
+        if (sacd_input_open == sacd_net_input_open)
+            return 1;
+
         sacd_input_open = sacd_net_input_open;
         sacd_input_close = sacd_net_input_close;
         sacd_input_read = sacd_net_input_read;
@@ -604,10 +904,16 @@ int sacd_input_setup(const char* path)
         sacd_input_authenticate  = sacd_dev_input_authenticate;
         sacd_input_decrypt = sacd_dev_input_decrypt;
         sacd_input_total_sectors = sacd_net_input_total_sectors;
+        sacd_input_copy = sacd_net_input_copy;
+        sacd_input_read_ranges = sacd_net_input_read_ranges;
+        sacd_input_read_limits = sacd_net_input_read_limits;
 
         return 1;
     } 
 
+    if (sacd_input_open == sacd_dev_input_open)
+        return 0;
+
     sacd_input_open = sacd_dev_input_open;
     sacd_input_close = sacd_dev_input_close;
     sacd_input_read = sacd_dev_input_read;
@@ -615,6 +921,9 @@ int sacd_input_setup(const char* path)
     sacd_input_authenticate  = sacd_dev_input_authenticate;
     sacd_input_decrypt = sacd_dev_input_decrypt;
     sacd_input_total_sectors = sacd_dev_input_total_sectors;
+    sacd_input_copy = sacd_dev_input_copy;
+    sacd_input_read_ranges = sacd_dev_input_read_ranges;
+    sacd_input_read_limits = sacd_dev_input_read_limits;
 
     return 0;
 } 
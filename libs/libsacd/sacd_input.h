@@ -48,6 +48,29 @@
 
 typedef struct sacd_input_s * sacd_input_t;
 
+/* one of the ranges of a vectored read */
+typedef struct
+{
+    uint32_t            lsn;
+    uint32_t            count;
+    uint8_t            *buffer;
+} sacd_block_range_t;
+
+/* request sizes in blocks that suit a source, see sacd_get_read_limits */
+typedef struct
+{
+    uint32_t            min;
+    uint32_t            start;              // what to begin with before anything has been measured
+    uint32_t            max;
+} sacd_read_limits_t;
+
+enum
+{
+    // the sectors belong to a track area and only their audio packets are
+    // needed, supplementary and padding packets may be returned as zeros
+    SACD_READ_AUDIO_ONLY = 1
+};
+
 extern sacd_input_t (*sacd_input_open)         (const char *);
 extern int          (*sacd_input_close)        (sacd_input_t);
 extern ssize_t      (*sacd_input_read)         (sacd_input_t, int, int, void *);
@@ -55,6 +78,9 @@ extern char *       (*sacd_input_error)        (sacd_input_t);
 extern int          (*sacd_input_authenticate) (sacd_input_t);
 extern int          (*sacd_input_decrypt)      (sacd_input_t, uint8_t *, int);
 extern uint32_t     (*sacd_input_total_sectors)(sacd_input_t);
+extern ssize_t      (*sacd_input_copy)         (sacd_input_t, int, int, int, off_t);
+extern ssize_t      (*sacd_input_read_ranges)  (sacd_input_t, const sacd_block_range_t *, int, int);
+extern void         (*sacd_input_read_limits)  (sacd_input_t, sacd_read_limits_t *);
 
 int sacd_input_setup(const char *); 
 
@@ -0,0 +1,156 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <string.h>
+
+#include "scarletbook.h"
+#include "sacd_net_compact.h"
+
+#define RECORD_AUDIO_ONLY    0x8000
+
+/* returns the size of the headers of an audio sector, 0 if the headers
+   and packets don't fit into "available" bytes */
+static size_t audio_headers_size(const uint8_t *sector, size_t available)
+{
+    size_t  size, total;
+    int     i, packet_count, frame_count, dst_encoded;
+
+    packet_count = sector[0] >> 5;
+    frame_count = (sector[0] >> 2) & 7;
+    dst_encoded = sector[0] & 1;
+
+    size = AUDIO_SECTOR_HEADER_SIZE + packet_count * AUDIO_PACKET_INFO_SIZE
+         + frame_count * (dst_encoded ? AUDIO_FRAME_INFO_SIZE : AUDIO_FRAME_INFO_SIZE - 1);
+    if (size > available)
+        return 0;
+
+    total = size;
+    for (i = 0; i < packet_count; i++)
+    {
+        const uint8_t *info = sector + AUDIO_SECTOR_HEADER_SIZE + i * AUDIO_PACKET_INFO_SIZE;
+        total += (info[0] & 7) << 8 | info[1];
+    }
+    return total <= SACD_LSN_SIZE ? size : 0;
+}
+
+static inline int packet_type(const uint8_t *sector, int i)
+{
+    return (sector[AUDIO_SECTOR_HEADER_SIZE + i * AUDIO_PACKET_INFO_SIZE] >> 3) & 7;
+}
+
+static inline size_t packet_length(const uint8_t *sector, int i)
+{
+    const uint8_t *info = sector + AUDIO_SECTOR_HEADER_SIZE + i * AUDIO_PACKET_INFO_SIZE;
+    return (info[0] & 7) << 8 | info[1];
+}
+
+size_t sacd_compact_sector(const uint8_t *sector, int audio_only, uint8_t *record)
+{
+    size_t length = SACD_LSN_SIZE;
+    size_t headers, pos, audio_length, len;
+    int    i;
+
+    // zero padding at the end of a sector and all-zero sectors are left out
+    while (length > 0 && sector[length - 1] == 0)
+        length--;
+
+    if (audio_only && (headers = audio_headers_size(sector, SACD_LSN_SIZE)) != 0)
+    {
+        audio_length = headers;
+        for (i = 0; i < sector[0] >> 5; i++)
+        {
+            if (packet_type(sector, i) == DATA_TYPE_AUDIO)
+                audio_length += packet_length(sector, i);
+        }
+
+        if (audio_length < length)
+        {
+            memcpy(record + 2, sector, headers);
+            audio_length = headers;
+            pos = headers;
+            for (i = 0; i < sector[0] >> 5; i++)
+            {
+                len = packet_length(sector, i);
+                if (packet_type(sector, i) == DATA_TYPE_AUDIO)
+                {
+                    memcpy(record + 2 + audio_length, sector + pos, len);
+                    audio_length += len;
+                }
+                pos += len;
+            }
+            record[0] = (uint8_t) ((RECORD_AUDIO_ONLY | audio_length) >> 8);
+            record[1] = (uint8_t) audio_length;
+            return 2 + audio_length;
+        }
+    }
+
+    record[0] = (uint8_t) (length >> 8);
+    record[1] = (uint8_t) length;
+    memcpy(record + 2, sector, length);
+    return 2 + length;
+}
+
+size_t sacd_expand_sector(const uint8_t *record, size_t available, uint8_t *sector)
+{
+    const uint8_t *data = record + 2;
+    size_t         length, headers, pos, used, len;
+    int            i;
+
+    if (available < 2)
+        return 0;
+    length = (record[0] << 8 | record[1]) & ~RECORD_AUDIO_ONLY;
+    if (length > SACD_LSN_SIZE || length > available - 2)
+        return 0;
+
+    if (!(record[0] & (RECORD_AUDIO_ONLY >> 8)))
+    {
+        memcpy(sector, data, length);
+        memset(sector + length, 0, SACD_LSN_SIZE - length);
+        return 2 + length;
+    }
+
+    // put the audio packets back in place, the other packets become zeros
+    if (length == 0 || (headers = audio_headers_size(data, length)) == 0)
+        return 0;
+    memcpy(sector, data, headers);
+    pos = used = headers;
+    for (i = 0; i < data[0] >> 5; i++)
+    {
+        len = packet_length(data, i);
+        if (packet_type(data, i) == DATA_TYPE_AUDIO)
+        {
+            if (used + len > length)
+                return 0;
+            memcpy(sector + pos, data + used, len);
+            used += len;
+        }
+        else
+        {
+            memset(sector + pos, 0, len);
+        }
+        pos += len;
+    }
+    if (used != length)
+        return 0;
+    memset(sector + pos, 0, SACD_LSN_SIZE - pos);
+    return 2 + length;
+}
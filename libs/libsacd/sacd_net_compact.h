@@ -0,0 +1,46 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef SACD_NET_COMPACT_H_INCLUDED
+#define SACD_NET_COMPACT_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* a record is never longer than the sector plus its 16 bit length */
+#define SACD_COMPACT_RECORD_MAX    (2 + 2048)
+
+/**
+ * Writes the COMPACT record of one sector (see ServerResponse in
+ * sacd_ripper.proto) to "record" and returns its size. With "audio_only"
+ * the sector is taken for an audio sector and only its audio packets are
+ * kept, unless that doesn't save anything.
+ */
+size_t sacd_compact_sector(const uint8_t *sector, int audio_only, uint8_t *record);
+
+/**
+ * Restores a sector from the record at the start of "record", returns the
+ * size of the record or 0 when it is malformed.
+ */
+size_t sacd_expand_sector(const uint8_t *record, size_t available, uint8_t *sector);
+
+#endif /* SACD_NET_COMPACT_H_INCLUDED */
@@ -48,7 +48,8 @@ static bool read_callback(pb_istream_t *stream, uint8_t *buf, size_t count)
         /* Well, this is a really inefficient way to skip input. */
         /* It is only used when there are unknown fields. */
         char dummy;
-        while (count-- && socket_recv(socket, &dummy, 1, &got, MSG_WAITALL, 0) == IO_DONE && got == 1);
+        while (count && socket_recv(socket, &dummy, 1, &got, MSG_WAITALL, 0) == IO_DONE && got == 1)
+            count--;
         return count == 0;
     }
     
@@ -0,0 +1,131 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <string.h>
+
+#include <logging.h>
+
+#include "sacd_read_tuner.h"
+
+#define WINDOW_READS            4
+#define WINDOW_NANOSECONDS      50000000ULL     // 50ms
+#define MAX_READ_NANOSECONDS    500000000ULL    // a single read
+#define PROBE_WINDOWS           64              // settled windows between probes
+#define PROBE_GAIN              1.10            // a larger or smaller size has to be 10% faster
+
+static uint32_t step(sacd_read_tuner_t *tuner, int direction)
+{
+    if (direction > 0)
+        return tuner->size > tuner->limits.max / 2 ? tuner->limits.max : tuner->size * 2;
+    else
+        return tuner->size / 2 < tuner->limits.min ? tuner->limits.min : tuner->size / 2;
+}
+
+static void resize(sacd_read_tuner_t *tuner, uint32_t size)
+{
+    if (size != tuner->size)
+    {
+        LOG(lm_main, LOG_DEBUG, ("read size %u -> %u blocks", tuner->size, size));
+        tuner->size = size;
+    }
+}
+
+void sacd_read_tuner_init(sacd_read_tuner_t *tuner, const sacd_read_limits_t *limits)
+{
+    memset(tuner, 0, sizeof(sacd_read_tuner_t));
+    tuner->limits = *limits;
+    if (tuner->limits.min == 0)
+        tuner->limits.min = 1;
+    if (tuner->limits.max < tuner->limits.min)
+        tuner->limits.max = tuner->limits.min;
+    tuner->size = tuner->limits.start;
+    if (tuner->size < tuner->limits.min)
+        tuner->size = tuner->limits.min;
+    if (tuner->size > tuner->limits.max)
+        tuner->size = tuner->limits.max;
+
+    // probe upwards from the first window on
+    tuner->next_direction = 1;
+    tuner->settled = PROBE_WINDOWS;
+}
+
+uint32_t sacd_read_tuner_size(sacd_read_tuner_t *tuner)
+{
+    return tuner->size;
+}
+
+void sacd_read_tuner_update(sacd_read_tuner_t *tuner, uint32_t blocks, uint64_t nanoseconds)
+{
+    double rate;
+    uint32_t next;
+
+    if (blocks < tuner->size)
+        return;
+
+    if (nanoseconds > MAX_READ_NANOSECONDS && tuner->size > tuner->limits.min)
+    {
+        resize(tuner, step(tuner, -1));
+        tuner->direction = 0;
+        tuner->settled = 0;
+        tuner->reads = 0;
+        tuner->blocks = tuner->nanoseconds = 0;
+        return;
+    }
+
+    tuner->reads++;
+    tuner->blocks += blocks;
+    tuner->nanoseconds += nanoseconds;
+    if (tuner->reads < WINDOW_READS || tuner->nanoseconds < WINDOW_NANOSECONDS)
+        return;
+
+    rate = (double) tuner->blocks / (double) tuner->nanoseconds;
+    tuner->reads = 0;
+    tuner->blocks = tuner->nanoseconds = 0;
+
+    if (tuner->direction == 0)
+    {
+        tuner->best_size = tuner->size;
+        tuner->best_rate = rate;
+        if (++tuner->settled < PROBE_WINDOWS)
+            return;
+
+        tuner->settled = 0;
+        tuner->direction = tuner->next_direction;
+        tuner->next_direction = -tuner->next_direction;
+    }
+    else if (rate > tuner->best_rate * PROBE_GAIN)
+    {
+        tuner->best_size = tuner->size;
+        tuner->best_rate = rate;
+    }
+    else
+    {
+        resize(tuner, tuner->best_size);
+        tuner->direction = 0;
+        return;
+    }
+
+    next = step(tuner, tuner->direction);
+    if (next == tuner->size)
+        tuner->direction = 0;
+    else
+        resize(tuner, next);
+}
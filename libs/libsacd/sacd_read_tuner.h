@@ -0,0 +1,77 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef SACD_READ_TUNER_H_INCLUDED
+#define SACD_READ_TUNER_H_INCLUDED
+
+#include <stdint.h>
+
+#include "sacd_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Picks the amount of blocks to request per read.
+ *
+ * Starting at what the source suggests, the size is doubled (or halved) for as
+ * long as that raises the throughput by a good margin, and then stays at the 
+ * best size found. Every so often the neighbouring sizes are tried again, in
+ * case the source changed (a drive spinning up, a busier network). Reads that
+ * take too long are made smaller right away, a stalled request holds up the 
+ * whole pipeline and any interruption.
+ *
+ * A tuner belongs to one reading thread.
+ */
+typedef struct
+{
+    sacd_read_limits_t  limits;
+    uint32_t            size;
+    int                 direction;          // of the running probe, 0 when settled
+    int                 next_direction;     // of the next probe
+    uint32_t            settled;            // windows since the last probe
+    uint32_t            best_size;
+    double              best_rate;          // blocks per nanosecond
+
+    // the measuring window
+    uint32_t            reads;
+    uint64_t            blocks;
+    uint64_t            nanoseconds;
+} sacd_read_tuner_t;
+
+void sacd_read_tuner_init(sacd_read_tuner_t *, const sacd_read_limits_t *);
+
+/**
+ * The amount of blocks to read next.
+ */
+uint32_t sacd_read_tuner_size(sacd_read_tuner_t *);
+
+/**
+ * Accounts a read of "blocks" that took "nanoseconds". Reads shorter than the 
+ * current size (the end of a track) and failed ones are better left out.
+ */
+void sacd_read_tuner_update(sacd_read_tuner_t *, uint32_t blocks, uint64_t nanoseconds);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* SACD_READ_TUNER_H_INCLUDED */
@@ -43,11 +43,13 @@
 
 #include "sacd_input.h"
 #include "sacd_reader.h"
+#include "scarletbook.h"
 
 struct sacd_reader_s
 {
     /* Basic information. */
     int          is_image_file;
+    int          is_network;
 
     /* Information required for an image file. */
     sacd_input_t dev;
@@ -60,8 +62,9 @@ static sacd_reader_t *sacd_open_image_file(const char *location)
 {
     sacd_reader_t *sacd;
     sacd_input_t  dev;
+    int           is_network;
 
-    sacd_input_setup(location);
+    is_network = sacd_input_setup(location);
 
     dev = sacd_input_open(location);
     if (!dev)
@@ -77,6 +80,7 @@ static sacd_reader_t *sacd_open_image_file(const char *location)
         return NULL;
     }
     sacd->is_image_file = 1;
+    sacd->is_network    = is_network;
     sacd->dev           = dev;
 
     return sacd;
@@ -383,6 +387,27 @@ ssize_t sacd_read_block_raw(sacd_reader_t *sacd, uint32_t lb_number,
     return ret;
 }
 
+ssize_t sacd_read_block_ranges(sacd_reader_t *sacd, const sacd_block_range_t *ranges,
+                               int range_count, int flags)
+{
+    if (!sacd->dev)
+    {
+        fprintf(stderr, "libsacdread: Fatal error in block read.\n");
+        return 0;
+    }
+
+    return sacd_input_read_ranges(sacd->dev, ranges, range_count, flags);
+}
+
+ssize_t sacd_copy_block_raw(sacd_reader_t *sacd, uint32_t lb_number,
+                            size_t block_count, int out_fd, off_t out_offset)
+{
+    if (!sacd->dev)
+        return -1;
+
+    return sacd_input_copy(sacd->dev, (int) lb_number, (int) block_count, out_fd, out_offset);
+}
+
 int sacd_authenticate(sacd_reader_t *sacd)
 {
     if (!sacd->dev)
@@ -407,3 +432,18 @@ uint32_t sacd_get_total_sectors(sacd_reader_t *sacd)
     return sacd_input_total_sectors(sacd->dev);
 }
 
+void sacd_get_read_limits(sacd_reader_t *sacd, sacd_read_limits_t *limits)
+{
+    limits->min = limits->start = limits->max = MAX_PROCESSING_BLOCK_SIZE;
+    if (sacd->dev)
+        sacd_input_read_limits(sacd->dev, limits);
+}
+
+int sacd_supports_concurrent_read(sacd_reader_t *sacd)
+{
+#if defined(__lv2ppu__) || defined(WIN32) || defined(_WIN32)
+    return 0;
+#else
+    return sacd->dev && !sacd->is_network;
+#endif
+}
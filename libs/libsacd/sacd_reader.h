@@ -81,6 +81,34 @@ void sacd_close(sacd_reader_t *);
  */
 ssize_t sacd_read_block_raw(sacd_reader_t *, uint32_t, size_t, unsigned char *);
 
+/**
+ * Reads several ranges of blocks, each into its own buffer. Network sources
+ * fetch them with as few requests as possible.
+ *
+ * @param sacd A read handle that should have been returned by sacd_open.
+ * @param ranges The ranges to read.
+ * @param range_count The amount of ranges.
+ * @param flags SACD_READ_AUDIO_ONLY when the blocks are audio sectors of a
+ *              track area and only their audio packets are used.
+ *
+ * Returns the amount of blocks read up to the first range that came up short.
+ */
+ssize_t sacd_read_block_ranges(sacd_reader_t *, const sacd_block_range_t *, int, int);
+
+/**
+ * Copies raw blocks straight into a file descriptor without passing them through 
+ * user space. Only local inputs on platforms that don't need decryption support this.
+ *
+ * @param sacd A read handle that should have been returned by sacd_open.
+ * @param lb_number The block number from the start of the disc.
+ * @param block_count The amount of blocks to copy.
+ * @param out_fd The file descriptor to write to.
+ * @param out_offset The file offset to write to, the position of out_fd is undefined afterwards.
+ *
+ * Returns the amount of blocks copied, or -1 when nothing could be copied.
+ */
+ssize_t sacd_copy_block_raw(sacd_reader_t *, uint32_t, size_t, int, off_t);
+
 /**
  * Decrypts audio sectors, only available on PS3
  */
@@ -96,6 +124,18 @@ int sacd_authenticate(sacd_reader_t *);
  */
 uint32_t sacd_get_total_sectors(sacd_reader_t *);
 
+/**
+ * The request sizes (in blocks) that suit the source, from its backend: image files, 
+ * optical drives and network servers each have their own range.
+ */
+void sacd_get_read_limits(sacd_reader_t *, sacd_read_limits_t *);
+
+/**
+ * returns 1 when blocks can be read from several threads at the same time,
+ * i.e. for local image files and devices (not for network sources)
+ */
+int sacd_supports_concurrent_read(sacd_reader_t *);
+
 #ifdef __cplusplus
 };
 #endif
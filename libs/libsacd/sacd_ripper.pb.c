@@ -3,9 +3,10 @@
 
 const uint32_t ServerRequest_sector_offset_default = 0;
 const uint32_t ServerRequest_sector_count_default = 0;
+const uint32_t DaemonRequest_formats_default = 0;
 
 
-const pb_field_t ServerRequest_fields[4] = {
+const pb_field_t ServerRequest_fields[8] = {
     {1, PB_HTYPE_REQUIRED | PB_LTYPE_VARINT,
     offsetof(ServerRequest, type), 0,
     pb_membersize(ServerRequest, type), 0, 0},
@@ -20,10 +21,32 @@ const pb_field_t ServerRequest_fields[4] = {
     pb_membersize(ServerRequest, sector_count), 0,
     &ServerRequest_sector_count_default},
 
+    {4, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(ServerRequest, version, sector_count),
+    pb_delta(ServerRequest, has_version, version),
+    pb_membersize(ServerRequest, version), 0, 0},
+
+    {5, PB_HTYPE_ARRAY | PB_LTYPE_VARINT,
+    pb_delta_end(ServerRequest, range_offset, version),
+    pb_delta(ServerRequest, range_offset_count, range_offset),
+    pb_membersize(ServerRequest, range_offset[0]),
+    pb_arraysize(ServerRequest, range_offset), 0},
+
+    {6, PB_HTYPE_ARRAY | PB_LTYPE_VARINT,
+    pb_delta_end(ServerRequest, range_count, range_offset),
+    pb_delta(ServerRequest, range_count_count, range_count),
+    pb_membersize(ServerRequest, range_count[0]),
+    pb_arraysize(ServerRequest, range_count), 0},
+
+    {7, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(ServerRequest, flags, range_count),
+    pb_delta(ServerRequest, has_flags, flags),
+    pb_membersize(ServerRequest, flags), 0, 0},
+
     PB_LAST_FIELD
 };
 
-const pb_field_t ServerResponse_fields[4] = {
+const pb_field_t ServerResponse_fields[5] = {
     {1, PB_HTYPE_REQUIRED | PB_LTYPE_VARINT,
     offsetof(ServerResponse, type), 0,
     pb_membersize(ServerResponse, type), 0, 0},
@@ -32,11 +55,102 @@ const pb_field_t ServerResponse_fields[4] = {
     pb_delta_end(ServerResponse, result, type), 0,
     pb_membersize(ServerResponse, result), 0, 0},
 
+    {4, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(ServerResponse, version, result),
+    pb_delta(ServerResponse, has_version, version),
+    pb_membersize(ServerResponse, version), 0, 0},
+
     {3, PB_HTYPE_OPTIONAL | PB_LTYPE_BYTES,
-    pb_delta_end(ServerResponse, data, result),
+    pb_delta_end(ServerResponse, data, version),
     pb_delta(ServerResponse, has_data, data),
-    512 * 2048, 0, 0},
+    2048 * (2048 + 2), 0, 0},
+
+    PB_LAST_FIELD
+};
+
+
+const pb_field_t DaemonRequest_fields[11] = {
+    {1, PB_HTYPE_REQUIRED | PB_LTYPE_VARINT,
+    offsetof(DaemonRequest, type), 0,
+    pb_membersize(DaemonRequest, type), 0, 0},
+
+    {2, PB_HTYPE_OPTIONAL | PB_LTYPE_STRING,
+    pb_delta_end(DaemonRequest, input, type),
+    pb_delta(DaemonRequest, has_input, input),
+    pb_membersize(DaemonRequest, input), 0, 0},
+
+    {3, PB_HTYPE_OPTIONAL | PB_LTYPE_STRING,
+    pb_delta_end(DaemonRequest, output_dir, input),
+    pb_delta(DaemonRequest, has_output_dir, output_dir),
+    pb_membersize(DaemonRequest, output_dir), 0, 0},
+
+    {4, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(DaemonRequest, formats, output_dir),
+    pb_delta(DaemonRequest, has_formats, formats),
+    pb_membersize(DaemonRequest, formats), 0,
+    &DaemonRequest_formats_default},
+
+    {5, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(DaemonRequest, two_channel, formats),
+    pb_delta(DaemonRequest, has_two_channel, two_channel),
+    pb_membersize(DaemonRequest, two_channel), 0, 0},
+
+    {6, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(DaemonRequest, multi_channel, two_channel),
+    pb_delta(DaemonRequest, has_multi_channel, multi_channel),
+    pb_membersize(DaemonRequest, multi_channel), 0, 0},
+
+    {7, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(DaemonRequest, convert_dst, multi_channel),
+    pb_delta(DaemonRequest, has_convert_dst, convert_dst),
+    pb_membersize(DaemonRequest, convert_dst), 0, 0},
+
+    {8, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(DaemonRequest, dsf_nopad, convert_dst),
+    pb_delta(DaemonRequest, has_dsf_nopad, dsf_nopad),
+    pb_membersize(DaemonRequest, dsf_nopad), 0, 0},
+
+    {9, PB_HTYPE_OPTIONAL | PB_LTYPE_STRING,
+    pb_delta_end(DaemonRequest, tracks, dsf_nopad),
+    pb_delta(DaemonRequest, has_tracks, tracks),
+    pb_membersize(DaemonRequest, tracks), 0, 0},
+
+    {10, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(DaemonRequest, job_id, tracks),
+    pb_delta(DaemonRequest, has_job_id, job_id),
+    pb_membersize(DaemonRequest, job_id), 0, 0},
 
     PB_LAST_FIELD
 };
 
+const pb_field_t DaemonEvent_fields[7] = {
+    {1, PB_HTYPE_REQUIRED | PB_LTYPE_VARINT,
+    offsetof(DaemonEvent, type), 0,
+    pb_membersize(DaemonEvent, type), 0, 0},
+
+    {2, PB_HTYPE_REQUIRED | PB_LTYPE_VARINT,
+    pb_delta_end(DaemonEvent, job_id, type), 0,
+    pb_membersize(DaemonEvent, job_id), 0, 0},
+
+    {3, PB_HTYPE_OPTIONAL | PB_LTYPE_STRING,
+    pb_delta_end(DaemonEvent, path, job_id),
+    pb_delta(DaemonEvent, has_path, path),
+    pb_membersize(DaemonEvent, path), 0, 0},
+
+    {4, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(DaemonEvent, current, path),
+    pb_delta(DaemonEvent, has_current, current),
+    pb_membersize(DaemonEvent, current), 0, 0},
+
+    {5, PB_HTYPE_OPTIONAL | PB_LTYPE_VARINT,
+    pb_delta_end(DaemonEvent, total, current),
+    pb_delta(DaemonEvent, has_total, total),
+    pb_membersize(DaemonEvent, total), 0, 0},
+
+    {6, PB_HTYPE_OPTIONAL | PB_LTYPE_STRING,
+    pb_delta_end(DaemonEvent, message, total),
+    pb_delta(DaemonEvent, has_message, message),
+    pb_membersize(DaemonEvent, message), 0, 0},
+
+    PB_LAST_FIELD
+};
@@ -7,21 +7,64 @@ typedef enum {
     ServerRequest_Type_DISC_OPEN = 1,
     ServerRequest_Type_DISC_CLOSE = 2,
     ServerRequest_Type_DISC_READ = 3,
-    ServerRequest_Type_DISC_SIZE = 4
+    ServerRequest_Type_DISC_SIZE = 4,
+    ServerRequest_Type_DISC_READ_RANGES = 5
 } ServerRequest_Type;
 
+typedef enum {
+    ServerRequest_Flags_COMPACT = 1,
+    ServerRequest_Flags_AUDIO_ONLY = 2
+} ServerRequest_Flags;
+
 typedef enum {
     ServerResponse_Type_DISC_OPENED = 1,
     ServerResponse_Type_DISC_CLOSED = 2,
     ServerResponse_Type_DISC_READ = 3,
-    ServerResponse_Type_DISC_SIZE = 4
+    ServerResponse_Type_DISC_SIZE = 4,
+    ServerResponse_Type_DISC_READ_RANGES = 5
 } ServerResponse_Type;
 
+typedef enum {
+    DaemonRequest_Type_JOB_SUBMIT = 1,
+    DaemonRequest_Type_JOB_CANCEL = 2,
+    DaemonRequest_Type_SHUTDOWN = 3
+} DaemonRequest_Type;
+
+typedef enum {
+    DaemonRequest_Format_DSF = 1,
+    DaemonRequest_Format_DSDIFF = 2,
+    DaemonRequest_Format_DSDIFF_EDIT_MASTER = 4,
+    DaemonRequest_Format_ISO = 8,
+    DaemonRequest_Format_CUE_SHEET = 16,
+    DaemonRequest_Format_WAV = 32,
+    DaemonRequest_Format_AIFF = 64,
+    DaemonRequest_Format_DOP = 128,
+    DaemonRequest_Format_DOP_RAW = 256
+} DaemonRequest_Format;
+
+typedef enum {
+    DaemonEvent_Type_JOB_QUEUED = 1,
+    DaemonEvent_Type_JOB_STARTED = 2,
+    DaemonEvent_Type_TRACK_STARTED = 3,
+    DaemonEvent_Type_JOB_PROGRESS = 4,
+    DaemonEvent_Type_JOB_FINISHED = 5,
+    DaemonEvent_Type_JOB_FAILED = 6,
+    DaemonEvent_Type_SHUTTING_DOWN = 7
+} DaemonEvent_Type;
+
 /* Struct definitions */
 typedef struct {
     ServerRequest_Type type;
     uint32_t sector_offset;
     uint32_t sector_count;
+    bool has_version;
+    uint32_t version;
+    size_t range_offset_count;
+    uint32_t range_offset[16];
+    size_t range_count_count;
+    uint32_t range_count[16];
+    bool has_flags;
+    uint32_t flags;
 } ServerRequest;
 
 typedef struct {
@@ -32,16 +75,56 @@ typedef struct {
 typedef struct {
     ServerResponse_Type type;
     int64_t result;
+    bool has_version;
+    uint32_t version;
     bool has_data;
     ServerResponse_data_t data;
 } ServerResponse;
 
+typedef struct {
+    DaemonRequest_Type type;
+    bool has_input;
+    char input[1024];
+    bool has_output_dir;
+    char output_dir[1024];
+    bool has_formats;
+    uint32_t formats;
+    bool has_two_channel;
+    bool two_channel;
+    bool has_multi_channel;
+    bool multi_channel;
+    bool has_convert_dst;
+    bool convert_dst;
+    bool has_dsf_nopad;
+    bool dsf_nopad;
+    bool has_tracks;
+    char tracks[1024];
+    bool has_job_id;
+    uint32_t job_id;
+} DaemonRequest;
+
+typedef struct {
+    DaemonEvent_Type type;
+    uint32_t job_id;
+    bool has_path;
+    char path[1024];
+    bool has_current;
+    uint32_t current;
+    bool has_total;
+    uint32_t total;
+    bool has_message;
+    char message[256];
+} DaemonEvent;
+
 /* Default values for struct fields */
 extern const uint32_t ServerRequest_sector_offset_default;
 extern const uint32_t ServerRequest_sector_count_default;
+extern const uint32_t DaemonRequest_formats_default;
 
 /* Struct field encoding specification for nanopb */
-extern const pb_field_t ServerRequest_fields[4];
-extern const pb_field_t ServerResponse_fields[4];
+extern const pb_field_t ServerRequest_fields[8];
+extern const pb_field_t ServerResponse_fields[5];
+extern const pb_field_t DaemonRequest_fields[11];
+extern const pb_field_t DaemonEvent_fields[7];
 
 #endif
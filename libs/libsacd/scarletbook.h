@@ -65,13 +65,14 @@
 #define MAX_DST_SIZE                   (1024 * 64)
 #define SAMPLES_PER_FRAME              588
 #define FRAME_SIZE_64                 (SAMPLES_PER_FRAME * 64 / 8)
+#define DSD_SILENCE_BYTE              0x69
 #define SUPPORTED_VERSION_MAJOR        1
 #define SUPPORTED_VERSION_MINOR        20
 
 #define MAX_GENRE_COUNT                29
 #define MAX_CATEGORY_COUNT             3
 
-#define MAX_PROCESSING_BLOCK_SIZE      512
+#define MAX_PROCESSING_BLOCK_SIZE      512                 // blocks per read until the read tuner knows better
 
 enum
 {
@@ -567,6 +568,7 @@ typedef struct scarletbook_audio_frame_t
     int                 channel_count;
 
     int                 dst_encoded;
+    int                 time_code;                                        // frame count, see TIME_FRAMECOUNT
 } 
 scarletbook_audio_frame_t;
 
@@ -584,9 +586,17 @@ typedef struct
     int                        area_count;
     scarletbook_area_t         area[2];
 
+    uint64_t                   toc_fingerprint;                           // hash over the raw Master and Area TOCs
+
     scarletbook_audio_frame_t  frame;
     audio_sector_t             audio_sector;
     int                        packet_info_idx;
+
+    // frames lost to unreadable sectors, see scarletbook_process_lost_sectors
+    int                        lost_sectors;                              // since the last frame handed on
+    int                        next_time_code;                            // of the frame after that one, -1 if unknown
+    int                        end_time_code;                             // of the frame after the track, -1 if unknown
+    int                        area_channel_count;
 } 
 scarletbook_handle_t;
 
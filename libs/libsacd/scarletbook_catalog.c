@@ -0,0 +1,754 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <logging.h>
+
+#include "scarletbook.h"
+#include "scarletbook_helpers.h"
+#include "scarletbook_catalog.h"
+
+#define CATALOG_INDEX_MAGIC     "SACDCATI"
+#define CATALOG_LOG_MAGIC       "SACDCATL"
+#define CATALOG_VERSION         1
+#define CATALOG_HEADER_SIZE     16
+#define CATALOG_NULL_STRING     0xffff
+#define CATALOG_MIN_BUCKETS     1024
+
+struct catalog_t
+{
+    char                *index_path;
+    char                *log_path;
+    FILE                *log;
+    int                 dirty;              // entries were added since the index was written
+
+    catalog_entry_t     **path_buckets;
+    catalog_entry_t     **fingerprint_buckets;
+    size_t              bucket_count;       // power of two
+    size_t              entry_count;
+    catalog_entry_t     *retired;           // replaced entries, callers may still hold them
+
+    pthread_mutex_t     lock;
+};
+
+typedef struct
+{
+    uint8_t             *data;
+    size_t              len;
+    size_t              size;
+} catalog_buffer_t;
+
+typedef struct
+{
+    const uint8_t       *p;
+    const uint8_t       *end;
+    int                 error;
+} catalog_reader_t;
+
+static size_t hash_string(const char *str)
+{
+    return (size_t) fnv1a_update(FNV1A_SEED, str, strlen(str));
+}
+
+static char *catalog_strdup(const char *str)
+{
+    return str ? strdup(str) : NULL;
+}
+
+/*
+ * Record encoding, all integers little endian:
+ *
+ *   u32 record length (excluding itself)
+ *   u64 fingerprint, u64 file size, i64 file mtime
+ *   str path, album title, album artist, disc title, disc artist, catalog number, genre
+ *   u16 year, u16 disc number, u16 disc count
+ *   u8  area count, u8 two channel area index + 1
+ *   per area: u8 channel count, u8 extra settings, u8 frame format, u8 track count,
+ *             u32 total frames, per track: u32 frames, str title
+ *
+ * Strings are a u16 length (0xffff for NULL) followed by the bytes.
+ */
+static int buffer_reserve(catalog_buffer_t *buf, size_t len)
+{
+    if (buf->len + len > buf->size)
+    {
+        size_t  size = buf->size ? buf->size : 256;
+        uint8_t *data;
+
+        while (size < buf->len + len)
+            size *= 2;
+        data = (uint8_t *) realloc(buf->data, size);
+        if (!data)
+            return 0;
+        buf->data = data;
+        buf->size = size;
+    }
+    return 1;
+}
+
+static void put_uint(catalog_buffer_t *buf, uint64_t value, int bytes)
+{
+    int i;
+
+    if (!buffer_reserve(buf, bytes))
+        return;
+    for (i = 0; i < bytes; i++)
+        buf->data[buf->len++] = (uint8_t) (value >> (8 * i));
+}
+
+static void put_string(catalog_buffer_t *buf, const char *str)
+{
+    size_t len;
+
+    if (!str)
+    {
+        put_uint(buf, CATALOG_NULL_STRING, 2);
+        return;
+    }
+    len = strlen(str);
+    if (len >= CATALOG_NULL_STRING)
+        len = CATALOG_NULL_STRING - 1;
+    put_uint(buf, len, 2);
+    if (!buffer_reserve(buf, len))
+        return;
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+}
+
+static void encode_entry(catalog_buffer_t *buf, const catalog_entry_t *entry)
+{
+    size_t start;
+    int    i, j;
+
+    buf->len = 0;
+    put_uint(buf, 0, 4);
+    start = buf->len;
+
+    put_uint(buf, entry->fingerprint, 8);
+    put_uint(buf, entry->file_size, 8);
+    put_uint(buf, (uint64_t) entry->file_mtime, 8);
+    put_string(buf, entry->path);
+    put_string(buf, entry->album_title);
+    put_string(buf, entry->album_artist);
+    put_string(buf, entry->disc_title);
+    put_string(buf, entry->disc_artist);
+    put_string(buf, entry->catalog_number);
+    put_string(buf, entry->genre);
+    put_uint(buf, entry->year, 2);
+    put_uint(buf, entry->disc_number, 2);
+    put_uint(buf, entry->disc_count, 2);
+    put_uint(buf, entry->area_count, 1);
+    put_uint(buf, entry->twoch_area_idx + 1, 1);
+    for (i = 0; i < entry->area_count; i++)
+    {
+        const catalog_area_t *area = &entry->area[i];
+
+        put_uint(buf, area->channel_count, 1);
+        put_uint(buf, area->extra_settings, 1);
+        put_uint(buf, area->frame_format, 1);
+        put_uint(buf, area->track_count, 1);
+        put_uint(buf, area->total_frames, 4);
+        for (j = 0; j < area->track_count; j++)
+        {
+            put_uint(buf, area->track_frames[j], 4);
+            put_string(buf, area->track_titles[j]);
+        }
+    }
+
+    if (buf->len >= 4)
+    {
+        uint32_t len = (uint32_t) (buf->len - start);
+        buf->data[0] = (uint8_t) len;
+        buf->data[1] = (uint8_t) (len >> 8);
+        buf->data[2] = (uint8_t) (len >> 16);
+        buf->data[3] = (uint8_t) (len >> 24);
+    }
+}
+
+static uint64_t get_uint(catalog_reader_t *r, int bytes)
+{
+    uint64_t value = 0;
+    int      i;
+
+    if (r->error || r->end - r->p < bytes)
+    {
+        r->error = 1;
+        return 0;
+    }
+    for (i = 0; i < bytes; i++)
+        value |= (uint64_t) r->p[i] << (8 * i);
+    r->p += bytes;
+    return value;
+}
+
+static char *get_string(catalog_reader_t *r)
+{
+    size_t len = (size_t) get_uint(r, 2);
+    char   *str;
+
+    if (r->error || len == CATALOG_NULL_STRING)
+        return NULL;
+    if ((size_t) (r->end - r->p) < len)
+    {
+        r->error = 1;
+        return NULL;
+    }
+    str = (char *) malloc(len + 1);
+    if (!str)
+    {
+        r->error = 1;
+        return NULL;
+    }
+    memcpy(str, r->p, len);
+    str[len] = '\0';
+    r->p += len;
+    return str;
+}
+
+static int decode_entry(catalog_reader_t *r, catalog_entry_t *entry)
+{
+    int i, j;
+
+    memset(entry, 0, sizeof(catalog_entry_t));
+    entry->fingerprint    = get_uint(r, 8);
+    entry->file_size      = get_uint(r, 8);
+    entry->file_mtime     = (int64_t) get_uint(r, 8);
+    entry->path           = get_string(r);
+    entry->album_title    = get_string(r);
+    entry->album_artist   = get_string(r);
+    entry->disc_title     = get_string(r);
+    entry->disc_artist    = get_string(r);
+    entry->catalog_number = get_string(r);
+    entry->genre          = get_string(r);
+    entry->year           = (uint16_t) get_uint(r, 2);
+    entry->disc_number    = (uint16_t) get_uint(r, 2);
+    entry->disc_count     = (uint16_t) get_uint(r, 2);
+    entry->area_count     = (int) get_uint(r, 1);
+    entry->twoch_area_idx = (int) get_uint(r, 1) - 1;
+    if (entry->area_count > 2)
+        r->error = 1;
+
+    for (i = 0; i < entry->area_count && !r->error; i++)
+    {
+        catalog_area_t *area = &entry->area[i];
+
+        area->channel_count  = (uint8_t) get_uint(r, 1);
+        area->extra_settings = (uint8_t) get_uint(r, 1);
+        area->frame_format   = (uint8_t) get_uint(r, 1);
+        area->track_count    = (uint8_t) get_uint(r, 1);
+        area->total_frames   = (uint32_t) get_uint(r, 4);
+        area->track_frames   = (uint32_t *) calloc(area->track_count + 1, sizeof(uint32_t));
+        area->track_titles   = (char **) calloc(area->track_count + 1, sizeof(char *));
+        if (!area->track_frames || !area->track_titles)
+        {
+            r->error = 1;
+            break;
+        }
+        for (j = 0; j < area->track_count; j++)
+        {
+            area->track_frames[j] = (uint32_t) get_uint(r, 4);
+            area->track_titles[j] = get_string(r);
+        }
+    }
+
+    if (r->error || !entry->path)
+    {
+        catalog_entry_free(entry);
+        return 0;
+    }
+    return 1;
+}
+
+void catalog_entry_free(catalog_entry_t *entry)
+{
+    int i, j;
+
+    free(entry->path);
+    free(entry->album_title);
+    free(entry->album_artist);
+    free(entry->disc_title);
+    free(entry->disc_artist);
+    free(entry->catalog_number);
+    free(entry->genre);
+    for (i = 0; i < 2; i++)
+    {
+        if (entry->area[i].track_titles)
+        {
+            for (j = 0; j < entry->area[i].track_count; j++)
+                free(entry->area[i].track_titles[j]);
+        }
+        free(entry->area[i].track_titles);
+        free(entry->area[i].track_frames);
+    }
+    memset(entry, 0, sizeof(catalog_entry_t));
+}
+
+int catalog_entry_copy(catalog_entry_t *dst, const catalog_entry_t *src)
+{
+    catalog_buffer_t buf;
+    catalog_reader_t r;
+    int              ret;
+
+    // a round trip through the record encoding gives a deep copy
+    memset(&buf, 0, sizeof(buf));
+    encode_entry(&buf, src);
+    if (!buf.data)
+        return 0;
+    r.p     = buf.data + 4;
+    r.end   = buf.data + buf.len;
+    r.error = 0;
+    ret = decode_entry(&r, dst);
+    free(buf.data);
+    return ret;
+}
+
+int catalog_entry_from_handle(catalog_entry_t *entry, scarletbook_handle_t *handle)
+{
+    master_toc_t  *mtoc = handle->master_toc;
+    master_text_t *text = &handle->master_text;
+    char          catalog_number[17];
+    const char    *genre;
+    int           i, j;
+
+    memset(entry, 0, sizeof(catalog_entry_t));
+    entry->fingerprint    = handle->toc_fingerprint;
+    entry->album_title    = catalog_strdup(text->album_title);
+    entry->album_artist   = catalog_strdup(text->album_artist);
+    entry->disc_title     = catalog_strdup(text->disc_title);
+    entry->disc_artist    = catalog_strdup(text->disc_artist);
+    entry->year           = mtoc->disc_date_year;
+    entry->disc_number    = mtoc->album_sequence_number;
+    entry->disc_count     = mtoc->album_set_size;
+
+    if (get_album_catalog_number(mtoc, catalog_number))
+        entry->catalog_number = strdup(catalog_number);
+    genre = get_album_genre(mtoc);
+    if (genre)
+        entry->genre = strdup(genre);
+
+    entry->area_count     = handle->area_count;
+    entry->twoch_area_idx = handle->twoch_area_idx;
+    for (i = 0; i < handle->area_count; i++)
+    {
+        scarletbook_area_t *sb_area  = &handle->area[i];
+        area_toc_t         *area_toc = sb_area->area_toc;
+        catalog_area_t     *area     = &entry->area[i];
+
+        area->channel_count  = area_toc->channel_count;
+        area->extra_settings = area_toc->extra_settings;
+        area->frame_format   = area_toc->frame_format;
+        area->track_count    = area_toc->track_count;
+        area->total_frames   = TIME_FRAMECOUNT(&area_toc->total_playtime);
+        area->track_frames   = (uint32_t *) calloc(area->track_count + 1, sizeof(uint32_t));
+        area->track_titles   = (char **) calloc(area->track_count + 1, sizeof(char *));
+        if (!area->track_frames || !area->track_titles)
+        {
+            catalog_entry_free(entry);
+            return 0;
+        }
+        for (j = 0; j < area->track_count; j++)
+        {
+            area->track_frames[j] = TIME_FRAMECOUNT(&sb_area->area_tracklist_time->duration[j]);
+            area->track_titles[j] = catalog_strdup(sb_area->area_track_text[j].track_type_title);
+        }
+    }
+    return 1;
+}
+
+static void unlink_entry(catalog_t *catalog, catalog_entry_t *entry)
+{
+    catalog_entry_t **pp;
+
+    for (pp = &catalog->path_buckets[hash_string(entry->path) & (catalog->bucket_count - 1)]; *pp; pp = &(*pp)->next_by_path)
+    {
+        if (*pp == entry)
+        {
+            *pp = entry->next_by_path;
+            break;
+        }
+    }
+    for (pp = &catalog->fingerprint_buckets[entry->fingerprint & (catalog->bucket_count - 1)]; *pp; pp = &(*pp)->next_by_fingerprint)
+    {
+        if (*pp == entry)
+        {
+            *pp = entry->next_by_fingerprint;
+            break;
+        }
+    }
+    catalog->entry_count--;
+}
+
+static void link_entry(catalog_t *catalog, catalog_entry_t *entry)
+{
+    size_t path_idx = hash_string(entry->path) & (catalog->bucket_count - 1);
+    size_t fp_idx   = entry->fingerprint & (catalog->bucket_count - 1);
+
+    entry->next_by_path                  = catalog->path_buckets[path_idx];
+    catalog->path_buckets[path_idx]      = entry;
+    entry->next_by_fingerprint           = catalog->fingerprint_buckets[fp_idx];
+    catalog->fingerprint_buckets[fp_idx] = entry;
+    catalog->entry_count++;
+}
+
+static int resize_buckets(catalog_t *catalog, size_t bucket_count)
+{
+    catalog_entry_t **path_buckets, **fingerprint_buckets, *entry, *next;
+    size_t          old_count = catalog->bucket_count, i;
+
+    path_buckets        = (catalog_entry_t **) calloc(bucket_count, sizeof(catalog_entry_t *));
+    fingerprint_buckets = (catalog_entry_t **) calloc(bucket_count, sizeof(catalog_entry_t *));
+    if (!path_buckets || !fingerprint_buckets)
+    {
+        free(path_buckets);
+        free(fingerprint_buckets);
+        return 0;
+    }
+
+    catalog->bucket_count = bucket_count;
+    catalog->entry_count  = 0;
+    for (i = 0; i < old_count; i++)
+    {
+        for (entry = catalog->path_buckets[i]; entry; entry = next)
+        {
+            next = entry->next_by_path;
+            entry->next_by_path = NULL;
+            entry->next_by_fingerprint = NULL;
+            {
+                size_t path_idx = hash_string(entry->path) & (bucket_count - 1);
+                size_t fp_idx   = entry->fingerprint & (bucket_count - 1);
+                entry->next_by_path          = path_buckets[path_idx];
+                path_buckets[path_idx]       = entry;
+                entry->next_by_fingerprint   = fingerprint_buckets[fp_idx];
+                fingerprint_buckets[fp_idx]  = entry;
+                catalog->entry_count++;
+            }
+        }
+    }
+    free(catalog->path_buckets);
+    free(catalog->fingerprint_buckets);
+    catalog->path_buckets        = path_buckets;
+    catalog->fingerprint_buckets = fingerprint_buckets;
+    return 1;
+}
+
+static catalog_entry_t *lookup_path(catalog_t *catalog, const char *path)
+{
+    catalog_entry_t *entry;
+
+    for (entry = catalog->path_buckets[hash_string(path) & (catalog->bucket_count - 1)]; entry; entry = entry->next_by_path)
+    {
+        if (strcmp(entry->path, path) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+// takes ownership of "entry", an older entry for the same path is retired
+static void insert_entry(catalog_t *catalog, catalog_entry_t *entry)
+{
+    catalog_entry_t *old = lookup_path(catalog, entry->path);
+
+    if (old)
+    {
+        unlink_entry(catalog, old);
+        old->next_by_path = catalog->retired;
+        catalog->retired  = old;
+    }
+    if (catalog->entry_count >= catalog->bucket_count)
+        resize_buckets(catalog, catalog->bucket_count * 2);
+    link_entry(catalog, entry);
+}
+
+static void free_entry_list(catalog_entry_t *entry, int by_path)
+{
+    catalog_entry_t *next;
+
+    for (; entry; entry = next)
+    {
+        next = by_path ? entry->next_by_path : entry->next_by_fingerprint;
+        catalog_entry_free(entry);
+        free(entry);
+    }
+}
+
+// replays a catalog file, returns the number of entries read or -1 when it doesn't exist
+static int load_file(catalog_t *catalog, const char *path, const char *magic)
+{
+    FILE             *fd;
+    uint8_t          *data;
+    long             size;
+    catalog_reader_t r;
+    int              count = 0;
+
+    fd = fopen(path, "rb");
+    if (!fd)
+        return -1;
+
+    fseek(fd, 0, SEEK_END);
+    size = ftell(fd);
+    fseek(fd, 0, SEEK_SET);
+    data = size > 0 ? (uint8_t *) malloc(size) : NULL;
+    if (!data || fread(data, 1, size, fd) != (size_t) size)
+    {
+        free(data);
+        fclose(fd);
+        return 0;
+    }
+    fclose(fd);
+
+    if (size < CATALOG_HEADER_SIZE || memcmp(data, magic, 8) != 0 || data[8] != CATALOG_VERSION)
+    {
+        LOG(lm_main, LOG_WARNING, ("catalog: ignoring %s, unknown format", path));
+        free(data);
+        return 0;
+    }
+
+    r.p   = data + CATALOG_HEADER_SIZE;
+    r.end = data + size;
+    while (r.end - r.p >= 4)
+    {
+        catalog_reader_t record;
+        catalog_entry_t  *entry;
+        uint32_t         len;
+
+        r.error = 0;
+        len = (uint32_t) get_uint(&r, 4);
+        if ((uint32_t) (r.end - r.p) < len)
+            break;                          // incomplete record from an interrupted run
+
+        record.p     = r.p;
+        record.end   = r.p + len;
+        record.error = 0;
+        r.p += len;
+
+        entry = (catalog_entry_t *) malloc(sizeof(catalog_entry_t));
+        if (!entry)
+            break;
+        if (!decode_entry(&record, entry))
+        {
+            free(entry);
+            continue;
+        }
+        insert_entry(catalog, entry);
+        count++;
+    }
+
+    free(data);
+    return count;
+}
+
+static int write_header(FILE *fd, const char *magic)
+{
+    uint8_t header[CATALOG_HEADER_SIZE];
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, magic, 8);
+    header[8] = CATALOG_VERSION;
+    return fwrite(header, 1, sizeof(header), fd) == sizeof(header);
+}
+
+// writes all entries to a new index and starts an empty log
+static int write_index(catalog_t *catalog)
+{
+    catalog_buffer_t buf;
+    catalog_entry_t  *entry;
+    FILE             *fd;
+    char             *tmp_path;
+    size_t           i;
+    int              ok;
+
+    tmp_path = (char *) malloc(strlen(catalog->index_path) + 5);
+    if (!tmp_path)
+        return 0;
+    sprintf(tmp_path, "%s.tmp", catalog->index_path);
+
+    fd = fopen(tmp_path, "wb");
+    if (!fd)
+    {
+        LOG(lm_main, LOG_ERROR, ("catalog: can't create %s", tmp_path));
+        free(tmp_path);
+        return 0;
+    }
+
+    memset(&buf, 0, sizeof(buf));
+    ok = write_header(fd, CATALOG_INDEX_MAGIC);
+    for (i = 0; i < catalog->bucket_count && ok; i++)
+    {
+        for (entry = catalog->path_buckets[i]; entry && ok; entry = entry->next_by_path)
+        {
+            encode_entry(&buf, entry);
+            ok = buf.data && fwrite(buf.data, 1, buf.len, fd) == buf.len;
+        }
+    }
+    free(buf.data);
+    ok = (fclose(fd) == 0) && ok;
+
+    if (ok)
+    {
+        remove(catalog->index_path);
+        ok = rename(tmp_path, catalog->index_path) == 0;
+    }
+    if (!ok)
+    {
+        LOG(lm_main, LOG_ERROR, ("catalog: can't write %s", catalog->index_path));
+        remove(tmp_path);
+        free(tmp_path);
+        return 0;
+    }
+    free(tmp_path);
+
+    // everything in the log is part of the index now
+    if (catalog->log)
+    {
+        fclose(catalog->log);
+        catalog->log = NULL;
+    }
+    remove(catalog->log_path);
+    catalog->dirty = 0;
+    return 1;
+}
+
+catalog_t *catalog_open(const char *path)
+{
+    catalog_t *catalog;
+    int       logged;
+
+    catalog = (catalog_t *) calloc(1, sizeof(catalog_t));
+    if (!catalog)
+        return NULL;
+
+    catalog->index_path = strdup(path);
+    catalog->log_path   = (char *) malloc(strlen(path) + 5);
+    if (!catalog->index_path || !catalog->log_path || !resize_buckets(catalog, CATALOG_MIN_BUCKETS))
+    {
+        free(catalog->index_path);
+        free(catalog->log_path);
+        free(catalog);
+        return NULL;
+    }
+    sprintf(catalog->log_path, "%s.log", path);
+    pthread_mutex_init(&catalog->lock, NULL);
+
+    load_file(catalog, catalog->index_path, CATALOG_INDEX_MAGIC);
+    logged = load_file(catalog, catalog->log_path, CATALOG_LOG_MAGIC);
+
+    // fold a log left behind by an earlier run into the index, new entries get a clean log
+    if (logged >= 0)
+        write_index(catalog);
+
+    return catalog;
+}
+
+void catalog_close(catalog_t *catalog)
+{
+    size_t i;
+
+    if (!catalog)
+        return;
+
+    if (catalog->dirty)
+        write_index(catalog);
+    if (catalog->log)
+        fclose(catalog->log);
+
+    for (i = 0; i < catalog->bucket_count; i++)
+        free_entry_list(catalog->path_buckets[i], 1);
+    free_entry_list(catalog->retired, 1);
+
+    pthread_mutex_destroy(&catalog->lock);
+    free(catalog->path_buckets);
+    free(catalog->fingerprint_buckets);
+    free(catalog->index_path);
+    free(catalog->log_path);
+    free(catalog);
+}
+
+const catalog_entry_t *catalog_find_path(catalog_t *catalog, const char *path, uint64_t file_size, int64_t file_mtime)
+{
+    catalog_entry_t *entry;
+
+    pthread_mutex_lock(&catalog->lock);
+    entry = lookup_path(catalog, path);
+    if (entry && (entry->file_size != file_size || entry->file_mtime != file_mtime))
+        entry = NULL;
+    pthread_mutex_unlock(&catalog->lock);
+    return entry;
+}
+
+const catalog_entry_t *catalog_find_fingerprint(catalog_t *catalog, uint64_t fingerprint)
+{
+    catalog_entry_t *entry;
+
+    pthread_mutex_lock(&catalog->lock);
+    for (entry = catalog->fingerprint_buckets[fingerprint & (catalog->bucket_count - 1)]; entry; entry = entry->next_by_fingerprint)
+    {
+        if (entry->fingerprint == fingerprint)
+            break;
+    }
+    pthread_mutex_unlock(&catalog->lock);
+    return entry;
+}
+
+int catalog_add(catalog_t *catalog, const catalog_entry_t *entry)
+{
+    catalog_buffer_t buf;
+    catalog_entry_t  *copy;
+    int              ok = 1;
+
+    if (!entry->path)
+        return 0;
+
+    copy = (catalog_entry_t *) malloc(sizeof(catalog_entry_t));
+    if (!copy || !catalog_entry_copy(copy, entry))
+    {
+        free(copy);
+        return 0;
+    }
+
+    memset(&buf, 0, sizeof(buf));
+    encode_entry(&buf, copy);
+
+    pthread_mutex_lock(&catalog->lock);
+    insert_entry(catalog, copy);
+    catalog->dirty = 1;
+
+    if (!catalog->log)
+    {
+        catalog->log = fopen(catalog->log_path, "ab");
+        if (catalog->log)
+            fseek(catalog->log, 0, SEEK_END);
+        if (catalog->log && ftell(catalog->log) == 0)
+            write_header(catalog->log, CATALOG_LOG_MAGIC);
+    }
+    if (catalog->log && buf.data)
+    {
+        ok = fwrite(buf.data, 1, buf.len, catalog->log) == buf.len;
+        fflush(catalog->log);
+    }
+    pthread_mutex_unlock(&catalog->lock);
+
+    free(buf.data);
+    return ok;
+}
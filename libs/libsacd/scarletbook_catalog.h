@@ -0,0 +1,128 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef SCARLETBOOK_CATALOG_H_INCLUDED
+#define SCARLETBOOK_CATALOG_H_INCLUDED
+
+#include <stdint.h>
+#include "scarletbook.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The disc catalog keeps the parsed TOC metadata of every image seen so
+ * far, keyed by the image path and by the TOC fingerprint.
+ *
+ * It is stored as a binary index file (all entries, rewritten on close)
+ * plus an append log next to it ("<file>.log") that receives new entries
+ * as they are added, so an interrupted run keeps its progress. On open
+ * the log is replayed over the index, later entries for a path replace
+ * earlier ones.
+ *
+ * One process should update a catalog at a time.
+ */
+
+typedef struct
+{
+    uint8_t             channel_count;
+    uint8_t             extra_settings;
+    uint8_t             frame_format;
+    uint8_t             track_count;
+    uint32_t            total_frames;                       // in SACD frames (1/75 s)
+    uint32_t           *track_frames;
+    char              **track_titles;                       // UTF-8, may be NULL
+} catalog_area_t;
+
+typedef struct catalog_entry_t
+{
+    uint64_t            fingerprint;
+    uint64_t            file_size;
+    int64_t             file_mtime;
+    char               *path;
+
+    char               *album_title;                        // UTF-8 text, NULL when absent
+    char               *album_artist;
+    char               *disc_title;
+    char               *disc_artist;
+    char               *catalog_number;
+    char               *genre;
+    uint16_t            year;
+    uint16_t            disc_number;
+    uint16_t            disc_count;
+
+    int                 area_count;
+    int                 twoch_area_idx;                     // -1 when absent
+    catalog_area_t      area[2];
+
+    struct catalog_entry_t *next_by_path;
+    struct catalog_entry_t *next_by_fingerprint;
+} catalog_entry_t;
+
+typedef struct catalog_t catalog_t;
+
+/**
+ * Opens the catalog at "path", a missing catalog starts out empty and is
+ * created once entries are added. Returns NULL when out of memory.
+ */
+catalog_t *catalog_open(const char *path);
+
+/**
+ * Writes a new index when entries were added and closes the catalog.
+ */
+void catalog_close(catalog_t *);
+
+/**
+ * Returns the entry for an image path if the file has not changed since
+ * it was added (same size and modification time), otherwise NULL. The
+ * entry stays valid until the catalog is closed.
+ */
+const catalog_entry_t *catalog_find_path(catalog_t *, const char *path, uint64_t file_size, int64_t file_mtime);
+
+/**
+ * Returns an entry for a disc with the given TOC fingerprint, NULL if the
+ * disc is unknown.
+ */
+const catalog_entry_t *catalog_find_fingerprint(catalog_t *, uint64_t fingerprint);
+
+/**
+ * Adds a copy of "entry" to the catalog and its log. Thread safe.
+ */
+int catalog_add(catalog_t *, const catalog_entry_t *entry);
+
+/**
+ * Fills "entry" from an opened disc, the path, size and mtime are left to
+ * the caller. Release with catalog_entry_free().
+ */
+int catalog_entry_from_handle(catalog_entry_t *entry, scarletbook_handle_t *handle);
+
+/**
+ * Copies "entry" with a different image path.
+ */
+int catalog_entry_copy(catalog_entry_t *dst, const catalog_entry_t *src);
+
+void catalog_entry_free(catalog_entry_t *entry);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* SCARLETBOOK_CATALOG_H_INCLUDED */
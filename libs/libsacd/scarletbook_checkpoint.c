@@ -0,0 +1,215 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#include <logging.h>
+#include <checksum.h>
+
+#include "scarletbook_checkpoint.h"
+
+#define CHECKPOINT_MAGIC        "SACDCKPT"
+#define CHECKPOINT_VERSION      2
+#define CHECKPOINT_MAX_SIZE     (256 * 1024 * 1024)
+
+// the checkpoint file is laid out as:
+//   magic, version, sizeof(scarletbook_checkpoint_t), the checkpoint, 
+//   frame_size bytes of frame data, state size (64 bit), the state, 
+//   CRC-32C of everything before it
+// in the byte order of the machine, a checkpoint isn't meant to be moved
+
+static char *checkpoint_path(const char *filename, const char *extension)
+{
+    char *path = (char *) malloc(strlen(filename) + strlen(extension) + 1);
+
+    if (path)
+    {
+        strcpy(path, filename);
+        strcat(path, extension);
+    }
+    return path;
+}
+
+int scarletbook_checkpoint_save(const char *filename, const scarletbook_checkpoint_t *checkpoint, 
+                                const uint8_t *frame_data, const uint8_t *state, size_t state_size)
+{
+    char *path, *tmp_path;
+    uint32_t header[2], crc;
+    uint64_t size = state_size;
+    size_t frame_size = checkpoint->frame_size > 0 ? (size_t) checkpoint->frame_size : 0;
+    FILE *fd;
+    int ret = -1;
+
+    path = checkpoint_path(filename, SCARLETBOOK_CHECKPOINT_EXTENSION);
+    tmp_path = checkpoint_path(filename, SCARLETBOOK_CHECKPOINT_EXTENSION ".tmp");
+    if (!path || !tmp_path)
+    {
+        free(path);
+        free(tmp_path);
+        return -1;
+    }
+
+    header[0] = CHECKPOINT_VERSION;
+    header[1] = sizeof(scarletbook_checkpoint_t);
+
+    crc = crc32c(0, (const uint8_t *) CHECKPOINT_MAGIC, 8);
+    crc = crc32c(crc, (const uint8_t *) header, sizeof(header));
+    crc = crc32c(crc, (const uint8_t *) checkpoint, sizeof(scarletbook_checkpoint_t));
+    crc = crc32c(crc, frame_data, frame_size);
+    crc = crc32c(crc, (const uint8_t *) &size, sizeof(size));
+    crc = crc32c(crc, state, state_size);
+
+    // written aside and renamed, so there is always one complete checkpoint
+    fd = fopen(tmp_path, "wb");
+    if (fd)
+    {
+        if (fwrite(CHECKPOINT_MAGIC, 1, 8, fd) == 8 &&
+            fwrite(header, 1, sizeof(header), fd) == sizeof(header) &&
+            fwrite(checkpoint, 1, sizeof(scarletbook_checkpoint_t), fd) == sizeof(scarletbook_checkpoint_t) &&
+            fwrite(frame_data, 1, frame_size, fd) == frame_size &&
+            fwrite(&size, 1, sizeof(size), fd) == sizeof(size) &&
+            fwrite(state, 1, state_size, fd) == state_size &&
+            fwrite(&crc, 1, sizeof(crc), fd) == sizeof(crc))
+        {
+            ret = 0;
+        }
+        if (fclose(fd) != 0)
+            ret = -1;
+    }
+#ifdef _WIN32
+    // rename doesn't replace files here
+    if (ret == 0)
+        remove(path);
+#endif
+    if (ret == 0 && rename(tmp_path, path) != 0)
+        ret = -1;
+    if (ret != 0)
+    {
+        LOG(lm_main, LOG_ERROR, ("can't write the checkpoint %s, errno: %d, %s", path, errno, strerror(errno)));
+        remove(tmp_path);
+    }
+
+    free(path);
+    free(tmp_path);
+    return ret;
+}
+
+int scarletbook_checkpoint_load(const char *filename, scarletbook_checkpoint_t *checkpoint, 
+                                uint8_t **frame_data, uint8_t **state, size_t *state_size)
+{
+    char *path;
+    uint8_t *data = 0, *p;
+    uint32_t header[2], crc;
+    uint64_t size;
+    long length;
+    size_t frame_size;
+    FILE *fd;
+    int ret = -1;
+
+    *frame_data = 0;
+    *state = 0;
+    *state_size = 0;
+
+    path = checkpoint_path(filename, SCARLETBOOK_CHECKPOINT_EXTENSION);
+    if (!path)
+        return -1;
+    fd = fopen(path, "rb");
+    free(path);
+    if (!fd)
+        return -1;
+
+    // the whole file is read and checked before anything of it is used
+    if (fseek(fd, 0, SEEK_END) == 0 && (length = ftell(fd)) > 0 && length < CHECKPOINT_MAX_SIZE && fseek(fd, 0, SEEK_SET) == 0)
+    {
+        data = (uint8_t *) malloc((size_t) length);
+        if (data && fread(data, 1, (size_t) length, fd) != (size_t) length)
+        {
+            free(data);
+            data = 0;
+        }
+    }
+    fclose(fd);
+    if (!data)
+        return -1;
+
+    p = data;
+    if ((size_t) length < 8 + sizeof(header) + sizeof(scarletbook_checkpoint_t) + sizeof(size) + sizeof(crc) || memcmp(p, CHECKPOINT_MAGIC, 8) != 0)
+        goto done;
+    p += 8;
+    memcpy(header, p, sizeof(header));
+    p += sizeof(header);
+    if (header[0] != CHECKPOINT_VERSION || header[1] != sizeof(scarletbook_checkpoint_t))
+        goto done;
+    memcpy(checkpoint, p, sizeof(scarletbook_checkpoint_t));
+    p += sizeof(scarletbook_checkpoint_t);
+
+    frame_size = checkpoint->frame_size > 0 ? (size_t) checkpoint->frame_size : 0;
+    if (frame_size > (size_t) (data + length - p) - sizeof(size) - sizeof(crc))
+        goto done;
+    p += frame_size;
+    memcpy(&size, p, sizeof(size));
+    p += sizeof(size);
+    if (size != (uint64_t) (data + length - p) - sizeof(crc))
+        goto done;
+    p += size;
+    memcpy(&crc, p, sizeof(crc));
+    if (crc != crc32c(0, data, (size_t) (p - data)))
+        goto done;
+
+    *frame_data = (uint8_t *) malloc(frame_size + 1);
+    *state = (uint8_t *) malloc((size_t) size + 1);
+    if (!*frame_data || !*state)
+    {
+        free(*frame_data);
+        free(*state);
+        *frame_data = 0;
+        *state = 0;
+        goto done;
+    }
+    p = data + 8 + sizeof(header) + sizeof(scarletbook_checkpoint_t);
+    memcpy(*frame_data, p, frame_size);
+    memcpy(*state, p + frame_size + sizeof(size), (size_t) size);
+    *state_size = (size_t) size;
+    ret = 0;
+
+done:
+    if (ret != 0)
+    {
+        LOG(lm_main, LOG_NOTICE, ("ignoring the damaged checkpoint of %s", filename));
+    }
+    free(data);
+    return ret;
+}
+
+void scarletbook_checkpoint_remove(const char *filename)
+{
+    char *path = checkpoint_path(filename, SCARLETBOOK_CHECKPOINT_EXTENSION);
+
+    if (path)
+    {
+        remove(path);
+        free(path);
+    }
+}
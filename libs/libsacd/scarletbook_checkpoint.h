@@ -0,0 +1,105 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef SCARLETBOOK_CHECKPOINT_H_INCLUDED
+#define SCARLETBOOK_CHECKPOINT_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Checkpoints of an output file, so that an interrupted extraction can
+ * carry on where it was instead of starting the file over.
+ *
+ * A checkpoint is taken at a sector boundary after every frame that
+ * started before it has been written. It records that sector, how much of
+ * the file is consistent with it, the frame that was still being collected
+ * and the state of the format handler. It is kept next to the file, with
+ * SCARLETBOOK_CHECKPOINT_EXTENSION appended, and replaced as a whole so
+ * that an interruption leaves either the old or the new one.
+ */
+
+#define SCARLETBOOK_CHECKPOINT_EXTENSION    ".checkpoint"
+
+enum
+{
+    CHECKPOINT_DST_IMPORT   = 1 << 0,
+    CHECKPOINT_DSD_EXPORT   = 1 << 1,
+    CHECKPOINT_DSF_NOPAD    = 1 << 2
+};
+
+typedef struct
+{
+    // what the file is made of, a checkpoint taken with other options doesn't apply
+    char                handler[32];
+    uint64_t            toc_fingerprint;
+    int32_t             area;
+    int32_t             track;
+    uint32_t            start_lsn;
+    uint32_t            length_lsn;
+    int32_t             options;            // CHECKPOINT_ flags
+
+    // how far it got
+    int32_t             complete;           // the file is done, the state is what it hands on to the next track
+    uint32_t            current_lsn;        // the first sector that wasn't processed
+    uint64_t            file_size;          // bytes of the file written up to current_lsn
+    uint64_t            write_length;
+
+    // the frame that started before current_lsn and isn't complete yet
+    int32_t             frame_started;
+    int32_t             frame_size;
+    int32_t             frame_sector_count;
+    int32_t             frame_channel_count;
+    int32_t             frame_dst_encoded;
+    int32_t             frame_time_code;
+    int32_t             next_time_code;     // of the frame after the last one written
+} 
+scarletbook_checkpoint_t;
+
+/**
+ * Replaces the checkpoint of the output file "filename". "frame_data" has
+ * frame_size bytes, "state" is the handler state. Returns 0 on success.
+ */
+int scarletbook_checkpoint_save(const char *filename, const scarletbook_checkpoint_t *checkpoint, 
+                                const uint8_t *frame_data, const uint8_t *state, size_t state_size);
+
+/**
+ * Reads the checkpoint of the output file "filename". On success "frame_data"
+ * and "state" are allocated (free them) and 0 is returned, -1 when there is
+ * no checkpoint or it can't be used.
+ */
+int scarletbook_checkpoint_load(const char *filename, scarletbook_checkpoint_t *checkpoint, 
+                                uint8_t **frame_data, uint8_t **state, size_t *state_size);
+
+/**
+ * Removes the checkpoint of the output file "filename", if any.
+ */
+void scarletbook_checkpoint_remove(const char *filename);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* SCARLETBOOK_CHECKPOINT_H_INCLUDED */
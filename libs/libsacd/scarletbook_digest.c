@@ -0,0 +1,528 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#ifndef __lv2ppu__
+#include <pthread.h>
+#endif
+
+#include <logging.h>
+#include <checksum.h>
+
+#include "scarletbook_digest.h"
+
+#define DIGEST_SLOT_SIZE    (256 * 1024)
+#define DIGEST_SLOTS        32                      // 8 MB between the writer and the hashing
+#define DIGEST_HEAD_SIZE    (256 * 1024)            // handlers rewrite their headers in here
+
+enum
+{
+    STREAM_PAYLOAD = 0,
+    STREAM_CONTAINER
+};
+
+typedef struct
+{
+    int                 stream;
+    uint64_t            offset;                     // container offset of data[0]
+    size_t              len;
+    uint8_t            *data;
+}
+digest_slot_t;
+
+struct scarletbook_digest_s
+{
+    digest_slot_t       slots[DIGEST_SLOTS];
+    int                 first;                      // oldest slot handed over for hashing
+    int                 count;                      // slots handed over
+    digest_slot_t      *open;                       // slot the writer is filling, not handed over yet
+#ifndef __lv2ppu__
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    pthread_t           thread;
+    int                 closing;
+#endif
+
+    // owned by the hashing
+    scarletbook_digest_result_t result;
+    sha256_t            sha256;
+    uint8_t            *head;                       // the first DIGEST_HEAD_SIZE bytes of the container
+    uint64_t            head_size;
+    uint32_t            body_crc32c;                // the container after the head, written in order
+    uint64_t            body_size;
+    int                 container_seen;
+    int                 container_broken;           // rewritten past the head
+};
+
+static void hash_payload(scarletbook_digest_t *d, const uint8_t *buf, size_t len)
+{
+    d->result.payload_crc32c = crc32c(d->result.payload_crc32c, buf, len);
+    sha256_update(&d->sha256, buf, len);
+    d->result.payload_size += len;
+}
+
+static void hash_container(scarletbook_digest_t *d, uint64_t offset, const uint8_t *buf, size_t len)
+{
+    size_t n;
+
+    d->container_seen = 1;
+    if (offset < DIGEST_HEAD_SIZE)
+    {
+        n = (size_t) (DIGEST_HEAD_SIZE - offset) < len ? (size_t) (DIGEST_HEAD_SIZE - offset) : len;
+        memcpy(d->head + offset, buf, n);
+        if (offset + n > d->head_size)
+            d->head_size = offset + n;
+        offset += n;
+        buf += n;
+        len -= n;
+    }
+    if (len == 0)
+        return;
+
+    // past the head the container has to be written front to back
+    if (offset != DIGEST_HEAD_SIZE + d->body_size)
+    {
+        d->container_broken = 1;
+        return;
+    }
+    d->body_crc32c = crc32c(d->body_crc32c, buf, len);
+    d->body_size += len;
+}
+
+static void hash_slot(scarletbook_digest_t *d, digest_slot_t *slot)
+{
+    if (slot->stream == STREAM_PAYLOAD)
+        hash_payload(d, slot->data, slot->len);
+    else
+        hash_container(d, slot->offset, slot->data, slot->len);
+}
+
+#ifndef __lv2ppu__
+static void *digest_thread(void *arg)
+{
+    scarletbook_digest_t *d = (scarletbook_digest_t *) arg;
+    digest_slot_t *slot;
+
+    pthread_mutex_lock(&d->lock);
+    for (;;)
+    {
+        while (d->count == 0 && !d->closing)
+            pthread_cond_wait(&d->cond, &d->lock);
+        if (d->count == 0)
+            break;
+
+        slot = &d->slots[d->first];
+        pthread_mutex_unlock(&d->lock);
+
+        hash_slot(d, slot);
+
+        pthread_mutex_lock(&d->lock);
+        d->first = (d->first + 1) % DIGEST_SLOTS;
+        d->count--;
+        pthread_cond_broadcast(&d->cond);
+    }
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+#endif
+
+// hands the open slot over for hashing
+static void digest_submit(scarletbook_digest_t *d)
+{
+    if (!d->open)
+        return;
+#ifdef __lv2ppu__
+    hash_slot(d, d->open);
+#else
+    pthread_mutex_lock(&d->lock);
+    d->count++;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+#endif
+    d->open = 0;
+}
+
+// copies into the open slot while the data continues it, otherwise into a fresh one
+static void digest_add(scarletbook_digest_t *d, int stream, uint64_t offset, const uint8_t *buf, size_t len)
+{
+    size_t n;
+
+    while (len > 0)
+    {
+        if (d->open && (d->open->stream != stream || d->open->len == DIGEST_SLOT_SIZE ||
+                        (stream == STREAM_CONTAINER && d->open->offset + d->open->len != offset)))
+        {
+            digest_submit(d);
+        }
+        if (!d->open)
+        {
+#ifdef __lv2ppu__
+            d->open = &d->slots[0];
+#else
+            pthread_mutex_lock(&d->lock);
+            while (d->count == DIGEST_SLOTS)
+                pthread_cond_wait(&d->cond, &d->lock);
+            d->open = &d->slots[(d->first + d->count) % DIGEST_SLOTS];
+            pthread_mutex_unlock(&d->lock);
+#endif
+            d->open->stream = stream;
+            d->open->offset = offset;
+            d->open->len = 0;
+        }
+
+        n = DIGEST_SLOT_SIZE - d->open->len < len ? DIGEST_SLOT_SIZE - d->open->len : len;
+        memcpy(d->open->data + d->open->len, buf, n);
+        d->open->len += n;
+        offset += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+scarletbook_digest_t *scarletbook_digest_create(int payload_kind)
+{
+    scarletbook_digest_t *d;
+    int i;
+
+    d = (scarletbook_digest_t *) calloc(1, sizeof(scarletbook_digest_t));
+    if (!d)
+        return 0;
+
+    d->head = (uint8_t *) calloc(1, DIGEST_HEAD_SIZE);
+    for (i = 0; i < DIGEST_SLOTS; i++)
+    {
+        d->slots[i].data = (uint8_t *) malloc(DIGEST_SLOT_SIZE);
+        if (!d->slots[i].data)
+            break;
+    }
+    if (!d->head || i < DIGEST_SLOTS)
+        goto error;
+
+    d->result.payload_kind = payload_kind;
+    sha256_init(&d->sha256);
+
+#ifndef __lv2ppu__
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->cond, NULL);
+    if (pthread_create(&d->thread, NULL, digest_thread, d) != 0)
+    {
+        pthread_cond_destroy(&d->cond);
+        pthread_mutex_destroy(&d->lock);
+        goto error;
+    }
+#endif
+    return d;
+
+error:
+    for (i = 0; i < DIGEST_SLOTS; i++)
+    {
+        free(d->slots[i].data);
+    }
+    free(d->head);
+    free(d);
+    return 0;
+}
+
+void scarletbook_digest_payload(scarletbook_digest_t *d, const uint8_t *buf, size_t len)
+{
+    digest_add(d, STREAM_PAYLOAD, 0, buf, len);
+}
+
+void scarletbook_digest_container(void *digest, uint64_t offset, const uint8_t *buf, size_t len)
+{
+    digest_add((scarletbook_digest_t *) digest, STREAM_CONTAINER, offset, buf, len);
+}
+
+void scarletbook_digest_close(scarletbook_digest_t *d, scarletbook_digest_result_t *result)
+{
+    int i;
+
+    digest_submit(d);
+#ifndef __lv2ppu__
+    pthread_mutex_lock(&d->lock);
+    d->closing = 1;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+    pthread_join(d->thread, NULL);
+    pthread_cond_destroy(&d->cond);
+    pthread_mutex_destroy(&d->lock);
+#endif
+
+    sha256_final(&d->sha256, d->result.payload_sha256);
+    d->result.has_container = d->container_seen && !d->container_broken;
+    if (d->body_size > 0)
+    {
+        d->result.container_size = DIGEST_HEAD_SIZE + d->body_size;
+        d->result.container_crc32c = crc32c_combine(crc32c(0, d->head, DIGEST_HEAD_SIZE), d->body_crc32c, d->body_size);
+    }
+    else
+    {
+        d->result.container_size = d->head_size;
+        d->result.container_crc32c = crc32c(0, d->head, (size_t) d->head_size);
+    }
+    *result = d->result;
+
+    for (i = 0; i < DIGEST_SLOTS; i++)
+    {
+        free(d->slots[i].data);
+    }
+    free(d->head);
+    free(d);
+}
+
+static const char *payload_names[] = { "dsd", "dst", "sectors" };
+
+// the manifest next to "filename", "name" is set to the file name without the directory
+static char *manifest_path(const char *filename, const char **name)
+{
+    const char *p;
+    char *path;
+
+    *name = filename;
+    for (p = filename; *p; p++)
+    {
+        if (*p == '/' || *p == '\\')
+            *name = p + 1;
+    }
+    path = (char *) malloc((size_t) (*name - filename) + sizeof(SCARLETBOOK_MANIFEST_NAME));
+    if (path)
+    {
+        memcpy(path, filename, (size_t) (*name - filename));
+        strcpy(path + (*name - filename), SCARLETBOOK_MANIFEST_NAME);
+    }
+    return path;
+}
+
+#ifndef __lv2ppu__
+static pthread_mutex_t manifest_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+int scarletbook_manifest_append(const char *filename, const scarletbook_digest_result_t *result)
+{
+    const char *name;
+    char *path;
+    FILE *fd;
+    int i, ret = -1;
+    long position;
+
+    // the manifest sits next to the file and names it without the directory
+    path = manifest_path(filename, &name);
+    if (!path)
+        return -1;
+
+#ifndef __lv2ppu__
+    pthread_mutex_lock(&manifest_lock);
+#endif
+    fd = fopen(path, "a");
+    if (fd)
+    {
+        fseek(fd, 0, SEEK_END);
+        position = ftell(fd);
+        if (position == 0)
+        {
+            fprintf(fd, "# crc32c size payload payload_size payload_crc32c payload_sha256 file\n");
+        }
+        if (result->has_container)
+            fprintf(fd, "%08" PRIx32 " %" PRIu64, result->container_crc32c, result->container_size);
+        else
+            fprintf(fd, "- -");
+        fprintf(fd, " %s %" PRIu64 " %08" PRIx32 " ", payload_names[result->payload_kind], result->payload_size, result->payload_crc32c);
+        for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+        {
+            fprintf(fd, "%02x", result->payload_sha256[i]);
+        }
+        fprintf(fd, " %s\n", name);
+        ret = fclose(fd) == 0 ? 0 : -1;
+    }
+    if (ret != 0)
+    {
+        LOG(lm_main, LOG_ERROR, ("can't write the manifest %s, errno: %d, %s", path, errno, strerror(errno)));
+    }
+#ifndef __lv2ppu__
+    pthread_mutex_unlock(&manifest_lock);
+#endif
+
+    free(path);
+    return ret;
+}
+
+typedef struct
+{
+    int                 has_container;
+    uint32_t            container_crc32c;
+    uint64_t            container_size;
+    char                payload_kind[16];
+    uint64_t            payload_size;
+    uint32_t            payload_crc32c;
+    char                payload_sha256[2 * SHA256_DIGEST_SIZE + 1];
+}
+manifest_entry_t;
+
+// the last entry of "name" in the manifest, returns 0 if there is none
+static int manifest_find(const char *path, const char *name, manifest_entry_t *entry)
+{
+    char line[2048], container[2][24];
+    manifest_entry_t e;
+    FILE *fd;
+    int found = 0, n;
+    size_t len;
+
+    fd = fopen(path, "r");
+    if (!fd)
+        return 0;
+
+    while (fgets(line, sizeof(line), fd))
+    {
+        len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = 0;
+        if (line[0] == '#')
+            continue;
+
+        n = 0;
+        if (sscanf(line, "%23s %23s %15s %" SCNu64 " %" SCNx32 " %64s %n", container[0], container[1], e.payload_kind,
+                   &e.payload_size, &e.payload_crc32c, e.payload_sha256, &n) < 6 || n == 0)
+            continue;
+        if (strcmp(line + n, name) != 0)
+            continue;
+
+        e.has_container = strcmp(container[0], "-") != 0;
+        if (e.has_container)
+        {
+            e.container_crc32c = (uint32_t) strtoul(container[0], 0, 16);
+            e.container_size = strtoull(container[1], 0, 10);
+        }
+        *entry = e;
+        found = 1;
+    }
+    fclose(fd);
+    return found;
+}
+
+// the CRC-32C and size of a file as it is on disk, returns -1 if it can't be read
+static int file_crc32c(const char *filename, uint32_t *crc, uint64_t *size)
+{
+    uint8_t *buf;
+    size_t n;
+    FILE *fd;
+
+    fd = fopen(filename, "rb");
+    if (!fd)
+        return -1;
+
+    buf = (uint8_t *) malloc(DIGEST_SLOT_SIZE);
+    if (!buf)
+    {
+        fclose(fd);
+        return -1;
+    }
+    *crc = 0;
+    *size = 0;
+    while ((n = fread(buf, 1, DIGEST_SLOT_SIZE, fd)) > 0)
+    {
+        *crc = crc32c(*crc, buf, n);
+        *size += n;
+    }
+    free(buf);
+    fclose(fd);
+    return 0;
+}
+
+int scarletbook_digest_verify(const char *filename, const scarletbook_digest_result_t *result, char *reason, size_t reason_size)
+{
+    manifest_entry_t entry;
+    const char *name;
+    char *path, sha256[2 * SHA256_DIGEST_SIZE + 1];
+    uint32_t crc;
+    uint64_t size;
+    int i, found, with_manifest = 0, with_file = 0;
+
+    path = manifest_path(filename, &name);
+    found = path && manifest_find(path, name, &entry);
+    free(path);
+
+    if (found)
+    {
+        if (entry.has_container && result->has_container)
+        {
+            if (entry.container_size != result->container_size || entry.container_crc32c != result->container_crc32c)
+            {
+                snprintf(reason, reason_size, "extraction differs from the manifest");
+                return DIGEST_VERIFY_MISMATCH;
+            }
+            with_manifest = 1;
+        }
+        // the same options hand the same kind of payload to the format
+        if (strcmp(entry.payload_kind, payload_names[result->payload_kind]) == 0)
+        {
+            for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+            {
+                sprintf(sha256 + 2 * i, "%02x", result->payload_sha256[i]);
+            }
+            if (entry.payload_size != result->payload_size || entry.payload_crc32c != result->payload_crc32c || strcmp(entry.payload_sha256, sha256) != 0)
+            {
+                snprintf(reason, reason_size, "%s payload differs from the manifest", entry.payload_kind);
+                return DIGEST_VERIFY_MISMATCH;
+            }
+            with_manifest = 1;
+        }
+    }
+
+    if (file_crc32c(filename, &crc, &size) != 0)
+    {
+        snprintf(reason, reason_size, found ? "no file" : "no file and no manifest entry");
+        return DIGEST_VERIFY_MISSING;
+    }
+    if (result->has_container)
+    {
+        if (size != result->container_size || crc != result->container_crc32c)
+        {
+            snprintf(reason, reason_size, "file differs");
+            return DIGEST_VERIFY_MISMATCH;
+        }
+        with_file = 1;
+    }
+    else if (with_manifest && entry.has_container)
+    {
+        // the file is still the one the manifest entry was made from
+        if (size != entry.container_size || crc != entry.container_crc32c)
+        {
+            snprintf(reason, reason_size, "file differs from the manifest");
+            return DIGEST_VERIFY_MISMATCH;
+        }
+        with_file = 1;
+    }
+
+    // without the container digest (no tee on this platform, or a header rewritten 
+    // past the head) the file itself can't be compared, that isn't a difference
+    if (!with_manifest && !with_file)
+    {
+        snprintf(reason, reason_size, found ? "manifest entry has nothing to compare" : "nothing to compare with, no manifest entry");
+        return DIGEST_VERIFY_UNVERIFIED;
+    }
+    snprintf(reason, reason_size, with_manifest && with_file ? "manifest and file" : with_manifest ? "manifest" : "file");
+    return DIGEST_VERIFY_OK;
+}
@@ -0,0 +1,115 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef SCARLETBOOK_DIGEST_H_INCLUDED
+#define SCARLETBOOK_DIGEST_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+#include <checksum.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Digests of an output file, computed while it is written.
+ *
+ * The payload is what the extraction hands to the format handler: decoded
+ * DSD, DST frames or disc sectors. It gets a CRC-32C and a SHA-256. The
+ * container is the file as it ends up on disk, headers included. It gets a
+ * CRC-32C, which can be put together from the pieces when a handler goes
+ * back to rewrite its header.
+ *
+ * The writing thread only copies the data, the hashing runs on a thread of
+ * the digest.
+ */
+
+#define SCARLETBOOK_MANIFEST_NAME   "sacd_extract.manifest"
+
+enum
+{
+    DIGEST_PAYLOAD_DSD = 0,
+    DIGEST_PAYLOAD_DST,
+    DIGEST_PAYLOAD_SECTORS
+};
+
+typedef struct
+{
+    int                 payload_kind;
+    uint64_t            payload_size;
+    uint32_t            payload_crc32c;
+    uint8_t             payload_sha256[SHA256_DIGEST_SIZE];
+
+    int                 has_container;      // 0 when the container wasn't seen or was rewritten past the head
+    uint64_t            container_size;
+    uint32_t            container_crc32c;
+} 
+scarletbook_digest_result_t;
+
+typedef struct scarletbook_digest_s scarletbook_digest_t;
+
+scarletbook_digest_t *scarletbook_digest_create(int payload_kind);
+
+/**
+ * Adds the next payload bytes.
+ */
+void scarletbook_digest_payload(scarletbook_digest_t *, const uint8_t *buf, size_t len);
+
+/**
+ * Adds bytes written to the container at "offset", a file_writer_tee_t.
+ */
+void scarletbook_digest_container(void *digest, uint64_t offset, const uint8_t *buf, size_t len);
+
+/**
+ * Waits for the hashing to finish, fills "result" and frees the digest.
+ */
+void scarletbook_digest_close(scarletbook_digest_t *, scarletbook_digest_result_t *result);
+
+/**
+ * Adds the digests of the output file "filename" to the manifest in its
+ * directory. Returns 0 on success.
+ */
+int scarletbook_manifest_append(const char *filename, const scarletbook_digest_result_t *result);
+
+enum
+{
+    DIGEST_VERIFY_OK = 0,
+    DIGEST_VERIFY_MISMATCH,
+    DIGEST_VERIFY_MISSING,
+    DIGEST_VERIFY_UNVERIFIED            // there was nothing to compare the new digests with
+};
+
+/**
+ * Compares the digests of a file derived again from the source with the
+ * file extracted before: with its latest entry in the manifest next to it
+ * when there is one, and with the CRC-32C and size of the file as it is
+ * on disk. "reason" receives what was compared or what differs. Returns
+ * one of the DIGEST_VERIFY values, DIGEST_VERIFY_UNVERIFIED when neither
+ * could be compared.
+ */
+int scarletbook_digest_verify(const char *filename, const scarletbook_digest_result_t *result, char *reason, size_t reason_size);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* SCARLETBOOK_DIGEST_H_INCLUDED */
@@ -0,0 +1,136 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef __lv2ppu__
+#include <pthread.h>
+#endif
+
+#include "scarletbook_error_map.h"
+
+struct scarletbook_error_map_s
+{
+    FILE               *out;
+    char               *label;
+    uint32_t            lost;                       // sectors
+    uint32_t            recovered;
+    uint32_t            retries;
+#ifndef __lv2ppu__
+    pthread_mutex_t     lock;
+#endif
+};
+
+static void write_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char) *str);
+        else
+            fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+scarletbook_error_map_t *scarletbook_error_map_create(FILE *out, const char *label)
+{
+    scarletbook_error_map_t *map = (scarletbook_error_map_t *) calloc(1, sizeof(scarletbook_error_map_t));
+
+    if (!map)
+        return NULL;
+
+    map->out = out;
+    map->label = strdup(label ? label : "");
+#ifndef __lv2ppu__
+    pthread_mutex_init(&map->lock, NULL);
+#endif
+    return map;
+}
+
+void scarletbook_error_map_add(scarletbook_error_map_t *map, const char *filename, uint32_t lsn, uint32_t count, int retries, int lost)
+{
+    if (!map)
+        return;
+
+#ifndef __lv2ppu__
+    pthread_mutex_lock(&map->lock);
+#endif
+    if (lost)
+        map->lost += count;
+    else
+        map->recovered += count;
+    map->retries += retries;
+
+    if (map->out)
+    {
+        fprintf(map->out, "{\"type\":\"%s\",\"label\":", lost ? "lost" : "recovered");
+        write_string(map->out, map->label);
+        fprintf(map->out, ",\"file\":");
+        write_string(map->out, filename);
+        fprintf(map->out, ",\"lsn\":%u,\"sectors\":%u,\"retries\":%d}\n", lsn, count, retries);
+        fflush(map->out);
+    }
+#ifndef __lv2ppu__
+    pthread_mutex_unlock(&map->lock);
+#endif
+}
+
+uint32_t scarletbook_error_map_lost(scarletbook_error_map_t *map)
+{
+    uint32_t lost;
+
+    if (!map)
+        return 0;
+
+#ifndef __lv2ppu__
+    pthread_mutex_lock(&map->lock);
+#endif
+    lost = map->lost;
+#ifndef __lv2ppu__
+    pthread_mutex_unlock(&map->lock);
+#endif
+    return lost;
+}
+
+void scarletbook_error_map_destroy(scarletbook_error_map_t *map)
+{
+    if (!map)
+        return;
+
+    if (map->out)
+    {
+        fprintf(map->out, "{\"type\":\"summary\",\"label\":");
+        write_string(map->out, map->label);
+        fprintf(map->out, ",\"lost\":%u,\"recovered\":%u,\"retries\":%u}\n", map->lost, map->recovered, map->retries);
+        fflush(map->out);
+    }
+#ifndef __lv2ppu__
+    pthread_mutex_destroy(&map->lock);
+#endif
+    free(map->label);
+    free(map);
+}
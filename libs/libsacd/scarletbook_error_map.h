@@ -0,0 +1,71 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef SCARLETBOOK_ERROR_MAP_H_INCLUDED
+#define SCARLETBOOK_ERROR_MAP_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Map of the sectors an extraction had trouble reading.
+ *
+ * Every run of sectors that needed retries is appended to the map file as a
+ * JSON line: the image or device, the output file, the first sector, the
+ * amount of sectors and of retries, and whether the sectors were "recovered" 
+ * by a retry or "lost" (the audio they held was replaced by silence, an ISO 
+ * gets zeros). A "summary" line follows at the end of the extraction.
+ *
+ * Several threads may add to the same map.
+ */
+
+typedef struct scarletbook_error_map_s scarletbook_error_map_t;
+
+/**
+ * Creates the map of the extraction of "label", written to "out" (which stays
+ * open and may be shared by several maps). "out" may be NULL to only count.
+ */
+scarletbook_error_map_t *scarletbook_error_map_create(FILE *out, const char *label);
+
+/**
+ * Adds "count" sectors at "lsn" of "filename" that took "retries" retries,
+ * "lost" when they still couldn't be read.
+ */
+void scarletbook_error_map_add(scarletbook_error_map_t *, const char *filename, uint32_t lsn, uint32_t count, int retries, int lost);
+
+/**
+ * Amount of sectors lost so far.
+ */
+uint32_t scarletbook_error_map_lost(scarletbook_error_map_t *);
+
+/**
+ * Writes the summary line and frees the map.
+ */
+void scarletbook_error_map_destroy(scarletbook_error_map_t *);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* SCARLETBOOK_ERROR_MAP_H_INCLUDED */
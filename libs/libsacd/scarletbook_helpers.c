@@ -31,6 +31,44 @@
 #define MAX_TRACK_TITLE_LEN 60
 #define MAX_TRACK_ARTIST_LEN 60
 
+#define FNV1A_PRIME 0x100000001b3ULL
+
+uint64_t fnv1a_update(uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+int get_album_catalog_number(master_toc_t *mtoc, char *catalog_number)
+{
+    int i;
+
+    memcpy(catalog_number, mtoc->album_catalog_number, 16);
+    catalog_number[16] = '\0';
+    for (i = 15; i >= 0 && (catalog_number[i] == ' ' || catalog_number[i] == '\0'); i--)
+        catalog_number[i] = '\0';
+    return catalog_number[0] != '\0';
+}
+
+const char *get_album_genre(master_toc_t *mtoc)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        if (mtoc->album_genre[i].category && mtoc->album_genre[i].genre <= MAX_GENRE_COUNT)
+            return album_genre[mtoc->album_genre[i].genre];
+    }
+    return NULL;
+}
+
 char *get_album_dir(scarletbook_handle_t *handle)
 {
     char disc_artist[MAX_DISC_ARTIST_LEN + 1];
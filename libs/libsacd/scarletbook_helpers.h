@@ -66,6 +66,25 @@ char *get_music_filename(scarletbook_handle_t *, int, int, const char *);
 
 int utf8cpy(char *, char *, int);
 
+/**
+ * 64 bit FNV-1a, used for the TOC fingerprint and the catalog hash tables.
+ * Start with FNV1A_SEED and feed the data through as it comes.
+ */
+#define FNV1A_SEED 0xcbf29ce484222325ULL
+
+uint64_t fnv1a_update(uint64_t hash, const void *data, size_t len);
+
+/**
+ * Copies the album catalog number without its padding into "catalog_number",
+ * which holds at least 17 chars. Returns 0 when the disc has none.
+ */
+int get_album_catalog_number(master_toc_t *, char *catalog_number);
+
+/**
+ * Returns the name of the first album genre that is set, NULL if there's none.
+ */
+const char *get_album_genre(master_toc_t *);
+
 #ifdef __cplusplus
 };
 #endif
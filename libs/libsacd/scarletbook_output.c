@@ -38,22 +38,53 @@
 #ifndef __lv2ppu__
 #include <pthread.h>
 #endif
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 #include <sys/atomic.h>
 
 #include <charset.h>
 #include <utils.h>
 #include <logging.h>
+#include <metrics.h>
+#include <trace.h>
 
 #include "scarletbook_output.h"
 #include "scarletbook_read.h"
 #include "sacd_reader.h"
+#include "file_writer.h"
+#include "dsd2pcm.h"
+#include "dsf.h"
+#include "scarletbook_digest.h"
+#include "scarletbook_checkpoint.h"
+#include "scarletbook_error_map.h"
+#include "sacd_read_tuner.h"
 
 #define WRITE_CACHE_SIZE 1 * 1024 * 1024
+#define READ_RETRY_DELAY 10000              // microseconds before retrying a sector, doubled for each retry
+
+// what create_output_file did besides failing
+enum
+{
+    OUTPUT_FILE_CREATED = 0,
+    OUTPUT_FILE_RESUMED,                    // an earlier run's file is carried on from its checkpoint
+    OUTPUT_FILE_SKIPPED                     // an earlier run finished the file
+};
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
 
 extern scarletbook_format_handler_t const * dsdiff_format_fn(void);
 extern scarletbook_format_handler_t const * dsdiff_edit_master_format_fn(void);
 extern scarletbook_format_handler_t const * dsf_format_fn(void);
 extern scarletbook_format_handler_t const * iso_format_fn(void);
+extern scarletbook_format_handler_t const * wav_format_fn(void);
+extern scarletbook_format_handler_t const * aiff_format_fn(void);
+extern scarletbook_format_handler_t const * dop_wav_format_fn(void);
+extern scarletbook_format_handler_t const * dop_raw_format_fn(void);
 
 typedef const scarletbook_format_handler_t *(*sacd_output_format_fn_t)(void); 
 static sacd_output_format_fn_t s_sacd_output_format_fns[] = 
@@ -62,23 +93,39 @@ static sacd_output_format_fn_t s_sacd_output_format_fns[] =
     dsdiff_edit_master_format_fn,
     dsf_format_fn,
     iso_format_fn,
+    wav_format_fn,
+    aiff_format_fn,
+    dop_wav_format_fn,
+    dop_raw_format_fn,
     NULL
 }; 
  
 struct scarletbook_process_frames_args{
     scarletbook_handle_t *handle;
     uint8_t *read_buffer;
+    uint8_t *lost_blocks;                   // blocks of read_buffer that couldn't be read, NULL if none
     int blocks_read;
     int last_block;
     frame_read_callback_t frame_read_callback;
     void *userdata;
+    metrics_t *metrics;
+};
+
+// the blocks a thread reads at a time, the buffers grow with the size its tuner picks
+struct block_reader
+{
+    sacd_read_tuner_t   tuner;
+    uint8_t            *read_buffer;
+    uint8_t            *lost_blocks;
+    uint32_t            capacity;                   // blocks
 };
 
 struct scarletbook_output_s
 {
     struct list_head    ripping_queue;
 
-    uint8_t            *read_buffer;
+    struct block_reader reader;                     // of the processing thread
+    struct block_reader staging;                    // what it reads while the frame thread still has "reader"
 
 #ifdef __lv2ppu__
     sys_ppu_thread_t    processing_thread_id;
@@ -87,12 +134,14 @@ struct scarletbook_output_s
 #endif
     atomic_t            stop_processing;            // indicates if the thread needs to stop or has stopped
     atomic_t            processing;
+    int                 processing_thread_joined;
 
 #ifdef __lv2ppu__
     sys_ppu_thread_t    sub_processing_thread_id;
 #else
     pthread_t           sub_processing_thread_id;
 #endif
+    struct scarletbook_process_frames_args process_frames_args;    // used by the sub processing thread until it is joined
 
     // stats
     int                 stats_total_tracks;
@@ -107,6 +156,34 @@ struct scarletbook_output_s
     fwprintf_callback_t fwprintf_callback;
 
     scarletbook_handle_t *sb_handle;
+
+    scarletbook_area_stream_t area_stream[2];
+
+    int                 direct_io;
+    int                 pcm_rate;                   // see scarletbook_output_set_pcm_rate
+    int                 digests;                    // see scarletbook_output_set_digests
+    int                 verify;                     // see scarletbook_output_set_verify
+    atomic_t            verify_failures;
+    atomic_t            verify_unverified;
+    int                 checkpoint_interval;        // see scarletbook_output_set_checkpoints
+
+    metrics_t          *metrics;                    // see scarletbook_output_set_metrics
+
+    // sectors that can't be read, see scarletbook_output_set_read_errors
+    int                 read_retries;
+    int                 max_read_errors;
+    atomic_t            lost_sectors;
+    scarletbook_error_map_t *error_map;
+
+    // tracks written at the same time, see scarletbook_output_set_track_workers
+    int                 track_workers;
+    int                 non_encrypted_disc;
+#ifndef __lv2ppu__
+    pthread_mutex_t     worker_lock;                // guards the ripping queue & stats between track workers
+    pthread_cond_t      area_order_cond;
+    int                 area_tracks_started[2];     // padding-less DSF tracks of an area are written in queue order
+    int                 area_tracks_finished[2];
+#endif
 };
 
 static scarletbook_format_handler_t const * find_output_format(char const * name)
@@ -137,6 +214,21 @@ static void destroy_ripping_queue(scarletbook_output_t *output)
     }
 }
 
+// a WAV/AIFF track queued right after the previous track of its area takes over the 
+// converter of that track (see pcm.c)
+static void continue_pcm_track(struct list_head *queue, scarletbook_output_format_t *ft)
+{
+    scarletbook_output_format_t *previous;
+
+    if (!(ft->handler.flags & OUTPUT_FLAG_PCM) || list_empty(queue))
+        return;
+    previous = list_entry(queue->prev, scarletbook_output_format_t, siblings);
+    if (previous->handler.write == ft->handler.write && previous->area == ft->area && previous->track == ft->track - 1)
+    {
+        previous->pcm_continued = 1;
+    }
+}
+
 int scarletbook_output_enqueue_track(scarletbook_output_t *output, int area, int track, char *file_path, char *fmt, int dsd_encoded_export, int dsf_nopad, int sub) 
 {
     scarletbook_format_handler_t const * handler;
@@ -156,6 +248,21 @@ int scarletbook_output_enqueue_track(scarletbook_output_t *output, int area, int
         output_format_ptr->dst_encoded_import = sb_handle->area[area].area_toc->frame_format == FRAME_FORMAT_DST;
         output_format_ptr->dsd_encoded_export = dsd_encoded_export;
         output_format_ptr->dsf_nopad = dsf_nopad;
+        output_format_ptr->direct_io = output->direct_io;
+        output_format_ptr->digests = output->digests;
+        output_format_ptr->verify = output->verify;
+        output_format_ptr->output = output;
+        // the tracks of a concurrent ISO are read by the ISO, they can't be resumed by themselves
+        output_format_ptr->checkpoint_interval = output->verify || sub ? 0 : output->checkpoint_interval;
+        if (handler->flags & OUTPUT_FLAG_PCM)
+        {
+            output_format_ptr->pcm_rate = output->pcm_rate ? output->pcm_rate : 88200;
+        }
+        else if (handler->flags & OUTPUT_FLAG_DOP)
+        {
+            output_format_ptr->pcm_rate = SACD_SAMPLING_FREQUENCY / 16;
+        }
+        output_format_ptr->area_stream = &output->area_stream[area];
         if (handler->flags & OUTPUT_FLAG_EDIT_MASTER)
         {
             output_format_ptr->start_lsn = sb_handle->area[area].area_toc->track_start;
@@ -187,10 +294,14 @@ int scarletbook_output_enqueue_track(scarletbook_output_t *output, int area, int
             scarletbook_output_format_t *output_format_ptr_head;
             output_format_ptr_head = list_entry(output->ripping_queue.next, scarletbook_output_format_t, siblings);
             if(output_format_ptr_head)
+            {
+                continue_pcm_track(&output_format_ptr_head->sub_queue, output_format_ptr);
                 list_add_tail(&output_format_ptr->siblings, &output_format_ptr_head->sub_queue);
+            }
         }
         else{
             INIT_LIST_HEAD(&output_format_ptr->sub_queue);
+            continue_pcm_track(&output->ripping_queue, output_format_ptr);
             list_add_tail(&output_format_ptr->siblings, &output->ripping_queue);
         }
 
@@ -214,6 +325,11 @@ int scarletbook_output_enqueue_raw_sectors(scarletbook_output_t *output, int sta
         output_format_ptr->filename = strdup(file_path);
         output_format_ptr->start_lsn = start_lsn;
         output_format_ptr->length_lsn = length_lsn;
+        output_format_ptr->direct_io = output->direct_io;
+        output_format_ptr->digests = output->digests;
+        output_format_ptr->verify = output->verify;
+        output_format_ptr->output = output;
+        output_format_ptr->checkpoint_interval = output->verify ? 0 : output->checkpoint_interval;
 
         LOG(lm_main, LOG_NOTICE, ("Queuing raw: %s, start_lsn: %d, length_lsn: %d", file_path, start_lsn, length_lsn));
 
@@ -224,151 +340,1214 @@ int scarletbook_output_enqueue_raw_sectors(scarletbook_output_t *output, int sta
     return -1;
 }
 
-static int create_output_file(scarletbook_output_format_t *ft)
+// size of the audio data that is going to be written, used to preallocate the file
+static uint64_t expected_output_size(scarletbook_output_format_t *ft)
 {
-    int result;
+    scarletbook_handle_t *sb_handle = ft->sb_handle;
+    uint64_t frame_count;
+
+    if (ft->handler.flags & OUTPUT_FLAG_RAW)
+    {
+        return (uint64_t) ft->length_lsn * SACD_LSN_SIZE;
+    }
+
+    // DST stays smaller than the sectors it is read from
+    if (ft->dst_encoded_import && !ft->dsd_encoded_export)
+    {
+        return (uint64_t) ft->length_lsn * SACD_LSN_SIZE;
+    }
+
+    if (ft->handler.flags & OUTPUT_FLAG_EDIT_MASTER)
+    {
+        frame_count = TIME_FRAMECOUNT(&sb_handle->area[ft->area].area_toc->total_playtime);
+    }
+    else
+    {
+        frame_count = TIME_FRAMECOUNT(&sb_handle->area[ft->area].area_tracklist_time->duration[ft->track]);
+    }
+    // 24 bit samples after the DSD to PCM conversion or DoP packing
+    if (ft->pcm_rate)
+    {
+        return frame_count * (ft->pcm_rate / SACD_FRAME_RATE) * 3 * ft->channel_count;
+    }
+    return frame_count * FRAME_SIZE_64 * ft->channel_count;
+}
+
+// what write_block hands to the handler
+static int payload_kind(scarletbook_output_format_t *ft)
+{
+    if (ft->handler.flags & OUTPUT_FLAG_RAW)
+        return DIGEST_PAYLOAD_SECTORS;
+    if (ft->dst_encoded_import && !ft->dsd_encoded_export)
+        return DIGEST_PAYLOAD_DST;
+    return DIGEST_PAYLOAD_DSD;
+}
+
+// prints how a file went, "detail" in brackets
+static void report_output_file(scarletbook_output_format_t *ft, const char *status, const char *detail)
+{
+    wchar_t *wide_filename;
 
 #ifdef _WIN32
-    wchar_t *wide_filename = (wchar_t *) charset_convert(ft->filename, strlen(ft->filename), "UTF-8", "UCS-2-INTERNAL");
-    ft->fd = _wfopen(wide_filename, L"wb");
+    wide_filename = (wchar_t *) charset_convert(ft->filename, strlen(ft->filename), "UTF-8", sizeof(wchar_t) == 2 ? "UCS-2-INTERNAL" : "UCS-4-INTERNAL");
+#else
+    wide_filename = (wchar_t *) charset_convert(ft->filename, strlen(ft->filename), "UTF-8", "WCHAR_T");
+#endif
+    ft->cb_fwprintf(stdout, L"\r%s: %ls (%s)\n", status, wide_filename, detail);
     free(wide_filename);
+}
+
+static FILE *open_output_file(const char *filename, const char *mode)
+{
+#ifdef _WIN32
+    wchar_t *wide_filename = (wchar_t *) charset_convert(filename, strlen(filename), "UTF-8", "UCS-2-INTERNAL");
+    wchar_t *wide_mode = (wchar_t *) charset_convert(mode, strlen(mode), "UTF-8", "UCS-2-INTERNAL");
+    FILE *fd = _wfopen(wide_filename, wide_mode);
+    free(wide_filename);
+    free(wide_mode);
+    return fd;
 #else
-    ft->fd = fopen(ft->filename, "wb");	
+    return fopen(filename, mode);
 #endif
+}
+
+// returns the size of an output file, -1 when there is none
+static off_t output_file_size(const char *filename)
+{
+    FILE *fd = open_output_file(filename, "rb");
+    off_t size = -1;
+
+    if (fd)
+    {
+        if (fseeko(fd, 0, SEEK_END) == 0)
+            size = ftello(fd);
+        fclose(fd);
+    }
+    return size;
+}
+
+// the part of a checkpoint that tells which output it belongs to
+static void init_checkpoint(scarletbook_output_format_t *ft, scarletbook_checkpoint_t *checkpoint)
+{
+    memset(checkpoint, 0, sizeof(scarletbook_checkpoint_t));
+    strncpy(checkpoint->handler, ft->handler.name, sizeof(checkpoint->handler) - 1);
+    checkpoint->toc_fingerprint = ft->sb_handle->toc_fingerprint;
+    checkpoint->area = ft->area;
+    checkpoint->track = ft->track;
+    checkpoint->start_lsn = ft->start_lsn;
+    checkpoint->length_lsn = ft->length_lsn;
+    checkpoint->options = (ft->dst_encoded_import ? CHECKPOINT_DST_IMPORT : 0) |
+                          (ft->dsd_encoded_export ? CHECKPOINT_DSD_EXPORT : 0) |
+                          (ft->dsf_nopad ? CHECKPOINT_DSF_NOPAD : 0);
+    checkpoint->current_lsn = ft->start_lsn;
+}
+
+static int same_output(const scarletbook_checkpoint_t *a, const scarletbook_checkpoint_t *b)
+{
+    return strncmp(a->handler, b->handler, sizeof(a->handler)) == 0 && a->toc_fingerprint == b->toc_fingerprint &&
+           a->area == b->area && a->track == b->track && a->start_lsn == b->start_lsn && 
+           a->length_lsn == b->length_lsn && a->options == b->options;
+}
+
+// records how far "ft" got, called at a sector boundary once the frames that started before 
+// current_lsn have been handed on
+static void save_checkpoint(scarletbook_output_format_t *ft)
+{
+    scarletbook_checkpoint_t checkpoint;
+    scarletbook_audio_frame_t *frame = &ft->sb_handle->frame;
+    uint8_t *state = 0;
+    size_t state_size = 0;
+    off_t position;
+
+    TRACE_BEGIN("checkpoint", "lsn", ft->current_lsn);
+
+#ifndef __lv2ppu__
+    // the frames still being decoded belong to the sectors before current_lsn
+    if (ft->dsd_encoded_export && ft->dst_encoded_import)
+    {
+        dst_decoder_flush(ft->dst_decoder);
+    }
+#endif
+
+    if (file_writer_sync(ft->fd) != 0 || (position = ftello(ft->fd)) < 0)
+    {
+        LOG(lm_main, LOG_ERROR, ("can't sync %s for a checkpoint, errno: %d, %s", ft->filename, errno, strerror(errno)));
+    }
+    else if (!ft->handler.savestate || (state = ft->handler.savestate(ft, &state_size)))
+    {
+        init_checkpoint(ft, &checkpoint);
+        checkpoint.current_lsn = ft->current_lsn;
+        checkpoint.file_size = (uint64_t) position;
+        checkpoint.write_length = ft->write_length;
+        checkpoint.frame_started = frame->started;
+        checkpoint.frame_size = frame->started ? frame->size : 0;
+        checkpoint.frame_sector_count = frame->sector_count;
+        checkpoint.frame_channel_count = frame->channel_count;
+        checkpoint.frame_dst_encoded = frame->dst_encoded;
+        checkpoint.frame_time_code = frame->time_code;
+        checkpoint.next_time_code = ft->sb_handle->next_time_code;
+        scarletbook_checkpoint_save(ft->filename, &checkpoint, frame->data, state, state_size);
+        free(state);
+    }
+    ft->checkpoint_time = time(0);
+
+    TRACE_END("checkpoint");
+}
+
+static inline void poll_checkpoint(scarletbook_output_format_t *ft)
+{
+    if (ft->checkpoint_interval && time(0) - ft->checkpoint_time >= ft->checkpoint_interval)
+    {
+        save_checkpoint(ft);
+    }
+}
+
+// marks a file as finished, the next run only skips files with such a checkpoint. The
+// one of a padding-less DSF track keeps its tail for the next track of the area.
+static void finish_checkpoint(scarletbook_output_format_t *ft)
+{
+    scarletbook_area_stream_t *area_stream = ft->area_stream;
+    scarletbook_checkpoint_t checkpoint;
+    uint32_t *state = 0;
+    size_t state_size = 0;
+    off_t file_size;
+    int i;
+
+    file_size = output_file_size(ft->filename);
+    if (file_size < 0)
+    {
+        scarletbook_checkpoint_remove(ft->filename);
+        return;
+    }
+
+    if (ft->dsf_nopad && area_stream && area_stream->dsf_carry_over && 
+        ft->track < ft->sb_handle->area[ft->area].area_toc->track_count - 1)
+    {
+        state_size = MAX_CHANNEL_COUNT * (sizeof(uint32_t) + SACD_BLOCK_SIZE_PER_CHANNEL);
+        state = (uint32_t *) malloc(state_size);
+        if (!state)
+        {
+            // without its tail the file can't be skipped, the next run extracts it again
+            scarletbook_checkpoint_remove(ft->filename);
+            return;
+        }
+        for (i = 0; i < MAX_CHANNEL_COUNT; i++)
+        {
+            state[i] = (uint32_t) area_stream->dsf_carry_over_len[i];
+        }
+        memcpy(state + MAX_CHANNEL_COUNT, area_stream->dsf_carry_over, MAX_CHANNEL_COUNT * SACD_BLOCK_SIZE_PER_CHANNEL);
+    }
+
+    init_checkpoint(ft, &checkpoint);
+    checkpoint.complete = 1;
+    checkpoint.current_lsn = ft->start_lsn + ft->length_lsn;
+    checkpoint.file_size = (uint64_t) file_size;
+    if (scarletbook_checkpoint_save(ft->filename, &checkpoint, 0, (uint8_t *) state, state_size) != 0)
+    {
+        scarletbook_checkpoint_remove(ft->filename);
+    }
+    free(state);
+}
+
+// takes the tail of a padding-less DSF track from its checkpoint
+static int load_carry_over(scarletbook_output_format_t *ft, const uint8_t *state, size_t state_size)
+{
+    scarletbook_area_stream_t *area_stream = ft->area_stream;
+    uint32_t len;
+    int i;
+
+    // the last track and a padded one hand nothing on
+    if (!ft->dsf_nopad || !area_stream || state_size == 0)
+        return 0;
+    if (state_size != MAX_CHANNEL_COUNT * (sizeof(uint32_t) + SACD_BLOCK_SIZE_PER_CHANNEL))
+        return -1;
+
+    if (!area_stream->dsf_carry_over)
+        area_stream->dsf_carry_over = (uint8_t *) calloc(MAX_CHANNEL_COUNT, SACD_BLOCK_SIZE_PER_CHANNEL);
+    if (!area_stream->dsf_carry_over)
+        return -1;
+
+    for (i = 0; i < MAX_CHANNEL_COUNT; i++)
+    {
+        memcpy(&len, state + i * sizeof(uint32_t), sizeof(uint32_t));
+        if (len > SACD_BLOCK_SIZE_PER_CHANNEL)
+            return -1;
+        area_stream->dsf_carry_over_len[i] = len;
+    }
+    memcpy(area_stream->dsf_carry_over, state + MAX_CHANNEL_COUNT * sizeof(uint32_t), MAX_CHANNEL_COUNT * SACD_BLOCK_SIZE_PER_CHANNEL);
+    return 0;
+}
+
+// picks up what an earlier run left of "ft", returns one of the OUTPUT_FILE values, 
+// a resumed file is open and positioned at its checkpoint
+static int resume_output_file(scarletbook_output_format_t *ft)
+{
+    scarletbook_checkpoint_t checkpoint, expected;
+    scarletbook_audio_frame_t *frame = &ft->sb_handle->frame;
+    uint8_t *frame_data, *state;
+    size_t state_size;
+    off_t file_size;
+    FILE *fd;
+    char progress[32];
+    int result = OUTPUT_FILE_CREATED;
+
+    // a file without a checkpoint may be left from a run without --resume, it is extracted again
+    if (scarletbook_checkpoint_load(ft->filename, &checkpoint, &frame_data, &state, &state_size) != 0)
+    {
+        return OUTPUT_FILE_CREATED;
+    }
+
+    init_checkpoint(ft, &expected);
+    if (!same_output(&checkpoint, &expected))
+    {
+        LOG(lm_main, LOG_NOTICE, ("the checkpoint of %s was taken with other options, starting over", ft->filename));
+    }
+    else if (checkpoint.complete)
+    {
+        // only the file the checkpoint was taken of counts as finished
+        if (output_file_size(ft->filename) != (off_t) checkpoint.file_size)
+        {
+            LOG(lm_main, LOG_NOTICE, ("%s changed since it was finished, starting over", ft->filename));
+        }
+        else if (load_carry_over(ft, state, state_size) == 0)
+        {
+            report_output_file(ft, "Skipped", "already extracted");
+            result = OUTPUT_FILE_SKIPPED;
+        }
+    }
+    else if (checkpoint.file_size > 0 && checkpoint.current_lsn > ft->start_lsn && checkpoint.current_lsn <= ft->start_lsn + ft->length_lsn &&
+             checkpoint.frame_size >= 0 && checkpoint.frame_size < MAX_DST_SIZE && (fd = open_output_file(ft->filename, "r+b")))
+    {
+        ft->write_cache = malloc(WRITE_CACHE_SIZE);
+        setvbuf(fd, ft->write_cache, _IOFBF , WRITE_CACHE_SIZE);
+
+        // what was written after the checkpoint is cut off and written again
+        ft->priv = calloc(1, ft->handler.priv_size);
+        if (fseeko(fd, 0, SEEK_END) == 0 && (file_size = ftello(fd)) >= 0 && (uint64_t) file_size >= checkpoint.file_size &&
+            file_writer_cut(fd, checkpoint.file_size) == 0 && ft->priv &&
+            (!ft->handler.loadstate || ft->handler.loadstate(ft, state, state_size) == 0))
+        {
+            ft->fd = fd;
+            ft->current_lsn = checkpoint.current_lsn;
+            ft->write_length = checkpoint.write_length;
+
+            memcpy(frame->data, frame_data, (size_t) checkpoint.frame_size);
+            frame->size = checkpoint.frame_size;
+            frame->started = checkpoint.frame_started;
+            frame->sector_count = checkpoint.frame_sector_count;
+            frame->channel_count = checkpoint.frame_channel_count;
+            frame->dst_encoded = checkpoint.frame_dst_encoded;
+            frame->time_code = checkpoint.frame_time_code;
+            ft->sb_handle->next_time_code = checkpoint.next_time_code;
+
+            snprintf(progress, sizeof(progress), "at %d%%", (int) ((uint64_t) (ft->current_lsn - ft->start_lsn) * 100 / ft->length_lsn));
+            report_output_file(ft, "Resuming", progress);
+            result = OUTPUT_FILE_RESUMED;
+        }
+        else
+        {
+            LOG(lm_main, LOG_NOTICE, ("can't resume %s from its checkpoint, starting over", ft->filename));
+            fclose(fd);
+            free(ft->write_cache);
+            free(ft->priv);
+            ft->write_cache = 0;
+            ft->priv = 0;
+        }
+    }
+
+    free(frame_data);
+    free(state);
+    return result;
+}
+
+static int create_output_file(scarletbook_output_format_t *ft)
+{
+    scarletbook_checkpoint_t checkpoint;
+    int result, resumed = 0;
+    uint64_t expected_size = expected_output_size(ft);
+
+    // the track span ends in close_output_file
+    TRACE_BEGIN_TEXT("track", "file", ft->filename);
+
+    ft->current_lsn = ft->start_lsn;
+
+    // handlers that can't restore their state and the ISO of a concurrent extraction start over
+    if (ft->checkpoint_interval && ((!ft->handler.loadstate && ft->handler.priv_size) || !list_empty(&ft->sub_queue)))
+    {
+        ft->checkpoint_interval = 0;
+    }
+#ifdef __lv2ppu__
+    // the SPU decoder can't be waited for
+    if (ft->dsd_encoded_export && ft->dst_encoded_import)
+    {
+        ft->checkpoint_interval = 0;
+    }
+#endif
+    if (ft->checkpoint_interval)
+    {
+        result = resume_output_file(ft);
+        if (result == OUTPUT_FILE_SKIPPED)
+        {
+            return result;
+        }
+        resumed = result == OUTPUT_FILE_RESUMED;
+
+        // the checkpoints sync the file through stdio
+        ft->direct_io = 0;
+
+        if (!resumed)
+        {
+            // an empty checkpoint first, where none can be written the file is extracted without
+            init_checkpoint(ft, &checkpoint);
+            if (scarletbook_checkpoint_save(ft->filename, &checkpoint, 0, 0, 0) != 0)
+            {
+                LOG(lm_main, LOG_WARNING, ("no checkpoints for %s, it can't be resumed", ft->filename));
+                ft->checkpoint_interval = 0;
+            }
+        }
+        else if (ft->digests)
+        {
+            LOG(lm_main, LOG_NOTICE, ("no digests for the resumed file %s", ft->filename));
+            ft->digests = 0;
+        }
+    }
+
+    // verifying writes nothing, the output only goes into the digests
+    if (ft->verify)
+    {
+        ft->digest = scarletbook_digest_create(payload_kind(ft));
+        if (!ft->digest)
+        {
+            LOG(lm_main, LOG_ERROR, ("can't verify %s", ft->filename));
+            goto error;
+        }
+        ft->direct_io = 0;
+        ft->fd = file_writer_open_tee(NULL, scarletbook_digest_container, ft->digest);
+        if (!ft->fd)
+        {
+            ft->fd = fopen(NULL_DEVICE, "wb");
+        }
+    }
+    else if (ft->direct_io)
+    {
+        ft->fd = file_writer_open_direct(ft->filename, expected_size);
+        ft->direct_io = ft->fd != 0;
+    }
+    if (!ft->direct_io && !ft->verify && !resumed)
+    {
+        ft->fd = open_output_file(ft->filename, "wb");
+    }
     if (ft->fd == 0)
     {   
         LOG(lm_main, LOG_ERROR, ("error creating %s, errno: %d, %s", ft->filename, errno, strerror(errno)));
         goto error;
     }
 
-#ifdef __lv2ppu__
-    sysFsChmod(ft->filename, S_IFMT | 0777); 
-#endif
+#ifdef __lv2ppu__
+    sysFsChmod(ft->filename, S_IFMT | 0777); 
+#endif
+
+    if (!ft->direct_io && !ft->verify)
+    {
+        file_writer_preallocate(ft->fd, expected_size);
+    }
+
+    // the digests see the payload in write_block and the container through a tee of the file
+    if (ft->digests && !ft->verify)
+    {
+        FILE *tee_fd;
+
+        ft->digest = scarletbook_digest_create(payload_kind(ft));
+        if (ft->digest && (tee_fd = file_writer_open_tee(ft->fd, scarletbook_digest_container, ft->digest)))
+        {
+            ft->fd = tee_fd;
+            ft->direct_io = 0;
+        }
+    }
+
+    if (!ft->direct_io && !ft->write_cache)
+    {
+        ft->write_cache = malloc(WRITE_CACHE_SIZE);
+        setvbuf(ft->fd, ft->write_cache, _IOFBF , WRITE_CACHE_SIZE);
+    }
+
+    ft->checkpoint_time = time(0);
+
+    // a resumed handler has its state back already
+    if (resumed)
+    {
+        return 0;
+    }
+
+    ft->priv = calloc(1, ft->handler.priv_size);
+
+    result = ft->handler.startwrite ? (*ft->handler.startwrite)(ft) : 0;
+
+    return result;
+
+error:
+
+    // close_output_file will be called
+    return -1;
+}
+
+// compares a file derived again with the one extracted before
+static void verify_output_file(scarletbook_output_format_t *ft, const scarletbook_digest_result_t *digest)
+{
+    char reason[128];
+    int result;
+
+    result = scarletbook_digest_verify(ft->filename, digest, reason, sizeof(reason));
+    if (result == DIGEST_VERIFY_UNVERIFIED)
+    {
+        sysAtomicInc(&ft->output->verify_unverified);
+    }
+    else if (result != DIGEST_VERIFY_OK)
+    {
+        sysAtomicInc(&ft->output->verify_failures);
+    }
+
+    if (result == DIGEST_VERIFY_OK)
+        report_output_file(ft, "Verified", reason);
+    else if (result == DIGEST_VERIFY_UNVERIFIED)
+        report_output_file(ft, "Not verified", reason);
+    else
+        report_output_file(ft, result == DIGEST_VERIFY_MISSING ? "MISSING" : "MISMATCH", reason);
+}
+
+// "completed" is 0 for files that are removed afterwards
+static inline int close_output_file(scarletbook_output_format_t * ft, int completed)
+{
+    int result;
+
+    result = ft->handler.stopwrite ? (*ft->handler.stopwrite)(ft) : 0;
+
+    if (ft->fd)
+    {
+        if (!ft->direct_io)
+        {
+            file_writer_trim(ft->fd);
+        }
+        fclose(ft->fd);
+    }
+    // a file cut short by a read error keeps its checkpoint as well
+    if (ft->checkpoint_interval && completed && ft->current_lsn == ft->start_lsn + ft->length_lsn)
+    {
+        finish_checkpoint(ft);
+    }
+    if (ft->digest)
+    {
+        scarletbook_digest_result_t digest;
+
+        scarletbook_digest_close(ft->digest, &digest);
+        if (completed && ft->verify)
+        {
+            verify_output_file(ft, &digest);
+        }
+        else if (completed)
+        {
+            scarletbook_manifest_append(ft->filename, &digest);
+        }
+    }
+    free(ft->write_cache);
+    free(ft->filename);
+    free(ft->priv);
+    free(ft);
+
+    TRACE_END("track");
+    return result;
+}
+
+// releases a file that create_output_file found finished
+static void skip_output_file(scarletbook_output_format_t *ft)
+{
+    free(ft->filename);
+    free(ft);
+
+    TRACE_END("track");
+}
+
+static void scarletbook_output_init_stats(scarletbook_output_t *output)
+{
+    struct list_head * node_ptr;
+    scarletbook_output_format_t * output_format_ptr;
+
+    output->stats_total_sectors = 0;
+    output->stats_total_sectors_processed = 0;
+    output->stats_current_file_total_sectors = 0;
+    output->stats_current_file_sectors_processed = 0;
+    output->stats_current_track = 0;
+    output->stats_total_tracks = 0;
+    list_for_each(node_ptr, &output->ripping_queue)
+    {
+        output_format_ptr = list_entry(node_ptr, scarletbook_output_format_t, siblings);
+        output->stats_total_sectors += output_format_ptr->length_lsn;
+        output->stats_total_tracks++;
+    }
+}
+
+static inline size_t write_block(scarletbook_output_format_t * ft, const uint8_t *buf, size_t len)
+{
+    uint64_t start = metrics_start();
+    size_t actual = ft->handler.write? (*ft->handler.write)(ft, buf, len) : 0;
+    ft->write_length += actual;
+    if (ft->digest)
+    {
+        // RAW handlers count in sectors
+        scarletbook_digest_payload(ft->digest, buf, ft->handler.flags & OUTPUT_FLAG_RAW ? len * SACD_LSN_SIZE : len);
+    }
+    metrics_stop(METRICS_WRITE, start, actual);
+    return actual;
+}
+
+// copies RAW output blocks inside the kernel, returns the number of blocks copied
+static ssize_t copy_raw_blocks(scarletbook_output_format_t *ft, sacd_read_tuner_t *tuner, uint32_t block_count)
+{
+    ssize_t copied;
+    off_t out_offset;
+    int out_fd;
+    uint64_t start, began;
+
+    if (fflush(ft->fd) != 0 || (out_fd = fileno(ft->fd)) < 0 || (out_offset = ftello(ft->fd)) < 0)
+    {
+        return -1;
+    }
+
+    // reading and writing are one call here, it counts as writing
+    TRACE_BEGIN("copy", "lsn", ft->current_lsn);
+    start = metrics_start();
+    began = metrics_now();
+    copied = sacd_copy_block_raw(ft->sb_handle->sacd, ft->current_lsn, block_count, out_fd, out_offset);
+    if (copied > 0)
+    {
+        sacd_read_tuner_update(tuner, (uint32_t) copied, metrics_now() - began);
+    }
+    metrics_stop(METRICS_WRITE, start, (uint64_t) max(copied, 0) * SACD_LSN_SIZE);
+    TRACE_END("copy");
+
+    // the data went around stdio, move its position to the end of the copied blocks
+    fseeko(ft->fd, out_offset + (off_t) max(copied, 0) * SACD_LSN_SIZE, SEEK_SET);
+    if (copied > 0)
+    {
+        ft->write_length += (uint64_t) copied * SACD_LSN_SIZE;
+    }
+    return copied;
+}
+
+static void frame_decoded_callback(uint8_t* frame_data, size_t frame_size, void *userdata)
+{
+    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
+    write_block(ft, frame_data, frame_size);
+}
+
+static void frame_error_callback(int frame_count, int frame_error_code, const char *frame_error_message, void *userdata)
+{
+    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
+#ifdef _WIN32
+    wchar_t *wide_errormessage = (wchar_t *) charset_convert(frame_error_message, strlen(frame_error_message), "UTF-8", sizeof(wchar_t) == 2 ? "UCS-2-INTERNAL" : "UCS-4-INTERNAL");
+#else
+    wchar_t *wide_errormessage = (wchar_t *) charset_convert(frame_error_message, strlen(frame_error_message), "UTF-8", "WCHAR_T");
+#endif
+    ft->cb_fwprintf(stderr, L"\nERROR %ls in frame: %d\n", wide_errormessage, frame_count);
+    free(wide_errormessage);
+}
+
+static void frame_read_callback(scarletbook_handle_t *handle, uint8_t* frame_data, size_t frame_size, void *userdata)
+{
+    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
+
+    if (ft->dsd_encoded_export && ft->dst_encoded_import)
+    {
+        dst_decoder_decode(ft->dst_decoder, frame_data, frame_size);
+    }
+    else
+    {
+        write_block(ft, frame_data, frame_size);
+    }
+}
+
+// hands the frames of the blocks read on, runs of blocks that couldn't be read 
+// make the frames they held get replaced by silence
+static void process_blocks(scarletbook_handle_t *handle, uint8_t *read_buffer, const uint8_t *lost_blocks, int blocks_read, int last_block, frame_read_callback_t frame_read_callback, void *userdata)
+{
+    int i, run;
+
+    if (!lost_blocks)
+    {
+        scarletbook_process_frames(handle, read_buffer, blocks_read, last_block, frame_read_callback, userdata);
+        return;
+    }
+
+    for (i = 0; i < blocks_read; i += run)
+    {
+        for (run = 1; i + run < blocks_read && lost_blocks[i + run] == lost_blocks[i]; run++)
+            ;
+        if (lost_blocks[i])
+        {
+            scarletbook_process_lost_sectors(handle, run, frame_read_callback, userdata);
+        }
+        else
+        {
+            scarletbook_process_frames(handle, read_buffer + i * SACD_LSN_SIZE, run, last_block && i + run == blocks_read, frame_read_callback, userdata);
+        }
+    }
+    if (last_block && blocks_read > 0 && lost_blocks[blocks_read - 1])
+    {
+        scarletbook_process_frames(handle, read_buffer, 0, 1, frame_read_callback, userdata);
+    }
+}
+
+#ifdef __lv2ppu__
+static void scarletbook_process_frames_thread(void *args){
+#else
+static void *scarletbook_process_frames_thread(void *void_args){
+#endif
+    struct scarletbook_process_frames_args *args;
+    uint64_t start;
+    args = (struct scarletbook_process_frames_args *)void_args;
+    metrics_thread_enter(args->metrics, "frame demux");
+    TRACE_THREAD("frame demux");
+    TRACE_BEGIN("demux", "blocks", args->blocks_read);
+    start = metrics_start();
+    process_blocks(args->handle, args->read_buffer, args->lost_blocks, args->blocks_read, args->last_block, args->frame_read_callback, args->userdata);
+    metrics_stop(METRICS_DEMUX, start, (uint64_t) args->blocks_read * SACD_LSN_SIZE);
+    TRACE_END("demux");
+    return 0;
+}
+
+int scarletbook_output_start_process_frames_thread(scarletbook_output_t *output, struct scarletbook_process_frames_args *args)
+{
+    int ret = 0;
+
+    args->metrics = output->metrics;
+    TRACE_BEGIN("start frame thread", NULL, TRACE_NO_ARG);
+#ifdef __lv2ppu__
+    ret = sysThreadCreate(&output->sub_processing_thread_id,
+                          scarletbook_process_frames_thread,
+                          (void *) args,
+                          1050,
+                          8192,
+                          THREAD_JOINABLE,
+                          "scarletbook_process_frames_thread");
+#else
+    ret = pthread_create(&output->sub_processing_thread_id, NULL, scarletbook_process_frames_thread, (void *) args);
+#endif
+    TRACE_END("start frame thread");
+    if (ret)
+    {
+        LOG(lm_main, LOG_ERROR, ("return code from sub processing thread creation is %d\n", ret));
+    }
+
+    return ret;
+}
+
+// returns how many blocks to read next, reads never cross the border of an encrypted area
+static uint32_t get_block_range(scarletbook_handle_t *handle, uint32_t current_lsn, uint32_t end_lsn, uint32_t max_blocks, int *encrypted)
+{
+    uint32_t block_size;
+    uint32_t encrypted_start_1 = 0;
+    uint32_t encrypted_start_2 = 0;
+    uint32_t encrypted_end_1 = 0;
+    uint32_t encrypted_end_2 = 0;
+
+    // set the encryption range
+    if (handle->area[0].area_toc != 0)
+    {
+        encrypted_start_1 = handle->area[0].area_toc->track_start;
+        encrypted_end_1 = handle->area[0].area_toc->track_end;
+    }
+    if (handle->area[1].area_toc != 0)
+    {
+        encrypted_start_2 = handle->area[1].area_toc->track_start;
+        encrypted_end_2 = handle->area[1].area_toc->track_end;
+    }
+
+    // check what block ranges are encrypted..
+    if (current_lsn < encrypted_start_1)
+    {
+        block_size = min(encrypted_start_1 - current_lsn, max_blocks);
+        *encrypted = 0;
+    }
+    else if (current_lsn >= encrypted_start_1 && current_lsn <= encrypted_end_1)
+    {
+        block_size = min(encrypted_end_1 + 1 - current_lsn, max_blocks);
+        *encrypted = 1;
+    }
+    else if (current_lsn > encrypted_end_1 && current_lsn < encrypted_start_2)
+    {
+        block_size = min(encrypted_start_2 - current_lsn, max_blocks);
+        *encrypted = 0;
+    }
+    else if (current_lsn >= encrypted_start_2 && current_lsn <= encrypted_end_2)
+    {
+        block_size = min(encrypted_end_2 + 1 - current_lsn, max_blocks);
+        *encrypted = 1;
+    }
+    else
+    {
+        block_size = max_blocks;
+        *encrypted = 0;
+    }
+    return min(end_lsn - current_lsn, block_size);
+}
+
+// the ATAPI call which returns the flag if the disc is encrypted or not is unknown at this point. 
+// user reports tell me that the only non-encrypted discs out there are DSD 3 14/16 discs. 
+// this is a quick hack/fix for these discs.
+static int is_non_encrypted_disc(scarletbook_handle_t *handle, int area, uint8_t *first_encrypted_block)
+{
+    switch (handle->area[area].area_toc->frame_format)
+    {
+    case FRAME_FORMAT_DSD_3_IN_14:
+    case FRAME_FORMAT_DSD_3_IN_16:
+        return *(uint64_t *)(first_encrypted_block + 16) == 0;
+    }
+    return 0;
+}
+
+// reads up to "count" blocks, returns how many were read
+static uint32_t read_sectors(sacd_reader_t *sacd, uint32_t lsn, uint32_t count, int flags, uint8_t *buffer)
+{
+    sacd_block_range_t range;
+    ssize_t ret;
+
+    if (flags)
+    {
+        range.lsn = lsn;
+        range.count = count;
+        range.buffer = buffer;
+        ret = sacd_read_block_ranges(sacd, &range, 1, flags);
+    }
+    else
+    {
+        ret = sacd_read_block_raw(sacd, lsn, count, buffer);
+    }
+    return ret > 0 ? (uint32_t) min((size_t) ret, count) : 0;
+}
+
+// reads what's left of a failed read by halves, down to single sectors which are retried 
+// a few times. Sectors that stay unreadable are zeroed and marked in "lost_blocks". 
+// Returns the number of lost sectors, -1 once there are more than the extraction allows.
+static int recover_sectors(scarletbook_output_format_t *ft, uint32_t lsn, uint32_t count, int flags, uint8_t *buffer, uint8_t *lost_blocks)
+{
+    scarletbook_output_t *output = ft->output;
+    sacd_reader_t *sacd = ft->sb_handle->sacd;
+    uint32_t got, half;
+    int retry, lost, lost_2nd, delay = READ_RETRY_DELAY;
+
+    got = read_sectors(sacd, lsn, count, flags, buffer);
+    if (got == count)
+    {
+        return 0;
+    }
+    lsn += got;
+    count -= got;
+    buffer += got * SACD_LSN_SIZE;
+    lost_blocks += got;
+
+    if (count > 1)
+    {
+        half = count / 2;
+        lost = recover_sectors(ft, lsn, half, flags, buffer, lost_blocks);
+        if (lost < 0)
+        {
+            return lost;
+        }
+        lost_2nd = recover_sectors(ft, lsn + half, count - half, flags, buffer + half * SACD_LSN_SIZE, lost_blocks + half);
+        return lost_2nd < 0 ? lost_2nd : lost + lost_2nd;
+    }
+
+    for (retry = 1; retry <= output->read_retries && sysAtomicRead(&output->stop_processing) == 0; retry++, delay *= 2)
+    {
+        usleep(delay);
+        if (read_sectors(sacd, lsn, 1, flags, buffer) == 1)
+        {
+            LOG(lm_main, LOG_NOTICE, ("sector %u of %s read after %d retries", lsn, ft->filename, retry));
+            scarletbook_error_map_add(output->error_map, ft->filename, lsn, 1, retry, 0);
+            return 0;
+        }
+    }
+
+    LOG(lm_main, LOG_ERROR, ("sector %u of %s can't be read", lsn, ft->filename));
+    memset(buffer, 0, SACD_LSN_SIZE);
+    *lost_blocks = 1;
+    scarletbook_error_map_add(output->error_map, ft->filename, lsn, 1, retry - 1, 1);
+    sysAtomicInc(&output->lost_sectors);
+    if (output->max_read_errors && (int) sysAtomicRead(&output->lost_sectors) > output->max_read_errors)
+    {
+        LOG(lm_main, LOG_ERROR, ("more than %d sectors can't be read, giving up", output->max_read_errors));
+        return -1;
+    }
+    return 1;
+}
+
+// reads "count" blocks, sectors that can't be read are zeroed and marked in "lost_blocks" 
+// (see recover_sectors). Returns the number of lost sectors or -1 when the extraction 
+// has to stop. Reads without trouble go into the tuner.
+static int read_blocks(scarletbook_output_format_t *ft, sacd_read_tuner_t *tuner, uint32_t lsn, uint32_t count, int flags, uint8_t *buffer, uint8_t *lost_blocks)
+{
+    uint64_t start, began;
+    int lost;
+
+    TRACE_BEGIN("read", "lsn", lsn);
+    start = metrics_start();
+    began = metrics_now();
+    memset(lost_blocks, 0, count);
+    lost = recover_sectors(ft, lsn, count, flags, buffer, lost_blocks);
+    if (lost == 0)
+    {
+        sacd_read_tuner_update(tuner, count, metrics_now() - began);
+    }
+    metrics_stop(METRICS_READ, start, (uint64_t) count * SACD_LSN_SIZE);
+    TRACE_END("read");
+    return lost;
+}
+
+// makes room for "count" blocks in the buffers of "reader"
+static int reserve_blocks(struct block_reader *reader, uint32_t count)
+{
+    uint8_t *read_buffer, *lost_blocks;
+
+    if (count <= reader->capacity)
+        return 0;
+
+    read_buffer = (uint8_t *) realloc(reader->read_buffer, (size_t) count * SACD_LSN_SIZE);
+    if (read_buffer)
+        reader->read_buffer = read_buffer;
+    lost_blocks = (uint8_t *) realloc(reader->lost_blocks, count);
+    if (lost_blocks)
+        reader->lost_blocks = lost_blocks;
+    if (!read_buffer || !lost_blocks)
+    {
+        LOG(lm_main, LOG_ERROR, ("could not allocate a read buffer of %u blocks", count));
+        return -1;
+    }
+    reader->capacity = count;
+    return 0;
+}
+
+// zeroes the lost sectors again once the blocks have been decrypted
+static void clear_lost_blocks(uint8_t *buffer, const uint8_t *lost_blocks, uint32_t count)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (lost_blocks[i])
+        {
+            memset(buffer + i * SACD_LSN_SIZE, 0, SACD_LSN_SIZE);
+        }
+    }
+}
+
+// lets the frame processing tell how many frames were lost to unreadable sectors
+static void expect_track_frames(scarletbook_output_format_t *ft)
+{
+    scarletbook_area_t *area = &ft->sb_handle->area[ft->area];
+    int first = 0, last = ft->track;
+
+    if (!(ft->handler.flags & (OUTPUT_FLAG_DSD | OUTPUT_FLAG_DST)) || !area->area_toc || !area->area_tracklist_time)
+    {
+        return;
+    }
+    if (ft->handler.flags & OUTPUT_FLAG_EDIT_MASTER)
+    {
+        last = area->area_toc->track_count - 1;
+    }
+    else
+    {
+        first = ft->track;
+    }
+    scarletbook_frame_expect(ft->sb_handle, TIME_FRAMECOUNT(&area->area_tracklist_time->start[first]),
+                             TIME_FRAMECOUNT(&area->area_tracklist_time->start[last]) + TIME_FRAMECOUNT(&area->area_tracklist_time->duration[last]),
+                             area->area_toc->channel_count);
+}
+
+#ifndef __lv2ppu__
+// tracks can be written at the same time when each of them is a complete DSF/DSDIFF 
+// file of its own and the source can be read from several threads
+static int can_write_tracks_in_parallel(scarletbook_output_t *output)
+{
+    struct list_head * node_ptr;
+    scarletbook_output_format_t * ft;
+    int count = 0;
+
+    if (output->track_workers < 2 || !sacd_supports_concurrent_read(output->sb_handle->sacd))
+        return 0;
+
+    list_for_each(node_ptr, &output->ripping_queue)
+    {
+        ft = list_entry(node_ptr, scarletbook_output_format_t, siblings);
+        if (!list_empty(&ft->sub_queue) || !(ft->handler.flags & (OUTPUT_FLAG_DSD | OUTPUT_FLAG_DST)))
+            return 0;
+        count++;
+    }
+    return count > 1;
+}
+
+static void remove_output_file(char *filename)
+{
+    if (remove(filename) != 0)
+    {
+        LOG(lm_main, LOG_ERROR, ("user cancelled, error removing: %s, [%s]", filename, strerror(errno)));
+    }
+}
+
+// writes a complete track, called from a track worker with its own read buffer, 
+// frame state and DST decoder
+static void write_track(scarletbook_output_t *output, scarletbook_output_format_t *ft, struct block_reader *reader, int order_idx, int decoder_threads)
+{
+    scarletbook_handle_t *handle;
+    uint32_t block_size, end_lsn;
+    int encrypted, area = ft->area, ordered = ft->dsf_nopad || (ft->handler.flags & OUTPUT_FLAG_PCM);
+    int started = 0, completed = 0, skipped = 0, result, lost;
+    uint8_t *read_buffer, *lost_blocks;
+    uint64_t start;
+    char *file_to_remove;
+
+    // padding-less DSF takes over the tail of the previous track in the same area, 
+    // WAV/AIFF its converter, so these tracks are written one after the other
+    if (ordered)
+    {
+        pthread_mutex_lock(&output->worker_lock);
+        while (output->area_tracks_finished[area] != order_idx)
+        {
+            pthread_cond_wait(&output->area_order_cond, &output->worker_lock);
+        }
+        pthread_mutex_unlock(&output->worker_lock);
+    }
+
+    handle = scarletbook_frame_clone(output->sb_handle);
+    if (!handle)
+    {
+        LOG(lm_main, LOG_ERROR, ("could not allocate frame state for %s", ft->filename));
+        sysAtomicSet(&output->stop_processing, 1);
+    }
+    else if (sysAtomicRead(&output->stop_processing) == 0)
+    {
+        ft->sb_handle = handle;
+        expect_track_frames(ft);
 
-    ft->write_cache = malloc(WRITE_CACHE_SIZE);
-    setvbuf(ft->fd, ft->write_cache, _IOFBF , WRITE_CACHE_SIZE);
+        if (ft->dsd_encoded_export && ft->dst_encoded_import)
+        {
+            ft->dst_decoder = dst_decoder_create(ft->channel_count, decoder_threads, frame_decoded_callback, frame_error_callback, ft);
+        }
 
-    ft->priv = calloc(1, ft->handler.priv_size);
+        started = 1;
+        result = create_output_file(ft);
+        if (result == OUTPUT_FILE_SKIPPED)
+        {
+            skipped = 1;
+            pthread_mutex_lock(&output->worker_lock);
+            output->stats_total_sectors_processed += ft->length_lsn;
+            pthread_mutex_unlock(&output->worker_lock);
+        }
+        else if (result == 0)
+        {
+            end_lsn = ft->start_lsn + ft->length_lsn;
 
-    result = ft->handler.startwrite ? (*ft->handler.startwrite)(ft) : 0;
+            // a resumed file has its start done already
+            pthread_mutex_lock(&output->worker_lock);
+            output->stats_total_sectors_processed += ft->current_lsn - ft->start_lsn;
+            pthread_mutex_unlock(&output->worker_lock);
 
-    return result;
+            while (sysAtomicRead(&output->stop_processing) == 0 && ft->current_lsn < end_lsn)
+            {
+                block_size = get_block_range(handle, ft->current_lsn, end_lsn, sacd_read_tuner_size(&reader->tuner), &encrypted);
+                if (reserve_blocks(reader, block_size) < 0)
+                {
+                    sysAtomicSet(&output->stop_processing, 1);
+                    break;
+                }
+                read_buffer = reader->read_buffer;
+                lost_blocks = reader->lost_blocks;
 
-error:
+                // tracks only use the audio packets of the track area
+                lost = read_blocks(ft, &reader->tuner, ft->current_lsn, block_size, encrypted ? SACD_READ_AUDIO_ONLY : 0, read_buffer, lost_blocks);
+                if (lost < 0)
+                {
+                    sysAtomicSet(&output->stop_processing, 1);
+                    break;
+                }
+                ft->current_lsn += block_size;
 
-    // close_output_file will be called
-    return -1;
-}
+                // encrypted blocks need to be decrypted first
+                if (encrypted && output->non_encrypted_disc == 0)
+                {
+                    TRACE_BEGIN("decrypt", "blocks", block_size);
+                    start = metrics_start();
+                    sacd_decrypt(handle->sacd, read_buffer, block_size);
+                    if (lost)
+                    {
+                        clear_lost_blocks(read_buffer, lost_blocks, block_size);
+                    }
+                    metrics_stop(METRICS_DECRYPT, start, (uint64_t) block_size * SACD_LSN_SIZE);
+                    TRACE_END("decrypt");
+                }
 
-static inline int close_output_file(scarletbook_output_format_t * ft)
-{
-    int result;
+                // includes handing the frames on to the DST decoder or the writer
+                TRACE_BEGIN("demux", "blocks", block_size);
+                start = metrics_start();
+                process_blocks(handle, read_buffer, lost ? lost_blocks : NULL, block_size, ft->current_lsn == end_lsn, frame_read_callback, ft);
+                metrics_stop(METRICS_DEMUX, start, (uint64_t) block_size * SACD_LSN_SIZE);
+                TRACE_END("demux");
+
+                // update statistics
+                pthread_mutex_lock(&output->worker_lock);
+                output->stats_total_sectors_processed += block_size;
+                output->stats_current_file_total_sectors = ft->length_lsn;
+                output->stats_current_file_sectors_processed = ft->current_lsn - ft->start_lsn;
+                if (output->stats_progress_callback)
+                {
+                    output->stats_progress_callback(output->stats_total_sectors, output->stats_total_sectors_processed, 
+                        output->stats_current_file_total_sectors, output->stats_current_file_sectors_processed);
+                }
+                pthread_mutex_unlock(&output->worker_lock);
+                metrics_poll(output->metrics);
+                poll_checkpoint(ft);
+            }
+            completed = ft->current_lsn == end_lsn;
+        }
 
-    result = ft->handler.stopwrite ? (*ft->handler.stopwrite)(ft) : 0;
+        // the decoder flushes its remaining frames before the file gets closed
+        if (ft->dsd_encoded_export && ft->dst_encoded_import)
+        {
+            dst_decoder_destroy(ft->dst_decoder);
+        }
+    }
 
-    if (ft->fd)
+    if (!started)
     {
-        fclose(ft->fd);
+        free(ft->filename);
+        free(ft);
     }
-    free(ft->write_cache);
-    free(ft->filename);
-    free(ft->priv);
-    free(ft);
+    else if (skipped)
+    {
+        skip_output_file(ft);
+    }
+    else if (completed)
+    {
+        close_output_file(ft, 1);
+    }
+    else
+    {
+        // an interrupted file is kept for its checkpoint
+        file_to_remove = ft->verify || ft->checkpoint_interval ? 0 : strdup(ft->filename);
+        close_output_file(ft, 0);
+        if (file_to_remove)
+        {
+            remove_output_file(file_to_remove);
+            free(file_to_remove);
+        }
+    }
+    scarletbook_frame_clone_free(handle);
 
-    return result;
+    if (ordered)
+    {
+        pthread_mutex_lock(&output->worker_lock);
+        output->area_tracks_finished[area]++;
+        pthread_cond_broadcast(&output->area_order_cond);
+        pthread_mutex_unlock(&output->worker_lock);
+    }
 }
 
-static void scarletbook_output_init_stats(scarletbook_output_t *output)
+static void *track_worker_thread(void *arg)
 {
-    struct list_head * node_ptr;
-    scarletbook_output_format_t * output_format_ptr;
-
-    output->stats_total_sectors = 0;
-    output->stats_total_sectors_processed = 0;
-    output->stats_current_file_total_sectors = 0;
-    output->stats_current_file_sectors_processed = 0;
-    output->stats_current_track = 0;
-    output->stats_total_tracks = 0;
-    list_for_each(node_ptr, &output->ripping_queue)
+    scarletbook_output_t *output = (scarletbook_output_t *) arg;
+    scarletbook_output_format_t * ft;
+    struct block_reader reader;
+    sacd_read_limits_t limits;
+    int order_idx, decoder_threads;
+
+    // every worker finds its own read size, they share the source
+    memset(&reader, 0, sizeof(reader));
+    sacd_get_read_limits(output->sb_handle->sacd, &limits);
+    sacd_read_tuner_init(&reader.tuner, &limits);
+    if (reserve_blocks(&reader, sacd_read_tuner_size(&reader.tuner)) < 0)
     {
-        output_format_ptr = list_entry(node_ptr, scarletbook_output_format_t, siblings);
-        output->stats_total_sectors += output_format_ptr->length_lsn;
-        output->stats_total_tracks++;
+        free(reader.read_buffer);
+        free(reader.lost_blocks);
+        sysAtomicSet(&output->stop_processing, 1);
+        return 0;
     }
-}
 
-static inline size_t write_block(scarletbook_output_format_t * ft, const uint8_t *buf, size_t len)
-{
-    size_t actual = ft->handler.write? (*ft->handler.write)(ft, buf, len) : 0;
-    ft->write_length += actual;
-    return actual;
-}
+    // share the processors between the decoders of all workers
+    decoder_threads = max((int) dst_decoder_processor_count() / output->track_workers, 1);
 
-static void frame_decoded_callback(uint8_t* frame_data, size_t frame_size, void *userdata)
-{
-    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
-    write_block(ft, frame_data, frame_size);
-}
+    metrics_thread_enter(output->metrics, "track worker");
+    TRACE_THREAD("track worker");
 
-static void frame_error_callback(int frame_count, int frame_error_code, const char *frame_error_message, void *userdata)
-{
-    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
-#ifdef _WIN32
-    wchar_t *wide_errormessage = (wchar_t *) charset_convert(frame_error_message, strlen(frame_error_message), "UTF-8", sizeof(wchar_t) == 2 ? "UCS-2-INTERNAL" : "UCS-4-INTERNAL");
-#else
-    wchar_t *wide_errormessage = (wchar_t *) charset_convert(frame_error_message, strlen(frame_error_message), "UTF-8", "WCHAR_T");
-#endif
-    ft->cb_fwprintf(stderr, L"\nERROR %ls in frame: %d\n", wide_errormessage, frame_count);
-    free(wide_errormessage);
+    for (;;)
+    {
+        pthread_mutex_lock(&output->worker_lock);
+        if (list_empty(&output->ripping_queue) || sysAtomicRead(&output->stop_processing) != 0)
+        {
+            pthread_mutex_unlock(&output->worker_lock);
+            break;
+        }
+        ft = list_entry(output->ripping_queue.next, scarletbook_output_format_t, siblings);
+        list_del(&ft->siblings);
+        order_idx = output->area_tracks_started[ft->area]++;
+        output->stats_current_track++;
+        if (output->stats_track_callback)
+        {
+            output->stats_track_callback(ft->filename, output->stats_current_track, output->stats_total_tracks, ft->dsd_encoded_export && ft->dst_encoded_import);
+        }
+        pthread_mutex_unlock(&output->worker_lock);
+
+        write_track(output, ft, &reader, order_idx, decoder_threads);
+    }
+
+    free(reader.read_buffer);
+    free(reader.lost_blocks);
+    return 0;
 }
 
-static void frame_read_callback(scarletbook_handle_t *handle, uint8_t* frame_data, size_t frame_size, void *userdata)
+static void write_tracks_in_parallel(scarletbook_output_t *output)
 {
-    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
+    scarletbook_output_format_t * ft;
+    pthread_t *workers;
+    int i, workers_started = 0, encrypted;
 
-    if (ft->dsd_encoded_export && ft->dst_encoded_import)
-    {
-        dst_decoder_decode(ft->dst_decoder, frame_data, frame_size);
-    }
-    else
+    ft = list_entry(output->ripping_queue.next, scarletbook_output_format_t, siblings);
+
+    // the first encrypted block tells if the disc needs to be decrypted at all
+    get_block_range(output->sb_handle, ft->start_lsn, ft->start_lsn + 1, 1, &encrypted);
+    if (encrypted && sacd_read_block_raw(output->sb_handle->sacd, ft->start_lsn, 1, output->reader.read_buffer) == 1)
     {
-        write_block(ft, frame_data, frame_size);
+        output->non_encrypted_disc = is_non_encrypted_disc(output->sb_handle, ft->area, output->reader.read_buffer);
     }
-}
 
-#ifdef __lv2ppu__
-static void scarletbook_process_frames_thread(void *args){
-#else
-static void *scarletbook_process_frames_thread(void *void_args){
-#endif
-    struct scarletbook_process_frames_args *args;
-    args = (struct scarletbook_process_frames_args *)void_args;
-    scarletbook_process_frames(args->handle, args->read_buffer, args->blocks_read, args->last_block, args->frame_read_callback, args->userdata);
-    return 0;
-}
+    pthread_mutex_init(&output->worker_lock, NULL);
+    pthread_cond_init(&output->area_order_cond, NULL);
 
-int scarletbook_output_start_process_frames_thread(scarletbook_output_t *output, struct scarletbook_process_frames_args *args)
-{
-    int ret = 0;
+    LOG(lm_main, LOG_NOTICE, ("Writing %d tracks with %d workers", output->stats_total_tracks, output->track_workers));
 
-#ifdef __lv2ppu__
-    ret = sysThreadCreate(&output->sub_processing_thread_id,
-                          scarletbook_process_frames_thread,
-                          (void *) args,
-                          1050,
-                          8192,
-                          THREAD_JOINABLE,
-                          "scarletbook_process_frames_thread");
-#else
-    ret = pthread_create(&output->sub_processing_thread_id, NULL, scarletbook_process_frames_thread, (void *) args);
-#endif
-    if (ret)
+    workers = (pthread_t *) calloc(output->track_workers, sizeof(pthread_t));
+    for (i = 0; workers && i < output->track_workers; i++)
     {
-        LOG(lm_main, LOG_ERROR, ("return code from sub processing thread creation is %d\n", ret));
+        if (pthread_create(&workers[i], NULL, track_worker_thread, (void *) output) != 0)
+        {
+            LOG(lm_main, LOG_ERROR, ("could not start track worker %d", i));
+            break;
+        }
+        workers_started++;
+    }
+    if (workers_started == 0)
+    {
+        // nothing can run, so don't leave half a queue
+        sysAtomicSet(&output->stop_processing, 1);
+    }
+    for (i = 0; i < workers_started; i++)
+    {
+        pthread_join(workers[i], NULL);
     }
+    free(workers);
 
-    return ret;
+    pthread_cond_destroy(&output->area_order_cond);
+    pthread_mutex_destroy(&output->worker_lock);
 }
+#endif
 
 #ifdef __lv2ppu__
 static void processing_thread(void *arg)
@@ -384,8 +1563,26 @@ static void *processing_thread(void *arg)
     int checked_for_non_encrypted_disc = 0;
     int processing_thread_run = 0;
     scarletbook_output_format_t *ft_sub = NULL;
+    sacd_read_limits_t limits;
+    uint64_t start;
+    int result;
 
     sysAtomicSet(&output->processing, 1);
+    sacd_get_read_limits(handle->sacd, &limits);
+    sacd_read_tuner_init(&output->reader.tuner, &limits);
+    metrics_thread_enter(output->metrics, "processing");
+    TRACE_THREAD("processing");
+
+#ifndef __lv2ppu__
+    if (can_write_tracks_in_parallel(output))
+    {
+        write_tracks_in_parallel(output);
+        destroy_ripping_queue(output);
+        sysAtomicSet(&output->processing, 0);
+        pthread_exit(0);
+    }
+#endif
+
     while (!list_empty(&output->ripping_queue))
     {
         node_ptr = output->ripping_queue.next;
@@ -395,7 +1592,7 @@ static void *processing_thread(void *arg)
         
         if (ft->dsd_encoded_export && ft->dst_encoded_import)
         {
-            ft->dst_decoder = dst_decoder_create(ft->channel_count, frame_decoded_callback, frame_error_callback, ft);
+            ft->dst_decoder = dst_decoder_create(ft->channel_count, 0, frame_decoded_callback, frame_error_callback, ft);
         }
 
         output->stats_current_file_total_sectors = ft->length_lsn;
@@ -408,33 +1605,34 @@ static void *processing_thread(void *arg)
         }
 
         scarletbook_frame_init(handle);
+        expect_track_frames(ft);
 
-        if (create_output_file(ft) == 0)
+        result = create_output_file(ft);
+        if (result == OUTPUT_FILE_SKIPPED)
+        {
+            if (ft->dsd_encoded_export && ft->dst_encoded_import)
+            {
+                dst_decoder_destroy(ft->dst_decoder);
+            }
+            output->stats_total_sectors_processed += ft->length_lsn;
+            skip_output_file(ft);
+            continue;
+        }
+        if (result == 0)
         {
             uint32_t block_size, end_lsn;
-            uint32_t encrypted_start_1 = 0;
-            uint32_t encrypted_start_2 = 0;
-            uint32_t encrypted_end_1 = 0;
-            uint32_t encrypted_end_2 = 0;
             struct list_head * node_ptr_sub;
 
             int encrypted;
+            ssize_t copied;
 
-            // set the encryption range
-            if (handle->area[0].area_toc != 0)
-            {
-                encrypted_start_1 = handle->area[0].area_toc->track_start;
-                encrypted_end_1 = handle->area[0].area_toc->track_end;
-            }
-            if (handle->area[1].area_toc != 0)
-            {
-                encrypted_start_2 = handle->area[1].area_toc->track_start;
-                encrypted_end_2 = handle->area[1].area_toc->track_end;
-            }
+            // plain ISO copies of local images don't need to pass through user space
+            int zero_copy = (ft->handler.flags & OUTPUT_FLAG_RAW) && list_empty(&ft->sub_queue) && !ft->direct_io && !ft->digest;
 
-            // what blocks do we need to process?
-            ft->current_lsn = ft->start_lsn;
+            // what blocks do we need to process? a resumed file has its start done already
             end_lsn = ft->start_lsn + ft->length_lsn;
+            output->stats_total_sectors_processed += ft->current_lsn - ft->start_lsn;
+            output->stats_current_file_sectors_processed = ft->current_lsn - ft->start_lsn;
 
             if(!list_empty(&ft->sub_queue))
             {
@@ -451,11 +1649,12 @@ static void *processing_thread(void *arg)
                     // First track starting immediately
                     list_del(node_ptr_sub);
                     end_lsn = ft_sub->start_lsn + ft_sub->length_lsn - 1;
+                    expect_track_frames(ft_sub);
                     if(create_output_file(ft_sub))
                         break;
                     if (ft_sub->dsd_encoded_export && ft_sub->dst_encoded_import)
                     {
-                        ft_sub->dst_decoder = dst_decoder_create(ft_sub->channel_count, frame_decoded_callback, frame_error_callback, ft_sub);
+                        ft_sub->dst_decoder = dst_decoder_create(ft_sub->channel_count, 0, frame_decoded_callback, frame_error_callback, ft_sub);
                     }
                 }
                 else{
@@ -464,44 +1663,50 @@ static void *processing_thread(void *arg)
                 }
             }
 
-            sysAtomicSet(&output->stop_processing, 0);
-
             while (sysAtomicRead(&output->stop_processing) == 0)
             {
                 if (ft->current_lsn < end_lsn)
                 {
-                    uint8_t *buf;
-                    // check what block ranges are encrypted..
-                    if (ft->current_lsn < encrypted_start_1)
-                    {
-                        block_size = min(encrypted_start_1 - ft->current_lsn, MAX_PROCESSING_BLOCK_SIZE);
-                        encrypted = 0;
-                    }
-                    else if (ft->current_lsn >= encrypted_start_1 && ft->current_lsn <= encrypted_end_1)
-                    {
-                        block_size = min(encrypted_end_1 + 1 - ft->current_lsn, MAX_PROCESSING_BLOCK_SIZE);
-                        encrypted = 1;
-                    }
-                    else if (ft->current_lsn > encrypted_end_1 && ft->current_lsn < encrypted_start_2)
+                    uint8_t *buf, *lost_blocks;
+                    int lost;
+                    block_size = get_block_range(handle, ft->current_lsn, end_lsn, sacd_read_tuner_size(&output->reader.tuner), &encrypted);
+
+                    if (zero_copy)
                     {
-                        block_size = min(encrypted_start_2 - ft->current_lsn, MAX_PROCESSING_BLOCK_SIZE);
-                        encrypted = 0;
+                        copied = copy_raw_blocks(ft, &output->reader.tuner, block_size);
+                        if (copied > 0)
+                        {
+                            ft->current_lsn += copied;
+                            output->stats_total_sectors_processed += copied;
+                            output->stats_current_file_sectors_processed += copied;
+                            if (output->stats_progress_callback)
+                            {
+                                output->stats_progress_callback(output->stats_total_sectors, output->stats_total_sectors_processed, 
+                                    output->stats_current_file_total_sectors, output->stats_current_file_sectors_processed);
+                            }
+                            metrics_poll(output->metrics);
+                            poll_checkpoint(ft);
+                            continue;
+                        }
+                        LOG(lm_main, LOG_NOTICE, ("kernel copy not available for %s, reading through user space", ft->filename));
+                        zero_copy = 0;
                     }
-                    else if (ft->current_lsn >= encrypted_start_2 && ft->current_lsn <= encrypted_end_2)
+
+                    // read some blocks to a local buffer first because previous frames might be still in process in a separate thread.
+                    // tracks only use the audio packets of the track area
+                    if (reserve_blocks(&output->staging, block_size) < 0)
                     {
-                        block_size = min(encrypted_end_2 + 1 - ft->current_lsn, MAX_PROCESSING_BLOCK_SIZE);
-                        encrypted = 1;
+                        sysAtomicSet(&output->stop_processing, 1);
+                        break;
                     }
-                    else
+                    buf = output->staging.read_buffer;
+                    lost_blocks = output->staging.lost_blocks;
+                    lost = read_blocks(ft, &output->reader.tuner, ft->current_lsn, block_size, encrypted && !(ft->handler.flags & OUTPUT_FLAG_RAW) ? SACD_READ_AUDIO_ONLY : 0, buf, lost_blocks);
+                    if (lost < 0)
                     {
-                        block_size = MAX_PROCESSING_BLOCK_SIZE;
-                        encrypted = 0;
+                        sysAtomicSet(&output->stop_processing, 1);
+                        break;
                     }
-                    block_size = min(end_lsn - ft->current_lsn, block_size);
-
-                    // read some blocks to a local buffer first because previous frames might be still in process in a separate thread.
-                    buf = malloc(sizeof(uint8_t) * block_size * SACD_LSN_SIZE);
-                    block_size = (uint32_t) sacd_read_block_raw(ft->sb_handle->sacd, ft->current_lsn, block_size, buf);
 
                     // Wait for the eixting frame processing thread to finish
                     if(processing_thread_run){
@@ -511,9 +1716,19 @@ static void *processing_thread(void *arg)
                             break;
                         }
                     }
-                    // Copy the content of the local buffer to output->read_buffer
-                    memcpy(output->read_buffer, buf, sizeof(uint8_t) * block_size * SACD_LSN_SIZE);
-                    free(buf);
+                    // everything before current_lsn has been handed on now
+                    poll_checkpoint(ft);
+
+                    // the frame thread is done with the buffers, they can grow now
+                    if (reserve_blocks(&output->reader, block_size) < 0)
+                    {
+                        sysAtomicSet(&output->stop_processing, 1);
+                        break;
+                    }
+
+                    // Copy the content of the local buffer to output->reader.read_buffer
+                    memcpy(output->reader.read_buffer, buf, sizeof(uint8_t) * block_size * SACD_LSN_SIZE);
+                    memcpy(output->reader.lost_blocks, lost_blocks, block_size);
 
                     ft->current_lsn += block_size;
                     output->stats_total_sectors_processed += block_size;
@@ -524,55 +1739,58 @@ static void *processing_thread(void *arg)
                     // this is a quick hack/fix for these discs.
                     if (encrypted && checked_for_non_encrypted_disc == 0)
                     {
-                        switch (handle->area[ft->area].area_toc->frame_format)
-                        {
-                        case FRAME_FORMAT_DSD_3_IN_14:
-                        case FRAME_FORMAT_DSD_3_IN_16:
-                            non_encrypted_disc = *(uint64_t *)(output->read_buffer + 16) == 0;
-                            break;
-                        }
-
+                        non_encrypted_disc = is_non_encrypted_disc(handle, ft->area, output->reader.read_buffer);
                         checked_for_non_encrypted_disc = 1;
                     }
 
                     // encrypted blocks need to be decrypted first
                     if (encrypted && non_encrypted_disc == 0)
                     {
-                        sacd_decrypt(ft->sb_handle->sacd, output->read_buffer, block_size);
+                        TRACE_BEGIN("decrypt", "blocks", block_size);
+                        start = metrics_start();
+                        sacd_decrypt(ft->sb_handle->sacd, output->reader.read_buffer, block_size);
+                        if (lost)
+                        {
+                            clear_lost_blocks(output->reader.read_buffer, output->reader.lost_blocks, block_size);
+                        }
+                        metrics_stop(METRICS_DECRYPT, start, (uint64_t) block_size * SACD_LSN_SIZE);
+                        TRACE_END("decrypt");
                     }
 
                     // process DSD & DST frames
                     if (ft->handler.flags & OUTPUT_FLAG_DSD || ft->handler.flags & OUTPUT_FLAG_DST)
                     {
-                        struct scarletbook_process_frames_args process_frames_args;
-                        process_frames_args.handle = ft->sb_handle;
-                        process_frames_args.read_buffer = output->read_buffer;
-                        process_frames_args.blocks_read = block_size;
-                        process_frames_args.last_block = ft->current_lsn == end_lsn;
-                        process_frames_args.frame_read_callback = frame_read_callback;
-                        process_frames_args.userdata = ft;
-                        scarletbook_output_start_process_frames_thread(output, &process_frames_args);
+                        struct scarletbook_process_frames_args *process_frames_args = &output->process_frames_args;
+                        process_frames_args->handle = ft->sb_handle;
+                        process_frames_args->read_buffer = output->reader.read_buffer;
+                        process_frames_args->lost_blocks = lost ? output->reader.lost_blocks : NULL;
+                        process_frames_args->blocks_read = block_size;
+                        process_frames_args->last_block = ft->current_lsn == end_lsn;
+                        process_frames_args->frame_read_callback = frame_read_callback;
+                        process_frames_args->userdata = ft;
+                        scarletbook_output_start_process_frames_thread(output, process_frames_args);
                         processing_thread_run = 1;
                     }
                     // ISO output is written without frame processing                        
                     else if (ft->handler.flags & OUTPUT_FLAG_RAW)
                     {
-                        write_block(ft, output->read_buffer, block_size);
+                        write_block(ft, output->reader.read_buffer, block_size);
                     }
                     // Sub processing
                     if (ft_sub){
                         if (ft_sub->handler.flags & OUTPUT_FLAG_DSD || ft_sub->handler.flags & OUTPUT_FLAG_DST){
-                            struct scarletbook_process_frames_args process_frames_args;
-
-                            process_frames_args.handle = ft_sub->sb_handle;
-                            process_frames_args.read_buffer = output->read_buffer;
-                            process_frames_args.blocks_read = block_size;
-                            process_frames_args.last_block = ft->current_lsn == end_lsn;
-                            process_frames_args.frame_read_callback = frame_read_callback;
-                            process_frames_args.userdata = ft_sub;
+                            struct scarletbook_process_frames_args *process_frames_args = &output->process_frames_args;
+
+                            process_frames_args->handle = ft_sub->sb_handle;
+                            process_frames_args->read_buffer = output->reader.read_buffer;
+                            process_frames_args->lost_blocks = lost ? output->reader.lost_blocks : NULL;
+                            process_frames_args->blocks_read = block_size;
+                            process_frames_args->last_block = ft->current_lsn == end_lsn;
+                            process_frames_args->frame_read_callback = frame_read_callback;
+                            process_frames_args->userdata = ft_sub;
                             // Push the read frames for processing (including DST decompression if applicable) in a separate thread.
                             // This thread is expected to finish before the end of the next raw block read.  If not, we wait for it to finish.
-                            scarletbook_output_start_process_frames_thread(output, &process_frames_args);
+                            scarletbook_output_start_process_frames_thread(output, process_frames_args);
                             processing_thread_run  = 1;
                         }
                     }
@@ -583,6 +1801,7 @@ static void *processing_thread(void *arg)
                         output->stats_progress_callback(output->stats_total_sectors, output->stats_total_sectors_processed, 
                             output->stats_current_file_total_sectors, output->stats_current_file_sectors_processed);
                     }
+                    metrics_poll(output->metrics);
                 }
                 else
                 {
@@ -600,7 +1819,7 @@ static void *processing_thread(void *arg)
                         {
                             dst_decoder_destroy(ft_sub->dst_decoder);
                         }
-                        close_output_file(ft_sub);
+                        close_output_file(ft_sub, 1);
                         ft_sub = NULL;
                     }
                     if(!list_empty(&ft->sub_queue)){
@@ -614,13 +1833,14 @@ static void *processing_thread(void *arg)
                         else if (ft->current_lsn >= ft_sub->start_lsn){
                             // Next sub queue item starting
                             output->stats_track_callback(ft_sub->filename, ft_sub->track + 1, handle->area[ft_sub->area].area_toc->track_count, ft->dsd_encoded_export && ft->dst_encoded_import);
+                            expect_track_frames(ft_sub);
                             if(create_output_file(ft_sub))
                                 break;
                             list_del(node_ptr_sub);
                             end_lsn = ft_sub->start_lsn + ft_sub->length_lsn;
                             if (ft_sub->dsd_encoded_export && ft_sub->dst_encoded_import)
                             {
-                                ft_sub->dst_decoder = dst_decoder_create(ft_sub->channel_count, frame_decoded_callback, frame_error_callback, ft_sub);
+                                ft_sub->dst_decoder = dst_decoder_create(ft_sub->channel_count, 0, frame_decoded_callback, frame_error_callback, ft_sub);
                             }
                         }
                         else{
@@ -650,18 +1870,19 @@ static void *processing_thread(void *arg)
             processing_thread_run = 0;
 
             if(ft_sub){
-                file_to_remove = strdup(ft_sub->filename);
+                // verifying leaves the existing files alone
+                file_to_remove = ft_sub->verify ? 0 : strdup(ft_sub->filename);
                 
                 if (ft_sub->dsd_encoded_export && ft_sub->dst_encoded_import)
                 {
                     dst_decoder_destroy(ft_sub->dst_decoder);
                 }
-                close_output_file(ft_sub);
+                close_output_file(ft_sub, 0);
                 
 #ifdef __lv2ppu__
-                if (sysFsUnlink(file_to_remove) != 0)
+                if (file_to_remove && sysFsUnlink(file_to_remove) != 0)
 #else
-                if (remove(file_to_remove) != 0)
+                if (file_to_remove && remove(file_to_remove) != 0)
 #endif
                 {
                     LOG(lm_main, LOG_ERROR, ("user cancelled, error removing: %s, [%s]", file_to_remove, strerror(errno)));
@@ -669,8 +1890,8 @@ static void *processing_thread(void *arg)
                 free(file_to_remove);
             }
             
-            // make a copy of the filename
-            file_to_remove = strdup(ft->filename);
+            // make a copy of the filename, unless the file is kept for its checkpoint
+            file_to_remove = ft->verify || ft->checkpoint_interval ? 0 : strdup(ft->filename);
 
             sysAtomicSet(&output->processing, 0);
 
@@ -679,13 +1900,13 @@ static void *processing_thread(void *arg)
                 dst_decoder_destroy(ft->dst_decoder);
             }
 
-            close_output_file(ft);
+            close_output_file(ft, 0);
 
             // remove the file being worked on
 #ifdef __lv2ppu__
-            if (sysFsUnlink(file_to_remove) != 0)
+            if (file_to_remove && sysFsUnlink(file_to_remove) != 0)
 #else
-            if (remove(file_to_remove) != 0)
+            if (file_to_remove && remove(file_to_remove) != 0)
 #endif
             {
                 LOG(lm_main, LOG_ERROR, ("user cancelled, error removing: %s, [%s]", file_to_remove, strerror(errno)));
@@ -705,7 +1926,7 @@ static void *processing_thread(void *arg)
             dst_decoder_destroy(ft->dst_decoder);
         }
 
-        close_output_file(ft);
+        close_output_file(ft, 1);
     } 
     destroy_ripping_queue(output);
     sysAtomicSet(&output->processing, 0);
@@ -723,8 +1944,17 @@ scarletbook_output_t *scarletbook_output_create(scarletbook_handle_t *handle, st
 {
     scarletbook_output_t *output = (scarletbook_output_t *) calloc(1, sizeof(scarletbook_output_t));
 
+    if (!output)
+        return NULL;
     INIT_LIST_HEAD(&output->ripping_queue);
-    output->read_buffer = (uint8_t *) malloc(MAX_PROCESSING_BLOCK_SIZE * SACD_LSN_SIZE);
+    if (reserve_blocks(&output->reader, MAX_PROCESSING_BLOCK_SIZE) < 0)
+    {
+        free(output->reader.read_buffer);
+        free(output->reader.lost_blocks);
+        free(output);
+        return NULL;
+    }
+    output->read_retries = 3;
     output->sb_handle = handle;
     output->stats_track_callback = cb_track;
     output->stats_progress_callback = cb_progress;
@@ -743,6 +1973,7 @@ int scarletbook_output_start(scarletbook_output_t *output)
     int ret = 0;
 
     scarletbook_output_init_stats(output);
+    sysAtomicSet(&output->stop_processing, 0);
 
 #ifdef __lv2ppu__
     ret = sysThreadCreate(&output->processing_thread_id,
@@ -763,12 +1994,69 @@ int scarletbook_output_start(scarletbook_output_t *output)
     return ret;
 }
 
+void scarletbook_output_set_direct_io(scarletbook_output_t *output, int direct_io)
+{
+    output->direct_io = direct_io;
+}
+
+void scarletbook_output_set_checkpoints(scarletbook_output_t *output, int interval)
+{
+    output->checkpoint_interval = interval;
+}
+
+void scarletbook_output_set_verify(scarletbook_output_t *output, int verify)
+{
+    output->verify = verify;
+}
+
+int scarletbook_output_verify_failures(scarletbook_output_t *output)
+{
+    return sysAtomicRead(&output->verify_failures);
+}
+
+int scarletbook_output_verify_unverified(scarletbook_output_t *output)
+{
+    return sysAtomicRead(&output->verify_unverified);
+}
+
+void scarletbook_output_set_digests(scarletbook_output_t *output, int digests)
+{
+    output->digests = digests;
+}
+
+void scarletbook_output_set_read_errors(scarletbook_output_t *output, int retries, int max_errors, scarletbook_error_map_t *error_map)
+{
+    output->read_retries = retries;
+    output->max_read_errors = max_errors;
+    output->error_map = error_map;
+}
+
+int scarletbook_output_lost_sectors(scarletbook_output_t *output)
+{
+    return sysAtomicRead(&output->lost_sectors);
+}
+
+void scarletbook_output_set_pcm_rate(scarletbook_output_t *output, int pcm_rate)
+{
+    output->pcm_rate = pcm_rate;
+}
+
+void scarletbook_output_set_track_workers(scarletbook_output_t *output, int track_workers)
+{
+    output->track_workers = track_workers;
+}
+
+void scarletbook_output_set_metrics(scarletbook_output_t *output, metrics_t *metrics)
+{
+    output->metrics = metrics;
+}
+
 void scarletbook_output_interrupt(scarletbook_output_t *output)
 {
     sysAtomicSet(&output->stop_processing, 1);
 }
 
-int scarletbook_output_destroy(scarletbook_output_t *output)
+int scarletbook_output_wait(scarletbook_output_t *output)
 {
 #ifdef __lv2ppu__
     uint64_t thr_exit_code;
@@ -777,24 +2065,51 @@ int scarletbook_output_destroy(scarletbook_output_t *output)
 #endif
     int ret = 0;
 
-    if (!output)
-        return -1;
+    if (output->processing_thread_joined)
+        return 0;
 
 #ifdef __lv2ppu__
-    scarletbook_output_interrupt(output);
     ret = sysThreadJoin(output->processing_thread_id, &thr_exit_code);
 #else
-    scarletbook_output_interrupt(output);
     ret = pthread_join(output->processing_thread_id, &thr_exit_code);
 #endif
     if (ret != 0)
     {
         LOG(lm_main, LOG_ERROR, ("processing thread didn't close properly... %x", thr_exit_code));
     }
+    output->processing_thread_joined = 1;
+
+    return ret;
+}
+
+void scarletbook_output_get_stats(scarletbook_output_t *output, uint32_t *total_sectors, uint32_t *sectors_processed)
+{
+    *total_sectors = output->stats_total_sectors;
+    *sectors_processed = output->stats_total_sectors_processed;
+}
+
+int scarletbook_output_destroy(scarletbook_output_t *output)
+{
+    int ret = 0;
+    int i;
+
+    if (!output)
+        return -1;
+
+    // waits for the queue to be processed, use scarletbook_output_interrupt to cancel
+    ret = scarletbook_output_wait(output);
 
     // If decoding is aborted (eg. ctrl+C), then free() buffers after the decoder has been destroyed,
     // to ensure that buffers aren't still in use when they're free()d.
-    free(output->read_buffer);
+    free(output->reader.read_buffer);
+    free(output->reader.lost_blocks);
+    free(output->staging.read_buffer);
+    free(output->staging.lost_blocks);
+    for (i = 0; i < 2; i++)
+    {
+        free(output->area_stream[i].dsf_carry_over);
+        dsd2pcm_destroy(output->area_stream[i].dsd2pcm);
+    }
     free(output);
 
     return ret;
@@ -807,11 +2122,13 @@ int scarletbook_output_join_process_frames_thread(scarletbook_output_t *output){
     void *thr_exit_code;
 #endif
     int ret = 0;
+    TRACE_BEGIN("join frame thread", NULL, TRACE_NO_ARG);
 #ifdef __lv2ppu__
     ret = sysThreadJoin(output->sub_processing_thread_id, &thr_exit_code);
 #else
     ret = pthread_join(output->sub_processing_thread_id, &thr_exit_code);
 #endif    
+    TRACE_END("join frame thread");
     if (ret != 0)
     {
             LOG(lm_main, LOG_ERROR, ("sub processing thread didn't close properly... %x", thr_exit_code));
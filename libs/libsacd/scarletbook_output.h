@@ -28,7 +28,10 @@
 #include <dst_decoder.h>
 #endif
 
+#include <time.h>
+#include <metrics.h>
 #include "scarletbook.h"
+#include "scarletbook_error_map.h"
 
 // forward declaration
 typedef struct scarletbook_output_format_t scarletbook_output_format_t;
@@ -39,7 +42,9 @@ enum
     OUTPUT_FLAG_RAW         = 1 << 0,
     OUTPUT_FLAG_DSD         = 1 << 1,
     OUTPUT_FLAG_DST         = 1 << 2,
-    OUTPUT_FLAG_EDIT_MASTER = 1 << 3
+    OUTPUT_FLAG_EDIT_MASTER = 1 << 3,
+    OUTPUT_FLAG_PCM         = 1 << 4,       // DSD converted to PCM by the handler
+    OUTPUT_FLAG_DOP         = 1 << 5        // DSD packed into 24 bit PCM samples (DSD over PCM)
 };
 
 // Handler structure defined by each output format.
@@ -52,11 +57,30 @@ typedef struct scarletbook_format_handler_t
     int (*stopwrite)(scarletbook_output_format_t *ft);
     int         flags;
     size_t      priv_size;
+    // optional, for outputs that can be resumed from a checkpoint (see scarletbook_checkpoint.h): 
+    // savestate returns the state of priv after what has been written (free it), loadstate 
+    // restores it in place of startwrite
+    uint8_t    *(*savestate)(scarletbook_output_format_t *ft, size_t *size);
+    int         (*loadstate)(scarletbook_output_format_t *ft, const uint8_t *state, size_t size);
 } 
 scarletbook_format_handler_t;
 
 typedef int (*fwprintf_callback_t)(FILE *stream, const wchar_t *format, ...);
 
+// State that is carried from one track to the next within the same area.
+// Owned by scarletbook_output_t, one per area, so that several areas (or
+// several track writers) never share it.
+typedef struct scarletbook_area_stream_t
+{
+    // padding-less DSF (-z): tail samples of the previous track, per channel
+    uint8_t                        *dsf_carry_over;
+    size_t                          dsf_carry_over_len[MAX_CHANNEL_COUNT];
+    // WAV/AIFF: the DSD to PCM converter of track dsd2pcm_track, with its filter state
+    struct dsd2pcm_s               *dsd2pcm;
+    int                             dsd2pcm_track;
+} 
+scarletbook_area_stream_t;
+
 struct scarletbook_output_format_t 
 {
     int                             area;
@@ -88,6 +112,17 @@ struct scarletbook_output_format_t
     fwprintf_callback_t             cb_fwprintf;
 
     int                             dsf_nopad;
+    int                             direct_io;
+    int                             pcm_rate;           // sample rate of the WAV/AIFF/DoP output
+    int                             pcm_continued;      // the next track of the area is queued after this one
+    int                             digests;
+    int                             verify;             // nothing is written, the digests are compared instead
+    struct scarletbook_digest_s    *digest;             // digests computed while writing, see scarletbook_digest.h
+    scarletbook_output_t           *output;
+    scarletbook_area_stream_t      *area_stream;
+    int                             checkpoint_interval;    // seconds between checkpoints, 0 without
+    time_t                          checkpoint_time;
+
     struct list_head                sub_queue;
     struct list_head                siblings;
 }; 
@@ -102,8 +137,44 @@ int scarletbook_output_destroy(scarletbook_output_t *);
 int scarletbook_output_enqueue_track(scarletbook_output_t *, int, int, char *, char *, int, int, int);
 int scarletbook_output_enqueue_raw_sectors(scarletbook_output_t *, int, int, char *, char *);
 int scarletbook_output_start(scarletbook_output_t *);
+// write output files with direct I/O (bypassing the page cache) where supported, 
+// must be set before the tracks are queued
+void scarletbook_output_set_direct_io(scarletbook_output_t *, int);
+// computes digests of the output files while writing them and adds them to a manifest 
+// next to each file (see scarletbook_digest.h), must be set before the tracks are queued
+void scarletbook_output_set_digests(scarletbook_output_t *, int);
+// derives the output files again without writing them and compares them with the files 
+// (or their manifest entries) extracted before, must be set before the tracks are queued
+void scarletbook_output_set_verify(scarletbook_output_t *, int);
+// number of files that didn't match or were missing, once the output has been processed
+int scarletbook_output_verify_failures(scarletbook_output_t *);
+// number of files there was nothing to compare with (no manifest entry and no digest of 
+// the file as written), they are neither verified nor failures
+int scarletbook_output_verify_unverified(scarletbook_output_t *);
+// takes a checkpoint of every file each "interval" seconds, a file with a checkpoint carries on 
+// from there and one without is taken as already extracted, interrupted files are kept for the 
+// next run (0 turns it off), must be set before the tracks are queued
+void scarletbook_output_set_checkpoints(scarletbook_output_t *, int interval);
+// how unreadable sectors are dealt with: a failing read is split up down to single sectors, 
+// each is retried "retries" times before it's taken as lost (audio frames it held become 
+// silence, ISO output gets zeros). The extraction stops once more than "max_errors" sectors 
+// are lost (0 for no limit). Sectors that needed retries are added to "error_map" (may be NULL).
+void scarletbook_output_set_read_errors(scarletbook_output_t *, int retries, int max_errors, scarletbook_error_map_t *error_map);
+// number of sectors lost so far
+int scarletbook_output_lost_sectors(scarletbook_output_t *);
+// sample rate of the WAV and AIFF output (88200 or 176400), must be set before the tracks are queued
+void scarletbook_output_set_pcm_rate(scarletbook_output_t *, int);
+// number of tracks that are written at the same time (each with its own reader and 
+// DST decoder), only used for local sources and DSF/DSDIFF track output
+void scarletbook_output_set_track_workers(scarletbook_output_t *, int);
+// times the stages of the extraction (see metrics.h), must be set before the output is started
+void scarletbook_output_set_metrics(scarletbook_output_t *, metrics_t *);
 void scarletbook_output_interrupt(scarletbook_output_t *);
 int scarletbook_output_is_busy(scarletbook_output_t *);
+// waits until the queue has been processed (or interrupted), scarletbook_output_destroy does the same
+int scarletbook_output_wait(scarletbook_output_t *);
+// sectors queued and read so far, up to date once scarletbook_output_wait returned
+void scarletbook_output_get_stats(scarletbook_output_t *, uint32_t *total_sectors, uint32_t *sectors_processed);
 int scarletbook_output_join_process_frames_thread(scarletbook_output_t *);
 
 #endif /* SCARLETBOOK_OUTPUT_H_INCLUDED */
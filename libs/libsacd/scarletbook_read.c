@@ -28,6 +28,7 @@
 #endif
 
 #include <charset.h>
+#include <logging.h>
 
 #include "endianess.h"
 #include "scarletbook.h"
@@ -65,7 +66,7 @@ scarletbook_handle_t *scarletbook_open(sacd_reader_t *sacd, int title)
 {
     scarletbook_handle_t *sb;
 
-    sb = (scarletbook_handle_t *) calloc(sizeof(scarletbook_handle_t), 1);
+    sb = scarletbook_open_toc(sacd);
     if (!sb)
         return NULL;
 
@@ -76,6 +77,22 @@ scarletbook_handle_t *scarletbook_open(sacd_reader_t *sacd, int title)
 #endif
 
     if (!sb->frame.data)
+    {
+        scarletbook_close(sb);
+        return NULL;
+    }
+
+    return sb;
+}
+
+scarletbook_handle_t *scarletbook_open_toc(sacd_reader_t *sacd)
+{
+    scarletbook_handle_t *sb;
+    uint8_t              *area_data[2] = { NULL, NULL };
+    int                   prefetched = 0;
+
+    sb = (scarletbook_handle_t *) calloc(sizeof(scarletbook_handle_t), 1);
+    if (!sb)
         return NULL;
 
     sb->sacd      = sacd;
@@ -89,21 +106,47 @@ scarletbook_handle_t *scarletbook_open(sacd_reader_t *sacd, int title)
         return NULL;
     }
 
+    // with two areas both Area TOCs are read at once, network sources get them with one request
+    if (sb->master_toc->area_1_toc_1_start && sb->master_toc->area_2_toc_1_start)
+    {
+        sacd_block_range_t ranges[2];
+
+        area_data[0] = malloc(sb->master_toc->area_1_toc_size * SACD_LSN_SIZE);
+        area_data[1] = malloc(sb->master_toc->area_2_toc_size * SACD_LSN_SIZE);
+        if (!area_data[0] || !area_data[1])
+        {
+            free(area_data[0]);
+            free(area_data[1]);
+            scarletbook_close(sb);
+            return 0;
+        }
+
+        ranges[0].lsn = sb->master_toc->area_1_toc_1_start;
+        ranges[0].count = sb->master_toc->area_1_toc_size;
+        ranges[0].buffer = area_data[0];
+        ranges[1].lsn = sb->master_toc->area_2_toc_1_start;
+        ranges[1].count = sb->master_toc->area_2_toc_size;
+        ranges[1].buffer = area_data[1];
+        prefetched = sacd_read_block_ranges(sacd, ranges, 2, 0) == (ssize_t) (ranges[0].count + ranges[1].count);
+    }
+
     if (sb->master_toc->area_1_toc_1_start)
     {
-        sb->area[sb->area_count].area_data = malloc(sb->master_toc->area_1_toc_size * SACD_LSN_SIZE);
+        sb->area[sb->area_count].area_data = area_data[0] ? area_data[0] : malloc(sb->master_toc->area_1_toc_size * SACD_LSN_SIZE);
         if (!sb->area[sb->area_count].area_data)
         {
             scarletbook_close(sb);
             return 0;
         }
 
-        if (!sacd_read_block_raw(sacd, sb->master_toc->area_1_toc_1_start, sb->master_toc->area_1_toc_size, sb->area[sb->area_count].area_data))
+        if (!prefetched && !sacd_read_block_raw(sacd, sb->master_toc->area_1_toc_1_start, sb->master_toc->area_1_toc_size, sb->area[sb->area_count].area_data))
         {
             sb->master_toc->area_1_toc_1_start = 0;
         }
         else
         {
+            sb->toc_fingerprint = fnv1a_update(sb->toc_fingerprint, sb->area[sb->area_count].area_data, sb->master_toc->area_1_toc_size * SACD_LSN_SIZE);
+
             if (!scarletbook_read_area_toc(sb, sb->area_count))
             {
                 fprintf(stderr, "libsacdread: Can't read Area TOC 1.\n");
@@ -114,19 +157,21 @@ scarletbook_handle_t *scarletbook_open(sacd_reader_t *sacd, int title)
     }
     if (sb->master_toc->area_2_toc_1_start)
     {
-        sb->area[sb->area_count].area_data = malloc(sb->master_toc->area_2_toc_size * SACD_LSN_SIZE);
+        sb->area[sb->area_count].area_data = area_data[1] ? area_data[1] : malloc(sb->master_toc->area_2_toc_size * SACD_LSN_SIZE);
         if (!sb->area[sb->area_count].area_data)
         {
             scarletbook_close(sb);
             return 0;
         }
 
-        if (!sacd_read_block_raw(sacd, sb->master_toc->area_2_toc_1_start, sb->master_toc->area_2_toc_size, sb->area[sb->area_count].area_data))
+        if (!prefetched && !sacd_read_block_raw(sacd, sb->master_toc->area_2_toc_1_start, sb->master_toc->area_2_toc_size, sb->area[sb->area_count].area_data))
         {
             sb->master_toc->area_2_toc_1_start = 0;
             return sb;
         }
 
+        sb->toc_fingerprint = fnv1a_update(sb->toc_fingerprint, sb->area[sb->area_count].area_data, sb->master_toc->area_2_toc_size * SACD_LSN_SIZE);
+
         if (!scarletbook_read_area_toc(sb, sb->area_count))
         {
             fprintf(stderr, "libsacdread: Can't read Area TOC 2.\n");
@@ -139,6 +184,62 @@ scarletbook_handle_t *scarletbook_open(sacd_reader_t *sacd, int title)
     return sb;
 }
 
+// the TOCs are hashed as read from disc so the fingerprint doesn't depend on the host
+uint64_t scarletbook_read_fingerprint(sacd_reader_t *sacd)
+{
+    uint8_t      *data, *area_data;
+    master_toc_t master_toc;
+    uint64_t     hash;
+    uint32_t     area_start[2];
+    uint16_t     area_size[2];
+    int          i;
+
+    data = (uint8_t *) malloc(MASTER_TOC_LEN * SACD_LSN_SIZE);
+    if (!data)
+        return 0;
+
+    if (!sacd_read_block_raw(sacd, START_OF_MASTER_TOC, MASTER_TOC_LEN, data) || strncmp("SACDMTOC", (char *) data, 8) != 0)
+    {
+        free(data);
+        return 0;
+    }
+    hash = fnv1a_update(FNV1A_SEED, data, MASTER_TOC_LEN * SACD_LSN_SIZE);
+
+    memcpy(&master_toc, data, sizeof(master_toc_t));
+    free(data);
+    SWAP32(master_toc.area_1_toc_1_start);
+    SWAP16(master_toc.area_1_toc_size);
+    SWAP32(master_toc.area_2_toc_1_start);
+    SWAP16(master_toc.area_2_toc_size);
+    area_start[0] = master_toc.area_1_toc_1_start;
+    area_size[0]  = master_toc.area_1_toc_size;
+    area_start[1] = master_toc.area_2_toc_1_start;
+    area_size[1]  = master_toc.area_2_toc_size;
+
+    // same order and failure handling as scarletbook_open_toc()
+    for (i = 0; i < 2; i++)
+    {
+        if (!area_start[i])
+            continue;
+
+        area_data = (uint8_t *) malloc(area_size[i] * SACD_LSN_SIZE);
+        if (!area_data)
+            return 0;
+
+        if (!sacd_read_block_raw(sacd, area_start[i], area_size[i], area_data))
+        {
+            free(area_data);
+            if (i == 1)
+                break;
+            continue;
+        }
+        hash = fnv1a_update(hash, area_data, area_size[i] * SACD_LSN_SIZE);
+        free(area_data);
+    }
+
+    return hash;
+}
+
 static void free_area(scarletbook_area_t *area)
 {
     int i;
@@ -229,6 +330,8 @@ static int scarletbook_read_master_toc(scarletbook_handle_t *handle)
     if (!sacd_read_block_raw(handle->sacd, START_OF_MASTER_TOC, MASTER_TOC_LEN, handle->master_data))
         return 0;
 
+    handle->toc_fingerprint = fnv1a_update(FNV1A_SEED, handle->master_data, MASTER_TOC_LEN * SACD_LSN_SIZE);
+
     master_toc = handle->master_toc = (master_toc_t *) handle->master_data;
 
     if (strncmp("SACDMTOC", master_toc->id, 8) != 0)
@@ -554,6 +657,54 @@ void scarletbook_frame_init(scarletbook_handle_t *handle)
     handle->frame.size = 0;
     handle->frame.started = 0;
     memset(&handle->audio_sector, 0, sizeof(audio_sector_t));
+    handle->lost_sectors = 0;
+    handle->next_time_code = -1;
+    handle->end_time_code = -1;
+}
+
+void scarletbook_frame_expect(scarletbook_handle_t *handle, int start, int end, int channel_count)
+{
+    handle->next_time_code = start;
+    handle->end_time_code = end;
+    handle->area_channel_count = channel_count;
+}
+
+scarletbook_handle_t *scarletbook_frame_clone(scarletbook_handle_t *handle)
+{
+    scarletbook_handle_t *sb;
+
+    sb = (scarletbook_handle_t *) malloc(sizeof(scarletbook_handle_t));
+    if (!sb)
+        return NULL;
+
+    memcpy(sb, handle, sizeof(scarletbook_handle_t));
+
+#ifdef __lv2ppu__
+    sb->frame.data = (uint8_t *) memalign(128, MAX_DST_SIZE);
+#else
+    sb->frame.data = (uint8_t *) malloc(MAX_DST_SIZE);
+#endif
+
+    if (!sb->frame.data)
+    {
+        free(sb);
+        return NULL;
+    }
+
+    scarletbook_frame_init(sb);
+
+    return sb;
+}
+
+void scarletbook_frame_clone_free(scarletbook_handle_t *handle)
+{
+    if (!handle)
+        return;
+
+    if (handle->frame.data)
+        free((void *) handle->frame.data);
+
+    free(handle);
 }
 
 static inline int get_channel_count(audio_frame_info_t *frame_info)
@@ -581,7 +732,61 @@ static inline void exec_read_callback(scarletbook_handle_t *handle, frame_read_c
     {
         handle->frame.started = 0;
         frame_read_callback(handle, handle->frame.data, handle->frame.size, userdata);
+        handle->next_time_code = handle->frame.time_code + 1;
+    }
+}
+
+// hands on a frame of silence for every frame lost before "time_code", DST frames 
+// are stored uncompressed
+static void replace_lost_frames(scarletbook_handle_t *handle, int time_code, int dst_encoded, frame_read_callback_t frame_read_callback, void *userdata)
+{
+    int lost = handle->lost_sectors;
+    int missing = time_code - handle->next_time_code;
+    int size = handle->area_channel_count * FRAME_SIZE_64;
+
+    handle->lost_sectors = 0;
+
+    // a sector holds the start of up to 7 frames
+    if (handle->next_time_code < 0 || size == 0 || missing < 0 || missing > lost * 7 + 1)
+    {
+        LOG(lm_main, LOG_NOTICE, ("can't tell how many frames were lost in %d sector(s)", lost));
+        return;
+    }
+
+    if (dst_encoded)
+    {
+        handle->frame.data[0] = 0;
+        memset(handle->frame.data + 1, DSD_SILENCE_BYTE, size);
+        size++;
+    }
+    else
+    {
+        memset(handle->frame.data, DSD_SILENCE_BYTE, size);
+    }
+    handle->frame.size = 0;
+    handle->frame.started = 0;
+    handle->frame.dst_encoded = dst_encoded;
+    handle->frame.channel_count = handle->area_channel_count;
+
+    LOG(lm_main, LOG_NOTICE, ("%d frame(s) lost in %d sector(s) replaced by silence", missing, lost));
+    while (missing-- > 0)
+    {
+        frame_read_callback(handle, handle->frame.data, size, userdata);
+    }
+    handle->next_time_code = time_code;
+}
+
+void scarletbook_process_lost_sectors(scarletbook_handle_t *handle, int count, frame_read_callback_t frame_read_callback, void *userdata)
+{
+    // the frame in progress may be complete, it only waited for the next frame start, 
+    // otherwise the rest of it is of no use
+    if (handle->frame.dst_encoded || handle->frame.size == handle->frame.channel_count * FRAME_SIZE_64)
+    {
+        exec_read_callback(handle, frame_read_callback, userdata);
     }
+    handle->frame.started = 0;
+    handle->packet_info_idx = handle->audio_sector.header.packet_info_count;
+    handle->lost_sectors += count;
 }
 
 void scarletbook_process_frames(scarletbook_handle_t *handle, uint8_t *read_buffer, int blocks_read, int last_block, frame_read_callback_t frame_read_callback, void *userdata)
@@ -639,6 +844,13 @@ void scarletbook_process_frames(scarletbook_handle_t *handle, uint8_t *read_buff
                 {
                     exec_read_callback(handle, frame_read_callback, userdata);
 
+                    if (handle->lost_sectors)
+                    {
+                        replace_lost_frames(handle, TIME_FRAMECOUNT(&handle->audio_sector.frame[frame_info_counter].timecode), 
+                                            handle->audio_sector.header.dst_encoded, frame_read_callback, userdata);
+                    }
+                    handle->frame.time_code = TIME_FRAMECOUNT(&handle->audio_sector.frame[frame_info_counter].timecode);
+
                     handle->frame.size = 0;
                     handle->frame.dst_encoded = handle->audio_sector.header.dst_encoded;
                     handle->frame.sector_count = handle->audio_sector.frame[frame_info_counter].sector_count;
@@ -683,6 +895,11 @@ void scarletbook_process_frames(scarletbook_handle_t *handle, uint8_t *read_buff
     if (last_block) 
     {
         exec_read_callback(handle, frame_read_callback, userdata);
+
+        if (handle->lost_sectors && handle->end_time_code >= 0)
+        {
+            replace_lost_frames(handle, handle->end_time_code, handle->frame.dst_encoded, frame_read_callback, userdata);
+        }
     }
 
 }
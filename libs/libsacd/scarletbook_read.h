@@ -37,11 +37,35 @@ extern "C" {
  */
 scarletbook_handle_t *scarletbook_open(sacd_reader_t *, int);
 
+/**
+ * Reads the Master TOC and Area TOCs only, the handle has no frame buffer
+ * and can't be used to process audio frames.
+ */
+scarletbook_handle_t *scarletbook_open_toc(sacd_reader_t *);
+
+/**
+ * Reads the raw Master and Area TOCs and returns the fingerprint that
+ * scarletbook_open() stores in toc_fingerprint, without parsing them.
+ * Returns 0 when the disc can't be read.
+ */
+uint64_t scarletbook_read_fingerprint(sacd_reader_t *);
+
 /**
  * initialize scarletbook audio frames structs
  */
 void scarletbook_frame_init(scarletbook_handle_t *handle);
 
+/**
+ * creates a copy of the handle that shares all TOC data but has its own
+ * audio frame state, so several tracks can be demuxed at the same time
+ */
+scarletbook_handle_t *scarletbook_frame_clone(scarletbook_handle_t *handle);
+
+/**
+ * frees a handle created by scarletbook_frame_clone, the shared TOC data is left alone
+ */
+void scarletbook_frame_clone_free(scarletbook_handle_t *handle);
+
 /**
  * callback when a complete audio frame has been read
  */
@@ -52,6 +76,20 @@ typedef void (*frame_read_callback_t)(scarletbook_handle_t *handle, uint8_t* fra
  */
 void scarletbook_process_frames(scarletbook_handle_t *, uint8_t *, int, int, frame_read_callback_t, void *);
 
+/**
+ * tells the frame processing which track follows, "start" and "end" are the frame counts 
+ * (see TIME_FRAMECOUNT) of its first frame and of the one after its last, so that frames 
+ * lost to unreadable sectors can be replaced by silence
+ */
+void scarletbook_frame_expect(scarletbook_handle_t *, int start, int end, int channel_count);
+
+/**
+ * takes the place of scarletbook_process_frames for "count" sectors that couldn't be read,
+ * the frame in progress is dropped unless it's complete. The next frame start (or the end of the track) tells
+ * how many frames were lost, each is handed to the callback as a frame of DSD silence.
+ */
+void scarletbook_process_lost_sectors(scarletbook_handle_t *, int count, frame_read_callback_t, void *);
+
 /**
  * scarletbook_close(ifofile);
  * Cleans up the scarletbook information. This will free all data allocated for the
@@ -0,0 +1,584 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include <logging.h>
+#include <dst_decoder.h>
+
+#include "scarletbook.h"
+#include "scarletbook_read.h"
+#include "scarletbook_helpers.h"
+#include "scarletbook_scan.h"
+#include "scarletbook_catalog.h"
+#include "sacd_reader.h"
+
+#define SCAN_QUEUE_PER_THREAD   4
+#define SCAN_MAX_THREADS        64
+
+typedef struct
+{
+    char                *data;
+    size_t              len;
+    size_t              size;
+} scan_record_t;
+
+typedef struct
+{
+    int                 format;
+    FILE                *out;
+
+    // bounded queue of image paths, filled by the caller, drained by the workers
+    char                **queue;
+    int                 queue_size;
+    int                 queue_head;
+    int                 queue_count;
+    int                 queue_done;
+    pthread_mutex_t     queue_lock;
+    pthread_cond_t      queue_not_empty;
+    pthread_cond_t      queue_not_full;
+
+    pthread_mutex_t     open_lock;          // sacd_open selects the input backend through globals
+    pthread_mutex_t     out_lock;
+    int                 failed;
+
+    catalog_t           *catalog;
+} scan_context_t;
+
+static const char *csv_header = "path,fingerprint,album_title,album_artist,disc_title,disc_artist,year,disc_number,disc_count,"
+                                "catalog_number,genre,area,channels,speaker_config,frame_format,tracks,duration,"
+                                "track_durations,error\n";
+
+static void record_printf(scan_record_t *rec, const char *fmt, ...)
+{
+    va_list ap;
+    int     n;
+
+    for (;;)
+    {
+        va_start(ap, fmt);
+        n = vsnprintf(rec->data + rec->len, rec->size - rec->len, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        if (rec->len + n < rec->size)
+        {
+            rec->len += n;
+            return;
+        }
+        rec->size = (rec->len + n + 1) * 2;
+        rec->data = (char *) realloc(rec->data, rec->size);
+    }
+}
+
+static void record_putc(scan_record_t *rec, char c)
+{
+    if (rec->len + 2 > rec->size)
+    {
+        rec->size = (rec->size + 2) * 2;
+        rec->data = (char *) realloc(rec->data, rec->size);
+    }
+    rec->data[rec->len++] = c;
+    rec->data[rec->len]   = '\0';
+}
+
+static void record_string(scan_record_t *rec, int format, const char *str)
+{
+    const char *p;
+
+    if (format == SCAN_FORMAT_CSV)
+    {
+        // only quote when needed, keeps the common rows short
+        if (!str)
+            return;
+        if (!strpbrk(str, ",\"\r\n"))
+        {
+            record_printf(rec, "%s", str);
+            return;
+        }
+        record_putc(rec, '"');
+        for (p = str; *p; p++)
+        {
+            if (*p == '"')
+                record_putc(rec, '"');
+            record_putc(rec, *p);
+        }
+        record_putc(rec, '"');
+        return;
+    }
+
+    if (!str)
+    {
+        record_printf(rec, "null");
+        return;
+    }
+    record_putc(rec, '"');
+    for (p = str; *p; p++)
+    {
+        unsigned char c = (unsigned char) *p;
+        if (c == '"' || c == '\\')
+        {
+            record_putc(rec, '\\');
+            record_putc(rec, c);
+        }
+        else if (c < 0x20)
+            record_printf(rec, "\\u%04x", c);
+        else
+            record_putc(rec, c);
+    }
+    record_putc(rec, '"');
+}
+
+static double frames_to_seconds(int frames)
+{
+    return (double) frames / SACD_FRAME_RATE;
+}
+
+static void scan_album_fields(scan_record_t *rec, int format, const catalog_entry_t *entry)
+{
+    if (format == SCAN_FORMAT_CSV)
+    {
+        record_string(rec, format, entry->album_title);
+        record_putc(rec, ',');
+        record_string(rec, format, entry->album_artist);
+        record_putc(rec, ',');
+        record_string(rec, format, entry->disc_title);
+        record_putc(rec, ',');
+        record_string(rec, format, entry->disc_artist);
+        record_printf(rec, ",%d,%d,%d,", entry->year, entry->disc_number, entry->disc_count);
+        record_string(rec, format, entry->catalog_number);
+        record_putc(rec, ',');
+        record_string(rec, format, entry->genre);
+        return;
+    }
+
+    record_printf(rec, ",\"album_title\":");
+    record_string(rec, format, entry->album_title);
+    record_printf(rec, ",\"album_artist\":");
+    record_string(rec, format, entry->album_artist);
+    record_printf(rec, ",\"disc_title\":");
+    record_string(rec, format, entry->disc_title);
+    record_printf(rec, ",\"disc_artist\":");
+    record_string(rec, format, entry->disc_artist);
+    record_printf(rec, ",\"year\":%d,\"disc_number\":%d,\"disc_count\":%d,\"catalog_number\":",
+                  entry->year, entry->disc_number, entry->disc_count);
+    record_string(rec, format, entry->catalog_number);
+    record_printf(rec, ",\"genre\":");
+    record_string(rec, format, entry->genre);
+}
+
+static void scan_area_fields(scan_record_t *rec, int format, const catalog_area_t *area)
+{
+    area_toc_t area_toc;
+    const char *speaker_config, *frame_format;
+    int        i;
+
+    // the helpers only look at these fields
+    memset(&area_toc, 0, sizeof(area_toc));
+    area_toc.channel_count  = area->channel_count;
+    area_toc.extra_settings = area->extra_settings;
+    area_toc.frame_format   = area->frame_format;
+    speaker_config = get_speaker_config_string(&area_toc);
+    frame_format   = get_frame_format_string(&area_toc);
+
+    if (format == SCAN_FORMAT_CSV)
+    {
+        record_printf(rec, ",%d,%s,%s,%d,%.3f,", area->channel_count, speaker_config, frame_format,
+                      area->track_count, frames_to_seconds(area->total_frames));
+        for (i = 0; i < area->track_count; i++)
+        {
+            record_printf(rec, i ? ";%.3f" : "%.3f", frames_to_seconds(area->track_frames[i]));
+        }
+        return;
+    }
+
+    record_printf(rec, "{\"channels\":%d,\"speaker_config\":\"%s\",\"frame_format\":\"%s\",\"tracks\":%d,\"duration\":%.3f,\"track_durations\":[",
+                  area->channel_count, speaker_config, frame_format,
+                  area->track_count, frames_to_seconds(area->total_frames));
+    for (i = 0; i < area->track_count; i++)
+    {
+        record_printf(rec, i ? ",%.3f" : "%.3f", frames_to_seconds(area->track_frames[i]));
+    }
+    record_printf(rec, "],\"track_titles\":[");
+    for (i = 0; i < area->track_count; i++)
+    {
+        if (i)
+            record_putc(rec, ',');
+        record_string(rec, format, area->track_titles[i]);
+    }
+    record_printf(rec, "]}");
+}
+
+static void scan_entry_record(scan_record_t *rec, int format, const char *path, const catalog_entry_t *entry)
+{
+    int i;
+
+    if (format == SCAN_FORMAT_CSV)
+    {
+        // one row per area, the album columns are repeated
+        for (i = 0; i < entry->area_count; i++)
+        {
+            record_string(rec, format, path);
+            record_printf(rec, ",%016" PRIx64 ",", entry->fingerprint);
+            scan_album_fields(rec, format, entry);
+            record_printf(rec, ",%s", i == entry->twoch_area_idx ? "stereo" : "multi");
+            scan_area_fields(rec, format, &entry->area[i]);
+            record_printf(rec, ",\n");
+        }
+        return;
+    }
+
+    record_printf(rec, "{\"path\":");
+    record_string(rec, format, path);
+    record_printf(rec, ",\"fingerprint\":\"%016" PRIx64 "\"", entry->fingerprint);
+    scan_album_fields(rec, format, entry);
+    record_printf(rec, ",\"areas\":[");
+    for (i = 0; i < entry->area_count; i++)
+    {
+        if (i)
+            record_putc(rec, ',');
+        scan_area_fields(rec, format, &entry->area[i]);
+    }
+    record_printf(rec, "]}\n");
+}
+
+static void scan_error_record(scan_record_t *rec, int format, const char *path, const char *error)
+{
+    if (format == SCAN_FORMAT_CSV)
+    {
+        record_string(rec, format, path);
+        record_printf(rec, ",,,,,,,,,,,,,,,,,,");
+        record_string(rec, format, error);
+        record_putc(rec, '\n');
+        return;
+    }
+    record_printf(rec, "{\"path\":");
+    record_string(rec, format, path);
+    record_printf(rec, ",\"error\":");
+    record_string(rec, format, error);
+    record_printf(rec, "}\n");
+}
+
+static int scan_image(scan_context_t *ctx, const char *path, scan_record_t *rec)
+{
+    sacd_reader_t         *sacd;
+    scarletbook_handle_t  *handle;
+    catalog_entry_t       entry;
+    const catalog_entry_t *known;
+    struct stat           st;
+    int                   have_stat = stat(path, &st) == 0;
+
+    // an unchanged image that was scanned before isn't opened at all
+    if (ctx->catalog && have_stat)
+    {
+        known = catalog_find_path(ctx->catalog, path, st.st_size, st.st_mtime);
+        if (known)
+        {
+            scan_entry_record(rec, ctx->format, path, known);
+            return 1;
+        }
+    }
+
+    pthread_mutex_lock(&ctx->open_lock);
+    sacd = sacd_open(path);
+    pthread_mutex_unlock(&ctx->open_lock);
+    if (!sacd)
+    {
+        scan_error_record(rec, ctx->format, path, "can't open image");
+        return 0;
+    }
+
+    // a known disc under a new path only needs its TOCs hashed, not parsed
+    known = NULL;
+    if (ctx->catalog)
+    {
+        uint64_t fingerprint = scarletbook_read_fingerprint(sacd);
+        if (fingerprint)
+            known = catalog_find_fingerprint(ctx->catalog, fingerprint);
+    }
+
+    if (known)
+    {
+        if (!catalog_entry_copy(&entry, known))
+        {
+            sacd_close(sacd);
+            scan_error_record(rec, ctx->format, path, "out of memory");
+            return 0;
+        }
+    }
+    else
+    {
+        handle = scarletbook_open_toc(sacd);
+        if (!handle)
+        {
+            sacd_close(sacd);
+            scan_error_record(rec, ctx->format, path, "not a ScarletBook disc");
+            return 0;
+        }
+        if (!catalog_entry_from_handle(&entry, handle))
+        {
+            scarletbook_close(handle);
+            sacd_close(sacd);
+            scan_error_record(rec, ctx->format, path, "out of memory");
+            return 0;
+        }
+        scarletbook_close(handle);
+    }
+    sacd_close(sacd);
+
+    free(entry.path);
+    entry.path       = strdup(path);
+    entry.file_size  = have_stat ? (uint64_t) st.st_size : 0;
+    entry.file_mtime = have_stat ? (int64_t) st.st_mtime : 0;
+    if (ctx->catalog && have_stat && entry.path)
+        catalog_add(ctx->catalog, &entry);
+
+    scan_entry_record(rec, ctx->format, path, &entry);
+    catalog_entry_free(&entry);
+    return 1;
+}
+
+static void *scan_worker_thread(void *arg)
+{
+    scan_context_t *ctx = (scan_context_t *) arg;
+    scan_record_t  rec;
+    char           *path;
+
+    rec.size = 4096;
+    rec.len  = 0;
+    rec.data = (char *) malloc(rec.size);
+    if (!rec.data)
+        return 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&ctx->queue_lock);
+        while (ctx->queue_count == 0 && !ctx->queue_done)
+            pthread_cond_wait(&ctx->queue_not_empty, &ctx->queue_lock);
+        if (ctx->queue_count == 0)
+        {
+            pthread_mutex_unlock(&ctx->queue_lock);
+            break;
+        }
+        path = ctx->queue[ctx->queue_head];
+        ctx->queue_head = (ctx->queue_head + 1) % ctx->queue_size;
+        ctx->queue_count--;
+        pthread_cond_signal(&ctx->queue_not_full);
+        pthread_mutex_unlock(&ctx->queue_lock);
+
+        rec.len     = 0;
+        rec.data[0] = '\0';
+        if (!scan_image(ctx, path, &rec))
+        {
+            pthread_mutex_lock(&ctx->out_lock);
+            ctx->failed++;
+            pthread_mutex_unlock(&ctx->out_lock);
+        }
+
+        // whole records only, lines of different images never interleave
+        pthread_mutex_lock(&ctx->out_lock);
+        fwrite(rec.data, 1, rec.len, ctx->out);
+        pthread_mutex_unlock(&ctx->out_lock);
+
+        free(path);
+    }
+
+    free(rec.data);
+    return 0;
+}
+
+static void scan_enqueue(const char *path, void *userdata)
+{
+    scan_context_t *ctx  = (scan_context_t *) userdata;
+    char           *copy = strdup(path);
+
+    if (!copy)
+        return;
+
+    pthread_mutex_lock(&ctx->queue_lock);
+    while (ctx->queue_count == ctx->queue_size)
+        pthread_cond_wait(&ctx->queue_not_full, &ctx->queue_lock);
+    ctx->queue[(ctx->queue_head + ctx->queue_count) % ctx->queue_size] = copy;
+    ctx->queue_count++;
+    pthread_cond_signal(&ctx->queue_not_empty);
+    pthread_mutex_unlock(&ctx->queue_lock);
+}
+
+static int is_iso_filename(const char *name)
+{
+    size_t len = strlen(name);
+
+    return len > 4 && strcasecmp(name + len - 4, ".iso") == 0;
+}
+
+static void scan_directory(const char *dir, scan_found_callback_t found, void *userdata)
+{
+    DIR           *d;
+    struct dirent *entry;
+    struct stat   st;
+    char          *path;
+    size_t        dir_len = strlen(dir);
+
+    d = opendir(dir);
+    if (!d)
+    {
+        LOG(lm_main, LOG_ERROR, ("can't open directory %s", dir));
+        return;
+    }
+
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        path = (char *) malloc(dir_len + strlen(entry->d_name) + 2);
+        if (!path)
+            break;
+        sprintf(path, "%s%s%s", dir, (dir_len && dir[dir_len - 1] == '/') ? "" : "/", entry->d_name);
+
+        if (stat(path, &st) == 0)
+        {
+            if (S_ISDIR(st.st_mode))
+                scan_directory(path, found, userdata);
+            else if (S_ISREG(st.st_mode) && is_iso_filename(entry->d_name))
+                found(path, userdata);
+        }
+        free(path);
+    }
+    closedir(d);
+}
+
+static void scan_path(const char *path, scan_found_callback_t found, void *userdata)
+{
+    struct stat st;
+
+    if (strcmp(path, "-") == 0)
+    {
+        char line[4096];
+
+        while (fgets(line, sizeof(line), stdin))
+        {
+            size_t len = strlen(line);
+            while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+                line[--len] = '\0';
+            if (len)
+                found(line, userdata);
+        }
+    }
+    else if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        scan_directory(path, found, userdata);
+    }
+    else
+    {
+        found(path, userdata);
+    }
+}
+
+void scarletbook_scan_paths(char **paths, int path_count, scan_found_callback_t found, void *userdata)
+{
+    int i;
+
+    for (i = 0; i < path_count; i++)
+        scan_path(paths[i], found, userdata);
+}
+
+int scarletbook_scan(char **paths, int path_count, int format, int thread_count, catalog_t *catalog, FILE *out)
+{
+    scan_context_t ctx;
+    pthread_t      *threads;
+    int            i, started = 0;
+
+    if (thread_count <= 0)
+    {
+        // TOC reads are small and latency bound, keep more of them in flight than there are cores
+        thread_count = (int) dst_decoder_processor_count() * 2;
+    }
+    if (thread_count > SCAN_MAX_THREADS)
+        thread_count = SCAN_MAX_THREADS;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.format     = format;
+    ctx.out        = out;
+    ctx.catalog    = catalog;
+    ctx.queue_size = thread_count * SCAN_QUEUE_PER_THREAD;
+    ctx.queue      = (char **) calloc(ctx.queue_size, sizeof(char *));
+    threads        = (pthread_t *) calloc(thread_count, sizeof(pthread_t));
+    if (!ctx.queue || !threads)
+    {
+        free(ctx.queue);
+        free(threads);
+        return -1;
+    }
+    pthread_mutex_init(&ctx.queue_lock, NULL);
+    pthread_cond_init(&ctx.queue_not_empty, NULL);
+    pthread_cond_init(&ctx.queue_not_full, NULL);
+    pthread_mutex_init(&ctx.open_lock, NULL);
+    pthread_mutex_init(&ctx.out_lock, NULL);
+
+    if (format == SCAN_FORMAT_CSV)
+        fputs(csv_header, out);
+
+    for (i = 0; i < thread_count; i++)
+    {
+        if (pthread_create(&threads[i], NULL, scan_worker_thread, &ctx) != 0)
+            break;
+        started++;
+    }
+
+    if (started)
+    {
+        scarletbook_scan_paths(paths, path_count, scan_enqueue, &ctx);
+    }
+    else
+    {
+        LOG(lm_main, LOG_ERROR, ("scan: can't start worker threads"));
+        ctx.failed = -1;
+    }
+
+    pthread_mutex_lock(&ctx.queue_lock);
+    ctx.queue_done = 1;
+    pthread_cond_broadcast(&ctx.queue_not_empty);
+    pthread_mutex_unlock(&ctx.queue_lock);
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    fflush(out);
+
+    pthread_mutex_destroy(&ctx.queue_lock);
+    pthread_cond_destroy(&ctx.queue_not_empty);
+    pthread_cond_destroy(&ctx.queue_not_full);
+    pthread_mutex_destroy(&ctx.open_lock);
+    pthread_mutex_destroy(&ctx.out_lock);
+    free(ctx.queue);
+    free(threads);
+
+    return ctx.failed;
+}
@@ -0,0 +1,65 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef SCARLETBOOK_SCAN_H_INCLUDED
+#define SCARLETBOOK_SCAN_H_INCLUDED
+
+#include <stdio.h>
+#include "scarletbook_catalog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+    SCAN_FORMAT_JSON = 0,       // one JSON object per image and line
+    SCAN_FORMAT_CSV  = 1        // one row per image area
+};
+
+typedef void (*scan_found_callback_t)(const char *path, void *userdata);
+
+/**
+ * Calls "found" for every image named by "paths", in order. A path is
+ * either an image, a directory that is searched recursively for *.iso
+ * files, or "-" to read a list of paths (one per line) from stdin.
+ */
+void scarletbook_scan_paths(char **paths, int path_count, scan_found_callback_t found, void *userdata);
+
+/**
+ * Reads the Master and Area TOCs of many images and writes one metadata
+ * record per image to "out".
+ *
+ * The paths are searched as by scarletbook_scan_paths(). Images are opened
+ * by "thread_count" workers at the same time (0 picks a default), fed
+ * through a bounded queue so a large tree is never held in memory.
+ *
+ * With a "catalog", unchanged images already in it are not opened, and
+ * newly scanned images are added to it.
+ *
+ * Returns the number of images that could not be read.
+ */
+int scarletbook_scan(char **paths, int path_count, int format, int thread_count, catalog_t *catalog, FILE *out);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* SCARLETBOOK_SCAN_H_INCLUDED */
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
@@ -42,6 +43,8 @@
 
 #include <charset.h>
 #include <logging.h>
+#include <metrics.h>
+#include <trace.h>
 
 #include "getopt.h"
 
@@ -50,14 +53,26 @@
 #include <scarletbook_read.h>
 #include <scarletbook_output.h>
 #include <scarletbook_print.h>
+#include <scarletbook_scan.h>
+#include <scarletbook_catalog.h>
 #include <scarletbook_helpers.h>
 #include <scarletbook_id3.h>
+#include <scarletbook_digest.h>
+#include <scarletbook_error_map.h>
 #include <cuesheet.h>
 #include <endianess.h>
 #include <fileutils.h>
 #include <utils.h>
 #include <yarn.h>
 #include <version.h>
+#ifndef _WIN32
+#include <sys/un.h>
+#include <socket.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <sacd_pb_stream.h>
+#include <sacd_ripper.pb.h>
+#endif
 
 #ifdef _WIN32
 #define CHAR2WCHAR(dst, src) dst = (wchar_t *) charset_convert(src, strlen(src), "UTF-8", sizeof(wchar_t) == 2 ? "UCS-2-INTERNAL" : "UCS-4-INTERNAL")
@@ -72,6 +87,8 @@ static struct opts_s
     int            output_dsf;
     int            output_dsdiff_em;
     int            output_dsdiff;
+    char          *output_pcm;      /* "wav", "aiff", "dop", "dop_raw" or 0 */
+    int            pcm_rate;
     int            output_iso;
     int            concurrent;
     int            convert_dst;
@@ -84,6 +101,30 @@ static struct opts_s
     int            select_tracks;
     char           selected_tracks[256]; /* scarletbook is limited to 256 tracks */
     int            dsf_nopad; 
+    int            track_workers;
+    int            direct_io;
+    int            manifest;
+    int            verify;
+    int            resume;
+    int            read_retries;
+    int            max_read_errors;
+    char          *error_map_file;
+    int            scan;
+    int            scan_format;
+    int            scan_threads;
+    int            threads;
+    int            pin_threads;
+    char         **scan_paths;
+    int            scan_path_count;
+    char          *catalog;
+    int            batch;
+    int            batch_discs;
+    char         **batch_paths;
+    int            batch_path_count;
+    char          *daemon_socket;
+    char          *metrics_file;
+    double         metrics_interval;
+    char          *trace_file;
     int            version;
 } opts;
 
@@ -101,6 +142,45 @@ void mkdir_wrap(char *name, int mode){
 #endif
 }
 
+// marks the tracks of a list like "1,5,13" as selected
+static void parse_track_selection(struct opts_s *o, const char *list)
+{
+    int track_nr, count = 0;
+    char *end;
+    while (*list)
+    {
+        track_nr = (int) strtol(list, &end, 10);
+        if (end == list)
+        {
+            list++;
+            continue;
+        }
+        list = end;
+        if (!track_nr)
+            continue;
+        track_nr = (track_nr - 1) & 0xff;
+        o->selected_tracks[track_nr] = 1;
+        count++;
+    }
+    o->select_tracks = count != 0;
+}
+
+// reads the count "arg" of "option" into "value", complains about anything
+// that isn't a number of at least "min"
+static int parse_count(const char *option, const char *arg, int min, int *value)
+{
+    char *end;
+    long count = strtol(arg, &end, 10);
+
+    if (end == arg || *end != '\0' || count < min || count > INT_MAX)
+    {
+        fprintf(stderr, "Invalid %s: %s (use a number of at least %d)\n", option, arg, min);
+        return 0;
+    }
+    *value = (int) count;
+    return 1;
+}
+
 /* Parse all options. */
 static int parse_options(int argc, char *argv[]) 
 {
@@ -114,6 +194,10 @@ static int parse_options(int argc, char *argv[])
         "  -e, --output-dsdiff-em          : output as Philips DSDIFF (Edit Master) file\n"
         "  -p, --output-dsdiff             : output as Philips DSDIFF file\n"
         "  -s, --output-dsf                : output as Sony DSF file\n"
+        "  --output-wav                    : output as 24 bit PCM WAV file, converted from DSD\n"
+        "  --output-aiff                   : output as 24 bit PCM AIFF file, converted from DSD\n"
+        "  --pcm-rate=88200|176400         : sample rate of the WAV/AIFF output (default 88200)\n"
+        "  --output-dop[=wav|raw]          : output as DSD over PCM (DoP) in a WAV file or a raw 24 bit stream\n"
         "  -z, --dsf-nopad                 : Do not zero pad DSF (cannot be used with -t)\n"
         "  -t, --select-track              : only output selected track(s) (ex. -t 1,5,13)\n"
         "  -I, --output-iso                : output as RAW ISO\n"
@@ -121,12 +205,41 @@ static int parse_options(int argc, char *argv[])
         "  -w, --concurrent                : Concurrent ISO+DSF/DSDIFF processing mode\n"
 #endif
         "  -c, --convert-dst               : convert DST to DSD\n"
+        "  -T, --track-workers[=N]         : write N DSF/DSDIFF tracks at the same time (local sources only)\n"
+        "  -j, --threads=N                 : number of processors to decode DST on (default the processors this\n"
+        "                                    process may use: its affinity mask and cgroup CPU quota count)\n"
+        "  --pin-threads                   : pin every DST decoding thread to one processor (Linux only)\n"
+        "  -D, --direct-io                 : write output files with direct I/O, bypassing the page cache\n"
+        "  --manifest                      : add CRC-32C and SHA-256 digests of every output file, computed while\n"
+        "                                    writing, to " SCARLETBOOK_MANIFEST_NAME " in its directory\n"
+        "  --verify                        : extract again without writing and compare with the files extracted before\n"
+        "                                    with the same options (or their manifest entries), nothing is written\n"
+        "  --resume                        : keep checkpoints of the files being extracted, so that a run with the\n"
+        "                                    same options continues an interrupted extraction where it stopped\n"
+        "  --read-retries=N                : retry a sector that can't be read N times before it's replaced\n"
+        "                                    by silence (zeros in an ISO), default 3\n"
+        "  --max-read-errors=N             : stop once more than N sectors can't be read (default no limit)\n"
+        "  --error-map=FILE                : append the sectors that needed retries or were lost to FILE as JSON lines\n"
         "  -C, --export-cue                : Export a CUE Sheet\n"
         "  -i, --input[=FILE]              : set source and determine if \"iso\" image, \n"
         "                                    device or server (ex. -i 192.168.1.10:2002)\n"
         "  -o, --output-dir[=DIR]          : Output directory (ISO output dir for concurrent processing mode)\n"
         "  -y, --output-dir-conc[=DIR]     : DSF/DSDIFF Output directory for concurrent processing mode\n"
         "  -P, --print                     : display disc and track information\n" 
+        "  --scan[=json|csv] PATH...       : write TOC metadata of many images as JSON lines or CSV,\n"
+        "                                    PATH is an image, a directory to search or - to read paths from stdin\n"
+        "  --scan-threads=N                : number of images scanned at the same time\n"
+        "  --catalog=FILE                  : disc catalog that caches scanned metadata, updated by scans and extractions\n"
+        "  --batch PATH...                 : extract many images in one run, PATH is an image, a directory to search\n"
+        "                                    or - to read paths from stdin, output options apply to every image\n"
+        "  --batch-discs=N                 : number of images extracted at the same time (default 2)\n"
+        "  --daemon=SOCKET                 : run extraction jobs received on a Unix domain socket,\n"
+        "                                    output options given here are the defaults of every job\n"
+        "  --metrics=FILE                  : append the time spent per stage (read, decrypt, demux, DST decode, write)\n"
+        "                                    of every extraction to FILE as JSON lines\n"
+        "  --metrics-interval=SECONDS      : also write the metrics while extracting, every SECONDS\n"
+        "  --trace=FILE                    : record a timeline of reads, frame decodes, writes and tracks\n"
+        "                                    to FILE in Chrome trace event format (view in ui.perfetto.dev)\n"
         "  -v, --version                   : Display version\n"
         "\n"
         "Help options:\n"
@@ -140,12 +253,16 @@ static int parse_options(int argc, char *argv[])
 #else
         "        [-e|--output-dsdiff-em] [-s|--output-dsf] [-z|--dsf-nopad] [-I|--output-iso] [-w|--concurrent]\n"
 #endif
-        "        [-c|--convert-dst] [-C|--export-cue] [-i|--input FILE] [-o|--output-dir DIR] [-y|--output-dir-conc DIR] [-P|--print]\n"
+        "        [--output-wav|--output-aiff [--pcm-rate 88200|176400]] [--output-dop[=wav|raw]]\n"
+        "        [-c|--convert-dst] [-T|--track-workers N] [-j|--threads N] [--pin-threads] [-D|--direct-io] [--manifest] [--verify] [--resume]\n"
+        "        [--read-retries N] [--max-read-errors N] [--error-map FILE] [-C|--export-cue] [-i|--input FILE] [-o|--output-dir DIR] [-y|--output-dir-conc DIR] [-P|--print]\n"
+        "        [--scan[=json|csv] [--scan-threads N] PATH...] [--catalog FILE]\n"
+        "        [--batch [--batch-discs N] PATH...] [--daemon SOCKET] [--metrics FILE [--metrics-interval SECONDS]] [--trace FILE]\n"
         "        [-?|--help] [--usage]\n";
 #ifdef SECTOR_LIMIT
-    static const char options_string[] = "2mepszIcCvi:o:y:t:P?";
+    static const char options_string[] = "2mepszIcCvi:o:y:t:T:j:DP?";
 #else
-    static const char options_string[] = "2mepszIwcCvi:o:y:t:P?";
+    static const char options_string[] = "2mepszIwcCvi:o:y:t:T:j:DP?";
 #endif
     static const struct option options_table[] = {
         {"2ch-tracks", no_argument, NULL, '2' },
@@ -154,17 +271,40 @@ static int parse_options(int argc, char *argv[])
         {"output-dsdiff", no_argument, NULL, 'p'}, 
         {"output-dsf", no_argument, NULL, 's'}, 
         {"dsf-nopad", no_argument, NULL, 'z'}, 
+        {"output-wav", no_argument, NULL, 'W'}, 
+        {"output-aiff", no_argument, NULL, 'A'}, 
+        {"pcm-rate", required_argument, NULL, 'R'}, 
+        {"output-dop", optional_argument, NULL, 'O'}, 
         {"output-iso", no_argument, NULL, 'I'}, 
 #ifndef SECTOR_LIMIT
         {"concurrent", no_argument, NULL, 'w'}, 
 #endif
         {"convert-dst", no_argument, NULL, 'c'}, 
+        {"track-workers", required_argument, NULL, 'T'}, 
+        {"threads", required_argument, NULL, 'j'}, 
+        {"pin-threads", no_argument, NULL, 'H'}, 
+        {"direct-io", no_argument, NULL, 'D'}, 
+        {"manifest", no_argument, NULL, 'M'}, 
+        {"verify", no_argument, NULL, 'V'}, 
+        {"resume", no_argument, NULL, 'Q'}, 
+        {"read-retries", required_argument, NULL, 'E'}, 
+        {"max-read-errors", required_argument, NULL, 'F'}, 
+        {"error-map", required_argument, NULL, 'G'}, 
         {"export-cue", no_argument, NULL, 'C'}, 
         {"version", no_argument, NULL, 'v'},
         {"input", required_argument, NULL, 'i' },
         {"output-dir", required_argument, NULL, 'o' },
         {"output-dir-conc", required_argument, NULL, 'y' },
         {"print", no_argument, NULL, 'P' },
+        {"scan", optional_argument, NULL, 'S' },
+        {"scan-threads", required_argument, NULL, 'J' },
+        {"catalog", required_argument, NULL, 'K' },
+        {"batch", no_argument, NULL, 'B' },
+        {"batch-discs", required_argument, NULL, 'N' },
+        {"daemon", required_argument, NULL, 'U' },
+        {"metrics", required_argument, NULL, 'X' },
+        {"metrics-interval", required_argument, NULL, 'Y' },
+        {"trace", required_argument, NULL, 'Z' },
 
         {"help", no_argument, NULL, '?' },
         {"usage", no_argument, NULL, 'u' },
@@ -186,6 +326,7 @@ static int parse_options(int argc, char *argv[])
             opts.output_dsdiff_em = 1;
             opts.output_dsdiff = 0;
             opts.output_dsf = 0; 
+            opts.output_pcm = 0;
             opts.output_iso = 0;
             opts.export_cue_sheet = 1;
             break;
@@ -193,29 +334,47 @@ static int parse_options(int argc, char *argv[])
             opts.output_dsdiff_em = 0; 
             opts.output_dsdiff = 1; 
             opts.output_dsf = 0; 
+            opts.output_pcm = 0;
             break;
         case 's': 
             opts.output_dsdiff_em = 0; 
             opts.output_dsdiff = 0; 
             opts.output_dsf = 1; 
+            opts.output_pcm = 0;
             break;
-        case 't': 
+        case 'W': 
+        case 'A': 
+            opts.output_dsdiff_em = 0; 
+            opts.output_dsdiff = 0; 
+            opts.output_dsf = 0; 
+            opts.output_pcm = opt == 'W' ? "wav" : "aiff";
+            break;
+        case 'O':
+            opts.output_dsdiff_em = 0; 
+            opts.output_dsdiff = 0; 
+            opts.output_dsf = 0; 
+            opts.output_pcm = "dop";
+            if (optarg && strcasecmp(optarg, "raw") == 0)
+                opts.output_pcm = "dop_raw";
+            else if (optarg && strcasecmp(optarg, "wav") != 0)
             {
-                int track_nr, count = 0;
-                char *track = strtok(optarg, " ,");
-                while (track != 0)
-                {
-                    track_nr = atoi(track);
-                    track = strtok(0, " ,");
-                    if (!track_nr)
-                        continue;
-                    track_nr = (track_nr - 1) & 0xff;
-                    opts.selected_tracks[track_nr] = 1;
-                    count++;
-                }
-                opts.select_tracks = count != 0;
+                fprintf(stderr, "Unknown DoP format: %s\n", optarg);
+                free(program_name);
+                return 0;
             }
             break;
+        case 'R':
+            opts.pcm_rate = atoi(optarg);
+            if (opts.pcm_rate != 88200 && opts.pcm_rate != 176400)
+            {
+                fprintf(stderr, "Unsupported PCM sample rate: %s (use 88200 or 176400)\n", optarg);
+                free(program_name);
+                return 0;
+            }
+            break;
+        case 't': 
+            parse_track_selection(&opts, optarg);
+            break;
         case 'z':
             opts.dsf_nopad = 1;
             break;
@@ -227,11 +386,65 @@ static int parse_options(int argc, char *argv[])
             opts.concurrent = 1;
             break;
         case 'c': opts.convert_dst = 1; break;
+        case 'T':
+            if (!parse_count("number of track workers", optarg, 1, &opts.track_workers))
+            {
+                free(program_name);
+                return 0;
+            }
+            break;
+        case 'j':
+            // 0 picks the processors available
+            if (!parse_count("number of threads", optarg, 0, &opts.threads))
+            {
+                free(program_name);
+                return 0;
+            }
+            break;
+        case 'H': opts.pin_threads = 1; break;
+        case 'D': opts.direct_io = 1; break;
+        case 'M': opts.manifest = 1; break;
+        case 'V': opts.verify = 1; break;
+        case 'Q': opts.resume = 1; break;
+        case 'E': opts.read_retries = max(atoi(optarg), 0); break;
+        case 'F': opts.max_read_errors = max(atoi(optarg), 0); break;
+        case 'G': opts.error_map_file = optarg; break;
         case 'C': opts.export_cue_sheet = 1; break;
         case 'i': opts.input_device = strdup(optarg); break;
         case 'o': opts.output_dir = strdup(optarg); break;
         case 'y': opts.output_dir_conc = strdup(optarg); break;
         case 'P': opts.print = 1; break;
+        case 'S':
+            opts.scan = 1;
+            if (optarg && strcasecmp(optarg, "csv") == 0)
+                opts.scan_format = SCAN_FORMAT_CSV;
+            else if (optarg && strcasecmp(optarg, "json") != 0)
+            {
+                fprintf(stderr, "Unknown scan format: %s\n", optarg);
+                free(program_name);
+                return 0;
+            }
+            break;
+        case 'J':
+            if (!parse_count("number of scan threads", optarg, 0, &opts.scan_threads))
+            {
+                free(program_name);
+                return 0;
+            }
+            break;
+        case 'K': opts.catalog = strdup(optarg); break;
+        case 'B': opts.batch = 1; break;
+        case 'N':
+            if (!parse_count("number of batch discs", optarg, 1, &opts.batch_discs))
+            {
+                free(program_name);
+                return 0;
+            }
+            break;
+        case 'U': opts.daemon_socket = optarg; break;
+        case 'X': opts.metrics_file = optarg; break;
+        case 'Y': opts.metrics_interval = atof(optarg); break;
+        case 'Z': opts.trace_file = optarg; break;
         case 'v': opts.version = 1; break;
         case '?':
             fprintf(stdout, help_text, program_name);
@@ -247,6 +460,30 @@ static int parse_options(int argc, char *argv[])
         }
     }
 
+    if (opts.scan) {
+        opts.scan_paths = &argv[optind];
+        opts.scan_path_count = argc - optind;
+        if (opts.scan_path_count == 0) {
+            fprintf(stderr, usage_text, program_name);
+            free(program_name);
+            return 0;
+        }
+        free(program_name);
+        return 1;
+    }
+
+    if (opts.batch) {
+        opts.batch_paths = &argv[optind];
+        opts.batch_path_count = argc - optind;
+        if (opts.batch_path_count == 0) {
+            fprintf(stderr, usage_text, program_name);
+            free(program_name);
+            return 0;
+        }
+        free(program_name);
+        return 1;
+    }
+
     if (optind < argc) {
         const char *remaining_arg = argv[optind++];
         strcpy(opts.output_file, remaining_arg);
@@ -275,9 +512,23 @@ static int safe_fwprintf(FILE *stream, const wchar_t *format, ...)
     return retval;
 }
 
+static volatile sig_atomic_t batch_interrupted = 0;
+static volatile sig_atomic_t daemon_interrupted = 0;
+
 static void handle_sigint(int sig_no)
 {
     safe_fwprintf(stdout, L"\rUser interrupted..                                                      \n");
+    if (opts.batch)
+    {
+        // the batch scheduler stops the running discs
+        batch_interrupted = 1;
+        return;
+    }
+    if (opts.daemon_socket)
+    {
+        daemon_interrupted = 1;
+        return;
+    }
     scarletbook_output_interrupt(output);
 }
 
@@ -322,11 +573,33 @@ static void init(void)
     opts.concurrent         = 0;
     opts.output_dsdiff      = 0;
     opts.output_dsdiff_em   = 0;
+    opts.output_pcm         = 0;
+    opts.pcm_rate           = 88200;
     opts.convert_dst        = 0;
     opts.export_cue_sheet   = 0;
     opts.print              = 0;
     opts.input_device       = "/dev/cdrom";
     opts.dsf_nopad              = 0;
+    opts.track_workers      = 1;
+    opts.direct_io          = 0;
+    opts.manifest           = 0;
+    opts.verify             = 0;
+    opts.resume             = 0;
+    opts.read_retries       = 3;
+    opts.max_read_errors    = 0;
+    opts.error_map_file     = 0;
+    opts.scan               = 0;
+    opts.scan_format        = SCAN_FORMAT_JSON;
+    opts.scan_threads       = 0;
+    opts.threads            = 0;
+    opts.pin_threads        = 0;
+    opts.catalog            = 0;
+    opts.batch              = 0;
+    opts.batch_discs        = 2;
+    opts.daemon_socket      = 0;
+    opts.metrics_file       = 0;
+    opts.metrics_interval   = 0;
+    opts.trace_file         = 0;
 
 #ifdef _WIN32
     signal(SIGINT, handle_sigint);
@@ -341,13 +614,1225 @@ static void init(void)
     g_fwprintf_lock = new_lock(0);
 }
 
-int main(int argc, char* argv[]) 
+// --metrics output, shared by all jobs
+static FILE *g_metrics_out = 0;
+
+// stage metrics of one extraction, NULL without --metrics
+static metrics_t *create_job_metrics(const char *label)
+{
+    return g_metrics_out ? metrics_create(g_metrics_out, label, opts.metrics_interval) : NULL;
+}
+
+// writes the report once the output of the job has been destroyed
+static void finish_job_metrics(metrics_t *metrics)
+{
+    metrics_report(metrics);
+    metrics_destroy(metrics);
+}
+
+// --error-map output, shared by all jobs
+static FILE *g_error_map_out = 0;
+
+// map of the unreadable sectors of one extraction, NULL without --error-map
+static scarletbook_error_map_t *create_job_error_map(const char *label)
+{
+    return g_error_map_out ? scarletbook_error_map_create(g_error_map_out, label) : NULL;
+}
+
+// file extension and name of the WAV, AIFF and DoP output formats
+static const char *pcm_output_extension(const char *format)
 {
-    char *albumdir = 0, *musicfilename, *file_path = 0;
+    return strcmp(format, "aiff") == 0 ? "aiff" : strcmp(format, "dop_raw") == 0 ? "raw" : "wav";
+}
+
+static const wchar_t *pcm_output_name(const char *format)
+{
+    return strcmp(format, "wav") == 0 ? L"WAV" : strcmp(format, "aiff") == 0 ? L"AIFF" : L"DoP";
+}
+
+// seconds between the checkpoints of a file with --resume
+#define CHECKPOINT_INTERVAL 10
+
+// the path of an output file, a new one unless verifying or resuming the files already there
+static char *output_file_path(const struct opts_s *o, char *dir, char *file, const char *ext)
+{
+    return o->verify || o->resume ? make_filename(dir, 0, file, ext) : get_unique_path(dir, file, ext);
+}
+
+// the directory "dir" of output files in "device", a new one unless verifying or resuming the one already there
+static void output_file_dir(const struct opts_s *o, char *device, char **dir)
+{
+    char *device_dir;
+    size_t len;
+
+    if (!o->verify && !o->resume)
+    {
+        get_unique_dir(device, dir);
+        mkdir_wrap(*dir, 0774);
+        return;
+    }
+    if (device)
+    {
+        device_dir = make_filename(device, *dir, 0, 0);
+        len = strlen(device_dir);
+        if (len > 0 && (device_dir[len - 1] == '/' || device_dir[len - 1] == '\\'))
+            device_dir[len - 1] = '\0';
+        free(*dir);
+        *dir = device_dir;
+    }
+    if (o->resume)
+    {
+        mkdir_wrap(*dir, 0774);
+    }
+}
+
+// creates the output of a disc and queues everything selected by the options "o", 
+// "albumdir_out" receives the album directory name (free it after processing).
+// Returns NULL when the output can't be created.
+static scarletbook_output_t *queue_disc_output(const struct opts_s *o, scarletbook_handle_t *handle, 
+                                               stats_track_callback_t cb_track, stats_progress_callback_t cb_progress, char **albumdir_out)
+{
+    scarletbook_output_t *output;
+    char *albumdir, *musicfilename, *file_path = 0;
     wchar_t *s_wchar;
     int i, j, area_idx[8];
     int n_areas = 0;
+
+    *albumdir_out = NULL;
+    output = scarletbook_output_create(handle, cb_track, cb_progress, safe_fwprintf);
+    if (!output)
+        return NULL;
+    scarletbook_output_set_track_workers(output, o->track_workers);
+    scarletbook_output_set_direct_io(output, o->direct_io);
+    scarletbook_output_set_digests(output, o->manifest);
+    scarletbook_output_set_verify(output, o->verify);
+    scarletbook_output_set_checkpoints(output, o->resume ? CHECKPOINT_INTERVAL : 0);
+    scarletbook_output_set_pcm_rate(output, o->pcm_rate);
+
+    // select the channel area
+    if(has_two_channel(handle) && o->two_channel){
+        area_idx[n_areas ++] = handle->twoch_area_idx;
+    }
+    if(has_multi_channel(handle) && o->multi_channel){
+        area_idx[n_areas ++] = handle->mulch_area_idx;
+    }
+
+    albumdir = (strlen(o->output_file) > 0 ? strdup(o->output_file) : get_album_dir(handle));
+    *albumdir_out = albumdir;
+
+    if(o->export_cue_sheet && !o->verify){
+        char *albumdir_loc;
+        albumdir_loc = (char *)malloc(strlen(albumdir)+16);
+
+        for(j = 0; j < n_areas; j ++){
+            wchar_t *wide_filename;
+            strcpy(albumdir_loc, albumdir);
+            if(n_areas > 1){
+                strcat(albumdir_loc, j ? " [multi]" : " [stereo]");
+            }
+
+            file_path = get_unique_path(o->output_dir, albumdir_loc, "cue");
+            CHAR2WCHAR(wide_filename, file_path);
+            safe_fwprintf(stdout, L"Exporting CUE sheet [%ls]\n", wide_filename);
+            write_cue_sheet(handle, file_path, area_idx[j], file_path);
+            free(file_path);
+            free(wide_filename);
+        }
+        free(albumdir_loc);
+    }
+
+    if (o->output_iso)
+    {
+
+        uint32_t total_sectors = sacd_get_total_sectors(handle->sacd);
+#ifdef SECTOR_LIMIT
+#define FAT32_SECTOR_LIMIT 2090000
+        uint32_t sector_size = FAT32_SECTOR_LIMIT;
+        uint32_t sector_offset = 0;
+        if (total_sectors > FAT32_SECTOR_LIMIT)
+        {
+            musicfilename = (char *) malloc(512);
+            file_path = make_filename(o->output_dir, 0, albumdir, "iso");
+            for (i = 1; total_sectors != 0; i++)
+            {
+                sector_size = min(total_sectors, FAT32_SECTOR_LIMIT);
+                snprintf(musicfilename, 512, "%s.%03d", file_path, i);
+                scarletbook_output_enqueue_raw_sectors(output, sector_offset, sector_size, musicfilename, "iso");
+                sector_offset += sector_size;
+                total_sectors -= sector_size;
+            }
+            free(musicfilename);
+        }
+        else
+#endif
+        {
+            file_path = output_file_path(o, o->output_dir, albumdir, "iso");
+            scarletbook_output_enqueue_raw_sectors(output, 0, total_sectors, file_path, "iso");
+
+
+            // Concurrent iso+dsf/dsdiff generation
+            if(o->concurrent && (o->output_dsf || o->output_dsdiff || o->output_pcm)){
+                safe_fwprintf(stdout, L"Concurrent mode enabled.\n");
+                CHAR2WCHAR(s_wchar, file_path);
+                safe_fwprintf(stdout, L"ISO output: %ls\n", s_wchar);
+                free(s_wchar);
+                free(file_path);
+
+                char *albumdir_loc;
+                albumdir_loc = (char *)malloc(strlen(albumdir)+16);
+                // fill the sub queue with items to rip
+                for (j = 0; j < n_areas; j ++){
+                    // create the output folder
+                    // If both stereo and multi-ch tracks are getting processed, create separate directories
+                    strcpy(albumdir_loc, albumdir);
+                    if(n_areas > 1){
+                        strcat(albumdir_loc, j ? " [multi]" : " [stereo]");
+                    }
+
+                    output_file_dir(o, o->output_dir_conc, &albumdir_loc);
+                    if(o->output_dsf){
+                        CHAR2WCHAR(s_wchar, albumdir_loc);
+                        safe_fwprintf(stdout, L"DSF output: %ls\n", s_wchar);
+                        free(s_wchar);
+                    }
+                    else if(o->output_pcm){
+                        CHAR2WCHAR(s_wchar, albumdir_loc);
+                        safe_fwprintf(stdout, L"%ls output: %ls\n", pcm_output_name(o->output_pcm), s_wchar);
+                        free(s_wchar);
+                    }
+                    else{
+                        CHAR2WCHAR(s_wchar, albumdir_loc);
+                        safe_fwprintf(stdout, L"DSDIFF output: %ls\n", s_wchar);
+                        free(s_wchar);
+                    }
+
+                    for (i = 0; i < handle->area[area_idx[j]].area_toc->track_count; i++) 
+                    {
+                        if (o->select_tracks && o->selected_tracks[i] == 0)
+                            continue;
+
+                        musicfilename = get_music_filename(handle, area_idx[j], i, o->output_file);
+
+                        if (o->output_dsf)
+                        {
+                            file_path = make_filename(albumdir_loc, 0, musicfilename, "dsf");
+                            scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, "dsf", 
+                                1 /* always decode to DSD */, o->dsf_nopad && !o->select_tracks, 1);
+                        }
+                        else if (o->output_pcm)
+                        {
+                            file_path = make_filename(albumdir_loc, 0, musicfilename, pcm_output_extension(o->output_pcm));
+                            scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, o->output_pcm, 
+                                1 /* always decode to DSD */, 0, 1);
+                        }
+                        else if (o->output_dsdiff)
+                        {
+                            file_path = make_filename(albumdir_loc, 0, musicfilename, "dff");
+                            scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, "dsdiff", 
+                                (o->convert_dst ? 1 : handle->area[area_idx[j]].area_toc->frame_format != FRAME_FORMAT_DST), 0, 1);
+                        }
+                        free(musicfilename);
+                        free(file_path);
+                    }
+                }
+                free(albumdir_loc);
+            }
+            else{
+                free(file_path);
+            }
+        }
+    }
+    else if (o->output_dsdiff_em)
+    {
+        char *albumdir_loc;
+        albumdir_loc = (char *)malloc(strlen(albumdir)+16);
+
+        for(j = 0; j < n_areas; j ++){
+            strcpy(albumdir_loc, albumdir);
+            if(n_areas > 1){
+                strcat(albumdir_loc, j ? " [multi]" : " [stereo]");
+            }
+
+            file_path = output_file_path(o, o->output_dir, albumdir_loc, "dff");
+            scarletbook_output_enqueue_track(output, area_idx[j], 0, file_path, "dsdiff_edit_master",
+                (o->convert_dst ? 1 : handle->area[area_idx[j]].area_toc->frame_format != FRAME_FORMAT_DST), 0, 0);
+            free(file_path);
+        }
+        free(albumdir_loc);
+    }
+
+    // Non-concurrent dsf/dsdiff generation
+    else if (!(o->output_iso && o->concurrent) && (o->output_dsf || o->output_dsdiff || o->output_pcm))
+    {
+        char *albumdir_loc;
+        albumdir_loc = (char *)malloc(strlen(albumdir)+16);
+
+        for(j = 0; j < n_areas; j ++){
+            // create the output folder
+            // If both stereo and multi-ch tracks are getting processed, create separate directories
+            strcpy(albumdir_loc, albumdir);
+            if(n_areas > 1){
+                strcat(albumdir_loc, j ? " [multi]" : " [stereo]");
+            }
+
+            output_file_dir(o, o->output_dir, &albumdir_loc);
+
+            if(o->output_dsf){
+                CHAR2WCHAR(s_wchar, albumdir_loc);
+                safe_fwprintf(stdout, L"DSF output: %ls\n", s_wchar);
+                free(s_wchar);
+            }
+            else if(o->output_pcm){
+                CHAR2WCHAR(s_wchar, albumdir_loc);
+                safe_fwprintf(stdout, L"%ls output: %ls\n", pcm_output_name(o->output_pcm), s_wchar);
+                free(s_wchar);
+            }
+            else{
+                CHAR2WCHAR(s_wchar, albumdir_loc);
+                safe_fwprintf(stdout, L"DSDIFF output: %ls\n", s_wchar);
+                free(s_wchar);
+            }
+
+            // fill the queue with items to rip
+            for (i = 0; i < handle->area[area_idx[j]].area_toc->track_count; i++) 
+            {
+                if (o->select_tracks && o->selected_tracks[i] == 0)
+                    continue;
+
+                musicfilename = get_music_filename(handle, area_idx[j], i, o->output_file);
+
+                if (o->output_dsf)
+                {
+                    file_path = make_filename(albumdir_loc, 0, musicfilename, "dsf");
+                    scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, "dsf", 
+                        1 /* always decode to DSD */, o->dsf_nopad && !o->select_tracks, 0);
+                }
+                else if (o->output_pcm)
+                {
+                    file_path = make_filename(albumdir_loc, 0, musicfilename, pcm_output_extension(o->output_pcm));
+                    scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, o->output_pcm, 
+                        1 /* always decode to DSD */, 0, 0);
+                }
+                else if (o->output_dsdiff)
+                {
+                    file_path = make_filename(albumdir_loc, 0, musicfilename, "dff");
+                    scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, "dsdiff", 
+                        (o->convert_dst ? 1 : handle->area[area_idx[j]].area_toc->frame_format != FRAME_FORMAT_DST), 0, 0);
+                }
+
+                free(musicfilename);
+                free(file_path);
+            }
+        }
+        free(albumdir_loc);
+    }
+
+    return output;
+}
+
+// remembers an extracted image, so later scans don't have to open it
+static void update_catalog(catalog_t *catalog, scarletbook_handle_t *handle, const char *path)
+{
+    catalog_entry_t entry;
+    struct stat     st;
+
+    // devices and network servers have no stable size/mtime to key on
+    if (!catalog || stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        return;
+
+    if (catalog_entry_from_handle(&entry, handle))
+    {
+        entry.path       = strdup(path);
+        entry.file_size  = st.st_size;
+        entry.file_mtime = st.st_mtime;
+        if (entry.path)
+            catalog_add(catalog, &entry);
+        catalog_entry_free(&entry);
+    }
+}
+
+#define BATCH_MAX_DISCS 16
+
+// state of a batch run, the images are listed up front so progress can be 
+// reported against the total
+typedef struct
+{
+    char                 **paths;
+    int                    path_count;
+    int                    path_capacity;
+    int                    next_path;
+
+    catalog_t             *catalog;
+    pthread_mutex_t        lock;                    // guards everything below and the naming of output files
+    scarletbook_output_t  *active[BATCH_MAX_DISCS];  // indexed by the slot of the worker
+    int                    next_slot;
+    int                    running;
+    int                    finished;
+    int                    failed;
+    uint64_t               sectors_processed;
+} batch_t;
+
+static void batch_add_path(const char *path, void *userdata)
+{
+    batch_t *batch = (batch_t *) userdata;
+    char   **paths;
+
+    if (batch->path_count == batch->path_capacity)
+    {
+        paths = (char **) realloc(batch->paths, (batch->path_capacity * 2 + 16) * sizeof(char *));
+        if (!paths)
+            return;
+        batch->paths = paths;
+        batch->path_capacity = batch->path_capacity * 2 + 16;
+    }
+    if ((batch->paths[batch->path_count] = strdup(path)) != NULL)
+        batch->path_count++;
+}
+
+static void batch_report(batch_t *batch, const char *path, const char *error, uint32_t sectors)
+{
+    wchar_t *wide_path;
+
+    CHAR2WCHAR(wide_path, path);
+    pthread_mutex_lock(&batch->lock);
+    batch->finished++;
+    if (error)
+    {
+        batch->failed++;
+        safe_fwprintf(stdout, L"\rFailed [%ls] (%d/%d): %s\n", wide_path, batch->finished, batch->path_count, error);
+    }
+    else
+    {
+        batch->sectors_processed += sectors;
+        safe_fwprintf(stdout, L"\rFinished [%ls] (%d/%d): %.1fMB\n", wide_path, batch->finished, batch->path_count,
+                      (double) sectors * SACD_LSN_SIZE / 1048576.00);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    free(wide_path);
+}
+
+// every disc worker takes the next image and runs its reader through the whole
+// image, the DST decoders of all discs share one thread budget (see run_batch), 
+// so one disc waiting on reads leaves the processors to the others
+static void *batch_worker_thread(void *arg)
+{
+    batch_t               *batch = (batch_t *) arg;
+    sacd_reader_t         *sacd;
+    scarletbook_handle_t  *sb_handle;
+    scarletbook_output_t  *disc_output;
+    metrics_t             *disc_metrics;
+    scarletbook_error_map_t *disc_error_map;
+    char                  *albumdir;
+    const char            *path;
+    uint32_t               total_sectors, sectors_processed;
+    int                    verify_failures, lost_sectors;
+    int                    slot;
+
+    // every worker owns a slot of "active" for its whole run, there are at
+    // most BATCH_MAX_DISCS workers
+    pthread_mutex_lock(&batch->lock);
+    slot = batch->next_slot++;
+    pthread_mutex_unlock(&batch->lock);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->lock);
+        if (batch->next_path == batch->path_count || batch_interrupted)
+        {
+            batch->running--;
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+        path = batch->paths[batch->next_path++];
+
+        // sacd_open selects the input backend through globals
+        sacd = sacd_open(path);
+        pthread_mutex_unlock(&batch->lock);
+        if (!sacd)
+        {
+            batch_report(batch, path, "can't open image", 0);
+            continue;
+        }
+
+        sb_handle = scarletbook_open(sacd, 0);
+        if (!sb_handle)
+        {
+            sacd_close(sacd);
+            batch_report(batch, path, "not a ScarletBook disc", 0);
+            continue;
+        }
+
+        update_catalog(batch->catalog, sb_handle, path);
+
+        // discs with the same album name must not pick the same output directory
+        pthread_mutex_lock(&batch->lock);
+        disc_output = queue_disc_output(&opts, sb_handle, handle_status_update_track_callback, NULL, &albumdir);
+        batch->active[slot] = disc_output;
+        pthread_mutex_unlock(&batch->lock);
+        if (!disc_output)
+        {
+            scarletbook_close(sb_handle);
+            sacd_close(sacd);
+            batch_report(batch, path, "out of memory", 0);
+            continue;
+        }
+
+        disc_metrics = create_job_metrics(path);
+        scarletbook_output_set_metrics(disc_output, disc_metrics);
+        disc_error_map = create_job_error_map(path);
+        scarletbook_output_set_read_errors(disc_output, opts.read_retries, opts.max_read_errors, disc_error_map);
+        scarletbook_output_start(disc_output);
+        scarletbook_output_wait(disc_output);
+        scarletbook_output_get_stats(disc_output, &total_sectors, &sectors_processed);
+        verify_failures = scarletbook_output_verify_failures(disc_output);
+        lost_sectors = scarletbook_output_lost_sectors(disc_output);
+
+        pthread_mutex_lock(&batch->lock);
+        batch->active[slot] = NULL;
+        pthread_mutex_unlock(&batch->lock);
+        scarletbook_output_destroy(disc_output);
+        finish_job_metrics(disc_metrics);
+        scarletbook_error_map_destroy(disc_error_map);
+
+        batch_report(batch, path, sectors_processed < total_sectors ? "interrupted" : 
+                     verify_failures ? "output differs" : lost_sectors ? "unreadable sectors replaced" : NULL, sectors_processed);
+
+        scarletbook_close(sb_handle);
+        sacd_close(sacd);
+        free(albumdir);
+    }
+
+    return 0;
+}
+
+// extracts all images of opts.batch_paths, returns the number of failed images
+static int run_batch(void)
+{
+    batch_t    batch;
+    pthread_t  workers[BATCH_MAX_DISCS];
+    time_t     started;
+    int        i, disc_count, started_workers = 0, failed;
+
+    memset(&batch, 0, sizeof(batch));
+    scarletbook_scan_paths(opts.batch_paths, opts.batch_path_count, batch_add_path, &batch);
+    if (batch.path_count == 0)
+    {
+        fprintf(stderr, "No images found.\n");
+        return 0;
+    }
+
+    if (opts.catalog && !(batch.catalog = catalog_open(opts.catalog)))
+        fprintf(stderr, "Can't open catalog %s.\n", opts.catalog);
+
+    // one budget for the DST decoding of all discs, the readers don't count against it
+    dst_decoder_set_thread_budget((int) dst_decoder_processor_count());
+
+    disc_count = min(max(opts.batch_discs, 1), min(BATCH_MAX_DISCS, batch.path_count));
+    safe_fwprintf(stdout, L"Extracting %d images, %d at a time\n", batch.path_count, disc_count);
+
+    pthread_mutex_init(&batch.lock, NULL);
+    started = time(0);
+    for (i = 0; i < disc_count; i++)
+    {
+        pthread_mutex_lock(&batch.lock);
+        batch.running++;
+        pthread_mutex_unlock(&batch.lock);
+        if (pthread_create(&workers[i], NULL, batch_worker_thread, &batch) != 0)
+        {
+            pthread_mutex_lock(&batch.lock);
+            batch.running--;
+            pthread_mutex_unlock(&batch.lock);
+            break;
+        }
+        started_workers++;
+    }
+
+    // signals only set a flag, the running discs are interrupted from here
+    for (;;)
+    {
+        pthread_mutex_lock(&batch.lock);
+        if (batch.running == 0)
+        {
+            pthread_mutex_unlock(&batch.lock);
+            break;
+        }
+        if (batch_interrupted)
+        {
+            for (i = 0; i < BATCH_MAX_DISCS; i++)
+            {
+                if (batch.active[i])
+                    scarletbook_output_interrupt(batch.active[i]);
+            }
+        }
+        pthread_mutex_unlock(&batch.lock);
+        usleep(100000);
+    }
+    for (i = 0; i < started_workers; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    safe_fwprintf(stdout, L"\rBatch done: %d of %d images extracted, %d failed, %.1fMB in %ds at %.2fMB/sec\n",
+                  batch.finished - batch.failed, batch.path_count, batch.failed + batch.path_count - batch.finished,
+                  (double) batch.sectors_processed * SACD_LSN_SIZE / 1048576.00, (int) (time(0) - started),
+                  (double) batch.sectors_processed * SACD_LSN_SIZE / 1048576.00 / (double) max(time(0) - started, 1));
+
+    failed = batch.failed + batch.path_count - batch.finished;
+    catalog_close(batch.catalog);
+    pthread_mutex_destroy(&batch.lock);
+    for (i = 0; i < batch.path_count; i++)
+    {
+        free(batch.paths[i]);
+    }
+    free(batch.paths);
+    return failed;
+}
+
+#ifndef _WIN32
+
+// a client connection, freed when its reader thread has stopped and none of 
+// its jobs is queued or running anymore
+typedef struct daemon_client_s
+{
+    t_socket                socket;
+    pthread_mutex_t         send_lock;          // events of several threads must not interleave
+    int                     closed;             // guarded by send_lock
+    int                     refs;               // guarded by the daemon lock
+    struct daemon_client_s *next;
+} daemon_client_t;
+
+typedef struct daemon_job_s
+{
+    uint32_t                id;
+    struct opts_s           opts;
+    char                    input[1024];
+    char                    output_dir[1024];
+    int                     cancelled;
+    double                  last_progress;
+    daemon_client_t        *client;
+    struct daemon_job_s    *next;
+} daemon_job_t;
+
+// jobs are run one after another by a single worker, the DST decoders of a job 
+// use all processors already
+typedef struct
+{
+    t_socket                socket;
+    catalog_t              *catalog;
+
+    pthread_mutex_t         lock;               // guards everything below
+    pthread_cond_t          changed;
+    daemon_job_t           *queue_head;
+    daemon_job_t          **queue_tail;
+    daemon_job_t           *current;
+    scarletbook_output_t   *current_output;
+    daemon_client_t        *clients;
+    int                     client_count;
+    uint32_t                next_job_id;
+    int                     stopping;
+} daemon_t;
+
+// the output callbacks have no user data, they report to the running job
+static daemon_t g_daemon;
+
+#define DAEMON_PROGRESS_INTERVAL 0.5
+
+static void daemon_init_event(DaemonEvent *event, DaemonEvent_Type type, uint32_t job_id)
+{
+    memset(event, 0, sizeof(DaemonEvent));
+    event->type = type;
+    event->job_id = job_id;
+}
+
+static void daemon_set_event_text(char *dst, size_t size, bool *has, const char *src)
+{
+    if (src)
+    {
+        snprintf(dst, size, "%s", src);
+        *has = true;
+    }
+}
+
+// writes a zero terminated event, the caller holds the send lock of the client
+static void daemon_write_event(daemon_client_t *client, const DaemonEvent *event)
+{
+    pb_ostream_t output;
+    uint8_t      zero = 0;
+
+    if (client->closed)
+        return;
+
+    output = pb_ostream_from_socket(&client->socket);
+    if (!pb_encode(&output, DaemonEvent_fields, event) || !pb_write(&output, &zero, 1))
+    {
+        // the client went away, its jobs keep running
+        LOG(lm_main, LOG_NOTICE, ("daemon: client disconnected, dropping events"));
+        client->closed = 1;
+    }
+}
+
+static void daemon_send_event(daemon_client_t *client, const DaemonEvent *event)
+{
+    pthread_mutex_lock(&client->send_lock);
+    daemon_write_event(client, event);
+    pthread_mutex_unlock(&client->send_lock);
+}
+
+static void daemon_send_failure(daemon_client_t *client, uint32_t job_id, const char *path, const char *message)
+{
+    DaemonEvent event;
+
+    daemon_init_event(&event, DaemonEvent_Type_JOB_FAILED, job_id);
+    daemon_set_event_text(event.path, sizeof(event.path), &event.has_path, path);
+    daemon_set_event_text(event.message, sizeof(event.message), &event.has_message, message);
+    daemon_send_event(client, &event);
+}
+
+static void daemon_release_client(daemon_client_t *client)
+{
+    daemon_client_t **prior;
+    int               last;
+
+    pthread_mutex_lock(&g_daemon.lock);
+    last = --client->refs == 0;
+    if (last)
+    {
+        for (prior = &g_daemon.clients; *prior != client; prior = &(*prior)->next)
+            ;
+        *prior = client->next;
+        g_daemon.client_count--;
+        pthread_cond_broadcast(&g_daemon.changed);
+    }
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    if (last)
+    {
+        socket_destroy(&client->socket);
+        pthread_mutex_destroy(&client->send_lock);
+        free(client);
+    }
+}
+
+static void daemon_free_job(daemon_job_t *job)
+{
+    daemon_release_client(job->client);
+    free(job);
+}
+
+static void daemon_track_callback(char *filename, int current_track, int total_tracks, int dst_decomp)
+{
+    daemon_job_t *job = g_daemon.current;
+    DaemonEvent   event;
+
+    daemon_init_event(&event, DaemonEvent_Type_TRACK_STARTED, job->id);
+    daemon_set_event_text(event.path, sizeof(event.path), &event.has_path, filename);
+    event.has_current = true;
+    event.current = current_track;
+    event.has_total = true;
+    event.total = total_tracks;
+    daemon_send_event(job->client, &event);
+
+    handle_status_update_track_callback(filename, current_track, total_tracks, dst_decomp);
+}
+
+static void daemon_progress_callback(uint32_t stats_total_sectors, uint32_t stats_total_sectors_processed,
+                                     uint32_t stats_current_file_total_sectors, uint32_t stats_current_file_sectors_processed)
+{
+    daemon_job_t *job = g_daemon.current;
+    DaemonEvent   event;
+    double        now = timeout_gettime();
+
+    // several track workers may report at the same time
+    pthread_mutex_lock(&g_daemon.lock);
+    if (now - job->last_progress < DAEMON_PROGRESS_INTERVAL && stats_total_sectors_processed < stats_total_sectors)
+    {
+        pthread_mutex_unlock(&g_daemon.lock);
+        return;
+    }
+    job->last_progress = now;
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    daemon_init_event(&event, DaemonEvent_Type_JOB_PROGRESS, job->id);
+    event.has_current = true;
+    event.current = stats_total_sectors_processed;
+    event.has_total = true;
+    event.total = stats_total_sectors;
+    daemon_send_event(job->client, &event);
+}
+
+// extracts one image, the events of the job go to the client that submitted it
+static void daemon_run_job(daemon_job_t *job)
+{
+    DaemonEvent           event;
+    sacd_reader_t        *sacd;
+    scarletbook_handle_t *sb_handle;
+    scarletbook_output_t *job_output;
+    metrics_t            *job_metrics;
+    scarletbook_error_map_t *job_error_map;
+    char                 *albumdir;
+    uint32_t              total_sectors, sectors_processed;
+    int                   cancelled;
+    wchar_t              *wide_path;
+
+    CHAR2WCHAR(wide_path, job->input);
+    safe_fwprintf(stdout, L"\rJob %u: extracting [%ls]\n", job->id, wide_path);
+    free(wide_path);
+
+    daemon_init_event(&event, DaemonEvent_Type_JOB_STARTED, job->id);
+    daemon_set_event_text(event.path, sizeof(event.path), &event.has_path, job->input);
+    daemon_send_event(job->client, &event);
+
+    sacd = sacd_open(job->input);
+    if (!sacd)
+    {
+        daemon_send_failure(job->client, job->id, job->input, "can't open image");
+        return;
+    }
+
+    sb_handle = scarletbook_open(sacd, 0);
+    if (!sb_handle)
+    {
+        sacd_close(sacd);
+        daemon_send_failure(job->client, job->id, job->input, "not a ScarletBook disc");
+        return;
+    }
+
+    update_catalog(g_daemon.catalog, sb_handle, job->input);
+
+    job_output = queue_disc_output(&job->opts, sb_handle, daemon_track_callback, daemon_progress_callback, &albumdir);
+    if (!job_output)
+    {
+        scarletbook_close(sb_handle);
+        sacd_close(sacd);
+        daemon_send_failure(job->client, job->id, job->input, "out of memory");
+        return;
+    }
+    job_metrics = create_job_metrics(job->input);
+    scarletbook_output_set_metrics(job_output, job_metrics);
+    job_error_map = create_job_error_map(job->input);
+    scarletbook_output_set_read_errors(job_output, job->opts.read_retries, job->opts.max_read_errors, job_error_map);
+
+    // started under the lock, so a cancel request can't slip in before the output can be interrupted
+    pthread_mutex_lock(&g_daemon.lock);
+    scarletbook_output_start(job_output);
+    g_daemon.current_output = job_output;
+    if (job->cancelled)
+        scarletbook_output_interrupt(job_output);
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    scarletbook_output_wait(job_output);
+
+    pthread_mutex_lock(&g_daemon.lock);
+    g_daemon.current_output = NULL;
+    cancelled = job->cancelled;
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    scarletbook_output_get_stats(job_output, &total_sectors, &sectors_processed);
+    scarletbook_output_destroy(job_output);
+    finish_job_metrics(job_metrics);
+    scarletbook_error_map_destroy(job_error_map);
+    scarletbook_close(sb_handle);
+    sacd_close(sacd);
+    free(albumdir);
+
+    if (cancelled || sectors_processed < total_sectors)
+    {
+        daemon_send_failure(job->client, job->id, job->input, cancelled ? "cancelled" : "interrupted");
+        return;
+    }
+
+    daemon_init_event(&event, DaemonEvent_Type_JOB_FINISHED, job->id);
+    daemon_set_event_text(event.path, sizeof(event.path), &event.has_path, job->input);
+    event.has_current = true;
+    event.current = sectors_processed;
+    event.has_total = true;
+    event.total = total_sectors;
+    daemon_send_event(job->client, &event);
+}
+
+static void *daemon_worker_thread(void *arg)
+{
+    daemon_job_t *job;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&g_daemon.lock);
+        while (!g_daemon.queue_head && !g_daemon.stopping)
+            pthread_cond_wait(&g_daemon.changed, &g_daemon.lock);
+        if (g_daemon.stopping)
+        {
+            // jobs still queued are failed by run_daemon
+            pthread_mutex_unlock(&g_daemon.lock);
+            break;
+        }
+        job = g_daemon.queue_head;
+        g_daemon.queue_head = job->next;
+        if (!g_daemon.queue_head)
+            g_daemon.queue_tail = &g_daemon.queue_head;
+        g_daemon.current = job;
+        pthread_mutex_unlock(&g_daemon.lock);
+
+        daemon_run_job(job);
+
+        pthread_mutex_lock(&g_daemon.lock);
+        g_daemon.current = NULL;
+        pthread_mutex_unlock(&g_daemon.lock);
+        daemon_free_job(job);
+    }
+
+    return 0;
+}
+
+// fills the options of a job, fields missing in the request keep the values
+// given on the command line
+static const char *daemon_job_options(daemon_job_t *job, const DaemonRequest *request)
+{
+    struct stat st;
+
+    if (!request->has_input || !request->input[0])
+        return "no input given";
+
+    job->opts = opts;
+    strcpy(job->input, request->input);
+    job->opts.input_device = job->input;
+    job->opts.output_file[0] = 0;
+    job->opts.concurrent = 0;
+
+    if (request->has_output_dir)
+    {
+        strcpy(job->output_dir, request->output_dir);
+        job->opts.output_dir = job->output_dir[0] ? job->output_dir : 0;
+    }
+    if (job->opts.output_dir && (stat(job->opts.output_dir, &st) != 0 || !S_ISDIR(st.st_mode)))
+        return "output directory doesn't exist";
+
+    if (request->has_formats)
+    {
+        job->opts.output_dsf       = (request->formats & DaemonRequest_Format_DSF) != 0;
+        job->opts.output_dsdiff    = (request->formats & DaemonRequest_Format_DSDIFF) != 0;
+        job->opts.output_dsdiff_em = (request->formats & DaemonRequest_Format_DSDIFF_EDIT_MASTER) != 0;
+        job->opts.output_iso       = (request->formats & DaemonRequest_Format_ISO) != 0;
+        job->opts.output_pcm       = (request->formats & DaemonRequest_Format_WAV) ? "wav" : 
+                                     (request->formats & DaemonRequest_Format_AIFF) ? "aiff" : 
+                                     (request->formats & DaemonRequest_Format_DOP) ? "dop" : 
+                                     (request->formats & DaemonRequest_Format_DOP_RAW) ? "dop_raw" : 0;
+        job->opts.export_cue_sheet = (request->formats & (DaemonRequest_Format_CUE_SHEET | DaemonRequest_Format_DSDIFF_EDIT_MASTER)) != 0;
+    }
+    if (!(job->opts.output_dsf || job->opts.output_iso || job->opts.output_dsdiff || job->opts.output_pcm || job->opts.output_dsdiff_em || job->opts.export_cue_sheet))
+        return "no output format given";
+
+    if (request->has_two_channel || request->has_multi_channel)
+    {
+        job->opts.two_channel   = request->has_two_channel && request->two_channel;
+        job->opts.multi_channel = request->has_multi_channel && request->multi_channel;
+        if (!job->opts.two_channel && !job->opts.multi_channel)
+            job->opts.two_channel = 1;
+    }
+    if (request->has_convert_dst)
+        job->opts.convert_dst = request->convert_dst;
+    if (request->has_dsf_nopad)
+        job->opts.dsf_nopad = request->dsf_nopad;
+    if (request->has_tracks)
+    {
+        memset(job->opts.selected_tracks, 0, sizeof(job->opts.selected_tracks));
+        parse_track_selection(&job->opts, request->tracks);
+    }
+    return NULL;
+}
+
+static void daemon_submit_job(daemon_client_t *client, const DaemonRequest *request)
+{
+    daemon_job_t *job;
+    DaemonEvent   event;
+    const char   *error;
+
+    job = (daemon_job_t *) calloc(1, sizeof(daemon_job_t));
+    if (!job)
+    {
+        daemon_send_failure(client, 0, request->has_input ? request->input : NULL, "out of memory");
+        return;
+    }
+    if ((error = daemon_job_options(job, request)) != NULL)
+    {
+        daemon_send_failure(client, 0, request->has_input ? request->input : NULL, error);
+        free(job);
+        return;
+    }
+    job->client = client;
+
+    // the job must not report that it started before it was acknowledged
+    pthread_mutex_lock(&client->send_lock);
+    pthread_mutex_lock(&g_daemon.lock);
+    if (g_daemon.stopping)
+    {
+        pthread_mutex_unlock(&g_daemon.lock);
+        pthread_mutex_unlock(&client->send_lock);
+        daemon_send_failure(client, 0, job->input, "daemon is shutting down");
+        free(job);
+        return;
+    }
+    job->id = ++g_daemon.next_job_id;
+    client->refs++;
+    *g_daemon.queue_tail = job;
+    g_daemon.queue_tail = &job->next;
+    pthread_cond_broadcast(&g_daemon.changed);
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    daemon_init_event(&event, DaemonEvent_Type_JOB_QUEUED, job->id);
+    daemon_set_event_text(event.path, sizeof(event.path), &event.has_path, job->input);
+    daemon_write_event(client, &event);
+    pthread_mutex_unlock(&client->send_lock);
+}
+
+static void daemon_cancel_job(daemon_client_t *client, uint32_t job_id)
+{
+    daemon_job_t  *job, **prior;
+
+    pthread_mutex_lock(&g_daemon.lock);
+    if (g_daemon.current && g_daemon.current->id == job_id)
+    {
+        // the worker reports the cancelled job
+        g_daemon.current->cancelled = 1;
+        if (g_daemon.current_output)
+            scarletbook_output_interrupt(g_daemon.current_output);
+        pthread_mutex_unlock(&g_daemon.lock);
+        return;
+    }
+    for (prior = &g_daemon.queue_head; (job = *prior) != NULL; prior = &job->next)
+    {
+        if (job->id == job_id)
+        {
+            *prior = job->next;
+            if (!job->next)
+                g_daemon.queue_tail = prior;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    if (job)
+    {
+        daemon_send_failure(job->client, job->id, job->input, "cancelled");
+        daemon_free_job(job);
+    }
+    else
+    {
+        daemon_send_failure(client, job_id, NULL, "unknown job");
+    }
+}
+
+// reads the requests of a client until it disconnects
+static void *daemon_client_thread(void *arg)
+{
+    daemon_client_t *client = (daemon_client_t *) arg;
+    DaemonRequest    request;
+    DaemonEvent      event;
+    pb_istream_t     input;
+
+    for (;;)
+    {
+        memset(&request, 0, sizeof(request));
+        input = pb_istream_from_socket(&client->socket);
+        if (!pb_decode(&input, DaemonRequest_fields, &request))
+            break;
+
+        switch (request.type)
+        {
+        case DaemonRequest_Type_JOB_SUBMIT:
+            daemon_submit_job(client, &request);
+            break;
+        case DaemonRequest_Type_JOB_CANCEL:
+            daemon_cancel_job(client, request.has_job_id ? request.job_id : 0);
+            break;
+        case DaemonRequest_Type_SHUTDOWN:
+            pthread_mutex_lock(&g_daemon.lock);
+            g_daemon.stopping = 1;
+            pthread_cond_broadcast(&g_daemon.changed);
+            pthread_mutex_unlock(&g_daemon.lock);
+
+            daemon_init_event(&event, DaemonEvent_Type_SHUTTING_DOWN, 0);
+            daemon_send_event(client, &event);
+            break;
+        default:
+            daemon_send_failure(client, 0, NULL, "unknown request");
+            break;
+        }
+    }
+
+    daemon_release_client(client);
+    return 0;
+}
+
+// serves extraction jobs on opts.daemon_socket until a shutdown request or
+// SIGINT, returns non zero when the socket could not be set up
+static int run_daemon(void)
+{
+    struct sockaddr_un addr;
+    daemon_client_t   *client;
+    daemon_job_t      *job, *queued;
+    pthread_t          worker, reader;
+    t_socket           client_socket;
+    t_timeout          tm;
+    wchar_t           *wide_path;
+    struct stat        st;
+    mode_t             old_umask;
+    int                err, stopping;
+
+    if (strlen(opts.daemon_socket) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path %s is too long.\n", opts.daemon_socket);
+        return 1;
+    }
+
+    memset(&g_daemon, 0, sizeof(g_daemon));
+    g_daemon.queue_tail = &g_daemon.queue_head;
+
+    socket_open();
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, opts.daemon_socket);
+    // a socket left behind by a previous daemon would make bind fail, anything
+    // else at that path is left alone
+    if (lstat(opts.daemon_socket, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            fprintf(stderr, "%s exists and is not a socket.\n", opts.daemon_socket);
+            return 1;
+        }
+        unlink(opts.daemon_socket);
+    }
+    if (socket_create(&g_daemon.socket, AF_UNIX, SOCK_STREAM, 0) != IO_DONE)
+    {
+        fprintf(stderr, "Can't create socket.\n");
+        return 1;
+    }
+    // jobs can write anywhere the daemon can, only its owner may connect
+    old_umask = umask(077);
+    err = socket_bind(&g_daemon.socket, (SA *) &addr, sizeof(addr));
+    umask(old_umask);
+    if (err != IO_DONE || socket_listen(&g_daemon.socket, 16) != IO_DONE)
+    {
+        fprintf(stderr, "Can't listen on %s.\n", opts.daemon_socket);
+        socket_destroy(&g_daemon.socket);
+        return 1;
+    }
+    // accept wakes up regularly to notice a shutdown
+    socket_setnonblocking(&g_daemon.socket);
+
+    if (opts.catalog && !(g_daemon.catalog = catalog_open(opts.catalog)))
+        fprintf(stderr, "Can't open catalog %s.\n", opts.catalog);
+
+    dst_decoder_set_thread_budget((int) dst_decoder_processor_count());
+
+    pthread_mutex_init(&g_daemon.lock, NULL);
+    pthread_cond_init(&g_daemon.changed, NULL);
+    if (pthread_create(&worker, NULL, daemon_worker_thread, NULL) != 0)
+    {
+        fprintf(stderr, "Can't start the job worker.\n");
+        socket_destroy(&g_daemon.socket);
+        unlink(opts.daemon_socket);
+        catalog_close(g_daemon.catalog);
+        return 1;
+    }
+
+    CHAR2WCHAR(wide_path, opts.daemon_socket);
+    safe_fwprintf(stdout, L"Waiting for jobs on [%ls]\n", wide_path);
+    free(wide_path);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&g_daemon.lock);
+        stopping = g_daemon.stopping || daemon_interrupted;
+        pthread_mutex_unlock(&g_daemon.lock);
+        if (stopping)
+            break;
+
+        timeout_init(&tm, 0.2, -1);
+        timeout_markstart(&tm);
+        err = socket_accept(&g_daemon.socket, &client_socket, NULL, NULL, &tm);
+        if (err == IO_TIMEOUT)
+            continue;
+        if (err != IO_DONE)
+        {
+            LOG(lm_main, LOG_ERROR, ("daemon: accept failed: %s", socket_strerror(err)));
+            usleep(100000);
+            continue;
+        }
+        socket_setblocking(&client_socket);
+
+        client = (daemon_client_t *) calloc(1, sizeof(daemon_client_t));
+        if (!client)
+        {
+            socket_destroy(&client_socket);
+            continue;
+        }
+        client->socket = client_socket;
+        client->refs = 1;
+        pthread_mutex_init(&client->send_lock, NULL);
+
+        pthread_mutex_lock(&g_daemon.lock);
+        client->next = g_daemon.clients;
+        g_daemon.clients = client;
+        g_daemon.client_count++;
+        pthread_mutex_unlock(&g_daemon.lock);
+
+        if (pthread_create(&reader, NULL, daemon_client_thread, client) != 0)
+        {
+            daemon_release_client(client);
+            continue;
+        }
+        pthread_detach(reader);
+    }
+
+    safe_fwprintf(stdout, L"\rShutting down..\n");
+
+    // queued jobs are dropped, the running job is only stopped by SIGINT
+    pthread_mutex_lock(&g_daemon.lock);
+    g_daemon.stopping = 1;
+    if (daemon_interrupted && g_daemon.current_output)
+        scarletbook_output_interrupt(g_daemon.current_output);
+    queued = g_daemon.queue_head;
+    g_daemon.queue_head = NULL;
+    g_daemon.queue_tail = &g_daemon.queue_head;
+    pthread_cond_broadcast(&g_daemon.changed);
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    while ((job = queued) != NULL)
+    {
+        queued = job->next;
+        daemon_send_failure(job->client, job->id, job->input, "daemon is shutting down");
+        daemon_free_job(job);
+    }
+    pthread_join(worker, NULL);
+
+    // wake up the readers, each frees its client
+    pthread_mutex_lock(&g_daemon.lock);
+    for (client = g_daemon.clients; client; client = client->next)
+    {
+        socket_shutdown(&client->socket, SHUT_RDWR);
+    }
+    while (g_daemon.client_count > 0)
+        pthread_cond_wait(&g_daemon.changed, &g_daemon.lock);
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    socket_destroy(&g_daemon.socket);
+    unlink(opts.daemon_socket);
+    catalog_close(g_daemon.catalog);
+    pthread_cond_destroy(&g_daemon.changed);
+    pthread_mutex_destroy(&g_daemon.lock);
+    return 0;
+}
+
+#endif
+
+int main(int argc, char* argv[]) 
+{
+    char *albumdir = 0;
+    wchar_t *s_wchar;
     int nogo = 0;
+    int failed = 0;
+    int verify_failures, verify_unverified = 0;
     sacd_reader_t *sacd_reader;
 
 #ifdef PTW32_STATIC_LIB
@@ -358,6 +1843,27 @@ int main(int argc, char* argv[])
     init();
     if (parse_options(argc, argv)) 
     {
+        // before any decoder or scan thread is started
+        dst_decoder_set_processor_count(opts.threads);
+        dst_decoder_set_cpu_pinning(opts.pin_threads);
+
+        if (opts.scan)
+        {
+            // byte oriented output, stdout must not be switched to wide mode
+            catalog_t *catalog = 0;
+            int       failed;
+
+            if (opts.catalog && !(catalog = catalog_open(opts.catalog)))
+                fprintf(stderr, "Can't open catalog %s, scanning without it.\n", opts.catalog);
+            failed = scarletbook_scan(opts.scan_paths, opts.scan_path_count, opts.scan_format, opts.scan_threads, catalog, stdout);
+            catalog_close(catalog);
+
+            free_lock(g_fwprintf_lock);
+            charset_cleanup();
+            destroy_logging();
+            return failed != 0;
+        }
+
         setlocale(LC_ALL, "");
         if (fwide(stdout, 1) < 0)
         {
@@ -384,7 +1890,7 @@ int main(int argc, char* argv[])
             }
         }
 
-        if (opts.output_dir_conc && opts.concurrent && (opts.output_dsf || opts.output_dsdiff)){
+        if (opts.output_dir_conc && opts.concurrent && (opts.output_dsf || opts.output_dsdiff || opts.output_pcm)){
             struct stat sb;
             if(stat(opts.output_dir_conc, &sb) != 0 || !S_ISDIR(sb.st_mode)){
                 fprintf(stderr, "%s doesn't exist or is not a directory.\n", opts.output_dir_conc);
@@ -392,6 +1898,52 @@ int main(int argc, char* argv[])
             }
         }
 
+        if (!nogo && opts.metrics_file && !(g_metrics_out = fopen(opts.metrics_file, "a")))
+        {
+            fprintf(stderr, "Can't open metrics file %s.\n", opts.metrics_file);
+            failed = 1;
+            nogo = 1;
+        }
+
+        if (!nogo && opts.error_map_file && !(g_error_map_out = fopen(opts.error_map_file, "a")))
+        {
+            fprintf(stderr, "Can't open error map file %s.\n", opts.error_map_file);
+            failed = 1;
+            nogo = 1;
+        }
+
+        if (!nogo && opts.trace_file && trace_open(opts.trace_file) != 0)
+        {
+            fprintf(stderr, "Can't open trace file %s.\n", opts.trace_file);
+            failed = 1;
+            nogo = 1;
+        }
+
+        if (!nogo && opts.batch)
+        {
+            if (opts.output_dsf || opts.output_iso || opts.output_dsdiff || opts.output_pcm || opts.output_dsdiff_em || opts.export_cue_sheet)
+            {
+                failed = run_batch();
+            }
+            else
+            {
+                fprintf(stderr, "Batch mode needs an output format.\n");
+                failed = 1;
+            }
+            nogo = 1;
+        }
+
+        if (!nogo && opts.daemon_socket)
+        {
+#ifdef _WIN32
+            fprintf(stderr, "Daemon mode is not supported on this platform.\n");
+            failed = 1;
+#else
+            failed = run_daemon();
+#endif
+            nogo = 1;
+        }
+
         if(!nogo){
             nogo = !(sacd_reader = sacd_open(opts.input_device)) ;
         }
@@ -402,218 +1954,64 @@ int main(int argc, char* argv[])
             handle = scarletbook_open(sacd_reader, 0);
             if (handle)
             {
+                if (opts.catalog)
+                {
+                    catalog_t *catalog = catalog_open(opts.catalog);
+                    if (!catalog)
+                        fprintf(stderr, "Can't open catalog %s.\n", opts.catalog);
+                    update_catalog(catalog, handle, opts.input_device);
+                    catalog_close(catalog);
+                }
+
                 if (opts.print)
                 {
                     scarletbook_print(handle);
                 }
 
-                if (opts.output_dsf || opts.output_iso || opts.output_dsdiff || opts.output_dsdiff_em || opts.export_cue_sheet)
+                if (opts.output_dsf || opts.output_iso || opts.output_dsdiff || opts.output_pcm || opts.output_dsdiff_em || opts.export_cue_sheet)
                 {
-                    output = scarletbook_output_create(handle, handle_status_update_track_callback, handle_status_update_progress_callback, safe_fwprintf);
-
-                    // select the channel area
-                    if(has_two_channel(handle) && opts.two_channel){
-                        area_idx[n_areas ++] = handle->twoch_area_idx;
-                    }
-                    if(has_multi_channel(handle) && opts.multi_channel){
-                        area_idx[n_areas ++] = handle->mulch_area_idx;
-                    }
-
-                    albumdir = (strlen(opts.output_file) > 0 ? strdup(opts.output_file) : get_album_dir(handle));
-
-                    if(opts.export_cue_sheet){
-                        char *albumdir_loc;
-                        albumdir_loc = (char *)malloc(strlen(albumdir)+16);
-
-                        for(j = 0; j < n_areas; j ++){
-                            wchar_t *wide_filename;
-                            strcpy(albumdir_loc, albumdir);
-                            if(n_areas > 1){
-                                strcat(albumdir_loc, j ? " [multi]" : " [stereo]");
-                            }
-
-                            file_path = get_unique_path(opts.output_dir, albumdir_loc, "cue");
-                            CHAR2WCHAR(wide_filename, file_path);
-                            safe_fwprintf(stdout, L"Exporting CUE sheet [%ls]\n", wide_filename);
-                            write_cue_sheet(handle, file_path, area_idx[j], file_path);
-                            free(file_path);
-                            free(wide_filename);
-                        }
-                        free(albumdir_loc);
-                    }
+                    metrics_t *metrics = create_job_metrics(opts.input_device);
+                    scarletbook_error_map_t *error_map = create_job_error_map(opts.input_device);
+                    int lost_sectors;
 
-                    if (opts.output_iso)
+                    output = queue_disc_output(&opts, handle, handle_status_update_track_callback, handle_status_update_progress_callback, &albumdir);
+                    if (!output)
                     {
-
-                        uint32_t total_sectors = sacd_get_total_sectors(sacd_reader);
-#ifdef SECTOR_LIMIT
-#define FAT32_SECTOR_LIMIT 2090000
-                        uint32_t sector_size = FAT32_SECTOR_LIMIT;
-                        uint32_t sector_offset = 0;
-                        if (total_sectors > FAT32_SECTOR_LIMIT)
-                        {
-                            musicfilename = (char *) malloc(512);
-                            file_path = make_filename(opts.output_dir, 0, albumdir, "iso");
-                            for (i = 1; total_sectors != 0; i++)
-                            {
-                                sector_size = min(total_sectors, FAT32_SECTOR_LIMIT);
-                                snprintf(musicfilename, 512, "%s.%03d", file_path, i);
-                                scarletbook_output_enqueue_raw_sectors(output, sector_offset, sector_size, musicfilename, "iso");
-                                sector_offset += sector_size;
-                                total_sectors -= sector_size;
-                            }
-                            free(musicfilename);
-                        }
-                        else
-#endif
-                        {
-                            file_path = get_unique_path(opts.output_dir, albumdir, "iso");
-                            scarletbook_output_enqueue_raw_sectors(output, 0, total_sectors, file_path, "iso");
-
-
-                            // Concurrent iso+dsf/dsdiff generation
-                            if(opts.concurrent && (opts.output_dsf || opts.output_dsdiff)){
-                                safe_fwprintf(stdout, L"Concurrent mode enabled.\n");
-                                CHAR2WCHAR(s_wchar, file_path);
-                                safe_fwprintf(stdout, L"ISO output: %ls\n", s_wchar);
-                                free(s_wchar);
-                                free(file_path);
-
-                                char *albumdir_loc;
-                                albumdir_loc = (char *)malloc(strlen(albumdir)+16);
-                                // fill the sub queue with items to rip
-                                for (j = 0; j < n_areas; j ++){
-                                    // create the output folder
-                                    // If both stereo and multi-ch tracks are getting processed, create separate directories
-                                    strcpy(albumdir_loc, albumdir);
-                                    if(n_areas > 1){
-                                        strcat(albumdir_loc, j ? " [multi]" : " [stereo]");
-                                    }
-
-                                    get_unique_dir(opts.output_dir_conc, &albumdir_loc);
-                                    mkdir_wrap(albumdir_loc, 0774);
-                                    if(opts.output_dsf){
-                                        CHAR2WCHAR(s_wchar, albumdir_loc);
-                                        safe_fwprintf(stdout, L"DSF output: %ls\n", s_wchar);
-                                        free(s_wchar);
-                                    }
-                                    else{
-                                        CHAR2WCHAR(s_wchar, albumdir_loc);
-                                        safe_fwprintf(stdout, L"DSDIFF output: %ls\n", s_wchar);
-                                        free(s_wchar);
-                                    }
-
-                                    for (i = 0; i < handle->area[area_idx[j]].area_toc->track_count; i++) 
-                                    {
-                                        if (opts.select_tracks && opts.selected_tracks[i] == 0)
-                                            continue;
-
-                                        musicfilename = get_music_filename(handle, area_idx[j], i, opts.output_file);
-
-                                        if (opts.output_dsf)
-                                        {
-                                            file_path = make_filename(albumdir_loc, 0, musicfilename, "dsf");
-                                            scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, "dsf", 
-                                                1 /* always decode to DSD */, opts.dsf_nopad && !opts.select_tracks, 1);
-                                        }
-                                        else if (opts.output_dsdiff)
-                                        {
-                                            file_path = make_filename(albumdir_loc, 0, musicfilename, "dff");
-                                            scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, "dsdiff", 
-                                                (opts.convert_dst ? 1 : handle->area[area_idx[j]].area_toc->frame_format != FRAME_FORMAT_DST), 0, 1);
-                                        }
-                                        free(musicfilename);
-                                        free(file_path);
-                                    }
-                                }
-                                free(albumdir_loc);
-                            }
-                            else{
-                                free(file_path);
-                            }
-                        }
+                        fprintf(stderr, "Can't create the output, out of memory.\n");
+                        finish_job_metrics(metrics);
+                        scarletbook_error_map_destroy(error_map);
+                        failed = 1;
                     }
-                    else if (opts.output_dsdiff_em)
+                    else
                     {
-                        char *albumdir_loc;
-                        albumdir_loc = (char *)malloc(strlen(albumdir)+16);
-
-                        for(j = 0; j < n_areas; j ++){
-                            strcpy(albumdir_loc, albumdir);
-                            if(n_areas > 1){
-                                strcat(albumdir_loc, j ? " [multi]" : " [stereo]");
-                            }
-
-                            file_path = get_unique_path(opts.output_dir, albumdir_loc, "dff");
-                            scarletbook_output_enqueue_track(output, area_idx[j], 0, file_path, "dsdiff_edit_master",
-                                (opts.convert_dst ? 1 : handle->area[area_idx[j]].area_toc->frame_format != FRAME_FORMAT_DST), 0, 0);
-                            free(file_path);
+                        scarletbook_output_set_metrics(output, metrics);
+                        scarletbook_output_set_read_errors(output, opts.read_retries, opts.max_read_errors, error_map);
+                        safe_fwprintf(stdout, L"\n");
+
+                        started_processing = time(0);
+                        scarletbook_output_start(output);
+                        scarletbook_output_wait(output);
+                        verify_failures = scarletbook_output_verify_failures(output);
+                        verify_unverified = scarletbook_output_verify_unverified(output);
+                        lost_sectors = scarletbook_output_lost_sectors(output);
+                        scarletbook_output_destroy(output);
+                        finish_job_metrics(metrics);
+                        scarletbook_error_map_destroy(error_map);
+
+                        if (lost_sectors)
+                        {
+                            safe_fwprintf(stdout, L"\r%d sector(s) couldn't be read.\n", lost_sectors);
+                            failed = 1;
                         }
-                        free(albumdir_loc);
-                    }
 
-                    // Non-concurrent dsf/dsdiff generation
-                    else if (!(opts.output_iso && opts.concurrent) && (opts.output_dsf || opts.output_dsdiff))
-                    {
-                        char *albumdir_loc;
-                        albumdir_loc = (char *)malloc(strlen(albumdir)+16);
-
-                        for(j = 0; j < n_areas; j ++){
-                            // create the output folder
-                            // If both stereo and multi-ch tracks are getting processed, create separate directories
-                            strcpy(albumdir_loc, albumdir);
-                            if(n_areas > 1){
-                                strcat(albumdir_loc, j ? " [multi]" : " [stereo]");
-                            }
-
-                            get_unique_dir(opts.output_dir, &albumdir_loc);
-                            mkdir_wrap(albumdir_loc, 0774);
-
-                            if(opts.output_dsf){
-                                CHAR2WCHAR(s_wchar, albumdir_loc);
-                                safe_fwprintf(stdout, L"DSF output: %ls\n", s_wchar);
-                                free(s_wchar);
-                            }
-                            else{
-                                CHAR2WCHAR(s_wchar, albumdir_loc);
-                                safe_fwprintf(stdout, L"DSDIFF output: %ls\n", s_wchar);
-                                free(s_wchar);
-                            }
-
-                            // fill the queue with items to rip
-                            for (i = 0; i < handle->area[area_idx[j]].area_toc->track_count; i++) 
-                            {
-                                if (opts.select_tracks && opts.selected_tracks[i] == 0)
-                                    continue;
-
-                                musicfilename = get_music_filename(handle, area_idx[j], i, opts.output_file);
-
-                                if (opts.output_dsf)
-                                {
-                                    file_path = make_filename(albumdir_loc, 0, musicfilename, "dsf");
-                                    scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, "dsf", 
-                                        1 /* always decode to DSD */, opts.dsf_nopad && !opts.select_tracks, 0);
-                                }
-                                else if (opts.output_dsdiff)
-                                {
-                                    file_path = make_filename(albumdir_loc, 0, musicfilename, "dff");
-                                    scarletbook_output_enqueue_track(output, area_idx[j], i, file_path, "dsdiff", 
-                                        (opts.convert_dst ? 1 : handle->area[area_idx[j]].area_toc->frame_format != FRAME_FORMAT_DST), 0, 0);
-                                }
-
-                                free(musicfilename);
-                                free(file_path);
-                            }
+                        if (opts.verify)
+                        {
+                            safe_fwprintf(stdout, L"\rVerify done, %d file(s) differ or are missing, %d couldn't be verified.\n", verify_failures, verify_unverified);
+                            failed = failed || verify_failures != 0;
                         }
-                        free(albumdir_loc);
+                        else
+                            fprintf(stdout, "\rWe are done..                                                          \n");
                     }
-                    safe_fwprintf(stdout, L"\n");
-
-                    started_processing = time(0);
-                    scarletbook_output_start(output);
-                    scarletbook_output_destroy(output);
-
-                    fprintf(stdout, "\rWe are done..                                                          \n");
                 }
                 scarletbook_close(handle);
 
@@ -622,6 +2020,16 @@ int main(int argc, char* argv[])
             sacd_close(sacd_reader);
         }
 
+        if (g_metrics_out)
+        {
+            fclose(g_metrics_out);
+        }
+        if (g_error_map_out)
+        {
+            fclose(g_error_map_out);
+        }
+        trace_close();
+
 #ifndef _WIN32
         freopen(0, "w", stdout);
 #endif
@@ -632,6 +2040,7 @@ int main(int argc, char* argv[])
     }
 
     free_lock(g_fwprintf_lock);
+    charset_cleanup();
     destroy_logging();
 
 #ifdef PTW32_STATIC_LIB
@@ -640,5 +2049,6 @@ int main(int argc, char* argv[])
 #endif
 
     printf("\n");
-    return 0;
+    // 2: nothing differs, but some files had nothing to be compared with
+    return failed != 0 ? 1 : verify_unverified != 0 ? 2 : 0;
 }
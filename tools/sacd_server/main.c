@@ -0,0 +1,1034 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Serves an ISO image or block device to sacd_extract clients over the
+  ServerRequest/ServerResponse protocol of sacd_ripper.proto ("-i host:port").
+
+  All clients are handled by one epoll loop on non blocking sockets. A read
+  response is written as the encoded response fields, followed by the sector
+  data straight from the image with sendfile() and the terminating zero byte,
+  corked so the pieces leave in full segments.
+
+  Everything that reads the image (sendfile() and the reads of compact
+  responses) runs on a small pool of I/O threads, so a slow disk only holds
+  up the clients waiting for it. The client is taken out of the epoll set
+  while a thread has it and handed back through an eventfd.
+
+  Clients that open with protocol version 2 may read several ranges per
+  request. With the COMPACT flag those sectors are read into memory and sent
+  as records that leave out zero padding and, for AUDIO_ONLY reads, all but
+  the audio packets of the track area sectors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/fs.h>
+
+#include <pb.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <logging.h>
+
+#include <sacd_ripper.pb.h>
+#include <sacd_net_compact.h>
+#include <version.h>
+
+#define SECTOR_SIZE               2048
+#define DEFAULT_PORT              2002
+#define DEFAULT_MAX_CLIENTS       256
+#define DEFAULT_IO_THREADS        4
+#define MAX_IO_THREADS            64
+#define MAX_EVENTS                64
+
+/* the highest protocol version spoken */
+#define PROTOCOL_VERSION          2
+
+/* ServerResponse.data holds at most this many sectors, in version 1 and 2 */
+#define MAX_READ_SECTORS          512
+#define MAX_READ_SECTORS_V2       2048
+#define MAX_RANGES                16
+
+/* sectors read at a time for compact responses */
+#define COMPACT_READ_SECTORS      64
+
+/* encoded requests are at most a few hundred bytes, anything longer is not a client */
+#define MAX_REQUEST_SIZE          256
+
+typedef struct
+{
+    off_t               offset;
+    size_t              left;
+} data_range_t;
+
+enum
+{
+    IO_NONE,
+    IO_COMPACT_READ,            /* reads the compact request into the payload */
+    IO_SEND                     /* send_response, the sectors come from the image */
+};
+
+typedef struct client_s
+{
+    int                 fd;
+    char                address[INET_ADDRSTRLEN + 8];
+
+    int                 version;
+
+    uint8_t             request[MAX_REQUEST_SIZE];
+    size_t              request_len;
+
+    /* response in progress: header, compact records or sectors from the image, trailer */
+    uint8_t             header[32];
+    size_t              header_len;
+    size_t              header_sent;
+    uint8_t            *payload;
+    size_t              payload_size;
+    size_t              payload_len;
+    size_t              payload_sent;
+    data_range_t        ranges[MAX_RANGES];
+    int                 range_count;
+    int                 range_idx;
+    int                 trailer_pending;
+    int                 sending;
+
+    /* compact read waiting for an I/O thread */
+    uint32_t            read_offset[MAX_RANGES];
+    uint32_t            read_count[MAX_RANGES];
+    int                 read_range_count;
+    uint32_t            read_sectors;
+    int                 read_audio_only;
+
+    /* the I/O thread that has the client owns it until the result is back */
+    int                 io_task;
+    int                 io_result;
+    struct client_s    *io_next;
+
+    uint64_t            sectors_sent;
+    struct client_s    *prev, *next;
+} client_t;
+
+static struct opts_s
+{
+    const char         *image;
+    const char         *bind_address;
+    int                 port;
+    int                 max_clients;
+    int                 io_threads;
+} opts;
+
+static struct
+{
+    int                 image_fd;
+    uint32_t            total_sectors;
+    int                 listen_fd;
+    int                 epoll_fd;
+    client_t           *clients;
+    int                 client_count;
+    uint64_t            bytes_sent;
+} server;
+
+static struct
+{
+    pthread_t           threads[MAX_IO_THREADS];
+    int                 thread_count;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    client_t           *queue, *queue_tail;     /* waiting for a thread */
+    client_t           *done;                   /* waiting for the epoll loop */
+    int                 event_fd;               /* tells the loop about done clients */
+    int                 quit;
+} io = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER, .event_fd = -1 };
+
+static volatile sig_atomic_t stop_serving = 0;
+
+static void handle_stop(int sig_no)
+{
+    stop_serving = 1;
+}
+
+/* Parse all options. */
+static int parse_options(int argc, char *argv[])
+{
+    int opt;
+    char *program_name;
+
+    static const char help_text[] =
+        "Usage: %s [options] IMAGE\n"
+        "  -p, --port=PORT                 : TCP port to listen on (default 2002)\n"
+        "  -b, --bind=ADDRESS              : IPv4 address to listen on (default all)\n"
+        "  -c, --max-clients=N             : number of clients served at the same time (default 256)\n"
+        "  -t, --io-threads=N              : threads reading the image (default 4)\n"
+        "  -v, --version                   : Display version\n"
+        "\n"
+        "IMAGE is an ISO image or a block device, clients read it with\n"
+        "sacd_extract -i <address>:<port>\n"
+        "\n"
+        "Help options:\n"
+        "  -?, --help                      : Show this help message\n";
+
+    static const struct option options_table[] = {
+        {"port", required_argument, NULL, 'p' },
+        {"bind", required_argument, NULL, 'b' },
+        {"max-clients", required_argument, NULL, 'c' },
+        {"io-threads", required_argument, NULL, 't' },
+        {"version", no_argument, NULL, 'v' },
+        {"help", no_argument, NULL, '?' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    program_name = strrchr(argv[0], '/');
+    program_name = program_name ? program_name + 1 : argv[0];
+
+    while ((opt = getopt_long(argc, argv, "p:b:c:t:v?", options_table, NULL)) >= 0) {
+        switch (opt) {
+        case 'p': opts.port = atoi(optarg); break;
+        case 'b': opts.bind_address = optarg; break;
+        case 'c': opts.max_clients = atoi(optarg); break;
+        case 't': opts.io_threads = atoi(optarg); break;
+        case 'v':
+            fprintf(stdout, "sacd_server version " SACD_RIPPER_VERSION_STRING "\n");
+            return 0;
+        default:
+            fprintf(stdout, help_text, program_name);
+            return 0;
+        }
+    }
+
+    if (optind != argc - 1 || opts.port <= 0 || opts.port > 65535 || opts.max_clients <= 0 ||
+        opts.io_threads <= 0 || opts.io_threads > MAX_IO_THREADS)
+    {
+        fprintf(stderr, help_text, program_name);
+        return 0;
+    }
+    opts.image = argv[optind];
+    return 1;
+}
+
+static int open_image(const char *path)
+{
+    struct stat st;
+    uint64_t    size;
+
+    server.image_fd = open(path, O_RDONLY);
+    if (server.image_fd < 0 || fstat(server.image_fd, &st) != 0)
+    {
+        fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    if (S_ISBLK(st.st_mode))
+    {
+        if (ioctl(server.image_fd, BLKGETSIZE64, &size) != 0)
+        {
+            fprintf(stderr, "Can't get the size of %s: %s\n", path, strerror(errno));
+            return 0;
+        }
+    }
+    else if (S_ISREG(st.st_mode))
+    {
+        size = (uint64_t) st.st_size;
+    }
+    else
+    {
+        fprintf(stderr, "%s is neither an image nor a block device.\n", path);
+        return 0;
+    }
+
+    server.total_sectors = (uint32_t) (size / SECTOR_SIZE);
+    posix_fadvise(server.image_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 1;
+}
+
+static int open_listener(void)
+{
+    struct sockaddr_in addr;
+    int                one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t) opts.port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (opts.bind_address && inet_pton(AF_INET, opts.bind_address, &addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "%s is not an IPv4 address.\n", opts.bind_address);
+        return 0;
+    }
+
+    server.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server.listen_fd < 0)
+    {
+        fprintf(stderr, "Can't create socket: %s\n", strerror(errno));
+        return 0;
+    }
+    setsockopt(server.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(server.listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(server.listen_fd, 64) != 0)
+    {
+        fprintf(stderr, "Can't listen on port %d: %s\n", opts.port, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+static void close_client(client_t *client)
+{
+    LOG(lm_main, LOG_NOTICE, ("%s disconnected, %llu sectors sent", client->address, (unsigned long long) client->sectors_sent));
+
+    if (client->prev)
+        client->prev->next = client->next;
+    else
+        server.clients = client->next;
+    if (client->next)
+        client->next->prev = client->prev;
+    server.client_count--;
+
+    // closing the socket also takes it out of the epoll set
+    close(client->fd);
+    free(client->payload);
+    free(client);
+}
+
+static void accept_clients(void)
+{
+    struct sockaddr_in addr;
+    socklen_t          addr_len;
+    struct epoll_event event;
+    client_t          *client;
+    int                fd, one = 1;
+
+    for (;;)
+    {
+        addr_len = sizeof(addr);
+        fd = accept4(server.listen_fd, (struct sockaddr *) &addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+                LOG(lm_main, LOG_ERROR, ("accept failed: %s", strerror(errno)));
+            return;
+        }
+
+        if (server.client_count >= opts.max_clients || !(client = (client_t *) calloc(1, sizeof(client_t))))
+        {
+            LOG(lm_main, LOG_WARNING, ("refusing client, %d clients connected", server.client_count));
+            close(fd);
+            continue;
+        }
+
+        // requests are a few bytes each and the client waits for every answer
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        client->fd = fd;
+        inet_ntop(AF_INET, &addr.sin_addr, client->address, INET_ADDRSTRLEN);
+        sprintf(client->address + strlen(client->address), ":%u", ntohs(addr.sin_port));
+
+        event.events = EPOLLIN;
+        event.data.ptr = client;
+        if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            free(client);
+            continue;
+        }
+
+        client->next = server.clients;
+        if (server.clients)
+            server.clients->prev = client;
+        server.clients = client;
+        server.client_count++;
+        LOG(lm_main, LOG_NOTICE, ("%s connected", client->address));
+    }
+}
+
+/* reads a varint at "pos", returns 1 when done, 0 if the buffer ends first and -1 if it is too long */
+static int read_varint(const uint8_t *buf, size_t len, size_t *pos, uint64_t *value)
+{
+    int shift = 0;
+
+    *value = 0;
+    do
+    {
+        if (*pos == len)
+            return 0;
+        if (shift > 63)
+            return -1;
+        *value |= (uint64_t) (buf[*pos] & 0x7f) << shift;
+        shift += 7;
+    } while (buf[(*pos)++] & 0x80);
+    return 1;
+}
+
+/* returns the length of the first zero terminated message in "buf" including
+   the terminator, 0 if it is incomplete and -1 if it can't be a message */
+static int message_length(const uint8_t *buf, size_t len)
+{
+    size_t   pos = 0;
+    uint64_t key, value;
+    int      ret;
+
+    for (;;)
+    {
+        if ((ret = read_varint(buf, len, &pos, &key)) <= 0)
+            return ret;
+        if (key == 0)
+            return (int) pos;
+
+        switch (key & 7)
+        {
+        case PB_WT_VARINT:
+            if ((ret = read_varint(buf, len, &pos, &value)) <= 0)
+                return ret;
+            break;
+        case PB_WT_64BIT:
+            pos += 8;
+            break;
+        case PB_WT_32BIT:
+            pos += 4;
+            break;
+        case PB_WT_STRING:
+            if ((ret = read_varint(buf, len, &pos, &value)) <= 0)
+                return ret;
+            if (value > len)
+                return -1;
+            pos += (size_t) value;
+            break;
+        default:
+            return -1;
+        }
+        if (pos > len)
+            return 0;
+    }
+}
+
+/* clamps the requested ranges to the image and the response size, a range
+   that comes up short ends the list. Returns the amount of sectors. */
+static uint32_t clamp_ranges(const ServerRequest *request, uint32_t *offset, uint32_t *count, int *range_count)
+{
+    uint32_t total = 0;
+    int      i;
+
+    *range_count = 0;
+    if (request->range_offset_count != request->range_count_count)
+        return 0;
+
+    for (i = 0; i < (int) request->range_offset_count; i++)
+    {
+        offset[i] = request->range_offset[i];
+        count[i] = 0;
+        if (offset[i] < server.total_sectors)
+            count[i] = request->range_count[i];
+        if (count[i] > server.total_sectors - offset[i])
+            count[i] = server.total_sectors - offset[i];
+        if (count[i] > MAX_READ_SECTORS_V2 - total)
+            count[i] = MAX_READ_SECTORS_V2 - total;
+
+        total += count[i];
+        *range_count = i + 1;
+        if (count[i] != request->range_count[i])
+            break;
+    }
+    return total;
+}
+
+/* reads the ranges and writes their compact sector records to the client's
+   payload, returns the amount of sectors that could be read */
+static uint32_t compact_ranges(client_t *client, const uint32_t *offset, const uint32_t *count, int range_count, uint32_t sectors, int audio_only, uint8_t *read_buffer)
+{
+    uint32_t done = 0, pos, chunk, j;
+    size_t   size = (size_t) sectors * SACD_COMPACT_RECORD_MAX;
+    ssize_t  got;
+    int      i;
+
+    client->payload_len = 0;
+    if (client->payload_size < size)
+    {
+        uint8_t *payload = (uint8_t *) realloc(client->payload, size);
+        if (!payload)
+            return 0;
+        client->payload = payload;
+        client->payload_size = size;
+    }
+
+    for (i = 0; i < range_count; i++)
+    {
+        for (pos = 0; pos < count[i]; pos += chunk)
+        {
+            chunk = count[i] - pos;
+            if (chunk > COMPACT_READ_SECTORS)
+                chunk = COMPACT_READ_SECTORS;
+            got = pread(server.image_fd, read_buffer, (size_t) chunk * SECTOR_SIZE, (off_t) (offset[i] + pos) * SECTOR_SIZE);
+            if (got < 0)
+            {
+                LOG(lm_main, LOG_ERROR, ("%s: reading sector %u failed: %s", client->address, offset[i] + pos, strerror(errno)));
+                return done;
+            }
+            for (j = 0; j < chunk && (size_t) got >= (j + 1) * SECTOR_SIZE; j++)
+            {
+                client->payload_len += sacd_compact_sector(read_buffer + j * SECTOR_SIZE, audio_only, client->payload + client->payload_len);
+                done++;
+            }
+            if (j < chunk)
+                return done;
+        }
+    }
+    return done;
+}
+
+/* encodes the response fields, the "data_len" bytes of a read are sent by send_response */
+static void start_response(client_t *client, ServerResponse *response, uint32_t sectors, size_t data_len)
+{
+    pb_ostream_t output;
+    uint8_t      zero = 0;
+
+    output = pb_ostream_from_buffer(client->header, sizeof(client->header));
+    pb_encode(&output, ServerResponse_fields, response);
+    if (sectors > 0)
+    {
+        // the data field is written by hand, its bytes come from the image or the payload
+        uint8_t key = (3 << 3) | PB_WT_STRING;
+        pb_write(&output, &key, 1);
+        pb_encode_varint(&output, (uint64_t) data_len);
+        client->trailer_pending = 1;
+        client->sectors_sent += sectors;
+        server.bytes_sent += data_len;
+    }
+    else
+    {
+        client->payload_len = 0;
+        client->range_count = 0;
+        pb_write(&output, &zero, 1);
+    }
+    client->header_len = output.bytes_written;
+    client->header_sent = 0;
+    client->sending = 1;
+}
+
+/* answers a compact read once an I/O thread has read it */
+static void finish_compact_read(client_t *client, uint32_t sectors)
+{
+    ServerResponse response;
+
+    memset(&response, 0, sizeof(response));
+    response.type = ServerResponse_Type_DISC_READ_RANGES;
+    response.result = sectors;
+    start_response(client, &response, sectors, client->payload_len);
+}
+
+/* prepares the response to a request, a compact read is left to an I/O thread (io_task) */
+static void handle_request(client_t *client, const ServerRequest *request)
+{
+    ServerResponse response;
+    uint32_t       offset[MAX_RANGES], count[MAX_RANGES];
+    uint32_t       sectors = 0;
+    size_t         data_len = 0;
+    int            i, range_count;
+
+    memset(&response, 0, sizeof(response));
+    client->payload_len = client->payload_sent = 0;
+    client->range_count = client->range_idx = 0;
+    switch (request->type)
+    {
+    case ServerRequest_Type_DISC_OPEN:
+        response.type = ServerResponse_Type_DISC_OPENED;
+        response.result = 0;
+        // only clients that sent a version know the answer
+        client->version = 1;
+        if (request->has_version)
+        {
+            client->version = request->version < PROTOCOL_VERSION ? (int) request->version : PROTOCOL_VERSION;
+            response.has_version = true;
+            response.version = (uint32_t) client->version;
+        }
+        break;
+    case ServerRequest_Type_DISC_CLOSE:
+        response.type = ServerResponse_Type_DISC_CLOSED;
+        response.result = 1;
+        break;
+    case ServerRequest_Type_DISC_SIZE:
+        response.type = ServerResponse_Type_DISC_SIZE;
+        response.result = server.total_sectors;
+        break;
+    case ServerRequest_Type_DISC_READ:
+        response.type = ServerResponse_Type_DISC_READ;
+        if (request->sector_offset < server.total_sectors)
+        {
+            sectors = request->sector_count;
+            if (sectors > server.total_sectors - request->sector_offset)
+                sectors = server.total_sectors - request->sector_offset;
+            if (sectors > MAX_READ_SECTORS)
+                sectors = MAX_READ_SECTORS;
+        }
+        if (sectors > 0)
+        {
+            client->ranges[0].offset = (off_t) request->sector_offset * SECTOR_SIZE;
+            client->ranges[0].left = (size_t) sectors * SECTOR_SIZE;
+            client->range_count = 1;
+            data_len = (size_t) sectors * SECTOR_SIZE;
+        }
+        response.result = sectors;
+        break;
+    case ServerRequest_Type_DISC_READ_RANGES:
+        response.type = ServerResponse_Type_DISC_READ_RANGES;
+        sectors = clamp_ranges(request, offset, count, &range_count);
+        if (sectors > 0 && request->has_flags && (request->flags & ServerRequest_Flags_COMPACT))
+        {
+            memcpy(client->read_offset, offset, range_count * sizeof(uint32_t));
+            memcpy(client->read_count, count, range_count * sizeof(uint32_t));
+            client->read_range_count = range_count;
+            client->read_sectors = sectors;
+            client->read_audio_only = (request->flags & ServerRequest_Flags_AUDIO_ONLY) != 0;
+            client->io_task = IO_COMPACT_READ;
+            return;
+        }
+        else
+        {
+            for (i = 0; i < range_count; i++)
+            {
+                if (count[i] == 0)
+                    continue;
+                client->ranges[client->range_count].offset = (off_t) offset[i] * SECTOR_SIZE;
+                client->ranges[client->range_count].left = (size_t) count[i] * SECTOR_SIZE;
+                client->range_count++;
+            }
+            data_len = (size_t) sectors * SECTOR_SIZE;
+        }
+        response.result = sectors;
+        break;
+    default:
+        response.type = (ServerResponse_Type) request->type;
+        response.result = -1;
+        break;
+    }
+
+    start_response(client, &response, sectors, data_len);
+}
+
+/* returns 1 when the response is out, 0 when the socket is full and -1 on errors */
+static int send_response(client_t *client)
+{
+    ssize_t n;
+    int     cork = 1;
+    uint8_t zero = 0;
+
+    if (client->header_sent == 0 && client->trailer_pending)
+        setsockopt(client->fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+
+    while (client->header_sent < client->header_len)
+    {
+        n = send(client->fd, client->header + client->header_sent, client->header_len - client->header_sent, MSG_NOSIGNAL);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        client->header_sent += n;
+    }
+
+    while (client->payload_sent < client->payload_len)
+    {
+        n = send(client->fd, client->payload + client->payload_sent, client->payload_len - client->payload_sent, MSG_NOSIGNAL);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        client->payload_sent += n;
+    }
+
+    while (client->range_idx < client->range_count)
+    {
+        data_range_t *range = &client->ranges[client->range_idx];
+
+        n = sendfile(client->fd, server.image_fd, &range->offset, range->left);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        if (n == 0)
+        {
+            LOG(lm_main, LOG_ERROR, ("%s: image ended early", client->address));
+            return -1;
+        }
+        range->left -= n;
+        if (range->left == 0)
+            client->range_idx++;
+    }
+
+    if (client->trailer_pending)
+    {
+        n = send(client->fd, &zero, 1, MSG_NOSIGNAL);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        client->trailer_pending = 0;
+
+        cork = 0;
+        setsockopt(client->fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+    }
+
+    client->sending = 0;
+    return 1;
+}
+
+static void *io_thread(void *arg)
+{
+    uint8_t  *read_buffer = (uint8_t *) arg;
+    client_t *client;
+    uint64_t  one = 1;
+
+    pthread_mutex_lock(&io.lock);
+    for (;;)
+    {
+        while (!io.quit && !io.queue)
+            pthread_cond_wait(&io.cond, &io.lock);
+        if (io.quit)
+            break;
+        client = io.queue;
+        io.queue = client->io_next;
+        if (!io.queue)
+            io.queue_tail = NULL;
+        pthread_mutex_unlock(&io.lock);
+
+        if (client->io_task == IO_COMPACT_READ)
+            client->io_result = (int) compact_ranges(client, client->read_offset, client->read_count, client->read_range_count, 
+                                                     client->read_sectors, client->read_audio_only, read_buffer);
+        else
+            client->io_result = send_response(client);
+
+        pthread_mutex_lock(&io.lock);
+        client->io_next = io.done;
+        io.done = client;
+        pthread_mutex_unlock(&io.lock);
+        if (write(io.event_fd, &one, sizeof(one)) < 0)
+            LOG(lm_main, LOG_ERROR, ("can't wake up the epoll loop: %s", strerror(errno)));
+
+        pthread_mutex_lock(&io.lock);
+    }
+    pthread_mutex_unlock(&io.lock);
+    free(read_buffer);
+    return 0;
+}
+
+static int start_io_threads(void)
+{
+    uint8_t *read_buffer;
+    int      i;
+
+    io.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (io.event_fd < 0)
+    {
+        fprintf(stderr, "Can't create eventfd: %s\n", strerror(errno));
+        return 0;
+    }
+
+    for (i = 0; i < opts.io_threads; i++)
+    {
+        read_buffer = (uint8_t *) malloc(COMPACT_READ_SECTORS * SECTOR_SIZE);
+        if (!read_buffer || pthread_create(&io.threads[i], NULL, io_thread, read_buffer) != 0)
+        {
+            free(read_buffer);
+            break;
+        }
+        io.thread_count++;
+    }
+    if (io.thread_count == 0)
+    {
+        fprintf(stderr, "Can't start the I/O threads.\n");
+        return 0;
+    }
+    return 1;
+}
+
+static void stop_io_threads(void)
+{
+    int i;
+
+    pthread_mutex_lock(&io.lock);
+    io.quit = 1;
+    pthread_cond_broadcast(&io.cond);
+    pthread_mutex_unlock(&io.lock);
+    for (i = 0; i < io.thread_count; i++)
+    {
+        pthread_join(io.threads[i], NULL);
+    }
+    if (io.event_fd >= 0)
+        close(io.event_fd);
+}
+
+/* hands the client to an I/O thread for its io_task, the epoll loop leaves it alone until it is back */
+static void queue_io(client_t *client)
+{
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    client->io_next = NULL;
+
+    pthread_mutex_lock(&io.lock);
+    if (io.queue_tail)
+        io.queue_tail->io_next = client;
+    else
+        io.queue = client;
+    io.queue_tail = client;
+    pthread_cond_signal(&io.cond);
+    pthread_mutex_unlock(&io.lock);
+}
+
+/* answers the requests received so far, returns -1 when the client has to go */
+static int serve_client(client_t *client)
+{
+    ServerRequest      request;
+    pb_istream_t       input;
+    struct epoll_event event;
+    int                len, ret;
+
+    for (;;)
+    {
+        if (client->sending)
+        {
+            // sectors from the image may have to come from the disk first
+            if (client->range_idx < client->range_count)
+            {
+                client->io_task = IO_SEND;
+                queue_io(client);
+                return 0;
+            }
+            ret = send_response(client);
+            if (ret < 0)
+                return -1;
+            if (ret == 0)
+            {
+                event.events = EPOLLOUT;
+                event.data.ptr = client;
+                epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+                return 0;
+            }
+        }
+
+        len = message_length(client->request, client->request_len);
+        if (len < 0 || (len == 0 && client->request_len == sizeof(client->request)))
+        {
+            LOG(lm_main, LOG_ERROR, ("%s: malformed request", client->address));
+            return -1;
+        }
+        if (len == 0)
+            break;
+
+        memset(&request, 0, sizeof(request));
+        input = pb_istream_from_buffer(client->request, len);
+        if (!pb_decode(&input, ServerRequest_fields, &request))
+        {
+            LOG(lm_main, LOG_ERROR, ("%s: malformed request", client->address));
+            return -1;
+        }
+        client->request_len -= len;
+        memmove(client->request, client->request + len, client->request_len);
+
+        handle_request(client, &request);
+        if (client->io_task)
+        {
+            queue_io(client);
+            return 0;
+        }
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = client;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+    return 0;
+}
+
+/* takes back the clients the I/O threads are done with and carries on with them */
+static void finish_io(void)
+{
+    struct epoll_event event;
+    client_t          *client, *next;
+    uint64_t           count;
+    int                task;
+
+    if (read(io.event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        LOG(lm_main, LOG_ERROR, ("reading the eventfd failed: %s", strerror(errno)));
+
+    pthread_mutex_lock(&io.lock);
+    client = io.done;
+    io.done = NULL;
+    pthread_mutex_unlock(&io.lock);
+
+    for (; client; client = next)
+    {
+        next = client->io_next;
+        task = client->io_task;
+        client->io_task = IO_NONE;
+
+        event.events = EPOLLIN;
+        event.data.ptr = client;
+        if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, client->fd, &event) != 0 || (task == IO_SEND && client->io_result < 0))
+        {
+            close_client(client);
+            continue;
+        }
+        if (task == IO_COMPACT_READ)
+        {
+            finish_compact_read(client, (uint32_t) client->io_result);
+        }
+        else if (client->io_result == 0)
+        {
+            // the socket is full, the rest goes once it takes more
+            event.events = EPOLLOUT;
+            epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+            continue;
+        }
+        if (serve_client(client) < 0)
+            close_client(client);
+    }
+}
+
+static int receive_requests(client_t *client)
+{
+    ssize_t n;
+
+    for (;;)
+    {
+        if (client->request_len == sizeof(client->request))
+            return 0;
+        n = recv(client->fd, client->request + client->request_len, sizeof(client->request) - client->request_len, 0);
+        if (n == 0)
+            return -1;
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        client->request_len += n;
+    }
+}
+
+static void run_server(void)
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event event;
+    client_t          *client;
+    int                i, n;
+
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event);
+    event.data.ptr = &io;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, io.event_fd, &event);
+
+    while (!stop_serving)
+    {
+        n = epoll_wait(server.epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == &io)
+            {
+                finish_io();
+                continue;
+            }
+            client = (client_t *) events[i].data.ptr;
+            if (!client)
+            {
+                accept_clients();
+                continue;
+            }
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                close_client(client);
+                continue;
+            }
+            if ((events[i].events & EPOLLIN) && receive_requests(client) < 0)
+            {
+                close_client(client);
+                continue;
+            }
+            if (serve_client(client) < 0)
+                close_client(client);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct sigaction sa;
+
+    opts.port = DEFAULT_PORT;
+    opts.max_clients = DEFAULT_MAX_CLIENTS;
+    opts.io_threads = DEFAULT_IO_THREADS;
+    opts.bind_address = NULL;
+
+    if (!parse_options(argc, argv))
+        return 1;
+
+    init_logging();
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+    sa.sa_handler = &handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    server.image_fd = server.listen_fd = server.epoll_fd = -1;
+    if (!open_image(opts.image) || !open_listener() || (server.epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 || !start_io_threads())
+    {
+        stop_io_threads();
+        if (server.epoll_fd >= 0)
+            close(server.epoll_fd);
+        if (server.image_fd >= 0)
+            close(server.image_fd);
+        if (server.listen_fd >= 0)
+            close(server.listen_fd);
+        destroy_logging();
+        return 1;
+    }
+
+    fprintf(stdout, "Serving %s (%u sectors) on %s:%d\n", opts.image, server.total_sectors,
+            opts.bind_address ? opts.bind_address : "0.0.0.0", opts.port);
+    fflush(stdout);
+
+    run_server();
+
+    // the threads finish what they have, the clients still queued are closed with the rest
+    stop_io_threads();
+    while (server.clients)
+    {
+        close_client(server.clients);
+    }
+    fprintf(stdout, "Stopped, %.1fMB sent\n", (double) server.bytes_sent / 1048576.00);
+
+    close(server.epoll_fd);
+    close(server.listen_fd);
+    close(server.image_fd);
+    destroy_logging();
+    return 0;
+}